@@ -47,9 +47,10 @@ class Column(object):
     def _load_output_file(self, item_id, rows, fn=None):
         assert len(rows) > 0
 
-        metadata_path = '{}/tables/{}/{}_{}_metadata.bin'.format(
-            self._db_path, self._table._descriptor.id,
-            self._descriptor.id, item_id)
+        metadata_path = '{}/{}'.format(
+            self._db_path,
+            self._table._item_path(self._descriptor.id, item_id,
+                                   '_metadata.bin'))
         try:
             metadata_contents = self._storage.read(
                 metadata_path.encode('ascii'))
@@ -57,9 +58,9 @@ class Column(object):
             raise ScannerException('Path {} does not exist'.format(
                 metadata_path))
 
-        path = '{}/tables/{}/{}_{}.bin'.format(
-            self._db_path, self._table._descriptor.id,
-            self._descriptor.id, item_id)
+        path = '{}/{}'.format(
+            self._db_path,
+            self._table._item_path(self._descriptor.id, item_id, '.bin'))
         try:
             contents = self._storage.read(path.encode('ascii'))
         except UserWarning:
@@ -206,9 +207,9 @@ class Column(object):
                                    'an RGB24 frame')
         num_items = len(self._table._descriptor.end_rows)
 
-        paths = ['{}/tables/{:d}/{:d}_{:d}.bin'.format(
+        paths = ['{}/{}'.format(
             self._db._db_path,
-            self._table._descriptor.id, self._descriptor.id, item_id)
+            self._table._item_path(self._descriptor.id, item_id, '.bin'))
                           for item_id in range(num_items)]
         temp_paths = []
         for _ in range(len(paths)):
@@ -35,6 +35,7 @@ from scannerpy.job import Job
 from scannerpy.bulk_job import BulkJob
 
 from storehouse import StorageConfig, StorageBackend
+from google.protobuf.message import DecodeError
 
 import scannerpy.libscanner as bindings
 import scanner.metadata_pb2 as metadata_types
@@ -46,7 +47,7 @@ SCRIPT_DIR = os.path.dirname(os.path.realpath(__file__))
 
 def start_master(port=None, config=None, config_path=None, block=False,
                  watchdog=True, prefetch_table_metadata=True,
-                 no_workers_timeout=30):
+                 no_workers_timeout=30, memoized_cache_bytes=0):
     """
     Start a master server instance on this node.
 
@@ -58,6 +59,9 @@ def start_master(port=None, config=None, config_path=None, block=False,
         block: If true, will wait until the server is shutdown. Server
                will not shutdown currently unless wait_For_server_shutdown
                is eventually called.
+        memoized_cache_bytes: Bytes of memoized Op outputs to keep before
+                              evicting the least recently used. 0 keeps
+                              everything.
 
     Returns:
         A cpp database instance.
@@ -72,7 +76,8 @@ def start_master(port=None, config=None, config_path=None, block=False,
         (config.master_address + ':' + port).encode('ascii'))
     result = bindings.start_master(db, port.encode('ascii'), watchdog,
                                    prefetch_table_metadata,
-                                   no_workers_timeout)
+                                   no_workers_timeout,
+                                   memoized_cache_bytes)
     if not result.success():
         raise ScannerException('Failed to start master: {}'.format(result.msg()))
     if block:
@@ -135,7 +140,8 @@ class Database(object):
                  config_path=None, config=None,
                  debug=None, start_cluster=True,
                  prefetch_table_metadata=True,
-                 no_workers_timeout=30):
+                 no_workers_timeout=30,
+                 memoized_cache_bytes=0):
         """
         Initializes a Scanner database.
 
@@ -159,6 +165,7 @@ class Database(object):
         self._start_cluster = start_cluster
         self._prefetch_table_metadata = prefetch_table_metadata
         self._no_workers_timeout = no_workers_timeout
+        self._memoized_cache_bytes = memoized_cache_bytes
         self._debug = debug
         if debug is None:
             self._debug = (master is None and workers is None)
@@ -257,11 +264,87 @@ class Database(object):
             ('{}/{}'.format(self._db_path, path)).encode('ascii'),
             descriptor.SerializeToString())
 
+    def _read_db_metadata_log_segment(self, segment):
+        # Returns None if the segment does not exist
+        path = '{}/db_metadata_log/{}.bin'.format(self._db_path, segment)
+        try:
+            return self._storage.read(path.encode('ascii'))
+        except RuntimeError:
+            return None
+
+    def _load_db_metadata_log_segment(self, segment):
+        # Returns None past the end of the log. Only the newest segment can be
+        # partially written, since a writer may still be saving it, so a
+        # segment which fails to parse is an error if others follow it.
+        data = self._read_db_metadata_log_segment(segment)
+        if data is None:
+            return None
+        log_segment = self.protobufs.DatabaseLogSegment()
+        try:
+            log_segment.ParseFromString(data)
+        except DecodeError:
+            if self._read_db_metadata_log_segment(segment + 1) is not None:
+                raise ScannerException(
+                    'Corrupt database metadata log segment {}'.format(
+                        segment))
+            return None
+        return log_segment
+
+    def _replay_db_metadata_log(self, desc):
+        # Changes since the descriptor was last compacted are kept in a log of
+        # segments numbered from desc.log_start
+        tables = {}
+        for t in desc.tables:
+            tables[t.id] = self.protobufs.DatabaseDescriptor.Table()
+            tables[t.id].CopyFrom(t)
+        bulk_jobs = {}
+        for j in desc.bulk_jobs:
+            bulk_jobs[j.id] = self.protobufs.DatabaseDescriptor.BulkJob()
+            bulk_jobs[j.id].CopyFrom(j)
+        LogEntry = self.protobufs.DatabaseLogEntry
+        segment = desc.log_start
+        while True:
+            log_segment = self._load_db_metadata_log_segment(segment)
+            if log_segment is None:
+                break
+            for entry in log_segment.entries:
+                if entry.type == LogEntry.ADD_TABLE:
+                    t = self.protobufs.DatabaseDescriptor.Table()
+                    t.id = entry.id
+                    t.name = entry.name
+                    tables[entry.id] = t
+                    desc.next_table_id = max(desc.next_table_id, entry.id + 1)
+                elif entry.type == LogEntry.COMMIT_TABLE:
+                    tables[entry.id].committed = True
+                elif entry.type == LogEntry.REMOVE_TABLE:
+                    tables.pop(entry.id, None)
+                elif entry.type == LogEntry.ADD_BULK_JOB:
+                    j = self.protobufs.DatabaseDescriptor.BulkJob()
+                    j.id = entry.id
+                    j.name = entry.name
+                    bulk_jobs[entry.id] = j
+                    desc.next_bulk_job_id = max(desc.next_bulk_job_id,
+                                                entry.id + 1)
+                elif entry.type == LogEntry.COMMIT_BULK_JOB:
+                    bulk_jobs[entry.id].committed = True
+                elif entry.type == LogEntry.REMOVE_BULK_JOB:
+                    bulk_jobs.pop(entry.id, None)
+            segment += 1
+        if segment == desc.log_start:
+            return
+        tables = [tables[k] for k in sorted(tables.keys())]
+        bulk_jobs = [bulk_jobs[k] for k in sorted(bulk_jobs.keys())]
+        del desc.tables[:]
+        desc.tables.extend(tables)
+        del desc.bulk_jobs[:]
+        desc.bulk_jobs.extend(bulk_jobs)
+
     def _load_db_metadata(self):
         if self._cached_db_metadata is None:
             desc = self._load_descriptor(
                 self.protobufs.DatabaseDescriptor,
                 'db_metadata.bin')
+            self._replay_db_metadata_log(desc)
             self._cached_db_metadata = desc
             # table id cache
             self._table_id = {}
@@ -418,7 +501,8 @@ class Database(object):
                 res = self._bindings.start_master(
                     self._db, self.config.master_port.encode('ascii'), True,
                     self._prefetch_table_metadata,
-                    self._no_workers_timeout).success
+                    self._no_workers_timeout,
+                    self._memoized_cache_bytes).success
                 assert res
                 res = self._connect_to_master()
                 assert res
@@ -440,12 +524,13 @@ class Database(object):
                     '\"from scannerpy import start_master\n' +
                     'import pickle\n' +
                     'config=pickle.loads(\'\'\'{config:s}\'\'\')\n' +
-                    'start_master(port=\'{master_port:s}\', block=True, config=config, prefetch_table_metadata={prefetch}, no_workers_timeout={no_workers})\" ' +
+                    'start_master(port=\'{master_port:s}\', block=True, config=config, prefetch_table_metadata={prefetch}, no_workers_timeout={no_workers}, memoized_cache_bytes={memoized_cache_bytes})\" ' +
                     '').format(
                         master_port=master_port,
                         config=pickled_config,
                         prefetch=self._prefetch_table_metadata,
-                        no_workers=self._no_workers_timeout)
+                        no_workers=self._no_workers_timeout,
+                        memoized_cache_bytes=self._memoized_cache_bytes)
                 worker_cmd = (
                     'python -c ' +
                     '\"from scannerpy import start_worker\n' +
@@ -529,6 +614,17 @@ class Database(object):
         self.load_op('{}/libstdlib.so'.format(SCRIPT_DIR),
                      '{}/../scanner/stdlib/stdlib_pb2.py'.format(SCRIPT_DIR))
 
+    def drain_worker(self, address):
+        """
+        Asks the worker at address to finish the tasks it has already accepted
+        and then leave the cluster. Its tasks are not reassigned.
+        """
+        worker = self._connect_to_worker(address)
+        if worker is None:
+            raise ScannerException(
+                'Could not connect to worker at {}'.format(address))
+        self._try_rpc(lambda: worker.Drain(self.protobufs.Empty()))
+
     def stop_cluster(self):
         if self._start_cluster:
            if self._master:
@@ -628,7 +724,7 @@ class Database(object):
             lambda: self._master.RegisterPythonKernel(py_registration))
 
 
-    def ingest_videos(self, videos, inplace=False, force=False):
+    def ingest_videos(self, videos, inplace=False, force=False, append=False):
         """
         Creates a Table from a video.
 
@@ -638,6 +734,8 @@ class Database(object):
 
         Kwargs:
             force: TODO(wcrichto)
+            append: Add each video after the rows of its table if the table
+                already exists, instead of creating a new table.
 
         Returns:
             (list of created Tables, list of (path, reason) failures to ingest)
@@ -649,7 +747,7 @@ class Database(object):
         [table_names, paths] = zip(*videos)
         to_delete = []
         for table_name in table_names:
-            if self.has_table(table_name):
+            if self.has_table(table_name) and not append:
                 if force is True:
                     to_delete.append(table_name)
                 else:
@@ -661,6 +759,7 @@ class Database(object):
         ingest_params.table_names.extend(table_names)
         ingest_params.video_paths.extend(paths)
         ingest_params.inplace = inplace
+        ingest_params.append = append
         ingest_result = self._try_rpc(
             lambda: self._master.IngestVideos(ingest_params))
         if not ingest_result.result.success:
@@ -849,7 +948,8 @@ class Database(object):
         return [e.to_proto(eval_index) for e in eval_sorted], \
             input_ops, \
             sampling_slicing_ops, \
-            output_ops
+            output_ops, \
+            eval_sorted
 
     def _parse_size_string(self, s):
         (prefix, suffix) = (s[:-1], s[-1])
@@ -863,7 +963,57 @@ class Database(object):
             raise ScannerException('Invalid size suffix in "{}"'.format(s))
         return int(prefix) * mults[suffix]
 
-    def wait_on_current_job(self, show_progress=True):
+    def _upstream_ops(self, op):
+        upstream = set()
+        stack = [op]
+        while len(stack) > 0:
+            c = stack.pop()
+            if c in upstream:
+                continue
+            upstream.add(c)
+            for input in c._inputs:
+                if input._op is not None:
+                    stack.append(input._op)
+        return upstream
+
+    def _populate_memoized_tables(self, bulk_job, job_params, ops, **kwargs):
+        """
+        Computes the outputs of every memoized Op which are not cached yet, so
+        the bulk job can read them instead of recomputing them.
+
+        Each memoized Op runs as its own bulk job over the jobs missing its
+        outputs, evaluating only the Ops it depends on. Upstream Ops come
+        first, so their cached outputs are read by the Ops downstream.
+        """
+        memoized = self._try_rpc(
+            lambda: self._master.GetMemoizedTables(job_params))
+        if not memoized.result.success:
+            raise ScannerException(memoized.result.msg)
+
+        missing = collections.OrderedDict()
+        for t in sorted(memoized.tables,
+                        key=lambda t: (t.op_index, t.job_index)):
+            if not t.cached:
+                missing.setdefault(t.op_index, []).append(t)
+
+        for op_idx, tables in missing.items():
+            op = ops[op_idx]
+            upstream = self._upstream_ops(op)
+            output = Op.output(self, list(op._outputs))
+            jobs = []
+            for t in tables:
+                op_args = {}
+                for op_col, args in \
+                    bulk_job.jobs()[t.job_index].op_args().iteritems():
+                    arg_op = op_col if isinstance(op_col, Op) else op_col._op
+                    if arg_op in upstream:
+                        op_args[op_col] = args
+                op_args[output] = t.table_name
+                jobs.append(Job(op_args=op_args))
+            self.run(BulkJob(output=output, jobs=jobs), force=True,
+                     _populate_memoized=False, **kwargs)
+
+    def wait_on_current_job(self, show_progress=True, job_name=''):
         pbar = None
         total_tasks = None
         last_task_count = 0
@@ -871,7 +1021,8 @@ class Database(object):
         last_failed_workers = 0
         while True:
             try:
-                job_status = self._master.GetJobStatus(self.protobufs.Empty())
+                job_status = self._master.GetJobStatus(
+                    self.protobufs.GetJobStatusParams(job_name=job_name))
                 if show_progress and pbar is None and job_status.total_jobs != 0 \
                    and job_status.total_tasks != 0:
                     total_tasks = job_status.total_tasks
@@ -917,11 +1068,44 @@ class Database(object):
             io_packet_size=-1,
             cpu_pool=None,
             gpu_pool=None,
+            cpu_pool_huge_pages=None,
+            cpu_pool_prefault=False,
             pipeline_instances_per_node=None,
             show_progress=True,
             profiling=False,
             load_sparsity_threshold=8,
-            tasks_in_queue_per_pu=4):
+            tasks_in_queue_per_pu=4,
+            autotune_batch_size=False,
+            autotune_batches=32,
+            speculative_execution=True,
+            priority=0,
+            incremental=False,
+            job_name=None,
+            resume=False,
+            decode_replicas=1,
+            decoders_per_column=1,
+            inplace_read_ahead=2,
+            numa_placement=False,
+            memory_budget=None,
+            _populate_memoized=True):
+        """
+        Runs a bulk job and waits for it to finish.
+
+        Args:
+            bulk_job: The BulkJob to run.
+
+        Kwargs:
+            decode_replicas: Decode threads per pipeline instance.
+            decoders_per_column: Decoders the keyframe intervals of each video
+                column are spread over, so that sparse rows from different
+                intervals decode concurrently. Inplace videos ignore it and
+                use a single decoder per column.
+            inplace_read_ahead: Keyframe intervals of an inplace video read
+                in the background after each one a load worker reads.
+
+        Returns:
+            The output Tables.
+        """
         assert isinstance(bulk_job, BulkJob)
         assert isinstance(bulk_job.output(), Op)
 
@@ -939,11 +1123,16 @@ class Database(object):
                         opts.options[k] = str(v)
             compression_options.append(opts)
 
-        sorted_ops, input_ops, sampling_slicing_ops, output_ops = (
+        sorted_ops, input_ops, sampling_slicing_ops, output_ops, ops = (
             self._toposort(bulk_job.output()))
 
+        if resume and job_name is None:
+            raise ScannerException(
+                'Must specify the name of the bulk job to resume.')
+
         job_params = self.protobufs.BulkJobParameters()
-        job_name = ''.join(choice(ascii_uppercase) for _ in range(12))
+        if job_name is None:
+            job_name = ''.join(choice(ascii_uppercase) for _ in range(12))
         job_params.job_name = job_name
         job_params.ops.extend(sorted_ops)
         job_output_table_names = []
@@ -991,10 +1180,15 @@ class Database(object):
                     'string to the output Op.')
             j.output_table_name = output_table_name
 
-        # Delete tables if they exist and force was specified
+        # Delete tables if they exist and force was specified. Incremental
+        # bulk jobs append to them instead, and resumed bulk jobs continue
+        # writing the ones they created.
         to_delete = []
         for name in job_output_table_names:
-            if self.has_table(name):
+            if resume:
+                break
+            if self.has_table(name) and not (
+                    incremental and self.table(name).committed()):
                 if force:
                     to_delete.append(name)
                 else:
@@ -1011,27 +1205,70 @@ class Database(object):
         job_params.profiling = profiling
         job_params.tasks_in_queue_per_pu = tasks_in_queue_per_pu
         job_params.load_sparsity_threshold = load_sparsity_threshold
+        job_params.autotune_batch_size = autotune_batch_size
+        job_params.autotune_batches = autotune_batches
+        job_params.speculative_execution = speculative_execution
+        job_params.priority = priority
+        job_params.incremental = incremental
+        job_params.resume = resume
+        job_params.decode_replicas = decode_replicas
+        job_params.decoders_per_column = decoders_per_column
+        job_params.inplace_read_ahead = inplace_read_ahead
+        job_params.numa_placement = numa_placement
+        if memory_budget is not None:
+            job_params.memory_budget = self._parse_size_string(memory_budget)
         job_params.boundary_condition = (
             self.protobufs.BulkJobParameters.REPEAT_EDGE)
 
         job_params.memory_pool_config.pinned_cpu = False
         if cpu_pool is not None:
             job_params.memory_pool_config.cpu.use_pool = True
-            if cpu_pool[0] == 'p':
+            cpu_pool_size = cpu_pool
+            if cpu_pool_size[0] == 'p':
                 job_params.memory_pool_config.pinned_cpu = True
-                cpu_pool = cpu_pool[1:]
-            size = self._parse_size_string(cpu_pool)
+                cpu_pool_size = cpu_pool_size[1:]
+            size = self._parse_size_string(cpu_pool_size)
             job_params.memory_pool_config.cpu.free_space = size
+            if cpu_pool_huge_pages is not None:
+                job_params.memory_pool_config.cpu.huge_page_size = (
+                    self._parse_size_string(cpu_pool_huge_pages))
+            job_params.memory_pool_config.cpu.prefault = cpu_pool_prefault
 
         if gpu_pool is not None:
             job_params.memory_pool_config.gpu.use_pool = True
             size = self._parse_size_string(gpu_pool)
             job_params.memory_pool_config.gpu.free_space = size
 
+        # Compute the outputs of memoized Ops which are not cached yet. The
+        # master then splices the cached tables into this bulk job.
+        if _populate_memoized and any(op._memoize for op in ops):
+            self._populate_memoized_tables(
+                bulk_job, job_params, ops,
+                work_packet_size=work_packet_size,
+                io_packet_size=io_packet_size,
+                cpu_pool=cpu_pool,
+                gpu_pool=gpu_pool,
+                cpu_pool_huge_pages=cpu_pool_huge_pages,
+                cpu_pool_prefault=cpu_pool_prefault,
+                pipeline_instances_per_node=pipeline_instances_per_node,
+                show_progress=show_progress,
+                profiling=profiling,
+                load_sparsity_threshold=load_sparsity_threshold,
+                tasks_in_queue_per_pu=tasks_in_queue_per_pu,
+                autotune_batch_size=autotune_batch_size,
+                autotune_batches=autotune_batches,
+                speculative_execution=speculative_execution,
+                priority=priority,
+                decode_replicas=decode_replicas,
+                decoders_per_column=decoders_per_column,
+                inplace_read_ahead=inplace_read_ahead,
+                numa_placement=numa_placement,
+                memory_budget=memory_budget)
+
         # Run the job
         self._try_rpc(lambda: self._master.NewJob(job_params))
 
-        job_status = self.wait_on_current_job(show_progress)
+        job_status = self.wait_on_current_job(show_progress, job_name)
 
         if not job_status.result.success:
             raise ScannerException(job_status.result.msg)
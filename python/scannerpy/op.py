@@ -113,9 +113,12 @@ class OpGenerator:
             batch = kwargs.pop('batch', -1)
             warmup = kwargs.pop('warmup', 0)
             stencil = kwargs.pop('stencil', [])
+            memoize = kwargs.pop('memoize', False)
+            replicas = kwargs.pop('replicas', 1)
             args = kwargs.pop('args', None)
             op = Op(self._db, name, inputs, device, batch, warmup,
-                    stencil, kwargs if args is None else args)
+                    stencil, kwargs if args is None else args, memoize,
+                    replicas)
             return op.outputs()
 
         return make_op
@@ -123,7 +126,7 @@ class OpGenerator:
 
 class Op:
     def __init__(self, db, name, inputs, device, batch=-1, warmup=0,
-                 stencil=[0], args={}):
+                 stencil=[0], args={}, memoize=False, replicas=1):
         self._db = db
         self._name = name
         self._inputs = inputs
@@ -132,6 +135,8 @@ class Op:
         self._warmup = warmup
         self._stencil = stencil
         self._args = args
+        self._memoize = memoize
+        self._replicas = replicas
 
         if (name == 'Input' or
             name == 'Space' or
@@ -180,6 +185,8 @@ class Op:
         e.stencil.extend(self._stencil)
         e.batch = self._batch
         e.warmup = self._warmup
+        e.memoize = self._memoize
+        e.replicas = self._replicas
 
         if e.name == "Input":
             inp = e.inputs.add()
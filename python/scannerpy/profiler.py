@@ -5,6 +5,11 @@ import json
 from scannerpy.common import *
 
 
+# Prefix of counters which are combined with max rather than summed. Must
+# match Profiler::GAUGE_PREFIX.
+GAUGE_PREFIX = 'gauge:'
+
+
 def read_advance(fmt, buf, offset):
     new_offset = offset + struct.calcsize(fmt)
     return struct.unpack_from(fmt, buf, offset), new_offset
@@ -33,10 +38,14 @@ class Profiler:
             'jobs/{}/descriptor.bin'.format(job_id))
 
         self._profilers = {}
+        self._stage_replicas = {}
+        self._cpu_pool_page_sizes = {}
         for n in range(job.num_nodes):
             path = '{}/jobs/{}/profile_{}.bin'.format(db._db_path, job_id, n)
-            time, profs = self._parse_profiler_file(path)
+            time, profs, replicas, page_size = self._parse_profiler_file(path)
             self._profilers[n] = (time, profs)
+            self._stage_replicas[n] = replicas
+            self._cpu_pool_page_sizes[n] = page_size
 
     def write_trace(self, path):
         """
@@ -104,6 +113,26 @@ class Profiler:
         intv, _ = self._profilers.values()[0]
         return intv
 
+    def stage_replicas(self):
+        """
+        Threads each pipeline stage ran per pipeline instance.
+
+        Returns:
+            A dict from stage name ('pre' for decode, 'evalN' for the Nth
+            kernel group, 'post') to its number of replicas.
+        """
+        return self._stage_replicas.values()[0]
+
+    def cpu_pool_page_sizes(self):
+        """
+        Size of the pages backing the CPU memory pool of each node.
+
+        Returns:
+            A dict from node to page size in bytes, 0 if the node had no CPU
+            pool.
+        """
+        return self._cpu_pool_page_sizes
+
     def statistics(self):
         totals = {}
         for (total_start, total_end), profiler in self._profilers.values():
@@ -116,11 +145,21 @@ class Profiler:
                             totals[kind][key] = 0.0
                         totals[kind][key] += end-start
                     for (name, value) in thread['counters'].iteritems():
+                        # Gauges hold one value per worker, such as a
+                        # chosen batch size, so they are not summed
+                        if name.startswith(GAUGE_PREFIX):
+                            name = name[len(GAUGE_PREFIX):]
+                            totals[kind][name] = max(
+                                totals[kind].get(name, value), value)
+                            continue
                         if name not in totals[kind]:
                             totals[kind][name] = 0
                         totals[kind][name] += value
 
         totals['total_time'] = float(total_end - total_start)
+        totals['stage_replicas'] = self.stage_replicas()
+        totals['cpu_pool_page_size'] = min(
+            self._cpu_pool_page_sizes.values())
         readable_totals = self._convert_time(totals)
         return readable_totals
 
@@ -199,15 +238,33 @@ class Profiler:
         t, offset = read_advance('B', bytes_buffer, offset)
         num_eval_workers = t[0]
         t, offset = read_advance('B', bytes_buffer, offset)
-        groups_per_chain = t[0]
+        stages_per_chain = t[0]
+        replicas_per_stage = []
+        for i in range(stages_per_chain):
+            t, offset = read_advance('B', bytes_buffer, offset)
+            replicas_per_stage.append(t[0])
         for pu in range(num_eval_workers):
-            for fg in range(groups_per_chain):
-                prof, offset = self._parse_profiler_output(bytes_buffer, offset)
-                profilers[prof['worker_type']].append(prof)
+            for replicas in replicas_per_stage:
+                for r in range(replicas):
+                    prof, offset = self._parse_profiler_output(
+                        bytes_buffer, offset)
+                    profilers[prof['worker_type']].append(prof)
+        stage_replicas = {}
+        for i, replicas in enumerate(replicas_per_stage):
+            if i == 0:
+                name = 'pre'
+            elif i == stages_per_chain - 1:
+                name = 'post'
+            else:
+                name = 'eval{}'.format(i - 1)
+            stage_replicas[name] = replicas
         # Save worker profilers
         t, offset = read_advance('B', bytes_buffer, offset)
         num_save_workers = t[0]
         for i in range(num_save_workers):
             prof, offset = self._parse_profiler_output(bytes_buffer, offset)
             profilers[prof['worker_type']].append(prof)
-        return (start_time, end_time), profilers
+        t, offset = read_advance('q', bytes_buffer, offset)
+        cpu_pool_page_size = t[0]
+        return ((start_time, end_time), profilers, stage_replicas,
+                cpu_pool_page_size)
@@ -32,6 +32,16 @@ class Table:
                 self._db.protobufs.TableDescriptor,
                 'tables/{}/descriptor.bin'.format(self._id))
 
+    def _item_path(self, column_id, item_id, suffix):
+        # Items saved by a retried or backup attempt of their task are named
+        # after the attempt
+        self._need_descriptor()
+        attempts = self._descriptor.item_attempts
+        name = '{:d}_{:d}'.format(column_id, item_id)
+        if item_id < len(attempts) and attempts[item_id] > 0:
+            name += '_attempt{:d}'.format(attempts[item_id])
+        return 'tables/{:d}/{}{}'.format(self._id, name, suffix)
+
     def _load_column(self, name):
         if not self.committed():
             raise ScannerException('Table has not committed yet.')
@@ -43,9 +53,7 @@ class Table:
                 if c.type == self._db.protobufs.Video:
                     video_descriptor = self._db._load_descriptor(
                         self._db.protobufs.VideoDescriptor,
-                        'tables/{:d}/{:d}_0_video_metadata.bin'.format(
-                            self._id,
-                            c.id))
+                        self._item_path(c.id, 0, '_video_metadata.bin'))
                 self._video_descriptors.append(video_descriptor)
         for i, c in enumerate(self._descriptor.columns):
             if c.name == name:
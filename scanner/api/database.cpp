@@ -59,6 +59,7 @@ internal::DatabaseParameters machine_params_to_db_params(
   db.gpu_ids = params.gpu_ids;
   db.prefetch_table_metadata = true;
   db.no_workers_timeout = 30;
+  db.memoized_cache_bytes = 0;
   return db;
 }
 }
@@ -98,7 +99,8 @@ Result Database::start_master(const MachineParameters& machine_params,
                               const std::string& port,
                               bool watchdog,
                               bool prefetch_table_metadata,
-                              i64 no_workers_timeout) {
+                              i64 no_workers_timeout,
+                              i64 memoized_cache_bytes) {
   if (master_state_ != nullptr) {
     LOG(WARNING) << "Master already started";
     Result result;
@@ -110,6 +112,7 @@ Result Database::start_master(const MachineParameters& machine_params,
       machine_params_to_db_params(machine_params, storage_config_, db_path_);
   params.prefetch_table_metadata = prefetch_table_metadata;
   params.no_workers_timeout = no_workers_timeout;
+  params.memoized_cache_bytes = memoized_cache_bytes;
 
   auto master_service = scanner::internal::get_master_service(params);
   master_state_->service.reset(master_service);
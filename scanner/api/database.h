@@ -53,7 +53,8 @@ class Database {
   Result start_master(const MachineParameters& params, const std::string& port,
                       bool watchdog = true,
                       bool prefetch_table_metadata = true,
-                      i64 no_workers_timeout = 30);
+                      i64 no_workers_timeout = 30,
+                      i64 memoized_cache_bytes = 0);
 
   Result start_worker(const MachineParameters& params, const std::string& port,
                       bool watchdog = true,
@@ -18,6 +18,8 @@
 #include "scanner/engine/kernel_registry.h"
 #include "scanner/util/memory.h"
 
+#include <limits>
+
 namespace scanner {
 
 Element::Element(u8* _buffer, size_t _size)
@@ -28,6 +30,14 @@ Element::Element(Frame* frame)
 
 BaseKernel::BaseKernel(const KernelConfig& config) {}
 
+void BaseKernel::evict_row_cache(i64 min_row) {
+  auto end = row_cache_.lower_bound(
+      std::make_pair(min_row, std::numeric_limits<i32>::min()));
+  row_cache_.erase(row_cache_.begin(), end);
+}
+
+void BaseKernel::clear_row_cache() { row_cache_.clear(); }
+
 StenciledBatchedKernel::StenciledBatchedKernel(const KernelConfig& config)
     : BaseKernel(config) {}
 
@@ -136,10 +146,15 @@ KernelRegistration::KernelRegistration(const KernelBuilder& builder) {
   auto& output_devices = builder.output_devices_;
   bool can_batch = builder.can_batch_;
   i32 preferred_batch = builder.preferred_batch_size_;
+  // Without declared bounds the batch size is fixed to the preferred size
+  i32 min_batch = builder.min_batch_size_ != -1 ? builder.min_batch_size_
+                                                : preferred_batch;
+  i32 max_batch = builder.max_batch_size_ != -1 ? builder.max_batch_size_
+                                                : preferred_batch;
   KernelConstructor constructor = builder.constructor_;
   internal::KernelFactory* factory = new internal::KernelFactory(
       name, type, num_devices, input_devices, output_devices, can_batch,
-      preferred_batch, constructor);
+      preferred_batch, min_batch, max_batch, constructor);
   internal::KernelRegistry* registry = internal::get_kernel_registry();
   registry->add_kernel(name, factory);
 }
@@ -20,6 +20,9 @@
 #include "scanner/util/memory.h"
 #include "scanner/util/profiler.h"
 
+#include <map>
+#include <memory>
+#include <utility>
 #include <vector>
 
 namespace scanner {
@@ -173,11 +176,57 @@ class BaseKernel {
    **/
   virtual void set_profiler(Profiler* profiler) { profiler_ = profiler; }
 
+  /**
+   * @brief For internal use
+   *
+   * Called by the engine once rows before min_row have left the stencil
+   * cache, so no future input will reference them.
+   **/
+  void evict_row_cache(i64 min_row);
+
+  /**
+   * @brief For internal use
+   **/
+  void clear_row_cache();
+
   /**
    * The profiler allows an op to save profiling data for later
    * visualization. It is not guaranteed to be non-null, so check before use.
    */
   Profiler* profiler_ = nullptr;
+
+ protected:
+  /**
+   * @brief Returns a value derived from an input row, computing it only the
+   *        first time the row is seen.
+   *
+   * Stenciled kernels see each input row in several windows. Per-row
+   * preprocessing (e.g. a grayscale conversion) can be memoized here using
+   * the row id in Element::index so that it runs once per row instead of
+   * once per window. Entries live exactly as long as the row's elements are
+   * held in the engine's stencil cache, and are dropped when the kernel
+   * moves to a new task. Use different slots to cache several values for
+   * the same row.
+   *
+   * @param row
+   *        row id of the input element, i.e. Element::index
+   * @param compute
+   *        callable returning a T, invoked on a cache miss
+   */
+  template <typename T, typename F>
+  const T& memoize_row(i64 row, F compute, i32 slot = 0) {
+    auto key = std::make_pair(row, slot);
+    auto it = row_cache_.find(key);
+    if (it == row_cache_.end()) {
+      std::shared_ptr<void> value = std::make_shared<T>(compute());
+      it = row_cache_.emplace(key, std::move(value)).first;
+    }
+    return *static_cast<const T*>(it->second.get());
+  }
+
+ private:
+  // (Row, slot) -> memoized value
+  std::map<std::pair<i64, i32>, std::shared_ptr<void>> row_cache_;
 };
 
 
@@ -412,7 +461,9 @@ class KernelBuilder {
       device_type_(DeviceType::CPU),
       num_devices_(1),
       can_batch_(false),
-      preferred_batch_size_(1) {}
+      preferred_batch_size_(1),
+      min_batch_size_(-1),
+      max_batch_size_(-1) {}
 
   KernelBuilder& device(DeviceType device_type) {
     device_type_ = device_type;
@@ -438,7 +489,21 @@ class KernelBuilder {
 
   KernelBuilder& batch(i32 preferred_batch_size = 1) {
     can_batch_ = true;
-    preferred_batch_size = preferred_batch_size;
+    preferred_batch_size_ = preferred_batch_size;
+    return *this;
+  }
+
+  /**
+   * @brief Declares the batch sizes the kernel performs correctly with.
+   *
+   * When batch size autotuning is enabled for a bulk job, Scanner picks the
+   * batch size for this kernel within [min_batch_size, max_batch_size]
+   * unless the op specifies a batch size explicitly.
+   */
+  KernelBuilder& batch_bounds(i32 min_batch_size, i32 max_batch_size) {
+    can_batch_ = true;
+    min_batch_size_ = min_batch_size;
+    max_batch_size_ = max_batch_size;
     return *this;
   }
 
@@ -451,6 +516,8 @@ class KernelBuilder {
   std::map<std::string, DeviceType> output_devices_;
   bool can_batch_;
   i32 preferred_batch_size_;
+  i32 min_batch_size_;
+  i32 max_batch_size_;
 };
 }
 
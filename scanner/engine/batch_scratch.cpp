@@ -0,0 +1,74 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/batch_scratch.h"
+
+namespace scanner {
+namespace internal {
+
+StenciledBatchedColumns& BatchScratch::inputs(size_t num_columns, i64 batch) {
+  record_capacity();
+  batches_++;
+  inputs_.resize(num_columns);
+  for (auto& column : inputs_) {
+    column.resize(batch);
+    for (ElementList& stencil : column) {
+      stencil.clear();
+    }
+  }
+  return inputs_;
+}
+
+BatchedColumns& BatchScratch::outputs(size_t num_columns) {
+  outputs_.resize(num_columns);
+  for (ElementList& column : outputs_) {
+    column.clear();
+  }
+  return outputs_;
+}
+
+void BatchScratch::release() {
+  StenciledBatchedColumns().swap(inputs_);
+  BatchedColumns().swap(outputs_);
+  capacity_ = 0;
+  batches_ = 0;
+  growths_ = 0;
+}
+
+i64 BatchScratch::growths() {
+  // Catch growth from filling the last batch
+  record_capacity();
+  return growths_;
+}
+
+void BatchScratch::record_capacity() {
+  size_t capacity = inputs_.capacity() + outputs_.capacity();
+  for (auto& column : inputs_) {
+    capacity += column.capacity();
+    for (ElementList& stencil : column) {
+      capacity += stencil.capacity();
+    }
+  }
+  for (ElementList& column : outputs_) {
+    capacity += column.capacity();
+  }
+  if (capacity > capacity_ && batches_ > 0) {
+    growths_++;
+  }
+  capacity_ = capacity;
+}
+
+}
+}
@@ -0,0 +1,56 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/api/kernel.h"
+#include "scanner/util/common.h"
+
+namespace scanner {
+namespace internal {
+
+// Buffers a kernel's batches are staged in. Element lists are cleared instead
+// of freed between batches, so once the buffers have grown to the largest
+// batch of a task, staging a batch no longer touches the heap. Everything is
+// freed in bulk by release() when the task retires.
+class BatchScratch {
+ public:
+  // Empty input columns with batch rows each, ready for stencil elements
+  StenciledBatchedColumns& inputs(size_t num_columns, i64 batch);
+
+  // Empty output columns for the kernel to insert into
+  BatchedColumns& outputs(size_t num_columns);
+
+  void release();
+
+  // Number of batches staged since the last release
+  i64 batches() const { return batches_; }
+
+  // Number of batches which grew the buffers since the last release
+  i64 growths();
+
+ private:
+  // Notes whether the buffers grew while staging the previous batch
+  void record_capacity();
+
+  StenciledBatchedColumns inputs_;
+  BatchedColumns outputs_;
+  size_t capacity_ = 0;
+  i64 batches_ = 0;
+  i64 growths_ = 0;
+};
+
+}
+}
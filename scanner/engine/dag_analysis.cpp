@@ -14,10 +14,13 @@
  */
 
 #include "scanner/engine/dag_analysis.h"
+#include "scanner/engine/row_set.h"
 #include "scanner/engine/sampler.h"
 #include "scanner/api/op.h"
 #include "scanner/api/kernel.h"
 
+#include <set>
+
 namespace scanner {
 namespace internal {
 
@@ -30,6 +33,248 @@ bool is_builtin_op(const std::string& name) {
   return false;
 }
 
+namespace {
+
+// 64 bit FNV-1a. Stable across processes and builds, unlike std::hash, so it
+// can name tables which outlive the master.
+u64 fnv1a_hash(const std::string& data) {
+  u64 hash = 14695981039346656037ULL;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+void append_field(std::string& key, const std::string& field) {
+  key += std::to_string(field.size());
+  key += ':';
+  key += field;
+}
+
+Result hash_op_chain(const DatabaseMetadata& meta,
+                     const TableMetaCache& table_metas, const proto::Job& job,
+                     const std::vector<proto::Op>& ops, i64 op_idx,
+                     std::map<i64, u64>& op_hashes) {
+  Result result;
+  result.set_success(true);
+  if (op_hashes.count(op_idx) > 0) {
+    return result;
+  }
+  const proto::Op& op = ops.at(op_idx);
+  if (op.name() == SLICE_OP_NAME || op.name() == UNSLICE_OP_NAME) {
+    RESULT_ERROR(&result, "Can not memoize Op %d since it depends on a slice.",
+                 (i32)op_idx);
+    return result;
+  }
+  std::string key;
+  append_field(key, op.name());
+  if (op.name() == INPUT_OP_NAME) {
+    // Identify the version of the table being read
+    bool found = false;
+    for (const proto::ColumnInput& ci : job.inputs()) {
+      if (ci.op_index() != op_idx) {
+        continue;
+      }
+      if (!meta.has_table(ci.table_name())) {
+        RESULT_ERROR(&result, "Input table %s does not exist.",
+                     ci.table_name().c_str());
+        return result;
+      }
+      const TableMetadata& table = table_metas.at(ci.table_name());
+      append_field(key, std::to_string(table.id()));
+      append_field(key, std::to_string(table.get_descriptor().timestamp()));
+      append_field(key, std::to_string(table.num_rows()));
+      append_field(key, ci.column_name());
+      found = true;
+    }
+    if (!found) {
+      RESULT_ERROR(&result, "No table was bound to Input Op %d.",
+                   (i32)op_idx);
+      return result;
+    }
+  } else {
+    append_field(key, op.kernel_args());
+    append_field(key, std::to_string(op.device_type()));
+    append_field(key, std::to_string(op.warmup()));
+    for (i32 s : op.stencil()) {
+      append_field(key, std::to_string(s));
+    }
+    // Sampling Ops are parameterized per job
+    for (const proto::SamplingArgsAssignment& saa :
+         job.sampling_args_assignment()) {
+      if (saa.op_index() == op_idx) {
+        append_field(key, saa.SerializeAsString());
+      }
+    }
+    for (const proto::OpInput& input : op.inputs()) {
+      result = hash_op_chain(meta, table_metas, job, ops, input.op_index(),
+                             op_hashes);
+      if (!result.success()) {
+        return result;
+      }
+      append_field(key, std::to_string(op_hashes.at(input.op_index())));
+      append_field(key, input.column());
+    }
+  }
+  op_hashes[op_idx] = fnv1a_hash(key);
+  return result;
+}
+
+// Drop Ops which no longer contribute to the output Op and renumber the rest
+void remove_unreachable_ops(std::vector<proto::Job>& jobs,
+                            std::vector<proto::Op>& ops) {
+  std::vector<bool> reachable(ops.size(), false);
+  reachable.back() = true;
+  for (i64 i = ops.size() - 1; i >= 0; --i) {
+    if (!reachable[i]) {
+      continue;
+    }
+    for (const proto::OpInput& input : ops[i].inputs()) {
+      if (input.op_index() >= 0) {
+        reachable[input.op_index()] = true;
+      }
+    }
+  }
+  std::vector<i64> new_index(ops.size(), -1);
+  std::vector<proto::Op> kept_ops;
+  for (size_t i = 0; i < ops.size(); ++i) {
+    if (reachable[i]) {
+      new_index[i] = kept_ops.size();
+      kept_ops.push_back(ops[i]);
+    }
+  }
+  for (proto::Op& op : kept_ops) {
+    for (proto::OpInput& input : *op.mutable_inputs()) {
+      if (input.op_index() >= 0) {
+        input.set_op_index(new_index[input.op_index()]);
+      }
+    }
+  }
+  ops = kept_ops;
+
+  for (proto::Job& job : jobs) {
+    google::protobuf::RepeatedPtrField<proto::ColumnInput> inputs;
+    for (const proto::ColumnInput& ci : job.inputs()) {
+      if (new_index[ci.op_index()] >= 0) {
+        proto::ColumnInput* kept = inputs.Add();
+        kept->CopyFrom(ci);
+        kept->set_op_index(new_index[ci.op_index()]);
+      }
+    }
+    job.mutable_inputs()->Swap(&inputs);
+
+    google::protobuf::RepeatedPtrField<proto::SamplingArgsAssignment>
+        assignments;
+    for (const proto::SamplingArgsAssignment& saa :
+         job.sampling_args_assignment()) {
+      if (new_index[saa.op_index()] >= 0) {
+        proto::SamplingArgsAssignment* kept = assignments.Add();
+        kept->CopyFrom(saa);
+        kept->set_op_index(new_index[saa.op_index()]);
+      }
+    }
+    job.mutable_sampling_args_assignment()->Swap(&assignments);
+  }
+}
+
+}
+
+Result memoized_table_name(const DatabaseMetadata& meta,
+                           const TableMetaCache& table_metas,
+                           const proto::Job& job,
+                           const std::vector<proto::Op>& ops, i64 op_idx,
+                           std::string& table_name) {
+  std::map<i64, u64> op_hashes;
+  Result result =
+      hash_op_chain(meta, table_metas, job, ops, op_idx, op_hashes);
+  if (result.success()) {
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx",
+             (unsigned long long)op_hashes.at(op_idx));
+    table_name = MEMOIZED_TABLE_PREFIX + hex;
+  }
+  return result;
+}
+
+Result splice_memoized_ops(const DatabaseMetadata& meta,
+                           const TableMetaCache& table_metas,
+                           std::vector<proto::Job>& jobs,
+                           std::vector<proto::Op>& ops,
+                           std::vector<std::string>& memoized_tables) {
+  Result result;
+  result.set_success(true);
+
+  // Name every cached table before changing the DAG, since splicing an Op
+  // changes the chains of the Ops after it
+  std::map<i64, std::vector<std::string>> cached_tables;
+  std::map<i64, std::string> cached_columns;
+  for (size_t op_idx = 0; op_idx < ops.size(); ++op_idx) {
+    if (!ops[op_idx].memoize() || is_builtin_op(ops[op_idx].name())) {
+      continue;
+    }
+    // Input Ops produce a single column, so the Op can only be replaced if
+    // one of its columns is used
+    std::set<std::string> used_columns;
+    for (const proto::Op& op : ops) {
+      for (const proto::OpInput& input : op.inputs()) {
+        if (input.op_index() == (i32)op_idx) {
+          used_columns.insert(input.column());
+        }
+      }
+    }
+    if (used_columns.size() != 1) {
+      continue;
+    }
+    std::vector<std::string> table_names;
+    for (const proto::Job& job : jobs) {
+      std::string table_name;
+      result =
+          memoized_table_name(meta, table_metas, job, ops, op_idx, table_name);
+      if (!result.success()) {
+        return result;
+      }
+      if (!meta.has_table(table_name) ||
+          !meta.table_is_committed(meta.get_table_id(table_name))) {
+        break;
+      }
+      table_names.push_back(table_name);
+    }
+    if (table_names.size() == jobs.size()) {
+      cached_tables[op_idx] = table_names;
+      cached_columns[op_idx] = *used_columns.begin();
+    }
+  }
+  if (cached_tables.empty()) {
+    return result;
+  }
+
+  for (auto& kv : cached_tables) {
+    i64 op_idx = kv.first;
+    const std::string& column = cached_columns.at(op_idx);
+    VLOG(1) << "Reading memoized outputs of " << ops[op_idx].name() << " ("
+            << op_idx << ")";
+    proto::Op input_op;
+    input_op.set_name(INPUT_OP_NAME);
+    input_op.set_device_type(proto::DeviceType::CPU);
+    input_op.add_stencil(0);
+    input_op.set_batch(-1);
+    proto::OpInput* input = input_op.add_inputs();
+    input->set_op_index(-1);
+    input->set_column(column);
+    ops[op_idx] = input_op;
+    for (size_t job_idx = 0; job_idx < jobs.size(); ++job_idx) {
+      proto::ColumnInput* ci = jobs[job_idx].add_inputs();
+      ci->set_op_index(op_idx);
+      ci->set_table_name(kv.second[job_idx]);
+      ci->set_column_name(column);
+      memoized_tables.push_back(kv.second[job_idx]);
+    }
+  }
+  remove_unreachable_ops(jobs, ops);
+  return result;
+}
+
 Result validate_jobs_and_ops(
     DatabaseMetadata& meta, TableMetaCache& table_metas,
     const std::vector<proto::Job>& jobs,
@@ -1097,13 +1342,92 @@ void perform_liveness_analysis(const std::vector<proto::Op>& ops,
   }
 }
 
+void derive_fused_op_chains(const std::vector<proto::Op>& ops,
+                            DAGAnalysisInfo& info) {
+  auto is_stateful = [&info](i64 op_idx) {
+    return info.bounded_state_ops.count(op_idx) > 0 ||
+           info.unbounded_state_ops.count(op_idx) > 0;
+  };
+  info.fused_ops.clear();
+  for (i64 op_idx = 1; op_idx < ops.size(); ++op_idx) {
+    i64 prev_idx = op_idx - 1;
+    const proto::Op& op = ops.at(op_idx);
+    const proto::Op& prev_op = ops.at(prev_idx);
+    if (is_builtin_op(op.name()) || is_builtin_op(prev_op.name())) {
+      continue;
+    }
+    if (op.device_type() != DeviceType::CPU ||
+        prev_op.device_type() != DeviceType::CPU) {
+      continue;
+    }
+    if (is_stateful(op_idx) || is_stateful(prev_idx)) {
+      continue;
+    }
+    // With a zero stencil, the previous Op computes exactly the rows this Op
+    // consumes so they can be passed along batch by batch
+    if (info.stencils.at(op_idx) != std::vector<i32>{0}) {
+      continue;
+    }
+    if (info.batch_sizes.at(op_idx) != info.batch_sizes.at(prev_idx)) {
+      continue;
+    }
+    bool only_prev_inputs = op.inputs_size() > 0;
+    for (auto& input : op.inputs()) {
+      if (input.op_index() != prev_idx) {
+        only_prev_inputs = false;
+        break;
+      }
+    }
+    if (!only_prev_inputs) {
+      continue;
+    }
+    bool only_child = info.op_children.count(prev_idx) > 0;
+    if (only_child) {
+      for (i64 child : info.op_children.at(prev_idx)) {
+        if (child != op_idx) {
+          only_child = false;
+          break;
+        }
+      }
+    }
+    if (!only_child) {
+      continue;
+    }
+    info.fused_ops[op_idx] = true;
+  }
+}
+
+Result make_job_domain_samplers(const proto::Job& job,
+                                JobDomainSamplers& domain_samplers) {
+  for (const proto::SamplingArgsAssignment& saa :
+       job.sampling_args_assignment()) {
+    std::vector<std::unique_ptr<DomainSampler>>& samplers =
+        domain_samplers[saa.op_index()];
+    for (auto& sa : saa.sampling_args()) {
+      DomainSampler* sampler;
+      Result result = make_domain_sampler_instance(
+          sa.sampling_function(),
+          std::vector<u8>(sa.sampling_args().begin(), sa.sampling_args().end()),
+          sampler);
+      if (!result.success()) {
+        return result;
+      }
+      samplers.emplace_back(sampler);
+    }
+  }
+  Result result;
+  result.set_success(true);
+  return result;
+}
+
 Result derive_stencil_requirements(
     const DatabaseMetadata& meta, const TableMetaCache& table_meta,
     const proto::Job& job, const std::vector<proto::Op>& ops,
     const DAGAnalysisInfo& analysis_results,
+    const JobDomainSamplers& domain_samplers,
     proto::BulkJobParameters::BoundaryCondition boundary_condition,
     i64 table_id, i64 job_idx, i64 task_idx,
-    const std::vector<i64>& output_rows, LoadWorkEntry& output_entry,
+    const RowSet& output_rows, LoadWorkEntry& output_entry,
     std::deque<TaskStream>& task_streams) {
   const std::map<i64, std::vector<i32>>& stencils = analysis_results.stencils;
   const std::vector<std::vector<std::tuple<i32, std::string>>>& live_columns =
@@ -1124,26 +1448,6 @@ Result derive_stencil_requirements(
   const std::map<i64, bool>& unbounded_state_ops =
       analysis_results.unbounded_state_ops;
   const std::map<i64, i32>& warmup_sizes = analysis_results.warmup_sizes;
-  // Create domain samplers
-  // Op -> slice
-  std::map<i64, std::vector<std::unique_ptr<DomainSampler>>> domain_samplers;
-  for (const proto::SamplingArgsAssignment& saa :
-       job.sampling_args_assignment()) {
-    std::vector<std::unique_ptr<DomainSampler>>& samplers =
-        domain_samplers[saa.op_index()];
-    // Assign number of rows to correct op
-    for (auto& sa : saa.sampling_args()) {
-      DomainSampler* sampler;
-      Result result = make_domain_sampler_instance(
-          sa.sampling_function(),
-          std::vector<u8>(sa.sampling_args().begin(), sa.sampling_args().end()),
-          sampler);
-      if (!result.success()) {
-        return result;
-      }
-      samplers.emplace_back(sampler);
-    }
-  }
 
   // Associate input ops with table ids
   std::vector<i32> table_ids(job.inputs_size());
@@ -1161,12 +1465,11 @@ Result derive_stencil_requirements(
   // For each Op, determine the set of rows needed in the live columns list
   // and the set of rows to feed to the Op at the current column mapping
   // Op -> Rows
-  std::vector<std::set<i64>> required_output_rows_at_op(ops.size());
-  std::vector<std::vector<i64>> required_input_rows_at_op(ops.size());
+  std::vector<RowSet> required_output_rows_at_op(ops.size());
   // Track inputs for ecah column of the input Op since different rnput Op
   // colums may correspond to different tables and conservatively requesting
   // all rows could cause an invalid access
-  std::vector<std::set<i64>> required_input_op_output_rows;
+  std::vector<RowSet> required_input_op_output_rows;
   required_input_op_output_rows.resize(ops.at(0).inputs_size());
   std::vector<std::vector<i64>> required_input_op_input_rows;
   required_input_op_input_rows.resize(ops.at(0).inputs_size());
@@ -1176,8 +1479,17 @@ Result derive_stencil_requirements(
   // elements than required. Should we stop the boundary condition at the Op
   // by deduplication?
   auto handle_boundary = [boundary_condition](
-      const std::vector<i64>& downstream_rows, i64 max_rows,
-      std::vector<i64>& bounded_rows) {
+      const RowSet& downstream_set, const std::vector<i64>& downstream_rows,
+      i64 max_rows, std::vector<i64>& bounded_rows) {
+    // Rows which are entirely in bounds pass through unchanged
+    if (downstream_set.empty() ||
+        (downstream_set.min() >= 0 && downstream_set.max() < max_rows)) {
+      bounded_rows.insert(bounded_rows.end(), downstream_rows.begin(),
+                          downstream_rows.end());
+      Result result;
+      result.set_success(true);
+      return result;
+    }
     // Handle rows which touch boundaries
     for (size_t i = 0; i < downstream_rows.size(); ++i) {
       i64 r = downstream_rows[i];
@@ -1208,17 +1520,17 @@ Result derive_stencil_requirements(
   i32 slice_group = 0;
   {
     // Initialize output rows
-    required_output_rows_at_op.at(num_ops - 1) =
-        std::set<i64>(output_rows.begin(), output_rows.end());
+    required_output_rows_at_op.at(num_ops - 1) = output_rows;
     // For each kernel, derive the minimal required upstream elements
     for (i64 op_idx = num_ops - 1; op_idx >= 0; --op_idx) {
       auto& op = ops.at(op_idx);
-      std::vector<i64> downstream_rows(
-          required_output_rows_at_op.at(op_idx).begin(),
-          required_output_rows_at_op.at(op_idx).end());
-      std::sort(downstream_rows.begin(), downstream_rows.end());
-      std::vector<i64> compute_rows;
+      const RowSet& downstream_set = required_output_rows_at_op.at(op_idx);
+      std::vector<i64> downstream_rows = downstream_set.to_vector();
+      RowSet compute_set;
       // Determine which upstream rows are needed for the requested output rows
+      RowSet new_set;
+      // Samplers and boundary handling may repeat or reorder rows, so those
+      // branches also keep the exact list of rows fed to the Op
       std::vector<i64> new_rows;
       // Input Op
       if (op.name() == INPUT_OP_NAME) {
@@ -1227,15 +1539,14 @@ Result derive_stencil_requirements(
           // Determine input table this column came from
           for (size_t i = 0; i < table_ids.size(); ++i) {
             i32 table_id = table_ids[i];
-            std::vector<i64> output_rows(
-                required_input_op_output_rows.at(i).begin(),
-                required_input_op_output_rows.at(i).end());
-            std::sort(output_rows.begin(), output_rows.end());
+            const RowSet& output_set = required_input_op_output_rows.at(i);
+            std::vector<i64> output_rows = output_set.to_vector();
             std::vector<i64>& input_rows = required_input_op_input_rows.at(i);
             i64 num_rows = table_meta.at(table_id).num_rows();
 
             // Perform boundary restriction
-            Result result = handle_boundary(output_rows, num_rows, input_rows);
+            Result result =
+                handle_boundary(output_set, output_rows, num_rows, input_rows);
             if (!result.success()) {
               return result;
             }
@@ -1256,6 +1567,7 @@ Result derive_stencil_requirements(
         if (!result.success()) {
           return result;
         }
+        new_set = RowSet::from_rows(new_rows);
       }
       // Space Op
       else if (op.name() == SPACE_OP_NAME) {
@@ -1270,6 +1582,7 @@ Result derive_stencil_requirements(
         if (!result.success()) {
           return result;
         }
+        new_set = RowSet::from_rows(new_rows);
       }
       // Slice Op
       else if (op.name() == SLICE_OP_NAME) {
@@ -1287,17 +1600,24 @@ Result derive_stencil_requirements(
         }
 
         i64 rows_in_group = slice_output_counts.at(slice_group);
-        // Perform boundary restriction
-        std::vector<i64> bounded_rows;
-        Result result =
-            handle_boundary(downstream_rows, rows_in_group, bounded_rows);
-        if (!result.success()) {
-          return result;
-        }
+        if (downstream_set.empty() || (downstream_set.min() >= 0 &&
+                                       downstream_set.max() < rows_in_group)) {
+          // Remap row indices
+          new_set = downstream_set.shifted(offset);
+        } else {
+          // Perform boundary restriction
+          std::vector<i64> bounded_rows;
+          Result result = handle_boundary(downstream_set, downstream_rows,
+                                          rows_in_group, bounded_rows);
+          if (!result.success()) {
+            return result;
+          }
 
-        // Remap row indices
-        for (i64 r : bounded_rows) {
-          new_rows.push_back(r + offset);
+          // Remap row indices
+          for (i64 r : bounded_rows) {
+            new_rows.push_back(r + offset);
+          }
+          new_set = RowSet::from_rows(new_rows);
         }
       }
       // Unslice Op
@@ -1307,8 +1627,8 @@ Result derive_stencil_requirements(
         // can be computed entirely independently and choose output rows
         // that do not cross state boundaries to make it possible to assume
         // that all rows are in the same slice
-        i64 downstream_min = downstream_rows[0];
-        i64 downstream_max = downstream_rows[downstream_rows.size() - 1];
+        i64 downstream_min = downstream_set.min();
+        i64 downstream_max = downstream_set.max();
         const auto& unslice_input_counts = job_unslice_input_rows.at(op_idx);
         i64 offset = 0;
         slice_group = 0;
@@ -1323,59 +1643,34 @@ Result derive_stencil_requirements(
         }
         assert(found);
         // Remap row indices
-        for (i64 r : downstream_rows) {
-          new_rows.push_back(r - offset);
-        }
+        new_set = downstream_set.shifted(-offset);
       }
       // Output Op
       else if (op.name() == OUTPUT_OP_NAME) {
-        new_rows = downstream_rows;
+        new_set = downstream_set;
       }
       // Regular Op
       else {
         assert(!is_builtin_op(op.name()));
-        std::unordered_set<i64> current_rows;
-        current_rows.reserve(downstream_rows.size());
         // If bounded state, we need to handle warmup
         if (bounded_state_ops.count(op_idx) > 0) {
           i32 warmup = warmup_sizes.at(op_idx);
-          for (i64 r : downstream_rows) {
-            // Check that we have all warmup rows
-            for (i64 i = 0; i <= warmup; ++i) {
-              i64 req_row = r - i;
-              if (req_row < 0) {
-                continue;
-              }
-              current_rows.insert(req_row);
-            }
-          }
+          // Check that we have all warmup rows
+          compute_set = downstream_set.extended_back(warmup, 0);
         }
         // If unbounded state, we need all upstream inputs from 0
         else if (unbounded_state_ops.count(op_idx) > 0) {
-          i32 max_required_row = downstream_rows.back();
-          for (i64 i = 0; i <= max_required_row; ++i) {
-            current_rows.insert(i);
-          }
+          i64 max_required_row = downstream_set.max();
+          compute_set = RowSet::from_range(0, max_required_row + 1);
         } else {
-          current_rows.insert(downstream_rows.begin(), downstream_rows.end());
+          compute_set = downstream_set;
         }
-        compute_rows = std::vector<i64>(current_rows.begin(),
-                                        current_rows.end());
-        std::sort(compute_rows.begin(), compute_rows.end());
 
         // Ensure we have inputs for stenciling kernels
-        std::unordered_set<i64> stencil_rows;
         const std::vector<i32>& stencil = stencils.at(op_idx);
-        for (i64 r : current_rows) {
-          for (i64 s : stencil) {
-            stencil_rows.insert(r + s);
-          }
-        }
-        new_rows = std::vector<i64>(stencil_rows.begin(), stencil_rows.end());
-        std::sort(new_rows.begin(), new_rows.end());
+        new_set = compute_set.dilated(stencil);
       }
 
-      required_input_rows_at_op.at(op_idx) = new_rows;
       // Input Op inputs do not connect to any other Ops
       if (op.name() != INPUT_OP_NAME) {
         for (auto& input : op.inputs()) {
@@ -1391,24 +1686,23 @@ Result derive_stencil_requirements(
               }
             }
             assert(col_id != -1);
-            required_input_op_output_rows.at(col_id).insert(new_rows.begin(),
-                                                            new_rows.end());
+            required_input_op_output_rows.at(col_id).merge(new_set);
           }
-          auto& input_outputs = required_output_rows_at_op.at(input.op_index());
-          input_outputs.insert(new_rows.begin(), new_rows.end());
+          required_output_rows_at_op.at(input.op_index()).merge(new_set);
         }
       }
 
-      if (compute_rows.empty()) {
-        compute_rows = new_rows;
+      if (new_rows.empty()) {
+        new_rows = new_set.to_vector();
       }
 
       TaskStream s;
       s.slice_group = slice_group;
-      s.valid_input_rows = new_rows;
-      s.compute_input_rows = compute_rows;
-      s.valid_output_rows = downstream_rows;
-      task_streams.push_front(s);
+      s.compute_input_rows =
+          compute_set.empty() ? new_rows : compute_set.to_vector();
+      s.valid_input_rows = std::move(new_rows);
+      s.valid_output_rows = std::move(downstream_rows);
+      task_streams.push_front(std::move(s));
     }
   }
 
@@ -1423,9 +1717,10 @@ Result derive_stencil_requirements(
         required_input_op_input_rows.at(i).begin(),
         required_input_op_input_rows.at(i).end());
     out_sample->mutable_input_row_ids()->Swap(&input_data);
-    google::protobuf::RepeatedField<i64> output_data(
-        required_input_op_output_rows.at(i).begin(),
-        required_input_op_output_rows.at(i).end());
+    std::vector<i64> sample_output_rows =
+        required_input_op_output_rows.at(i).to_vector();
+    google::protobuf::RepeatedField<i64> output_data(sample_output_rows.begin(),
+                                                     sample_output_rows.end());
     out_sample->mutable_output_row_ids()->Swap(&output_data);
   }
   Result result;
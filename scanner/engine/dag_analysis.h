@@ -16,6 +16,8 @@
 #include "scanner/engine/metadata.h"
 #include "scanner/engine/table_meta_cache.h"
 #include "scanner/engine/runtime.h"
+#include "scanner/engine/row_set.h"
+#include "scanner/engine/sampler.h"
 
 #include <deque>
 
@@ -40,6 +42,9 @@ const std::vector<std::string> BUILTIN_OP_NAMES = {
 
 bool is_builtin_op(const std::string& name);
 
+// Prefix of the tables holding memoized Op outputs
+const std::string MEMOIZED_TABLE_PREFIX = "__memo_";
+
 struct DAGAnalysisInfo {
   std::vector<i32> op_slice_level;
   std::map<i64, i64> input_ops;
@@ -67,6 +72,10 @@ struct DAGAnalysisInfo {
   std::map<i64, i32> batch_sizes;
   std::map<i64, std::vector<i32>> stencils;
 
+  // Filled in by derive_fused_op_chains
+  // Op -> true if the Op executes in the same stage as the previous Op
+  std::map<i64, bool> fused_ops;
+
   // Filled in by remap_input_op_edges
   std::map<i64, i64> input_ops_to_first_op_columns;
 
@@ -78,6 +87,26 @@ struct DAGAnalysisInfo {
 };
 
 
+// Name of the table caching the outputs of the memoized Op op_idx for job.
+// It is derived from a hash of the Op chain leading to the Op, including the
+// kernel args of every Op and the version of every table the chain reads, so
+// the same computation maps to the same table across bulk jobs.
+Result memoized_table_name(const DatabaseMetadata& meta,
+                           const TableMetaCache& table_metas,
+                           const proto::Job& job,
+                           const std::vector<proto::Op>& ops, i64 op_idx,
+                           std::string& table_name);
+
+// Replace every memoized Op whose outputs are cached for all jobs with an
+// Input Op reading the cached tables, and drop the Ops which only fed it.
+// The names of the cached tables which were spliced in are returned in
+// memoized_tables.
+Result splice_memoized_ops(const DatabaseMetadata& meta,
+                           const TableMetaCache& table_metas,
+                           std::vector<proto::Job>& jobs,
+                           std::vector<proto::Op>& ops,
+                           std::vector<std::string>& memoized_tables);
+
 Result validate_jobs_and_ops(
     DatabaseMetadata& meta, TableMetaCache& table_metas,
     const std::vector<proto::Job>& jobs,
@@ -109,13 +138,32 @@ void remap_input_op_edges(std::vector<proto::Op>& ops,
 void perform_liveness_analysis(const std::vector<proto::Op>& ops,
                                DAGAnalysisInfo& info);
 
+// Find chains of adjacent CPU kernels which can be executed back-to-back on
+// each batch without staging their intermediates through the element cache.
+// An Op is fused with the Op before it when both are stateless CPU kernels
+// with the same batch size, the Op has a stencil of {0}, it only reads
+// outputs of the previous Op, and no other Op reads those outputs.
+void derive_fused_op_chains(const std::vector<proto::Op>& ops,
+                            DAGAnalysisInfo& info);
+
+// Op -> Slice -> sampler for a single Job
+using JobDomainSamplers =
+    std::map<i64, std::vector<std::unique_ptr<DomainSampler>>>;
+
+// Instantiate the domain samplers for a job. This is done once per job and
+// shared across all of its tasks since deserializing the sampler args is
+// relatively expensive.
+Result make_job_domain_samplers(const proto::Job& job,
+                                JobDomainSamplers& domain_samplers);
+
 Result derive_stencil_requirements(
     const DatabaseMetadata& meta, const TableMetaCache& table_meta,
     const proto::Job& job, const std::vector<proto::Op>& ops,
     const DAGAnalysisInfo& analysis_results,
+    const JobDomainSamplers& domain_samplers,
     proto::BulkJobParameters::BoundaryCondition boundary_condition,
     i64 table_id, i64 job_idx, i64 task_idx,
-    const std::vector<i64>& output_rows, LoadWorkEntry& output_entry,
+    const RowSet& output_rows, LoadWorkEntry& output_entry,
     std::deque<TaskStream>& task_streams);
 
 // Result derive_input_rows_from_output_rows(
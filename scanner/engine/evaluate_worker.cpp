@@ -6,7 +6,8 @@
 
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
-#include <thread>
+#include <limits>
+#include <future>
 
 namespace scanner {
 namespace internal {
@@ -16,13 +17,24 @@ PreEvaluateWorker::PreEvaluateWorker(const PreEvaluateWorkerArgs& args)
     worker_id_(args.worker_id),
     device_handle_(args.device_handle),
     num_cpus_(args.num_cpus),
-    profiler_(args.profiler) {
+    decoders_per_column_(std::max(args.decoders_per_column, 1)),
+    profiler_(args.profiler),
+    decoder_pool_(args.decoder_pool) {
+}
+
+PreEvaluateWorker::~PreEvaluateWorker() {
+  for (auto& decoders : decoders_) {
+    for (auto& decoder : decoders) {
+      decoder_pool_.release(std::move(decoder));
+    }
+  }
 }
 
-void PreEvaluateWorker::feed(EvalWorkEntry& work_entry, bool first) {
+void PreEvaluateWorker::feed(EvalWorkEntry&& input_entry, bool first) {
   auto feed_start = now();
 
-  entry_ = work_entry;
+  entry_ = std::move(input_entry);
+  EvalWorkEntry& work_entry = entry_;
 
   needs_configure_ = !(work_entry.job_index == last_job_idx_);
   needs_reset_ = true;
@@ -46,20 +58,18 @@ void PreEvaluateWorker::feed(EvalWorkEntry& work_entry, bool first) {
   i32 media_col_idx = 0;
   if (decoders_.empty()) {
     auto init_start = now();
-    VideoDecoderType decoder_type;
-    i32 num_devices;
     // Select a decoder type based on the type of the first op and
     // the available decoders
     if (device_handle_.type == DeviceType::GPU &&
         VideoDecoder::has_decoder_type(VideoDecoderType::NVIDIA)) {
       decoder_output_handle_.type = DeviceType::GPU;
       decoder_output_handle_.id = device_handle_.id;
-      decoder_type = VideoDecoderType::NVIDIA;
-      num_devices = 1;
+      decoder_type_ = VideoDecoderType::NVIDIA;
+      decoder_num_devices_ = 1;
     } else {
       decoder_output_handle_ = CPU_DEVICE;
-      decoder_type = VideoDecoderType::SOFTWARE;
-      num_devices = num_cpus_;
+      decoder_type_ = VideoDecoderType::SOFTWARE;
+      decoder_num_devices_ = num_cpus_;
     }
     for (size_t c = 0; c < work_entry.columns.size(); ++c) {
       if (work_entry.column_types[c] == ColumnType::Video &&
@@ -80,7 +90,7 @@ void PreEvaluateWorker::feed(EvalWorkEntry& work_entry, bool first) {
           hd.id = device_handle_.id;
 
           hwang::VideoDecoderType vd;
-          switch (decoder_type) {
+          switch (decoder_type_) {
             case VideoDecoderType::SOFTWARE:
               vd = hwang::VideoDecoderType::SOFTWARE;
               break;
@@ -92,15 +102,15 @@ void PreEvaluateWorker::feed(EvalWorkEntry& work_entry, bool first) {
           }
 
           inplace_decoders_.emplace_back(
-              new hwang::DecoderAutomata(hd, num_devices, vd));
+              new hwang::DecoderAutomata(hd, decoder_num_devices_, vd));
           //decoders_.back()->set_profiler(&profiler_);
-          decoders_.emplace_back(nullptr);
+          decoders_.emplace_back();
         } else {
-          decoders_.emplace_back(
-              new DecoderAutomata(device_handle_, num_devices, decoder_type));
-          decoders_.back()->set_profiler(&profiler_);
+          // Filled from the decoder pool once the geometry is known
+          decoders_.emplace_back();
           inplace_decoders_.emplace_back(nullptr);
         }
+        interval_start_rows_.emplace_back();
         media_col_idx++;
       }
     }
@@ -130,7 +140,49 @@ void PreEvaluateWorker::feed(EvalWorkEntry& work_entry, bool first) {
       }
 
       if (!work_entry.inplace_video[c]) {
-        decoders_[media_col_idx]->initialize(args);
+        FrameInfo info(args[0].height(), args[0].width(), 3, FrameType::U8);
+        // Keyframe intervals decode independently, so spread them over
+        // several decoders instead of flushing one decoder between them
+        size_t num_decoders =
+            std::min(args.size(), (size_t)decoders_per_column_);
+        auto& decoders = decoders_[media_col_idx];
+        while (decoders.size() > num_decoders) {
+          decoder_pool_.release(std::move(decoders.back()));
+          decoders.pop_back();
+        }
+        decoders.resize(num_decoders);
+        for (auto& decoder : decoders) {
+          if (!decoder) {
+            decoder = decoder_pool_.acquire(device_handle_,
+                                            decoder_num_devices_,
+                                            decoder_type_, info, &profiler_);
+          } else if (decoder->frame_info() != info) {
+            // Trade for an idle decoder already set up for this geometry
+            std::unique_ptr<DecoderAutomata> configured =
+                decoder_pool_.acquire_configured(
+                    device_handle_, decoder_num_devices_, decoder_type_, info,
+                    &profiler_);
+            if (configured) {
+              decoder_pool_.release(std::move(decoder));
+              decoder = std::move(configured);
+            }
+          }
+        }
+        // Deal intervals out round robin so that rows which are close
+        // together come from different decoders
+        std::vector<std::vector<proto::DecodeArgs>> decoder_args(num_decoders);
+        auto& start_rows = interval_start_rows_[media_col_idx];
+        start_rows.clear();
+        i64 rows = 0;
+        for (size_t i = 0; i < args.size(); ++i) {
+          decoder_args[i % num_decoders].push_back(args[i]);
+          start_rows.push_back(rows);
+          rows += args[i].valid_frames_size();
+        }
+        start_rows.push_back(rows);
+        for (size_t d = 0; d < num_decoders; ++d) {
+          decoders[d]->initialize(decoder_args[d]);
+        }
       } else {
         // Translate into encoded data
         std::vector<hwang::DecoderAutomata::EncodedData> encoded_data;
@@ -180,11 +232,15 @@ bool PreEvaluateWorker::yield(i32 item_size,
   i64 end_row = std::min(current_row_ + item_size, total_rows_);
 
   bool first_item = (start_row == 0);
+  // When a single item covers the whole entry, nothing else reads the
+  // buffered rows so they can be handed over instead of copied
+  bool whole_entry = first_item && end_row >= total_rows_;
   i32 media_col_idx = 0;
   EvalWorkEntry entry;
   entry.table_id = work_entry.table_id;
   entry.job_index = work_entry.job_index;
   entry.task_index = work_entry.task_index;
+  entry.attempt = work_entry.attempt;
   entry.needs_configure = first_item ? needs_configure_ : false;
   entry.needs_reset = first_item_ ? needs_reset_ : false;
   entry.last_in_io_packet = (end_row >= total_rows_) ? true : false;
@@ -210,7 +266,8 @@ bool PreEvaluateWorker::yield(i32 item_size,
           u8* buffer = new_block_buffer(decoder_output_handle_,
                                         num_rows * frame_info.size(), num_rows);
           if (!work_entry.inplace_video[c]) {
-            decoders_[media_col_idx]->get_frames(buffer, num_rows);
+            decode_rows(media_col_idx, column_start_row, num_rows, buffer,
+                        frame_info.size());
           } else {
             inplace_decoders_[media_col_idx]->get_frames(buffer, num_rows);
           }
@@ -234,23 +291,74 @@ bool PreEvaluateWorker::yield(i32 item_size,
       }
       media_col_idx++;
     } else {
-      entry.columns[c] =
-          std::vector<Element>(work_entry.columns[c].begin() + column_start_row,
-                               work_entry.columns[c].begin() + column_end_row);
+      if (whole_entry) {
+        entry.columns[c] = std::move(work_entry.columns[c]);
+      } else {
+        entry.columns[c] = std::vector<Element>(
+            work_entry.columns[c].begin() + column_start_row,
+            work_entry.columns[c].begin() + column_end_row);
+      }
       entry.column_handles.push_back(work_entry.column_handles[c]);
     }
-    entry.row_ids[c] =
-        std::vector<i64>(work_entry.row_ids[c].begin() + column_start_row,
-                         work_entry.row_ids[c].begin() + column_end_row);
+    if (whole_entry) {
+      entry.row_ids[c] = std::move(work_entry.row_ids[c]);
+    } else {
+      entry.row_ids[c] =
+          std::vector<i64>(work_entry.row_ids[c].begin() + column_start_row,
+                           work_entry.row_ids[c].begin() + column_end_row);
+    }
   }
   profiler_.add_interval("yield", yield_start, now());
 
   current_row_ += item_size;
 
-  output_entry = entry;
+  output_entry = std::move(entry);
   return true;
 }
 
+void PreEvaluateWorker::decode_rows(i32 media_col_idx, i64 start_row,
+                                    i64 num_rows, u8* buffer,
+                                    size_t frame_size) {
+  auto& decoders = decoders_[media_col_idx];
+  if (decoders.size() == 1) {
+    decoders[0]->get_frames(buffer, num_rows);
+    return;
+  }
+
+  // Decoder -> (first frame in buffer, frames) of each interval it covers
+  const std::vector<i64>& start_rows = interval_start_rows_[media_col_idx];
+  std::vector<std::vector<std::tuple<i64, i64>>> segments(decoders.size());
+  i64 end_row = start_row + num_rows;
+  for (size_t i = 0; i + 1 < start_rows.size(); ++i) {
+    i64 first = std::max(start_row, start_rows[i]);
+    i64 last = std::min(end_row, start_rows[i + 1]);
+    if (first < last) {
+      segments[i % decoders.size()].emplace_back(first - start_row,
+                                                 last - first);
+    }
+  }
+
+  auto decode = [&](size_t d) {
+    for (auto& segment : segments[d]) {
+      decoders[d]->get_frames(buffer + std::get<0>(segment) * frame_size,
+                              std::get<1>(segment));
+    }
+  };
+  if (!decode_pool_) {
+    decode_pool_.reset(new ThreadPool(decoders_per_column_ - 1));
+  }
+  std::vector<std::future<void>> decodes;
+  for (size_t d = 1; d < decoders.size(); ++d) {
+    if (!segments[d].empty()) {
+      decodes.push_back(decode_pool_->enqueue(decode, d));
+    }
+  }
+  decode(0);
+  for (auto& decoded : decodes) {
+    decoded.get();
+  }
+}
+
 EvaluateWorker::EvaluateWorker(const EvaluateWorkerArgs& args)
   : node_id_(args.node_id),
     worker_id_(worker_id_),
@@ -341,6 +449,49 @@ EvaluateWorker::EvaluateWorker(const EvaluateWorkerArgs& args)
     element_cache_[i].resize(arg_group_.column_mapping[i].size());
     element_cache_row_ids_[i].resize(arg_group_.column_mapping[i].size());
   }
+  // Determine where each fused chain ends. Fusion is only valid if the fused
+  // kernel can read the previous kernel's outputs without a copy.
+  for (size_t k = 0; k < kernels_.size(); ++k) {
+    if (arg_group_.fused_with_previous[k]) {
+      bool same_space = true;
+      for (auto& handle : kernel_input_devices_[k]) {
+        for (auto& prev_handle : kernel_output_devices_[k - 1]) {
+          same_space &= prev_handle.is_same_address_space(handle);
+        }
+      }
+      if (!same_space) {
+        arg_group_.fused_with_previous[k] = false;
+      }
+    }
+  }
+  fused_chain_end_.resize(kernels_.size());
+  fused_chain_names_.resize(kernels_.size());
+  for (size_t k = 0; k < kernels_.size(); ++k) {
+    i32 end = k;
+    fused_chain_names_[k] = arg_group_.op_names[k];
+    while (end + 1 < kernels_.size() &&
+           arg_group_.fused_with_previous[end + 1]) {
+      end++;
+      fused_chain_names_[k] += "+" + arg_group_.op_names[end];
+    }
+    fused_chain_end_[k] = end;
+  }
+  // Autotune batch sizes for kernels with a range of valid batch sizes. Ops
+  // in a fused chain must share one batch size so they are left alone.
+  batch_tuners_.resize(kernels_.size());
+  for (size_t k = 0; k < kernels_.size(); ++k) {
+    i32 min_batch = std::get<0>(arg_group_.kernel_batch_size_bounds[k]);
+    i32 max_batch = std::get<1>(arg_group_.kernel_batch_size_bounds[k]);
+    if (kernels_[k] == nullptr || min_batch >= max_batch ||
+        fused_chain_end_[k] != k || arg_group_.fused_with_previous[k]) {
+      continue;
+    }
+    batch_tuners_[k].reset(
+        new BatchSizeTuner(min_batch, max_batch, arg_group_.autotune_batches,
+                           arg_group_.kernel_batch_sizes[k]));
+  }
+  batch_scratch_.resize(kernels_.size());
+
   valid_output_rows_.resize(kernels_.size());
   current_valid_input_idx_.resize(kernels_.size());
   current_valid_output_idx_.assign(kernels_.size(), 0);
@@ -356,6 +507,7 @@ EvaluateWorker::EvaluateWorker(const EvaluateWorkerArgs& args)
 EvaluateWorker::~EvaluateWorker() {
   // Clear the stencil cache
   clear_stencil_cache();
+  release_batch_scratch();
 }
 
 void EvaluateWorker::new_task(i64 job_idx, i64 task_idx,
@@ -368,17 +520,17 @@ void EvaluateWorker::new_task(i64 job_idx, i64 task_idx,
     }
   }
   valid_input_rows_.clear();
-  valid_input_rows_set_.clear();
   current_valid_input_idx_.clear();
 
   compute_rows_.clear();
-  compute_rows_set_.clear();
   current_compute_idx_.clear();
 
   valid_output_rows_.clear();
-  valid_output_rows_set_.clear();
   current_valid_output_idx_.clear();
 
+  // Batch buffers are sized for the previous task's batches
+  release_batch_scratch();
+
   current_element_cache_input_idx_.clear();
   slice_group_ = -1;
   for (size_t k = 0; k < task_streams.size(); ++k) {
@@ -387,21 +539,15 @@ void EvaluateWorker::new_task(i64 job_idx, i64 task_idx,
       slice_group_ = ts.slice_group;
     }
     valid_input_rows_.push_back(ts.valid_input_rows);
-    valid_input_rows_set_.push_back(
-        std::set<i64>(ts.valid_input_rows.begin(), ts.valid_input_rows.end()));
     current_valid_input_idx_.emplace_back();
     for(i64 i = 0; i < arg_group_.column_mapping[k].size(); ++i) {
       current_valid_input_idx_.back().push_back(0);
     }
 
     compute_rows_.push_back(ts.compute_input_rows);
-    compute_rows_set_.push_back(std::set<i64>(
-        ts.compute_input_rows.begin(), ts.compute_input_rows.end()));
     current_compute_idx_.push_back(0);
 
     valid_output_rows_.push_back(ts.valid_output_rows);
-    valid_output_rows_set_.push_back(std::set<i64>(ts.valid_output_rows.begin(),
-                                                   ts.valid_output_rows.end()));
     current_valid_output_idx_.push_back(0);
 
     current_element_cache_input_idx_.push_back(0);
@@ -415,19 +561,25 @@ void EvaluateWorker::new_task(i64 job_idx, i64 task_idx,
     if (arg_group_.sampling_args.at(op_idx).at(job_idx).size() > 1) {
       slice = slice_group_;
     }
-    auto& sampling_args =
-        arg_group_.sampling_args.at(op_idx).at(job_idx).at(slice);
-    DomainSampler* sampler = nullptr;
-    Result result = make_domain_sampler_instance(
-        sampling_args.sampling_function(),
-        std::vector<u8>(sampling_args.sampling_args().begin(),
-                        sampling_args.sampling_args().end()),
-        sampler);
-    if (!result.success()) {
-      VLOG(1) << "Make domain sampler failed: " << result.msg();
-      THREAD_RETURN_SUCCESS();
+    auto key = std::make_tuple(op_idx, job_idx, slice);
+    auto it = sampler_cache_.find(key);
+    if (it == sampler_cache_.end()) {
+      auto& sampling_args =
+          arg_group_.sampling_args.at(op_idx).at(job_idx).at(slice);
+      DomainSampler* sampler = nullptr;
+      Result result = make_domain_sampler_instance(
+          sampling_args.sampling_function(),
+          std::vector<u8>(sampling_args.sampling_args().begin(),
+                          sampling_args.sampling_args().end()),
+          sampler);
+      if (!result.success()) {
+        VLOG(1) << "Make domain sampler failed: " << result.msg();
+        THREAD_RETURN_SUCCESS();
+      }
+      it = sampler_cache_.emplace(key, std::unique_ptr<DomainSampler>(sampler))
+               .first;
     }
-    domain_samplers_[op_idx].reset(sampler);
+    domain_samplers_[op_idx] = it->second.get();
   }
 
   // Make the op aware of the format of the data
@@ -444,9 +596,7 @@ void EvaluateWorker::new_task(i64 job_idx, i64 task_idx,
   clear_stencil_cache();
 }
 
-void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
-  entry_ = work_entry;
-
+void EvaluateWorker::feed(EvalWorkEntry&& work_entry) {
   auto feed_start = now();
 
   current_input_ = 0;
@@ -456,14 +606,21 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
         std::max(total_inputs_, (i32)work_entry.columns[i].size());
   }
 
-  std::vector<DeviceHandle> side_output_handles = work_entry.column_handles;
-  BatchedColumns side_output_columns = work_entry.columns;
-  std::vector<std::vector<i64>> side_row_ids = work_entry.row_ids;
+  // The input rows become the side output columns; only the bookkeeping
+  // fields of the entry are kept around for yield
+  std::vector<DeviceHandle> side_output_handles =
+      std::move(work_entry.column_handles);
+  BatchedColumns side_output_columns = std::move(work_entry.columns);
+  std::vector<std::vector<i64>> side_row_ids = std::move(work_entry.row_ids);
+  entry_ = std::move(work_entry);
 
   // For each kernel, produce as much output as can be produced given current
   // input rows and stencil cache.
   for (size_t k = 0; k < arg_group_.op_names.size(); ++k) {
     const std::string& op_name = arg_group_.op_names.at(k);
+    if (batch_tuners_[k]) {
+      arg_group_.kernel_batch_sizes[k] = batch_tuners_[k]->batch_size();
+    }
     DeviceHandle current_handle = kernel_devices_[k];
     const std::vector<DeviceHandle>& current_input_handles =
         kernel_input_devices_[k];
@@ -471,14 +628,12 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
         kernel_output_devices_[k];
 
     std::vector<i64>& kernel_valid_input_rows = valid_input_rows_[k];
-    std::set<i64>& kernel_valid_input_rows_set = valid_input_rows_set_[k];
     std::vector<i64>& kernel_current_input_idx = current_valid_input_idx_[k];
 
     std::vector<i64>& kernel_compute_rows = compute_rows_[k];
     i64& kernel_current_compute_idx = current_compute_idx_[k];
 
     std::vector<i64>& kernel_valid_output_rows = valid_output_rows_[k];
-    std::set<i64>& kernel_valid_output_rows_set = valid_output_rows_set_[k];
     i64& kernel_current_output_idx = current_valid_output_idx_[k];
 
     i64& kernel_element_cache_input_idx = current_element_cache_input_idx_[k];
@@ -489,67 +644,73 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
     std::vector<i32>& input_column_idx = arg_group_.column_mapping[k];
     std::set<i32>& input_column_idx_set = column_mapping_set_[k];
 
-    // Since inputs can arrive at different rates, we need to keep
-    // inputs around until they have been used.
-    // Place all new input elements in side output columns into intermediate
-    // cache. If different device, move all required values in the side output
-    // columns to the proper device for this kernel
-    assert(op_name == INPUT_OP_NAME ||
-           current_input_handles.size() == input_column_idx.size());
-    if (kernel_cache_devices.empty()) {
-      for (i32 i = 0; i < input_column_idx.size(); ++i) {
-        kernel_cache_devices.push_back(current_input_handles[i]);
-      }
-    }
-    for (i32 i = 0; i < input_column_idx.size(); ++i) {
-      i32 in_col_idx = input_column_idx[i];
-      assert(in_col_idx < side_output_columns.size());
-      // Select elements which this kernel requires as inputs
-      auto& row_ids = side_row_ids[in_col_idx];
-      ElementList valid_inputs;
-      i64& current_input_idx = kernel_current_input_idx[i];
-      for (size_t r = 0; r < row_ids.size(); ++r) {
-        assert(current_input_idx >= kernel_valid_input_rows.size() ||
-               row_ids[r] <= kernel_valid_input_rows[current_input_idx]);
-        if (current_input_idx < kernel_valid_input_rows.size() &&
-            row_ids[r] == kernel_valid_input_rows[current_input_idx]) {
-          // Insert row ids for valid elements into cache
-          kernel_cache_row_ids[i].push_back(row_ids[r]);
-          Element element(side_output_columns[in_col_idx][r]);
-          // We provide the input index to the kernel so that it can detect
-          // non-consecutive elements
-          element.index = row_ids[r];
-          valid_inputs.push_back(element);
-          current_input_idx++;
+    // Ops fused with the previous Op receive their inputs directly from it
+    // when the head of the fused chain executes, so they skip the cache.
+    bool fused = arg_group_.fused_with_previous[k];
+    i64 max_row_id_seen = -1;
+    if (!fused) {
+      // Since inputs can arrive at different rates, we need to keep
+      // inputs around until they have been used.
+      // Place all new input elements in side output columns into intermediate
+      // cache. If different device, move all required values in the side
+      // output columns to the proper device for this kernel
+      assert(op_name == INPUT_OP_NAME ||
+             current_input_handles.size() == input_column_idx.size());
+      if (kernel_cache_devices.empty()) {
+        for (i32 i = 0; i < input_column_idx.size(); ++i) {
+          kernel_cache_devices.push_back(current_input_handles[i]);
         }
       }
-      if (valid_inputs.size() > 0) {
-        auto copy_start = now();
-        ElementList list =
-            copy_or_ref_elements(profiler_, side_output_handles[in_col_idx],
-                                 current_input_handles[i], valid_inputs);
-        profiler_.add_interval("op_marshal", copy_start, now());
-        // Insert new elements into cache
-        kernel_cache[i].insert(kernel_cache[i].end(), list.begin(), list.end());
-      }
-    }
-    // Determine the highest row seen so we know how many elements we
-    // might be able to produce
-    i64 max_row_id_seen = -1;
-    if (input_column_idx.size() > 0 && kernel_cache_row_ids[0].size() > 0) {
-      max_row_id_seen = kernel_cache_row_ids[0].back();
-      for (i32 i = 1; i < input_column_idx.size(); ++i) {
-        max_row_id_seen =
-            std::min(max_row_id_seen, kernel_cache_row_ids[i].back());
+      for (i32 i = 0; i < input_column_idx.size(); ++i) {
+        i32 in_col_idx = input_column_idx[i];
+        assert(in_col_idx < side_output_columns.size());
+        // Select elements which this kernel requires as inputs
+        auto& row_ids = side_row_ids[in_col_idx];
+        ElementList valid_inputs;
+        i64& current_input_idx = kernel_current_input_idx[i];
+        for (size_t r = 0; r < row_ids.size(); ++r) {
+          assert(current_input_idx >= kernel_valid_input_rows.size() ||
+                 row_ids[r] <= kernel_valid_input_rows[current_input_idx]);
+          if (current_input_idx < kernel_valid_input_rows.size() &&
+              row_ids[r] == kernel_valid_input_rows[current_input_idx]) {
+            // Insert row ids for valid elements into cache
+            kernel_cache_row_ids[i].push_back(row_ids[r]);
+            Element element(side_output_columns[in_col_idx][r]);
+            // We provide the input index to the kernel so that it can detect
+            // non-consecutive elements
+            element.index = row_ids[r];
+            valid_inputs.push_back(element);
+            current_input_idx++;
+          }
+        }
+        if (valid_inputs.size() > 0) {
+          auto copy_start = now();
+          ElementList list =
+              copy_or_ref_elements(profiler_, side_output_handles[in_col_idx],
+                                   current_input_handles[i], valid_inputs);
+          profiler_.add_interval("op_marshal", copy_start, now());
+          // Insert new elements into cache
+          kernel_cache[i].insert(kernel_cache[i].end(), list.begin(),
+                                 list.end());
+        }
       }
-      // Update current compute position
-      for (i64 i = 0; i < kernel_cache_row_ids[0].size(); ++i) {
-        i64 row_id = kernel_cache_row_ids[0][i];
-        assert(kernel_current_compute_idx >= kernel_compute_rows.size() ||
-               row_id <= kernel_compute_rows[kernel_current_compute_idx]);
-        if (kernel_current_compute_idx < kernel_compute_rows.size() &&
-            row_id == kernel_compute_rows[kernel_current_compute_idx]) {
-          kernel_current_compute_idx++;
+      // Determine the highest row seen so we know how many elements we
+      // might be able to produce
+      if (input_column_idx.size() > 0 && kernel_cache_row_ids[0].size() > 0) {
+        max_row_id_seen = kernel_cache_row_ids[0].back();
+        for (i32 i = 1; i < input_column_idx.size(); ++i) {
+          max_row_id_seen =
+              std::min(max_row_id_seen, kernel_cache_row_ids[i].back());
+        }
+        // Update current compute position
+        for (i64 i = 0; i < kernel_cache_row_ids[0].size(); ++i) {
+          i64 row_id = kernel_cache_row_ids[0][i];
+          assert(kernel_current_compute_idx >= kernel_compute_rows.size() ||
+                 row_id <= kernel_compute_rows[kernel_current_compute_idx]);
+          if (kernel_current_compute_idx < kernel_compute_rows.size() &&
+              row_id == kernel_compute_rows[kernel_current_compute_idx]) {
+            kernel_current_compute_idx++;
+          }
         }
       }
     }
@@ -585,6 +746,17 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
       if (op_name == INPUT_OP_NAME) {
         num_output_columns = 0;
       }
+    } else if (fused) {
+      // Same rows as the head of the fused chain
+      producible_elements = fused_row_ids_.size();
+      kernel_stencil = arg_group_.kernel_stencils[k];
+      for (i64& current_input_idx : kernel_current_input_idx) {
+        current_input_idx += producible_elements;
+      }
+      kernel_current_compute_idx += producible_elements;
+
+      auto& unused_outputs = arg_group_.unused_outputs[k];
+      num_output_columns = kernel_num_outputs_[k] - unused_outputs.size();
     } else {
       kernel_stencil = arg_group_.kernel_stencils[k];
       i32 kernel_batch_size = arg_group_.kernel_batch_sizes[k];
@@ -608,10 +780,15 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
     // element cache
     // NOTE(apoms): elements in kernel cache from each column should be the same
     // since the input domain for all inputs to a kernel must be the same
-    std::vector<i64> producible_row_ids(
-        kernel_compute_rows.begin() + kernel_element_cache_input_idx,
-        kernel_compute_rows.begin() + kernel_element_cache_input_idx +
-            producible_elements);
+    std::vector<i64> producible_row_ids;
+    if (fused) {
+      producible_row_ids = fused_row_ids_;
+    } else {
+      producible_row_ids = std::vector<i64>(
+          kernel_compute_rows.begin() + kernel_element_cache_input_idx,
+          kernel_compute_rows.begin() + kernel_element_cache_input_idx +
+              producible_elements);
+    }
 
     {
       // Get the output handles for only the columns that are used
@@ -720,6 +897,16 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
         Element ele = add_element_ref(current_handle, element);
         output_column.push_back(ele);
       }
+    } else if (fused) {
+      // Outputs were already computed along with the head of the fused chain
+      BatchedColumns& fused_columns = fused_outputs_.at(k);
+      assert(fused_columns.size() == num_output_columns);
+      for (size_t cidx = 0; cidx < fused_columns.size(); ++cidx) {
+        i32 col_idx = side_output_columns.size() - num_output_columns + cidx;
+        side_output_columns[col_idx].swap(fused_columns[cidx]);
+        side_row_ids[col_idx] = producible_row_ids;
+      }
+      fused_outputs_.erase(k);
     } else {
       assert(!is_builtin_op(op_name));
       // If a regular kernel
@@ -728,11 +915,27 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
       i64 row_start = kernel_element_cache_input_idx;
       i64 row_end = row_start + producible_elements;
 
+      // If this kernel heads a fused chain, figure out where each fused Op
+      // finds its inputs among the outputs of the Op before it
+      i32 chain_end = fused_chain_end_[k];
+      std::vector<std::vector<i32>> fused_input_columns;
+      if (chain_end > k) {
+        fused_input_columns = compute_fused_input_columns(
+            k, side_output_columns.size() - num_output_columns);
+        fused_row_ids_ = producible_row_ids;
+        for (i32 j = k + 1; j <= chain_end; ++j) {
+          fused_outputs_[j].resize(kernel_num_outputs_[j] -
+                                   arg_group_.unused_outputs[j].size());
+        }
+      }
+
       for (i32 start = row_start; start < row_end; start += kernel_batch_size) {
         i32 batch = std::min((i64)kernel_batch_size, row_end - start);
         i32 end = start + batch;
         // Stage inputs to the kernel using the stencil cache
-        StenciledBatchedColumns input_columns(input_column_idx.size());
+        BatchScratch& scratch = batch_scratch_[k];
+        StenciledBatchedColumns& input_columns =
+            scratch.inputs(input_column_idx.size(), batch);
         // For each column
         // NOTE(apoms): choosing the first columns row ids is fine because all
         // input row ids for each column should be the same since all inputs
@@ -741,7 +944,6 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
         for (size_t i = 0; i < input_column_idx.size(); ++i) {
           auto& cache_deque = kernel_cache[i];
           auto& col = input_columns[i];
-          col.resize(batch);
           // For each batch element
           for (i64 r = start; r < end; ++r) {
             auto& input_stencil = col[r - start];
@@ -768,34 +970,32 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
         }
 
         // Setup output buffers to receive op output
-        BatchedColumns output_columns;
-        output_columns.resize(num_output_columns);
+        BatchedColumns& output_columns = scratch.outputs(num_output_columns);
 
         // Map from previous output columns to the set of input columns needed
         // by the kernel
         auto eval_start = now();
         kernel->execute_kernel(input_columns, output_columns);
-        profiler_.add_interval("evaluate:" + op_name, eval_start, now());
-
-        // Delete unused output columns
-        auto& unused_outputs = arg_group_.unused_outputs[k];
-        for (size_t y = 0; y < unused_outputs.size(); ++y) {
-          i32 unused_col_idx =
-              unused_outputs[unused_outputs.size() - 1 - y];
-          ElementList& column = output_columns[unused_col_idx];
-          for (Element& element : column) {
-            delete_element(current_output_handles[unused_col_idx], element);
+        auto eval_end = now();
+        profiler_.add_interval("evaluate:" + op_name, eval_start, eval_end);
+
+        std::unique_ptr<BatchSizeTuner>& tuner = batch_tuners_[k];
+        // Tasks and work packets shorter than a candidate only produce
+        // partial batches, so those are measured as well
+        if (tuner) {
+          tuner->record(
+              batch, std::chrono::duration<f64>(eval_end - eval_start).count());
+          if (tuner->done()) {
+            i32 chosen = tuner->batch_size();
+            VLOG(1) << "Autotuned batch size for " << op_name << " (worker "
+                    << worker_id_ << "): " << chosen;
+            profiler_.set_gauge("batch_size:" + op_name, chosen);
+            arg_group_.kernel_batch_sizes[k] = chosen;
+            tuner.reset();
           }
-          output_columns.erase(output_columns.begin() + unused_col_idx);
         }
 
-        // Verify the kernel produced the correct amount of output
-        for (size_t i = 0; i < output_columns.size(); ++i) {
-          LOG_IF(FATAL, output_columns[i].size() != batch)
-              << "Op " << k << " produced " << output_columns[i].size()
-              << " output elements for column " << i << ". Expected " << batch
-              << " outputs.";
-        }
+        prune_kernel_outputs(k, batch, output_columns);
 
         // Add new output columns
         for (size_t cidx = 0; cidx < output_columns.size(); ++cidx) {
@@ -809,6 +1009,17 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
               producible_row_ids.begin() + start - row_start,
               producible_row_ids.begin() + start - row_start + batch);
         }
+
+        // Run the rest of the fused chain on this batch while it is hot
+        if (chain_end > k) {
+          std::vector<i64> batch_row_ids(
+              producible_row_ids.begin() + start - row_start,
+              producible_row_ids.begin() + start - row_start + batch);
+          execute_fused_chain(k, batch_row_ids, fused_input_columns,
+                              output_columns);
+          profiler_.add_interval("evaluate_fused:" + fused_chain_names_[k],
+                                 eval_start, now());
+        }
       }
     }
 
@@ -817,13 +1028,10 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
     // Filter outputs to only the ones that will be used downstream
     // For each output row, check if it is in the valid output rows
     if (num_output_columns > 0) {
-      BatchedColumns temp_output_columns(num_output_columns);
-      std::vector<std::vector<i64>> temp_row_ids(num_output_columns);
-
-      // For each column, transfer all valid rows to temp output, deleting all
-      // the non valid rows, and then swap the temp rows into the side
-      // output columns
+      // For each column, compact the valid rows to the front in place,
+      // deleting all the non valid rows, and then drop the leftover tail
       i32 first_col_idx = side_output_columns.size() - num_output_columns;
+      i64 num_kept = 0;
       for (i64 row_start = 0;
            row_start < side_output_columns[first_col_idx].size(); ++row_start) {
         assert(!side_row_ids[first_col_idx].empty());
@@ -836,10 +1044,11 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
           // Is a valid row, so keep
           for (i64 i = 0; i < num_output_columns; ++i) {
             i32 col_idx = side_output_columns.size() - num_output_columns + i;
-            auto& element = side_output_columns[col_idx][row_start];
-            temp_output_columns[i].push_back(element);
-            temp_row_ids[i].push_back(next_row);
+            side_output_columns[col_idx][num_kept] =
+                side_output_columns[col_idx][row_start];
+            side_row_ids[col_idx][num_kept] = next_row;
           }
+          num_kept++;
           kernel_current_output_idx++;
         } else {
           // Is not a valid row, so delete
@@ -852,8 +1061,8 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
       }
       for (i64 i = 0; i < num_output_columns; ++i) {
         i32 col_idx = side_output_columns.size() - num_output_columns + i;
-        side_output_columns[col_idx].swap(temp_output_columns[i]);
-        side_row_ids[col_idx].swap(temp_row_ids[i]);
+        side_output_columns[col_idx].resize(num_kept);
+        side_row_ids[col_idx].resize(num_kept);
       }
     }
 
@@ -883,6 +1092,9 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
             break;
           }
         }
+        if (kernels_[k]) {
+          kernels_[k]->evict_row_cache(min_used_row);
+        }
         kernel_element_cache_input_idx += producible_elements;
       }
     }
@@ -903,7 +1115,7 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
     // Delete elements from stencil cache that will no longer be used
   }
 
-  final_output_handles_ = side_output_handles;
+  final_output_handles_ = std::move(side_output_handles);
   if (final_output_columns_.size() == 0) {
     final_output_columns_.resize(side_output_columns.size());
     final_row_ids_.resize(side_output_columns.size());
@@ -922,6 +1134,115 @@ void EvaluateWorker::feed(EvalWorkEntry& work_entry) {
   profiler_.add_interval("feed", feed_start, now());
 }
 
+void EvaluateWorker::release_batch_scratch() {
+  for (BatchScratch& scratch : batch_scratch_) {
+    profiler_.increment("batches_staged", scratch.batches());
+    profiler_.increment("batch_scratch_growths", scratch.growths());
+    scratch.release();
+  }
+}
+
+void EvaluateWorker::prune_kernel_outputs(i32 k, i64 batch,
+                                          BatchedColumns& output_columns) {
+  const std::vector<DeviceHandle>& current_output_handles =
+      kernel_output_devices_[k];
+  // Delete unused output columns
+  auto& unused_outputs = arg_group_.unused_outputs[k];
+  for (size_t y = 0; y < unused_outputs.size(); ++y) {
+    i32 unused_col_idx = unused_outputs[unused_outputs.size() - 1 - y];
+    ElementList& column = output_columns[unused_col_idx];
+    for (Element& element : column) {
+      delete_element(current_output_handles[unused_col_idx], element);
+    }
+    output_columns.erase(output_columns.begin() + unused_col_idx);
+  }
+
+  // Verify the kernel produced the correct amount of output
+  for (size_t i = 0; i < output_columns.size(); ++i) {
+    LOG_IF(FATAL, output_columns[i].size() != batch)
+        << "Op " << k << " produced " << output_columns[i].size()
+        << " output elements for column " << i << ". Expected " << batch
+        << " outputs.";
+  }
+}
+
+std::vector<std::vector<i32>> EvaluateWorker::compute_fused_input_columns(
+    i32 head, i64 num_prior_columns) {
+  // Replay how feed() appends output columns and removes dead columns over
+  // the chain to find which output of the previous Op each column mapping
+  // entry refers to. Each column is tagged with (Op, output index).
+  std::vector<std::tuple<i32, i32>> layout;
+  for (i64 i = 0; i < num_prior_columns; ++i) {
+    layout.emplace_back(-1, i);
+  }
+  i32 chain_end = fused_chain_end_[head];
+  std::vector<std::vector<i32>> input_columns(chain_end - head + 1);
+  for (i32 j = head; j <= chain_end; ++j) {
+    if (j > head) {
+      for (i32 col_idx : arg_group_.column_mapping[j]) {
+        auto& tag = layout.at(col_idx);
+        LOG_IF(FATAL, std::get<0>(tag) != j - 1)
+            << "Fused op " << arg_group_.op_names[j]
+            << " reads a column not produced by the previous op";
+        input_columns[j - head].push_back(std::get<1>(tag));
+      }
+    }
+    i32 num_outputs =
+        kernel_num_outputs_[j] - arg_group_.unused_outputs[j].size();
+    for (i32 c = 0; c < num_outputs; ++c) {
+      layout.emplace_back(j, c);
+    }
+    auto& dead_columns = arg_group_.dead_columns[j];
+    for (size_t y = 0; y < dead_columns.size(); ++y) {
+      i32 dead_col_idx = dead_columns[dead_columns.size() - 1 - y];
+      layout.erase(layout.begin() + dead_col_idx);
+    }
+  }
+  return input_columns;
+}
+
+void EvaluateWorker::execute_fused_chain(
+    i32 head, const std::vector<i64>& row_ids,
+    const std::vector<std::vector<i32>>& fused_input_columns,
+    const BatchedColumns& head_outputs) {
+  i64 batch = row_ids.size();
+  const BatchedColumns* prev_outputs = &head_outputs;
+  for (i32 j = head + 1; j <= fused_chain_end_[head]; ++j) {
+    const std::vector<i32>& input_column_idx = fused_input_columns[j - head];
+    // Each input is the single element at the current row since fused Ops
+    // have a stencil of {0}
+    BatchScratch& scratch = batch_scratch_[j];
+    StenciledBatchedColumns& input_columns =
+        scratch.inputs(input_column_idx.size(), batch);
+    for (size_t i = 0; i < input_column_idx.size(); ++i) {
+      const ElementList& prev_column = (*prev_outputs)[input_column_idx[i]];
+      auto& col = input_columns[i];
+      for (i64 r = 0; r < batch; ++r) {
+        Element element = prev_column[r];
+        element.index = row_ids[r];
+        col[r].push_back(element);
+      }
+    }
+
+    BatchedColumns& output_columns = scratch.outputs(kernel_num_outputs_[j]);
+    auto eval_start = now();
+    kernels_[j]->execute_kernel(input_columns, output_columns);
+    profiler_.add_interval("evaluate:" + arg_group_.op_names[j], eval_start,
+                           now());
+
+    prune_kernel_outputs(j, batch, output_columns);
+
+    // Stash outputs until feed() reaches this Op
+    BatchedColumns& stashed_columns = fused_outputs_.at(j);
+    for (size_t cidx = 0; cidx < output_columns.size(); ++cidx) {
+      stashed_columns[cidx].insert(stashed_columns[cidx].end(),
+                                   output_columns[cidx].begin(),
+                                   output_columns[cidx].end());
+    }
+    prev_outputs = &output_columns;
+  }
+}
+
 bool EvaluateWorker::yield(i32 item_size, EvalWorkEntry& output_entry) {
   EvalWorkEntry& work_entry = entry_;
 
@@ -931,6 +1252,7 @@ bool EvaluateWorker::yield(i32 item_size, EvalWorkEntry& output_entry) {
   output_work_entry.table_id = work_entry.table_id;
   output_work_entry.job_index = work_entry.job_index;
   output_work_entry.task_index = work_entry.task_index;
+  output_work_entry.attempt = work_entry.attempt;
   output_work_entry.needs_configure = work_entry.needs_configure;
   output_work_entry.needs_reset = work_entry.needs_reset;
   output_work_entry.last_in_io_packet = work_entry.last_in_io_packet;
@@ -948,25 +1270,78 @@ bool EvaluateWorker::yield(i32 item_size, EvalWorkEntry& output_entry) {
   work_item_row_ids.resize(num_final_output_columns);
 
   for (i32 i = 0; i < num_final_output_columns; ++i) {
-    work_item_output_columns[i].insert(work_item_output_columns[i].end(),
-                                       final_output_columns_[i].begin(),
-                                       final_output_columns_[i].end());
-    work_item_row_ids[i].insert(work_item_row_ids[i].end(),
-                                final_row_ids_[i].begin(),
-                                final_row_ids_[i].end());
-    final_output_columns_[i].clear();
-    final_row_ids_[i].clear();
+    // The output vectors start out empty, so swapping hands over the
+    // buffered rows and leaves the buffers empty for the next feed
+    work_item_output_columns[i].swap(final_output_columns_[i]);
+    work_item_row_ids[i].swap(final_row_ids_[i]);
   }
 
-  output_entry = output_work_entry;
+  output_entry = std::move(output_work_entry);
 
   profiler_.add_interval("yield", yield_start, now());
 
   return true;
 }
 
+BatchSizeTuner::BatchSizeTuner(i32 min_batch_size, i32 max_batch_size,
+                               i32 total_batches, i32 default_batch_size) {
+  min_batch_size = std::max(min_batch_size, 1);
+  max_batch_size = std::max(max_batch_size, min_batch_size);
+  for (i32 b = 1; b < max_batch_size; b *= 2) {
+    if (b >= min_batch_size) {
+      candidates_.push_back(b);
+    }
+  }
+  candidates_.push_back(max_batch_size);
+  batches_per_candidate_ =
+      std::max(1, total_batches / static_cast<i32>(candidates_.size()));
+  if (total_batches <= 0) {
+    chosen_batch_size_ = std::max(default_batch_size, 1);
+    done_ = true;
+  } else {
+    chosen_batch_size_ = max_batch_size;
+    done_ = candidates_.size() == 1;
+  }
+}
+
+i32 BatchSizeTuner::batch_size() const {
+  return done_ ? chosen_batch_size_ : candidates_[current_candidate_];
+}
+
+void BatchSizeTuner::record(i64 rows, f64 seconds) {
+  if (done_) {
+    return;
+  }
+  rows_measured_ += rows;
+  seconds_measured_ += seconds;
+  if (++batches_measured_ < batches_per_candidate_) {
+    return;
+  }
+  throughputs_.push_back(seconds_measured_ > 0
+                             ? rows_measured_ / seconds_measured_
+                             : std::numeric_limits<f64>::max());
+  batches_measured_ = 0;
+  rows_measured_ = 0;
+  seconds_measured_ = 0;
+  if (++current_candidate_ < candidates_.size()) {
+    return;
+  }
+  size_t best = 0;
+  for (size_t i = 1; i < throughputs_.size(); ++i) {
+    if (throughputs_[i] > throughputs_[best]) {
+      best = i;
+    }
+  }
+  chosen_batch_size_ = candidates_[best];
+  done_ = true;
+}
+
 void EvaluateWorker::clear_stencil_cache() {
   for (size_t k = 0; k < kernels_.size(); ++k) {
+    // Memoized per-row values share the lifetime of the cached elements
+    if (kernels_[k]) {
+      kernels_[k]->clear_row_cache();
+    }
     std::vector<i32>& kernel_stencil = arg_group_.kernel_stencils[k];
     bool degenerate_stencil =
         (kernel_stencil.size() == 1 && kernel_stencil[0] == 0);
@@ -1031,7 +1406,7 @@ PostEvaluateWorker::PostEvaluateWorker(const PostEvaluateWorkerArgs& args)
   current_offset_ = 0;
 }
 
-void PostEvaluateWorker::feed(EvalWorkEntry& entry) {
+void PostEvaluateWorker::feed(EvalWorkEntry&& entry) {
   EvalWorkEntry& work_entry = entry;
 
   // HACK(apoms): this will fail horrible and leak memory if
@@ -1045,6 +1420,7 @@ void PostEvaluateWorker::feed(EvalWorkEntry& entry) {
     buffered_entry_.table_id = work_entry.table_id;
     buffered_entry_.job_index = work_entry.job_index;
     buffered_entry_.task_index = work_entry.task_index;
+    buffered_entry_.attempt = work_entry.attempt;
     buffered_entry_.last_in_task = work_entry.last_in_task;
     buffered_entry_.columns.resize(column_mapping_.size());
     buffered_entry_.row_ids.resize(column_mapping_.size());
@@ -1174,7 +1550,7 @@ void PostEvaluateWorker::feed(EvalWorkEntry& entry) {
     // Only push an entry if it is non empty
     if (buffered_entry_.columns.size() > 0 &&
         buffered_entry_.columns[0].size() > 0) {
-      buffered_entries_.push_back(buffered_entry_);
+      buffered_entries_.push_back(std::move(buffered_entry_));
       buffered_entry_.columns.clear();
       buffered_entry_.row_ids.clear();
     }
@@ -1186,7 +1562,7 @@ bool PostEvaluateWorker::yield(EvalWorkEntry& output) {
 
   bool got_result = false;
   if (buffered_entries_.size() > 0) {
-    output = buffered_entries_.front();
+    output = std::move(buffered_entries_.front());
     buffered_entries_.pop_front();
     got_result = true;
   }
@@ -15,12 +15,15 @@
 
 #pragma once
 
+#include "scanner/engine/batch_scratch.h"
 #include "scanner/engine/kernel_factory.h"
 #include "scanner/engine/runtime.h"
 #include "scanner/engine/sampler.h"
 #include "scanner/util/common.h"
 #include "scanner/util/queue.h"
+#include "scanner/util/thread_pool.h"
 #include "scanner/video/decoder_automata.h"
+#include "scanner/video/decoder_pool.h"
 #include "scanner/video/video_encoder.h"
 
 #include "hwang/decoder_automata.h"
@@ -40,33 +43,57 @@ struct PreEvaluateWorkerArgs {
   i32 node_id;
   i32 num_cpus;
   i32 work_packet_size;
+  i32 decoders_per_column;
 
   // Per worker arguments
   i32 worker_id;
+  // Index of this thread among the decode threads sharing its input queue
+  i32 replica;
   DeviceHandle device_handle;
   Profiler& profiler;
+  // Shared by all decode threads of the worker and kept across jobs
+  DecoderPool& decoder_pool;
 };
 
 class PreEvaluateWorker {
  public:
   PreEvaluateWorker(const PreEvaluateWorkerArgs& args);
+  ~PreEvaluateWorker();
 
-  void feed(EvalWorkEntry& entry, bool is_first_in_task);
+  void feed(EvalWorkEntry&& entry, bool is_first_in_task);
 
   bool yield(i32 item_size, EvalWorkEntry& output);
 
  private:
+  // Decode rows [start_row, start_row + num_rows) of a media column into
+  // consecutive frames of buffer
+  void decode_rows(i32 media_col_idx, i64 start_row, i64 num_rows, u8* buffer,
+                   size_t frame_size);
+
   const i32 node_id_;
   const i32 worker_id_;
   const DeviceHandle device_handle_;
   const i32 num_cpus_;
+  const i32 decoders_per_column_;
 
   Profiler& profiler_;
+  DecoderPool& decoder_pool_;
 
   i32 last_job_idx_ = -1;
 
   DeviceHandle decoder_output_handle_;
-  std::vector<std::unique_ptr<DecoderAutomata>> decoders_;
+  VideoDecoderType decoder_type_;
+  i32 decoder_num_devices_;
+  // Media column -> decoders its keyframe intervals are dealt out to. Taken
+  // from the decoder pool when a column is first decoded, or when it switches
+  // to a geometry the pool has a decoder configured for.
+  std::vector<std::vector<std::unique_ptr<DecoderAutomata>>> decoders_;
+  // Media column -> first row of each keyframe interval of the current
+  // entry, followed by the number of rows
+  std::vector<std::vector<i64>> interval_start_rows_;
+  // Threads running the decoders of a column after the first, started when a
+  // column first uses more than one decoder and kept for the worker's life
+  std::unique_ptr<ThreadPool> decode_pool_;
   std::vector<std::unique_ptr<hwang::DecoderAutomata>> inplace_decoders_;
 
   // Continuation state
@@ -104,6 +131,15 @@ struct OpArgGroup {
   std::vector<std::vector<i32>> kernel_stencils;
   // Batch size needed by kernels
   std::vector<i32> kernel_batch_sizes;
+  // Range of batch sizes to autotune over. Equal to the batch size when the
+  // kernel should not be autotuned.
+  std::vector<std::tuple<i32, i32>> kernel_batch_size_bounds;
+  // Number of batches to spend measuring candidate batch sizes
+  i32 autotune_batches;
+  // Whether the kernel is executed in the same stage as the previous kernel
+  std::vector<bool> fused_with_previous;
+  // Threads per pipeline instance running this group
+  i32 replicas;
 };
 
 struct EvaluateWorkerArgs {
@@ -116,6 +152,7 @@ struct EvaluateWorkerArgs {
   // Per worker arguments
   i32 ki;
   i32 kg;
+  i32 replica;
   OpArgGroup arg_group;
 
   Profiler& profiler;
@@ -123,6 +160,37 @@ struct EvaluateWorkerArgs {
 };
 
 
+// Picks a kernel's batch size by running a few batches at each candidate
+// size and keeping the one with the highest throughput. Candidates are the
+// powers of two within the kernel's bounds plus the upper bound itself.
+// With no batches to measure, the tuner keeps the default batch size.
+class BatchSizeTuner {
+ public:
+  BatchSizeTuner(i32 min_batch_size, i32 max_batch_size, i32 total_batches,
+                 i32 default_batch_size);
+
+  // Batch size to use for the next batch
+  i32 batch_size() const;
+
+  // Record the time it took to evaluate a batch of the given number of rows.
+  // Batches cut short by the end of a task count like full ones.
+  void record(i64 rows, f64 seconds);
+
+  bool done() const { return done_; }
+
+ private:
+  std::vector<i32> candidates_;
+  i32 batches_per_candidate_;
+  size_t current_candidate_ = 0;
+  i32 batches_measured_ = 0;
+  i64 rows_measured_ = 0;
+  f64 seconds_measured_ = 0;
+  // Rows per second for each measured candidate
+  std::vector<f64> throughputs_;
+  i32 chosen_batch_size_;
+  bool done_ = false;
+};
+
 class EvaluateWorker {
  public:
   EvaluateWorker(const EvaluateWorkerArgs& args);
@@ -131,13 +199,29 @@ class EvaluateWorker {
   void new_task(i64 job_idx, i64 task_idx,
                 const std::vector<TaskStream>& task_streams);
 
-  void feed(EvalWorkEntry& entry);
+  void feed(EvalWorkEntry&& entry);
 
   bool yield(i32 item_size, EvalWorkEntry& output);
 
  private:
   void clear_stencil_cache();
 
+  // Frees the batch buffers and records how often they had to grow
+  void release_batch_scratch();
+
+  // Delete the unused outputs of kernel k and check the output sizes
+  void prune_kernel_outputs(i32 k, i64 batch, BatchedColumns& output_columns);
+
+  // Op in chain -> index into the previous Op's used outputs for each input
+  std::vector<std::vector<i32>> compute_fused_input_columns(
+      i32 head, i64 num_prior_columns);
+
+  // Run the Ops fused after head on one batch of the head's outputs
+  void execute_fused_chain(
+      i32 head, const std::vector<i64>& row_ids,
+      const std::vector<std::vector<i32>>& fused_input_columns,
+      const BatchedColumns& head_outputs);
+
   const i32 node_id_;
   const i32 worker_id_;
 
@@ -153,26 +237,42 @@ class EvaluateWorker {
   // Used for computing complement of column mapping
   std::vector<std::set<i32>> column_mapping_set_;
 
+  // Kernel -> last kernel in the fused chain it heads (itself if none)
+  std::vector<i32> fused_chain_end_;
+  // Kernel -> name of its fused chain, used for profiling
+  std::vector<std::string> fused_chain_names_;
+  // Kernel -> batch size tuner, nullptr if the batch size is fixed
+  std::vector<std::unique_ptr<BatchSizeTuner>> batch_tuners_;
+
+  // Row ids and outputs computed by the head of a fused chain for the rest
+  // of the chain during the current feed
+  std::vector<i64> fused_row_ids_;
+  std::map<i64, BatchedColumns> fused_outputs_;
+  // Kernel -> buffers its batches are staged in during the current task
+  std::vector<BatchScratch> batch_scratch_;
+
   /// Task state
   i64 job_idx_;
   i64 task_idx_;
   i64 slice_group_;
-  std::map<i64, std::unique_ptr<DomainSampler>> domain_samplers_;
+  // Op -> sampler for the current task's job and slice
+  std::map<i64, DomainSampler*> domain_samplers_;
+  // (Op, Job, Slice) -> sampler. Samplers only depend on the job and slice so
+  // they are kept across tasks instead of being rebuilt for each one.
+  std::map<std::tuple<i64, i64, i64>, std::unique_ptr<DomainSampler>>
+      sampler_cache_;
 
   // Inputs
-  std::vector<std::set<i64>> valid_input_rows_set_;
   std::vector<std::vector<i64>> valid_input_rows_;
   // Tracks which input we should expect next for which column
   std::vector<std::vector<i64>> current_valid_input_idx_;
 
   // List of row ids of the uutputs to compute
-  std::vector<std::set<i64>> compute_rows_set_;
   std::vector<std::vector<i64>> compute_rows_;
   // Tracks which index in compute_rows_ we should expect next
   std::vector<i64> current_compute_idx_;
 
   // Outputs to keep
-  std::vector<std::set<i64>> valid_output_rows_set_;
   std::vector<std::vector<i64>> valid_output_rows_;
   // Tracks which output we should expect next
   std::vector<i64> current_valid_output_idx_;
@@ -191,7 +291,7 @@ class EvaluateWorker {
   i32 total_inputs_;
 
   std::vector<DeviceHandle> final_output_handles_;
-  std::vector<std::deque<Element>> final_output_columns_;
+  std::vector<ElementList> final_output_columns_;
   std::vector<std::vector<i64>> final_row_ids_;
 };
 
@@ -217,7 +317,7 @@ class PostEvaluateWorker {
  public:
   PostEvaluateWorker(const PostEvaluateWorkerArgs& args);
 
-  void feed(EvalWorkEntry& entry);
+  void feed(EvalWorkEntry&& entry);
 
   bool yield(EvalWorkEntry& output);
 
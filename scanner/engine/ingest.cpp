@@ -218,29 +218,38 @@ void cleanup_video_codec(CodecState state) {
   av_bitstream_filter_close(state.annexb);
 }
 
-bool parse_video_inplace(storehouse::StorageBackend* storage,
-                         const std::string& table_name, i32 table_id,
-                         const std::string& path, std::string& error_message) {
+// Descriptor of a new table holding the index and frame columns of videos
+proto::TableDescriptor new_video_table_descriptor(const std::string& table_name,
+                                                  i32 table_id) {
   proto::TableDescriptor table_desc;
   table_desc.set_id(table_id);
   table_desc.set_name(table_name);
   table_desc.set_job_id(-1);
+
+  Column* index_col = table_desc.add_columns();
+  index_col->set_name(index_column_name());
+  index_col->set_id(0);
+  index_col->set_type(ColumnType::Other);
+
+  Column* frame_col = table_desc.add_columns();
+  frame_col->set_name(frame_column_name());
+  frame_col->set_id(1);
+  frame_col->set_type(ColumnType::Video);
+  return table_desc;
+}
+
+bool parse_video_inplace(storehouse::StorageBackend* storage,
+                         proto::TableDescriptor& table_desc,
+                         const std::string& path, std::string& error_message) {
+  const i32 table_id = table_desc.id();
+  // The video is stored as a new item after any rows already in the table
+  const i32 item_id = table_desc.end_rows_size();
+  const i64 prior_rows =
+      item_id > 0 ? table_desc.end_rows(item_id - 1) : 0;
   table_desc.set_timestamp(
       std::chrono::duration_cast<std::chrono::seconds>(now().time_since_epoch())
           .count());
 
-  {
-    Column* index_col = table_desc.add_columns();
-    index_col->set_name(index_column_name());
-    index_col->set_id(0);
-    index_col->set_type(ColumnType::Other);
-
-    Column* frame_col = table_desc.add_columns();
-    frame_col->set_name(frame_column_name());
-    frame_col->set_id(1);
-    frame_col->set_type(ColumnType::Video);
-  }
-
   StoreResult result;
   std::unique_ptr<RandomReadFile> file = nullptr;
   EXP_BACKOFF(make_unique_random_read_file(storage, path, file),
@@ -290,7 +299,7 @@ bool parse_video_inplace(storehouse::StorageBackend* storage,
   proto::VideoDescriptor& video_descriptor = video_meta.get_descriptor();
   video_descriptor.set_table_id(table_id);
   video_descriptor.set_column_id(1);
-  video_descriptor.set_item_id(0);
+  video_descriptor.set_item_id(item_id);
 
   video_descriptor.set_width(index.frame_width());
   video_descriptor.set_height(index.frame_height());
@@ -312,11 +321,12 @@ bool parse_video_inplace(storehouse::StorageBackend* storage,
   VLOG(2) << "Average GOP length: " << frame / (float)keyframe_indices.size();
 
   // Create index column
-  std::string index_path = table_item_output_path(table_id, 0, 0);
+  std::string index_path = table_item_output_path(table_id, 0, item_id);
   std::unique_ptr<WriteFile> index_file{};
   BACKOFF_FAIL(make_unique_write_file(storage, index_path, index_file));
 
-  std::string index_metadata_path = table_item_metadata_path(table_id, 0, 0);
+  std::string index_metadata_path =
+      table_item_metadata_path(table_id, 0, item_id);
   std::unique_ptr<WriteFile> index_metadata_file{};
   BACKOFF_FAIL(make_unique_write_file(storage, index_metadata_path,
                                       index_metadata_file));
@@ -326,11 +336,11 @@ bool parse_video_inplace(storehouse::StorageBackend* storage,
   }
   BACKOFF_FAIL(index_metadata_file->save());
   for (i64 i = 0; i < frame; ++i) {
-    s_write(index_file.get(), i);
+    s_write(index_file.get(), prior_rows + i);
   }
   BACKOFF_FAIL(index_file->save());
 
-  table_desc.add_end_rows(frame);
+  table_desc.add_end_rows(prior_rows + frame);
   video_descriptor.set_frames(frame);
   video_descriptor.set_num_encoded_videos(1);
   video_descriptor.add_frames_per_video(frame);
@@ -362,29 +372,18 @@ bool parse_video_inplace(storehouse::StorageBackend* storage,
 }
 
 bool parse_and_write_video(storehouse::StorageBackend* storage,
-                           const std::string& table_name, i32 table_id,
+                           proto::TableDescriptor& table_desc,
                            const std::string& path,
                            std::string& error_message) {
-  proto::TableDescriptor table_desc;
-  table_desc.set_id(table_id);
-  table_desc.set_name(table_name);
-  table_desc.set_job_id(-1);
+  const i32 table_id = table_desc.id();
+  // The video is stored as a new item after any rows already in the table
+  const i32 item_id = table_desc.end_rows_size();
+  const i64 prior_rows =
+      item_id > 0 ? table_desc.end_rows(item_id - 1) : 0;
   table_desc.set_timestamp(
       std::chrono::duration_cast<std::chrono::seconds>(now().time_since_epoch())
           .count());
 
-  {
-    Column* index_col = table_desc.add_columns();
-    index_col->set_name(index_column_name());
-    index_col->set_id(0);
-    index_col->set_type(ColumnType::Other);
-
-    Column* frame_col = table_desc.add_columns();
-    frame_col->set_name(frame_column_name());
-    frame_col->set_id(1);
-    frame_col->set_type(ColumnType::Video);
-  }
-
   // Setup custom buffer for libavcodec so that we can read from a storehouse
   // file instead of a posix file
   FFStorehouseState file_state{};
@@ -418,7 +417,7 @@ bool parse_and_write_video(storehouse::StorageBackend* storage,
   proto::VideoDescriptor& video_descriptor = video_meta.get_descriptor();
   video_descriptor.set_table_id(table_id);
   video_descriptor.set_column_id(1);
-  video_descriptor.set_item_id(0);
+  video_descriptor.set_item_id(item_id);
 
   video_descriptor.set_width(state.in_cc->width);
   video_descriptor.set_height(state.in_cc->height);
@@ -427,7 +426,7 @@ bool parse_and_write_video(storehouse::StorageBackend* storage,
   video_descriptor.set_chroma_format(proto::VideoDescriptor::YUV_420);
   video_descriptor.set_codec_type(proto::VideoDescriptor::H264);
 
-  std::string data_path = table_item_output_path(table_id, 1, 0);
+  std::string data_path = table_item_output_path(table_id, 1, item_id);
   std::unique_ptr<WriteFile> demuxed_bytestream{};
   BACKOFF_FAIL(make_unique_write_file(storage, data_path, demuxed_bytestream));
 
@@ -527,11 +526,12 @@ bool parse_and_write_video(storehouse::StorageBackend* storage,
   BACKOFF_FAIL(demuxed_bytestream->save());
 
   // Create index column
-  std::string index_path = table_item_output_path(table_id, 0, 0);
+  std::string index_path = table_item_output_path(table_id, 0, item_id);
   std::unique_ptr<WriteFile> index_file{};
   BACKOFF_FAIL(make_unique_write_file(storage, index_path, index_file));
 
-  std::string index_metadata_path = table_item_metadata_path(table_id, 0, 0);
+  std::string index_metadata_path =
+      table_item_metadata_path(table_id, 0, item_id);
   std::unique_ptr<WriteFile> index_metadata_file{};
   BACKOFF_FAIL(make_unique_write_file(storage, index_metadata_path, index_metadata_file));
   s_write<i64>(index_metadata_file.get(), frame);
@@ -540,11 +540,11 @@ bool parse_and_write_video(storehouse::StorageBackend* storage,
   }
   BACKOFF_FAIL(index_metadata_file->save());
   for (i64 i = 0; i < frame; ++i) {
-    s_write(index_file.get(), i);
+    s_write(index_file.get(), prior_rows + i);
   }
   BACKOFF_FAIL(index_file->save());
 
-  table_desc.add_end_rows(frame);
+  table_desc.add_end_rows(prior_rows + frame);
   video_descriptor.set_frames(frame);
   video_descriptor.set_num_encoded_videos(1);
   video_descriptor.add_frames_per_video(frame);
@@ -895,7 +895,8 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
                      const std::vector<std::string>& table_names,
                      const std::vector<std::string>& paths,
                      bool inplace,
-                     std::vector<FailedVideo>& failed_videos) {
+                     std::vector<FailedVideo>& failed_videos,
+                     bool append) {
   Result result;
   result.set_success(true);
 
@@ -909,6 +910,9 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
       storage.get(), internal::DatabaseMetadata::descriptor_path());
 
   std::vector<i32> table_ids;
+  std::vector<proto::TableDescriptor> table_descs;
+  // Whether each video is appended to a table which already exists
+  std::vector<bool> appended;
   std::set<std::string> inserted_table_names;
   for (size_t i = 0; i < table_names.size(); ++i) {
     if (inserted_table_names.count(table_names[i]) > 0) {
@@ -916,13 +920,40 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
                    table_names[i].c_str());
       break;
     }
-    i32 table_id = meta.add_table(table_names[i]);
-    if (table_id == -1) {
-      RESULT_ERROR(&result, "Table name %s already exists in databse.",
-                   table_names[i].c_str());
-      break;
+    if (append && meta.has_table(table_names[i])) {
+      i32 table_id = meta.get_table_id(table_names[i]);
+      if (!meta.table_is_committed(table_id)) {
+        RESULT_ERROR(&result, "Can not append to uncommitted table %s.",
+                     table_names[i].c_str());
+        break;
+      }
+      internal::TableMetadata table = internal::read_table_metadata(
+          storage.get(), internal::TableMetadata::descriptor_path(table_id));
+      const auto& columns = table.columns();
+      if (columns.size() != 2 ||
+          columns[0].name() != internal::index_column_name() ||
+          columns[1].name() != internal::frame_column_name() ||
+          columns[1].type() != ColumnType::Video) {
+        RESULT_ERROR(&result, "Can not append video to table %s which was "
+                     "not ingested from videos.",
+                     table_names[i].c_str());
+        break;
+      }
+      table_ids.push_back(table_id);
+      table_descs.push_back(table.get_descriptor());
+      appended.push_back(true);
+    } else {
+      i32 table_id = meta.add_table(table_names[i]);
+      if (table_id == -1) {
+        RESULT_ERROR(&result, "Table name %s already exists in databse.",
+                     table_names[i].c_str());
+        break;
+      }
+      table_ids.push_back(table_id);
+      table_descs.push_back(
+          internal::new_video_table_descriptor(table_names[i], table_id));
+      appended.push_back(false);
     }
-    table_ids.push_back(table_id);
     inserted_table_names.insert(table_names[i]);
   }
   if (!result.success()) {
@@ -946,8 +977,8 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
         bool inplace_succeeded = false;
         if (inplace) {
           std::string inplace_error_string;
-          if (internal::parse_video_inplace(storage.get(), table_names[i],
-                                            table_ids[i], paths[i],
+          if (internal::parse_video_inplace(storage.get(), table_descs[i],
+                                            paths[i],
                                             inplace_error_string)) {
             inplace_succeeded = true;
           } else {
@@ -959,8 +990,8 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
         }
         // If inplace failed or not specified, copy
         if (!inplace_succeeded) {
-          if (!internal::parse_and_write_video(storage.get(), table_names[i],
-                                               table_ids[i], paths[i],
+          if (!internal::parse_and_write_video(storage.get(), table_descs[i],
+                                               paths[i],
                                                bad_messages[i])) {
             // Did not ingest correctly, skip it
             bad_videos[i] = true;
@@ -979,7 +1010,10 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
       num_bad_videos++;
       LOG(WARNING) << "Failed to ingest video " << paths[i] << "!";
       failed_videos.push_back({paths[i], bad_messages[i]});
-      meta.remove_table(table_ids[i]);
+      // Appended tables keep the rows they already had
+      if (!appended[i]) {
+        meta.remove_table(table_ids[i]);
+      }
     } else {
       meta.commit_table(table_ids[i]);
     }
@@ -31,7 +31,8 @@ Result ingest_videos(storehouse::StorageConfig* storage_config,
                      const std::vector<std::string>& table_names,
                      const std::vector<std::string>& paths,
                      bool inplace,
-                     std::vector<FailedVideo>& failed_videos);
+                     std::vector<FailedVideo>& failed_videos,
+                     bool append = false);
 
 // void ingest_images(storehouse::StorageConfig *storage_config,
 //                    const std::string &db_path, const std::string &table_name,
@@ -40,7 +40,8 @@ class KernelFactory {
   KernelFactory(const std::string& op_name, DeviceType type, i32 max_devices,
                 const std::map<std::string, DeviceType>& input_devices,
                 const std::map<std::string, DeviceType>& output_devices,
-                bool can_batch, i32 batch_size, KernelConstructor constructor)
+                bool can_batch, i32 batch_size, i32 min_batch_size,
+                i32 max_batch_size, KernelConstructor constructor)
     : op_name_(op_name),
       type_(type),
       max_devices_(max_devices),
@@ -48,6 +49,8 @@ class KernelFactory {
       output_devices_(output_devices),
       can_batch_(can_batch),
       preferred_batch_size_(batch_size),
+      min_batch_size_(min_batch_size),
+      max_batch_size_(max_batch_size),
       constructor_(constructor) {}
 
   const std::string& get_op_name() const { return op_name_; }
@@ -69,6 +72,11 @@ class KernelFactory {
 
   i32 preferred_batch_size() const { return preferred_batch_size_; }
 
+  /** Range of batch sizes the kernel supports when autotuning. */
+  i32 min_batch_size() const { return min_batch_size_; }
+
+  i32 max_batch_size() const { return max_batch_size_; }
+
   /* @brief Constructs a kernel to be used for processing elements of data.
    */
   BaseKernel* new_instance(const KernelConfig& config) {
@@ -83,6 +91,8 @@ class KernelFactory {
   std::map<std::string, DeviceType> output_devices_;
   bool can_batch_;
   i32 preferred_batch_size_;
+  i32 min_batch_size_;
+  i32 max_batch_size_;
   KernelConstructor constructor_;
 };
 }
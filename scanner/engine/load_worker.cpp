@@ -18,6 +18,7 @@
 #include "storehouse/storage_backend.h"
 
 #include <glog/logging.h>
+#include <algorithm>
 
 using storehouse::StoreResult;
 using storehouse::WriteFile;
@@ -192,7 +193,9 @@ LoadWorker::LoadWorker(const LoadWorkerArgs& args)
     profiler_(args.profiler),
     load_sparsity_threshold_(args.load_sparsity_threshold),
     io_packet_size_(args.io_packet_size),
-    work_packet_size_(args.work_packet_size) {
+    work_packet_size_(args.work_packet_size),
+    inplace_read_ahead_(args.inplace_read_ahead),
+    read_ahead_cache_(args.read_ahead_cache) {
   storage_.reset(
       storehouse::StorageBackend::make_from_config(args.storage_config));
   meta_ = read_database_metadata(storage_.get(),
@@ -200,8 +203,9 @@ LoadWorker::LoadWorker(const LoadWorkerArgs& args)
   table_metadata_.reset(new TableMetaCache(storage_.get(), meta_));
 }
 
-void LoadWorker::feed(LoadWorkEntry& input_entry) {
-  LoadWorkEntry& load_work_entry = input_entry;
+void LoadWorker::feed(LoadWorkEntry&& input_entry) {
+  entry_ = std::move(input_entry);
+  LoadWorkEntry& load_work_entry = entry_;
 
   if (load_work_entry.table_id() != last_table_id_) {
     // Not from the same task so clear cached data
@@ -209,7 +213,6 @@ void LoadWorker::feed(LoadWorkEntry& input_entry) {
     index_.clear();
   }
 
-  entry_ = input_entry;
   current_row_ = 0;
   total_rows_ = 0;
   for (auto& sample : load_work_entry.samples()) {
@@ -230,6 +233,7 @@ bool LoadWorker::yield(i32 item_size,
   eval_work_entry.table_id = load_work_entry.table_id();
   eval_work_entry.job_index = load_work_entry.job_index();
   eval_work_entry.task_index = load_work_entry.task_index();
+  eval_work_entry.attempt = load_work_entry.attempt();
 
   const auto& samples = load_work_entry.samples();
   assert(!samples.empty());
@@ -278,7 +282,8 @@ bool LoadWorker::yield(i32 item_size,
         auto key = std::make_tuple(table_id, col_id, item_id);
         if (index_.count(key) == 0) {
           index_[key] =
-              read_video_index(storage_.get(), table_id, col_id, item_id);
+              read_video_index(storage_.get(), table_id, col_id, item_id,
+                               table_meta.item_attempt(item_id));
         }
         const VideoIndexEntry& entry = index_.at(key);
         inplace = entry.inplace;
@@ -288,7 +293,8 @@ bool LoadWorker::yield(i32 item_size,
         if (entry.codec_type == proto::VideoDescriptor::H264) {
           // Video was encoded using h264
           read_video_column(profiler_, entry, valid_offsets, item_start_row,
-                            eval_work_entry.columns[out_col_idx]);
+                            eval_work_entry.columns[out_col_idx],
+                            &read_ahead_cache_, inplace_read_ahead_);
         } else {
           // Video was encoded as individual images
           i32 item_id = intervals.item_ids[i];
@@ -330,7 +336,7 @@ bool LoadWorker::yield(i32 item_size,
     out_col_idx++;
   }
 
-  output_entry = eval_work_entry;
+  output_entry = std::move(eval_work_entry);
 
   current_row_ += item_size;
 
@@ -341,8 +347,13 @@ bool LoadWorker::done() { return current_row_ >= total_rows_; }
 
 void read_video_column(Profiler& profiler, const VideoIndexEntry& index_entry,
                        const std::vector<i64>& rows, i64 start_frame,
-                       ElementList& element_list) {
-  std::unique_ptr<RandomReadFile> video_file = index_entry.open_file();
+                       ElementList& element_list,
+                       ReadAheadCache* read_ahead_cache, i32 read_ahead) {
+  bool use_cache = index_entry.inplace && read_ahead_cache != nullptr;
+  std::unique_ptr<RandomReadFile> video_file;
+  if (!use_cache) {
+    video_file = index_entry.open_file();
+  }
   u64 file_size = index_entry.file_size;
   const std::vector<u64>& keyframe_indices = index_entry.keyframe_indices;
   const std::vector<u64>& sample_offsets = index_entry.sample_offsets;
@@ -390,10 +401,25 @@ void read_video_column(Profiler& profiler, const VideoIndexEntry& index_entry,
     auto io_start = now();
 
     u64 pos = start_keyframe_byte_offset;
-    size_t size_read;
-    storehouse::StoreResult r =
-        video_file->read(pos, buffer_size, buffer, size_read);
-    //s_read(video_file.get(), buffer, buffer_size, pos);
+    if (use_cache) {
+      read_ahead_cache->read(index_entry.path, file_size, pos, buffer_size,
+                             buffer, profiler);
+      // The next task on this video most likely starts where this interval
+      // ends, so fetch the intervals after it while this one decodes
+      size_t last_keyframe_index = std::min(
+          end_keyframe_index + (size_t)read_ahead, keyframe_indices.size() - 1);
+      for (size_t k = end_keyframe_index; k < last_keyframe_index; ++k) {
+        u64 begin = sample_offsets[keyframe_indices[k]];
+        u64 end = sample_offsets[keyframe_indices[k + 1]];
+        read_ahead_cache->prefetch(index_entry.path, file_size, begin,
+                                   end - begin);
+      }
+    } else {
+      size_t size_read;
+      storehouse::StoreResult r =
+          video_file->read(pos, buffer_size, buffer, size_read);
+      //s_read(video_file.get(), buffer, buffer_size, pos);
+    }
 
     profiler.add_interval("io", io_start, now());
     profiler.increment("io_read", static_cast<i64>(buffer_size));
@@ -441,6 +467,7 @@ void LoadWorker::read_other_column(i32 table_id, i32 column_id, i32 item_id,
                                    const std::vector<i64>& rows,
                                    ElementList& element_list) {
   const std::vector<i64>& valid_offsets = rows;
+  i32 attempt = table_metadata_->at(table_id).item_attempt(item_id);
 
   // Read metadata file to determine num rows and sizes
   u64 num_elements = 0;
@@ -449,8 +476,8 @@ void LoadWorker::read_other_column(i32 table_id, i32 column_id, i32 item_id,
     std::unique_ptr<RandomReadFile> file;
     StoreResult result;
     BACKOFF_FAIL(make_unique_random_read_file(
-        storage_.get(), table_item_metadata_path(table_id, column_id, item_id),
-        file));
+        storage_.get(),
+        table_item_metadata_path(table_id, column_id, item_id, attempt), file));
 
     u64 file_size = 0;
     BACKOFF_FAIL(file->get_size(file_size));
@@ -475,8 +502,8 @@ void LoadWorker::read_other_column(i32 table_id, i32 column_id, i32 item_id,
   std::unique_ptr<RandomReadFile> file;
   StoreResult result;
   BACKOFF_FAIL(make_unique_random_read_file(
-      storage_.get(), table_item_output_path(table_id, column_id, item_id),
-      file));
+      storage_.get(),
+      table_item_output_path(table_id, column_id, item_id, attempt), file));
 
   u64 file_size = 0;
   BACKOFF_FAIL(file->get_size(file_size));
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include "scanner/engine/read_ahead_cache.h"
 #include "scanner/engine/runtime.h"
 #include "scanner/engine/video_index_entry.h"
 #include "scanner/engine/table_meta_cache.h"
@@ -34,13 +35,16 @@ struct LoadWorkerArgs {
   i32 load_sparsity_threshold;
   i32 io_packet_size;
   i32 work_packet_size;
+  // Keyframe intervals of an inplace video to read ahead of each one loaded
+  i32 inplace_read_ahead;
+  ReadAheadCache& read_ahead_cache;
 };
 
 class LoadWorker {
  public:
   LoadWorker(const LoadWorkerArgs& args);
 
-  void feed(LoadWorkEntry& input_entry);
+  void feed(LoadWorkEntry&& input_entry);
 
   bool yield(i32 item_size, EvalWorkEntry& output_entry);
 
@@ -65,6 +69,8 @@ class LoadWorker {
   i32 load_sparsity_threshold_;
   i32 io_packet_size_;
   i32 work_packet_size_;
+  i32 inplace_read_ahead_;
+  ReadAheadCache& read_ahead_cache_;
 
   // Continuation state
   bool first_item_;
@@ -75,9 +81,14 @@ class LoadWorker {
   i64 total_rows_;
 };
 
+// Inplace videos are read through read_ahead_cache if given, which then
+// reads the read_ahead keyframe intervals after each interval in the
+// background
 void read_video_column(Profiler& profiler,
                        const VideoIndexEntry& index_entry,
                        const std::vector<i64>& rows, i64 start_offset,
-                       ElementList& element_list);
+                       ElementList& element_list,
+                       ReadAheadCache* read_ahead_cache = nullptr,
+                       i32 read_ahead = 0);
 }
 }
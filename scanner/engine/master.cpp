@@ -25,6 +25,7 @@
 #include "scanner/engine/python_kernel.h"
 
 #include <grpc/support/log.h>
+#include <algorithm>
 #include <set>
 #include <mutex>
 
@@ -44,19 +45,18 @@ MasterImpl::MasterImpl(DatabaseParameters& params)
   recover_and_init_database();
 
   start_job_processor();
+  // Ping workers every 5 seconds to make sure they are alive
+  start_worker_pinger();
   VLOG(1) << "Master created.";
 }
 
 MasterImpl::~MasterImpl() {
   trigger_shutdown_.set();
-  {
-    std::unique_lock<std::mutex> lock(finished_mutex_);
-    finished_ = true;
-  }
-  finished_cv_.notify_all();
 
   {
     std::unique_lock<std::mutex> lk(work_mutex_);
+    // Release NextWork calls held in a long poll and wake the job processor
+    work_state_changed();
   }
 
   stop_job_processor();
@@ -175,7 +175,9 @@ grpc::Status MasterImpl::RegisterWorker(grpc::ServerContext* context,
         << status.error_code() << "): " << status.error_message();
   }
 
-  unstarted_workers_.push_back(node_id);
+  // The job processor starts the worker on a bulk job
+  local_totals_[split(worker_address, ':')[0]] += 1;
+  work_state_changed();
 
   return grpc::Status::OK;
 }
@@ -188,6 +190,8 @@ grpc::Status MasterImpl::UnregisterWorker(grpc::ServerContext* context,
   set_database_path(db_params_.db_path);
 
   i32 node_id = node_info->node_id();
+  // A worker that drained before leaving has no tasks outstanding, so
+  // nothing is reassigned when it is removed
   remove_worker(node_id);
 
   return grpc::Status::OK;
@@ -222,7 +226,7 @@ grpc::Status MasterImpl::IngestVideos(grpc::ServerContext* context,
                                              params->table_names().end()),
                     std::vector<std::string>(params->video_paths().begin(),
                                              params->video_paths().end()),
-                    params->inplace(), failed_videos));
+                    params->inplace(), failed_videos, params->append()));
   for (auto& failed : failed_videos) {
     result->add_failed_paths(failed.path);
     result->add_failed_messages(failed.message);
@@ -236,13 +240,42 @@ grpc::Status MasterImpl::IngestVideos(grpc::ServerContext* context,
 }
 
 grpc::Status MasterImpl::GetJobStatus(grpc::ServerContext* context,
-                                      const proto::Empty* empty,
+                                      const proto::GetJobStatusParams* params,
                                       proto::JobStatus* job_status) {
   VLOG(2) << "Master received GetJobStatus command";
-  std::unique_lock<std::mutex> lock(active_mutex_);
-  if (!active_bulk_job_) {
+  std::unique_lock<std::mutex> lk(work_mutex_);
+  const std::string& job_name = params->job_name();
+  // Without a name, report on the oldest bulk job which has not finished
+  BulkJob* job = nullptr;
+  for (auto& kv : bulk_jobs_) {
+    if (job_name.empty() || kv.second->name == job_name) {
+      job = kv.second.get();
+      break;
+    }
+  }
+  if (job != nullptr) {
+    job_status->set_finished(false);
+    job_status->set_queued(!job->finished &&
+                           (!job->started || num_bulk_job_workers(*job) == 0));
+
+    // The task state of a bulk job is only known once it has been set up
+    job_status->set_tasks_done(job->started ? job->total_tasks_used : 0);
+    job_status->set_total_tasks(job->started ? job->total_tasks : 0);
+
+    job_status->set_jobs_done(job->started ? job->next_job - 1 : 0);
+    job_status->set_jobs_failed(0);
+    job_status->set_total_jobs(job->started ? job->num_jobs : 0);
+    job_status->set_failed_workers(job->num_failed_workers);
+  } else {
     job_status->set_finished(true);
-    job_status->mutable_result()->CopyFrom(job_result_);
+    if (job_name.empty()) {
+      job_status->mutable_result()->CopyFrom(job_result_);
+    } else if (finished_bulk_jobs_.count(job_name) > 0) {
+      job_status->mutable_result()->CopyFrom(finished_bulk_jobs_.at(job_name));
+    } else {
+      RESULT_ERROR(job_status->mutable_result(), "Unknown bulk job %s",
+                   job_name.c_str());
+    }
 
     job_status->set_tasks_done(0);
     job_status->set_total_tasks(0);
@@ -250,15 +283,6 @@ grpc::Status MasterImpl::GetJobStatus(grpc::ServerContext* context,
     job_status->set_jobs_done(0);
     job_status->set_jobs_failed(0);
     job_status->set_total_jobs(0);
-  } else {
-    job_status->set_finished(false);
-
-    job_status->set_tasks_done(total_tasks_used_);
-    job_status->set_total_tasks(total_tasks_);
-
-    job_status->set_jobs_done(next_job_ - 1);
-    job_status->set_jobs_failed(0);
-    job_status->set_total_jobs(num_jobs_);
   }
   // Num workers
   i32 num_workers = 0;
@@ -268,7 +292,6 @@ grpc::Status MasterImpl::GetJobStatus(grpc::ServerContext* context,
     }
   }
   job_status->set_num_workers(num_workers);
-  job_status->set_failed_workers(num_failed_workers_);
   return grpc::Status::OK;
 }
 
@@ -446,7 +469,8 @@ grpc::Status MasterImpl::RegisterPythonKernel(
     bool can_batch = (batch_size > 1);
     KernelFactory* factory =
         new KernelFactory(op_name, device_type, 1, input_devices,
-                          output_devices, can_batch, batch_size, constructor);
+                          output_devices, can_batch, batch_size, batch_size,
+                          batch_size, constructor);
 
     // Register the kernel
     KernelRegistry* registry = get_kernel_registry();
@@ -527,88 +551,160 @@ grpc::Status MasterImpl::PokeWatchdog(grpc::ServerContext* context,
   return grpc::Status::OK;
 }
 
-grpc::Status MasterImpl::NextWork(grpc::ServerContext* context,
-                                  const proto::NodeInfo* node_info,
-                                  proto::NewWork* new_work) {
+grpc::Status MasterImpl::GetMemoizedTables(
+    grpc::ServerContext* context, const proto::BulkJobParameters* job_params,
+    proto::MemoizedTables* tables) {
+  VLOG(2) << "Master received GetMemoizedTables command";
   std::unique_lock<std::mutex> lk(work_mutex_);
-  VLOG(1) << "Master received NextWork command";
-  if (!worker_active_.at(node_info->node_id())) {
-    // Worker is not active
-    new_work->set_no_more_work(true);
-    return grpc::Status::OK;
-  }
+  tables->mutable_result()->set_success(true);
 
-  // If we do not have any outstanding work, try and create more
-  if (unallocated_job_tasks_.empty()) {
-    // If we have no more samples for this task, try and get another task
-    if (next_task_ == num_tasks_) {
-      // Check if there are any tasks left
-      if (next_job_ < num_jobs_ && task_result_.success()) {
-        next_task_ = 0;
-        num_tasks_ = job_tasks_.at(next_job_).size();
-        next_job_++;
-        VLOG(1) << "Tasks left: " << total_tasks_ - total_tasks_used_;
+  std::vector<proto::Op> ops(job_params->ops().begin(),
+                             job_params->ops().end());
+  for (i64 op_idx = 0; op_idx < ops.size(); ++op_idx) {
+    if (!ops[op_idx].memoize()) {
+      continue;
+    }
+    for (i64 job_idx = 0; job_idx < job_params->jobs_size(); ++job_idx) {
+      std::string table_name;
+      Result result =
+          memoized_table_name(meta_, *table_metas_.get(),
+                              job_params->jobs(job_idx), ops, op_idx,
+                              table_name);
+      if (!result.success()) {
+        tables->mutable_result()->CopyFrom(result);
+        tables->clear_tables();
+        return grpc::Status::OK;
       }
+      proto::MemoizedTable* table = tables->add_tables();
+      table->set_job_index(job_idx);
+      table->set_op_index(op_idx);
+      table->set_table_name(table_name);
+      table->set_cached(meta_.has_table(table_name) &&
+                        meta_.table_is_committed(
+                            meta_.get_table_id(table_name)));
     }
+  }
 
-    // Create more work if possible
-    if (next_task_ < num_tasks_) {
-      i64 current_job = next_job_ - 1;
-      i64 current_task = next_task_;
+  return grpc::Status::OK;
+}
 
-      unallocated_job_tasks_.push_front(
-          std::make_tuple(current_job, current_task));
-      next_task_++;
-    }
-  }
+// Longest an idle worker's NextWork request is held waiting for a task
+static const f64 NEXT_WORK_LONG_POLL_SECONDS = 1.0;
 
-  if (unallocated_job_tasks_.empty()) {
-    if (finished_) {
+grpc::Status MasterImpl::NextWork(grpc::ServerContext* context,
+                                  const proto::NodeInfo* node_info,
+                                  proto::NewWork* new_work) {
+  std::unique_lock<std::mutex> lk(work_mutex_);
+  VLOG(1) << "Master received NextWork command";
+  auto poll_deadline =
+      now() + std::chrono::duration_cast<timepoint_t::duration>(
+                  std::chrono::duration<f64>(NEXT_WORK_LONG_POLL_SECONDS));
+  std::tuple<i64, i64> job_task_id;
+  BulkJob* job;
+  while (true) {
+    if (!worker_active_.at(node_info->node_id())) {
+      // Worker is not active
+      new_work->set_no_more_work(true);
+      return grpc::Status::OK;
+    }
+    job = running_bulk_job(node_info->bulk_job_sequence());
+    if (job == nullptr) {
       // No more work
       new_work->set_no_more_work(true);
-    } else {
-      // Still have tasks that might be reassigned
+      return grpc::Status::OK;
+    }
+    take_cancelled_tasks(*job, node_info->node_id(),
+                         new_work->mutable_cancelled_tasks());
+
+    // Tasks come from whichever running bulk job needs the worker most. A
+    // worker whose pipeline belongs to another one finishes the tasks it has
+    // and is then started on that bulk job by the job processor.
+    BulkJob* next_job = pick_bulk_job_for_worker(node_info->node_id(), job);
+    if (next_job != job) {
+      VLOG(1) << "Moving worker " << node_info->node_id() << " from bulk job "
+              << job->name << " to " << next_job->name;
+      worker_next_bulk_jobs_[node_info->node_id()] = next_job->sequence;
+      new_work->set_no_more_work(true);
+      return grpc::Status::OK;
+    }
+
+    if (next_task_for_worker(*job, node_info->node_id(), job_task_id)) {
+      break;
+    }
+    // This worker would go idle, so use it to back up a straggler instead
+    if (job->job_params.speculative_execution() &&
+        find_straggler_task(*job, node_info->node_id(), job_task_id)) {
+      job->worker_histories[node_info->node_id()].tasks_speculated += 1;
+      job->task_next_attempt.emplace(job_task_id, 1);
+      break;
+    }
+    // Still have tasks that might be reassigned. An idle worker has nothing
+    // else to do, so hold its request until the state changes rather than
+    // have it ask again later.
+    if (!node_info->long_poll() || trigger_shutdown_.raised() ||
+        now() >= poll_deadline) {
       new_work->set_wait_for_work(true);
+      return grpc::Status::OK;
     }
-    return grpc::Status::OK;
+    i64 version = work_state_version_;
+    work_state_cv_.wait_until(lk, poll_deadline, [&] {
+      return work_state_version_ != version || trigger_shutdown_.raised();
+    });
   }
 
-  // Grab the next task sample
-  std::tuple<i64, i64> job_task_id = unallocated_job_tasks_.back();
-  unallocated_job_tasks_.pop_back();
-
-  assert(next_task_ <= num_tasks_);
-
   i64 job_idx;
   i64 task_idx;
   std::tie(job_idx, task_idx) = job_task_id;
 
   // If the job was blacklisted, then we throw it away
-  if (blacklisted_jobs_.count(job_idx) > 0) {
+  if (job->blacklisted_jobs.count(job_idx) > 0) {
     // TODO(apoms): we are telling the worker to re request work here
     // but we should just loop this whole process again
     new_work->set_wait_for_work(true);
     return grpc::Status::OK;
   }
 
-  new_work->set_table_id(job_to_table_id_.at(job_idx));
+  new_work->set_table_id(job->job_to_table_id.at(job_idx));
   new_work->set_job_index(job_idx);
   new_work->set_task_index(task_idx);
-  const auto& task_rows = job_tasks_.at(job_idx).at(task_idx);
-  for (i64 r : task_rows) {
-    new_work->add_output_rows(r);
+  job->job_tasks.task_rows(job_idx, task_idx, new_work->mutable_output_rows());
+  {
+    // Every attempt of a task saves its outputs under its own paths, so a
+    // duplicate attempt never overwrites the one which gets committed
+    auto attempt_it = job->task_next_attempt.find(job_task_id);
+    new_work->set_attempt(
+        attempt_it == job->task_next_attempt.end() ? 0 : attempt_it->second++);
+  }
+
+  // Remember what the worker is about to load
+  {
+    i64 worker_id = node_info->node_id();
+    job->worker_last_task[worker_id] = job_task_id;
+    auto& recent_tables = worker_recent_tables_[worker_id];
+    for (i32 table_id : job->job_input_tables.at(job_idx)) {
+      auto it = std::find(recent_tables.begin(), recent_tables.end(), table_id);
+      if (it != recent_tables.end()) {
+        recent_tables.erase(it);
+      }
+      recent_tables.push_back(table_id);
+    }
+    const size_t RECENT_TABLES_PER_WORKER = 32;
+    while (recent_tables.size() > RECENT_TABLES_PER_WORKER) {
+      recent_tables.pop_front();
+    }
   }
 
   // Track sample assigned to worker
-  active_job_tasks_[node_info->node_id()].insert(job_task_id);
-  worker_histories_[node_info->node_id()].tasks_assigned += 1;
+  job->active_job_tasks[node_info->node_id()].insert(job_task_id);
+  job->task_attempts[job_task_id][node_info->node_id()] = now();
+  job->worker_histories[node_info->node_id()].tasks_assigned += 1;
 
   return grpc::Status::OK;
 }
 
 grpc::Status MasterImpl::FinishedWork(
     grpc::ServerContext* context, const proto::FinishedWorkParameters* params,
-    proto::Empty* empty) {
+    proto::FinishedWorkReply* reply) {
   std::unique_lock<std::mutex> lk(work_mutex_);
   VLOG(1) << "Master received FinishedWork command";
 
@@ -619,37 +715,79 @@ grpc::Status MasterImpl::FinishedWork(
 
   if (!worker_active_[worker_id]) {
     // Technically the task was finished, but we don't count it for now
-    // because it would have been reinstered into the work queue
+    // because it would have been reinstered into the work queue. The reply
+    // leaves committed unset so the worker removes the outputs.
     return grpc::Status::OK;
   }
 
-  auto& worker_tasks = active_job_tasks_.at(worker_id);
+  auto job_it = bulk_jobs_.find(params->bulk_job_sequence());
+  if (job_it == bulk_jobs_.end() || !job_it->second->started) {
+    // The bulk job is no longer running, so the reply leaves committed unset
+    return grpc::Status::OK;
+  }
+  BulkJob& job = *job_it->second;
+
+  auto& worker_tasks = job.active_job_tasks[worker_id];
 
   std::tuple<i64, i64> job_tasks = std::make_tuple(job_id, task_id);
-  assert(worker_tasks.count(job_tasks) > 0);
+  if (worker_tasks.count(job_tasks) == 0) {
+    // Another attempt of this task finished first and was committed, so the
+    // worker removes the outputs of this attempt
+    VLOG(1) << "Discarding duplicate attempt " << params->attempt()
+            << " of task (" << job_id << ", " << task_id << ") from worker "
+            << worker_id;
+    job.cancelled_worker_tasks[worker_id].erase(job_tasks);
+    take_cancelled_tasks(job, worker_id, reply->mutable_cancelled_tasks());
+    return grpc::Status::OK;
+  }
   worker_tasks.erase(job_tasks);
 
-  worker_histories_[worker_id].tasks_retired += 1;
+  job.worker_histories[worker_id].tasks_retired += 1;
 
-  i64 active_job = next_job_ - 1;
+  // This attempt wins: record how long the task took and tell any other
+  // workers running a copy of it to abandon their attempt
+  auto attempts_it = job.task_attempts.find(job_tasks);
+  if (attempts_it != job.task_attempts.end()) {
+    auto& attempts = attempts_it->second;
+    if (attempts.count(worker_id) > 0) {
+      job.completed_task_seconds.push_back(
+          std::chrono::duration<f64>(now() - attempts.at(worker_id)).count());
+    }
+    for (auto& kv : attempts) {
+      i64 other_worker = kv.first;
+      if (other_worker == worker_id) {
+        continue;
+      }
+      VLOG(1) << "Task (" << job_id << ", " << task_id << ") finished on "
+              << "worker " << worker_id << ", cancelling attempt on worker "
+              << other_worker;
+      job.active_job_tasks[other_worker].erase(job_tasks);
+      job.cancelled_worker_tasks[other_worker].insert(job_tasks);
+    }
+    job.task_attempts.erase(attempts_it);
+  }
+  take_cancelled_tasks(job, worker_id, reply->mutable_cancelled_tasks());
+  reply->set_committed(true);
+  job.task_next_attempt.erase(job_tasks);
+  if (params->attempt() != 0) {
+    job.committed_task_attempts[job_tasks] = params->attempt();
+  }
+
+  i64 active_job = job.next_job - 1;
 
 
   // If job was blacklisted, then we have already updated total tasks
   // used to reflect that and we should ignore it
-  if (blacklisted_jobs_.count(job_id) == 0) {
-    total_tasks_used_++;
-    tasks_used_per_job_[job_id]++;
+  if (job.blacklisted_jobs.count(job_id) == 0) {
+    job.total_tasks_used++;
+    job.tasks_used_per_job[job_id]++;
+    // Logged by the job processor so a resumed job can skip the task
+    job.pending_checkpoint_tasks.emplace_back(job_id, task_id,
+                                              params->attempt());
   }
 
-  if (total_tasks_used_ == total_tasks_) {
-    VLOG(1) << "Master FinishedWork triggered finished!";
-    assert(next_job_ == num_jobs_);
-    {
-      std::unique_lock<std::mutex> lock(finished_mutex_);
-      finished_ = true;
-    }
-    finished_cv_.notify_all();
-  }
+  check_bulk_job_finished(job);
+  work_state_changed();
 
   return grpc::Status::OK;
 }
@@ -662,7 +800,17 @@ grpc::Status MasterImpl::FinishedJob(grpc::ServerContext* context,
 
   i32 worker_id = params->node_id();
 
-  unfinished_workers_[worker_id] = false;
+  auto it = worker_bulk_jobs_.find(worker_id);
+  if (it != worker_bulk_jobs_.end() &&
+      it->second == params->bulk_job_sequence()) {
+    auto job_it = bulk_jobs_.find(it->second);
+    if (job_it != bulk_jobs_.end()) {
+      job_it->second->worker_histories[worker_id].end_time = now();
+    }
+    // The job processor starts the worker on its next bulk job
+    worker_bulk_jobs_.erase(it);
+  }
+  work_state_changed();
 
   return grpc::Status::OK;
 }
@@ -674,19 +822,15 @@ grpc::Status MasterImpl::NewJob(grpc::ServerContext* context,
   job_result->set_success(true);
   set_database_path(db_params_.db_path);
 
-  job_params_.Clear();
-  job_params_.MergeFrom(*job_params);
-  {
-    std::unique_lock<std::mutex> lock(finished_mutex_);
-    finished_ = false;
-  }
-  finished_cv_.notify_all();
-
-  {
-    std::unique_lock<std::mutex> lock(active_mutex_);
-    active_bulk_job_ = true;
-  }
-  active_cv_.notify_all();
+  std::unique_lock<std::mutex> lk(work_mutex_);
+  std::unique_ptr<BulkJob> job(new BulkJob);
+  job->sequence = next_bulk_job_sequence_++;
+  job->name = job_params->job_name();
+  job->priority = job_params->priority();
+  job->job_params.CopyFrom(*job_params);
+  bulk_jobs_[job->sequence] = std::move(job);
+  // The job processor sets it up and starts workers on it
+  work_state_changed();
 
   return grpc::Status::OK;
 }
@@ -743,6 +887,10 @@ void MasterImpl::start_watchdog(grpc::Server* server, bool enable_timeout,
 }
 
 static const i32 NUM_PREFETCH_THREADS = 64;
+// How often the tasks finished by workers are appended to the checkpoint log
+static const f64 CHECKPOINT_INTERVAL_SECONDS = 1.0;
+// Number of finished bulk jobs whose results GetJobStatus still reports
+static const size_t MAX_FINISHED_BULK_JOBS = 1024;
 
 void MasterImpl::recover_and_init_database() {
   VLOG(1) << "Initializing database...";
@@ -763,24 +911,11 @@ void MasterImpl::recover_and_init_database() {
   // Prefetch table metadata for all tables
   if (db_params_.prefetch_table_metadata) {
     VLOG(1) << "Prefetching table metadata";
-    auto load_table_meta = [&](const std::string& table_name) {
-      std::string table_path =
-          TableMetadata::descriptor_path(meta_.get_table_id(table_name));
-      table_metas_->update(read_table_metadata(storage_, table_path));
-    };
-
-    VLOG(1) << "Spawning thread pool";
-    ThreadPool prefetch_pool(NUM_PREFETCH_THREADS);
-    std::vector<std::future<void>> futures;
+    std::vector<i32> table_ids;
     for (const auto& t : meta_.table_names()) {
-      futures.emplace_back(prefetch_pool.enqueue(load_table_meta, t));
+      table_ids.push_back(meta_.get_table_id(t));
     }
-
-    VLOG(1) << "Waiting on futures";
-    for (auto& future : futures) {
-      future.wait();
-    }
-
+    table_metas_->prefetch(table_ids, NUM_PREFETCH_THREADS);
     VLOG(1) << "Prefetch complete.";
   }
 
@@ -792,76 +927,205 @@ void MasterImpl::recover_and_init_database() {
 void MasterImpl::start_job_processor() {
   VLOG(1) << "Starting job processor";
   job_processor_thread_ = std::thread([this]() {
+    auto no_workers_start = now();
     while (!trigger_shutdown_.raised()) {
-      // Wait on not finished
+      i64 seen_work_state_version;
+      // Set up the bulk jobs submitted since the last pass, highest priority
+      // first. Other threads leave a bulk job alone until it is started.
+      std::vector<BulkJob*> submitted_jobs;
       {
-        std::unique_lock<std::mutex> lock(active_mutex_);
-        active_cv_.wait(lock, [this] {
-          return active_bulk_job_ || trigger_shutdown_.raised();
-        });
+        std::unique_lock<std::mutex> lk(work_mutex_);
+        seen_work_state_version = work_state_version_;
+        for (auto& kv : bulk_jobs_) {
+          if (!kv.second->started && !kv.second->finished) {
+            submitted_jobs.push_back(kv.second.get());
+          }
+        }
+      }
+      std::stable_sort(submitted_jobs.begin(), submitted_jobs.end(),
+                       [](const BulkJob* a, const BulkJob* b) {
+                         return a->priority > b->priority;
+                       });
+      for (BulkJob* job : submitted_jobs) {
+        bool set_up = setup_job(*job);
+        std::unique_lock<std::mutex> lk(work_mutex_);
+        if (set_up) {
+          job->started = true;
+          job->last_checkpoint_time = now();
+          // Nothing is left to compute if a resumed job finished all its
+          // tasks before, or an incremental job found no new rows
+          check_bulk_job_finished(*job);
+        } else {
+          job->finished = true;
+        }
+        work_state_changed();
+      }
+
+      std::vector<BulkJob*> running_jobs;
+      std::vector<BulkJob*> stopped_jobs;
+      std::map<BulkJob*, std::vector<i32>> workers_to_start;
+      {
+        std::unique_lock<std::mutex> lk(work_mutex_);
+        // If we have unfinished work but no workers for some period of time,
+        // then fail
+        bool has_workers = false;
+        for (auto& kv : worker_active_) {
+          has_workers |= kv.second;
+        }
+        bool has_unfinished_work = false;
+        for (auto& kv : bulk_jobs_) {
+          has_unfinished_work |= kv.second->started && !kv.second->finished;
+        }
+        if (has_workers || !has_unfinished_work) {
+          no_workers_start = now();
+        } else if (std::chrono::duration_cast<std::chrono::seconds>(
+                       now() - no_workers_start)
+                       .count() > db_params_.no_workers_timeout) {
+          for (auto& kv : bulk_jobs_) {
+            BulkJob& job = *kv.second;
+            if (job.started && !job.finished) {
+              RESULT_ERROR(
+                  &job.job_result,
+                  "No workers but have unfinished work after %ld seconds",
+                  db_params_.no_workers_timeout);
+              job.finished = true;
+            }
+          }
+        }
+
+        // Start idle workers, which just registered or left their last bulk
+        // job, on the bulk job which needs them most
+        for (auto& kv : worker_active_) {
+          i32 worker_id = kv.first;
+          if (!kv.second || worker_bulk_jobs_.count(worker_id) > 0) {
+            continue;
+          }
+          worker_next_bulk_jobs_.erase(worker_id);
+          BulkJob* job = pick_bulk_job_for_worker(worker_id, nullptr);
+          if (job == nullptr) {
+            continue;
+          }
+          // Counted towards the bulk job from now on, so the next idle
+          // worker is spread onto another one if it needs it more
+          worker_bulk_jobs_[worker_id] = job->sequence;
+          workers_to_start[job].push_back(worker_id);
+        }
+
+        for (auto& kv : bulk_jobs_) {
+          BulkJob* job = kv.second.get();
+          if (job->started && !job->finished) {
+            running_jobs.push_back(job);
+          }
+          // A bulk job is committed once no worker runs its pipeline
+          bool has_running_workers = false;
+          for (auto& w : worker_bulk_jobs_) {
+            has_running_workers |= w.second == job->sequence;
+          }
+          if (job->finished && !has_running_workers) {
+            stopped_jobs.push_back(job);
+          }
+        }
+      }
+
+      for (auto& kv : workers_to_start) {
+        VLOG(1) << "Starting " << kv.second.size() << " workers on bulk job "
+                << kv.first->name;
+        start_job_on_workers(*kv.first, kv.second);
+      }
+
+      // Log the tasks finished since the last checkpoint
+      for (BulkJob* job : running_jobs) {
+        if (std::chrono::duration<f64>(now() - job->last_checkpoint_time)
+                .count() >= CHECKPOINT_INTERVAL_SECONDS) {
+          write_checkpoint(*job);
+          job->last_checkpoint_time = now();
+        }
+      }
+
+      for (BulkJob* job : stopped_jobs) {
+        finish_bulk_job(*job);
+      }
+
+      // Sleep until workers report back or the next checkpoint is due. The
+      // no workers timeout is measured in seconds, so waking up once per
+      // checkpoint interval is often enough to notice it.
+      {
+        std::unique_lock<std::mutex> lk(work_mutex_);
+        work_state_cv_.wait_for(
+            lk, std::chrono::duration<f64>(CHECKPOINT_INTERVAL_SECONDS), [&] {
+              return work_state_version_ != seen_work_state_version ||
+                     trigger_shutdown_.raised();
+            });
+      }
+    }
+
+    // The bulk jobs which have not finished fail and keep their checkpoints
+    // so they can be resumed
+    std::vector<BulkJob*> unfinished_jobs;
+    {
+      std::unique_lock<std::mutex> lk(work_mutex_);
+      for (auto& kv : bulk_jobs_) {
+        unfinished_jobs.push_back(kv.second.get());
       }
-      if (trigger_shutdown_.raised()) break;
-      // Start processing job
-      bool result = process_job(&job_params_, &job_result_);
+    }
+    for (BulkJob* job : unfinished_jobs) {
+      finish_bulk_job(*job);
     }
   });
 }
 
 void MasterImpl::stop_job_processor() {
-  // Wake up job processor
-  {
-    std::unique_lock<std::mutex> lock(active_mutex_);
-    active_bulk_job_ = true;
-  }
-  active_cv_.notify_all();
+  // Woken up by the work_state_changed() call of the destructor
   if (job_processor_thread_.joinable()) {
     job_processor_thread_.join();
   }
 }
 
-bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
-                             proto::Result* job_result) {
-  // Reset job state
-  job_to_table_id_.clear();
-  slice_input_rows_per_job_.clear();
-  total_output_rows_per_job_.clear();
-  unallocated_job_tasks_.clear();
-  job_tasks_.clear();
-  next_job_ = 0;
-  num_jobs_ = -1;
-  next_task_ = 0;
-  num_tasks_ = -1;
-  task_result_.set_success(true);
-  active_job_tasks_.clear();
-  worker_histories_.clear();
-  unfinished_workers_.clear();
-  local_ids_.clear();
-  local_totals_.clear();
-  total_tasks_used_ = 0;
-  total_tasks_ = 0;
-  tasks_used_per_job_.clear();
-  num_failed_workers_ = 0;
+bool MasterImpl::setup_job(BulkJob& bulk_job) {
+  proto::BulkJobParameters* job_params = &bulk_job.job_params;
+  proto::Result* job_result = &bulk_job.job_result;
 
   job_result->set_success(true);
 
-  auto finished_fn = [this]() {
-    {
-      std::unique_lock<std::mutex> lock(finished_mutex_);
-      finished_ = true;
-    }
-    finished_cv_.notify_all();
-    {
-      std::unique_lock<std::mutex> lock(finished_mutex_);
-      active_bulk_job_ = false;
-    }
-    active_cv_.notify_all();
-  };
-
   std::vector<proto::Job> jobs(job_params->jobs().begin(),
                                job_params->jobs().end());
   std::vector<proto::Op> ops(job_params->ops().begin(),
                              job_params->ops().end());
 
+  // Read the cached outputs of memoized Ops instead of recomputing them. The
+  // spliced DAG replaces the one in job_params so workers evaluate it too.
+  bool has_memoized_ops = false;
+  for (const auto& op : ops) {
+    has_memoized_ops |= op.memoize();
+  }
+  if (has_memoized_ops) {
+    std::unique_lock<std::mutex> lk(work_mutex_);
+    std::vector<std::string> memoized_tables;
+    *job_result = splice_memoized_ops(meta_, *table_metas_.get(), jobs, ops,
+                                      memoized_tables);
+    if (!job_result->success()) {
+      return false;
+    }
+    if (!memoized_tables.empty()) {
+      VLOG(1) << "Reading " << memoized_tables.size()
+              << " memoized tables instead of recomputing their Ops";
+      job_params->clear_jobs();
+      for (const auto& job : jobs) {
+        job_params->add_jobs()->CopyFrom(job);
+      }
+      job_params->clear_ops();
+      for (const auto& op : ops) {
+        job_params->add_ops()->CopyFrom(op);
+      }
+    }
+    i64 timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+                        now().time_since_epoch())
+                        .count();
+    for (const std::string& table_name : memoized_tables) {
+      memoized_last_used_[table_name] = timestamp;
+    }
+  }
+
   const i32 work_packet_size = job_params->work_packet_size();
   const i32 io_packet_size = job_params->io_packet_size() != -1
                                  ? job_params->io_packet_size()
@@ -869,18 +1133,30 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
   if (io_packet_size > 0 && io_packet_size % work_packet_size != 0) {
     RESULT_ERROR(job_result,
                  "IO packet size must be a multiple of Work packet size.");
-    finished_fn();
     return false;
   }
 
   i32 total_rows = 0;
 
+  // Validation and the column lookups below touch the descriptor of every
+  // input table, so read them all up front instead of one at a time
+  {
+    std::vector<i32> input_table_ids;
+    for (const auto& job : jobs) {
+      for (auto& ci : job.inputs()) {
+        if (meta_.has_table(ci.table_name())) {
+          input_table_ids.push_back(meta_.get_table_id(ci.table_name()));
+        }
+      }
+    }
+    table_metas_->prefetch(input_table_ids, NUM_PREFETCH_THREADS);
+  }
+
   DAGAnalysisInfo dag_info;
   *job_result =
       validate_jobs_and_ops(meta_, *table_metas_.get(), jobs, ops, dag_info);
   if (!job_result->success()) {
     // No database changes made at this point, so just return
-    finished_fn();
     return false;
   }
 
@@ -964,31 +1240,43 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
       output_columns.push_back(c);
     }
   }
-  proto::BulkJobDescriptor job_descriptor;
-  job_descriptor.set_io_packet_size(io_packet_size);
-  job_descriptor.set_work_packet_size(work_packet_size);
-  job_descriptor.set_num_nodes(workers_.size());
+  bulk_job.job_descriptor.set_io_packet_size(io_packet_size);
+  bulk_job.job_descriptor.set_work_packet_size(work_packet_size);
+  bulk_job.job_descriptor.set_num_nodes(workers_.size());
 
   {
     auto& jobs = job_params->jobs();
-    job_descriptor.mutable_jobs()->CopyFrom(jobs);
+    bulk_job.job_descriptor.mutable_jobs()->CopyFrom(jobs);
   }
 
   // Add job name into database metadata so we can look up what jobs have
   // been run
-  i32 bulk_job_id = meta_.add_bulk_job(job_params->job_name());
-  job_descriptor.set_id(bulk_job_id);
-  job_descriptor.set_name(job_params->job_name());
+  i32 bulk_job_id;
+  if (job_params->resume()) {
+    // Continue the bulk job with this name which did not commit, reusing its
+    // output tables and skipping the tasks in its checkpoint log
+    if (!meta_.has_bulk_job(job_params->job_name()) ||
+        meta_.bulk_job_is_committed(
+            meta_.get_bulk_job_id(job_params->job_name()))) {
+      RESULT_ERROR(job_result, "No unfinished bulk job named %s to resume.",
+                   job_params->job_name().c_str());
+      return false;
+    }
+    bulk_job_id = meta_.get_bulk_job_id(job_params->job_name());
+  } else {
+    bulk_job_id = meta_.add_bulk_job(job_params->job_name());
+  }
+  bulk_job.job_descriptor.set_id(bulk_job_id);
+  bulk_job.job_descriptor.set_name(job_params->job_name());
   // Determine total output rows and slice input rows for using to
   // split stream
   *job_result = determine_input_rows_to_slices(meta_, *table_metas_.get(), jobs,
                                                ops, dag_info);
-  slice_input_rows_per_job_ = dag_info.slice_input_rows;
-  total_output_rows_per_job_ = dag_info.total_output_rows;
+  bulk_job.slice_input_rows_per_job = dag_info.slice_input_rows;
+  bulk_job.total_output_rows_per_job = dag_info.total_output_rows;
 
   if (!job_result->success()) {
     // No database changes made at this point, so just return
-    finished_fn();
     return false;
   }
 
@@ -996,16 +1284,67 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
   //  a) align with the natural boundaries defined by the slice partitioner
   //  b) use a user-specified size to chunk up the output sequence
 
-  // Job -> task -> rows
-  i32 total_tasks_temp = 0;
+  // Whether each job appends to its existing output table
+  std::vector<bool> appends_to_table(jobs.size(), false);
   for (size_t i = 0; i < jobs.size(); ++i) {
-    tasks_used_per_job_.push_back(0);
-
-    auto& slice_input_rows = slice_input_rows_per_job_[i];
-    i64 total_output_rows = total_output_rows_per_job_[i];
+    auto& slice_input_rows = bulk_job.slice_input_rows_per_job[i];
+    i64 total_output_rows = bulk_job.total_output_rows_per_job[i];
+
+    // Incremental bulk jobs append to output tables which already exist,
+    // computing only the rows past their end. Stateful Ops are warmed up
+    // from the rows before the first new one like at any task boundary.
+    const std::string& output_table_name = jobs.at(i).output_table_name();
+    const TableMetadata* existing_table = nullptr;
+    if (job_params->incremental() && meta_.has_table(output_table_name) &&
+        meta_.table_is_committed(meta_.get_table_id(output_table_name))) {
+      existing_table = &table_metas_->at(output_table_name);
+      const std::vector<Column>& existing_columns = existing_table->columns();
+      const std::vector<Column>& output_columns = job_output_columns.at(i);
+      bool same_columns = existing_columns.size() == output_columns.size();
+      for (size_t c = 0; same_columns && c < output_columns.size(); ++c) {
+        same_columns = existing_columns[c].name() == output_columns[c].name() &&
+                       existing_columns[c].type() == output_columns[c].type();
+      }
+      if (!same_columns) {
+        RESULT_ERROR(job_result,
+                     "Can not append to table %s since its columns differ "
+                     "from the outputs of the bulk job.",
+                     output_table_name.c_str());
+        return false;
+      }
+      if (!slice_input_rows.empty()) {
+        RESULT_ERROR(job_result,
+                     "Can not append to table %s since incremental bulk jobs "
+                     "do not support Slice Ops.",
+                     output_table_name.c_str());
+        return false;
+      }
+      if (existing_table->num_rows() > total_output_rows) {
+        RESULT_ERROR(job_result,
+                     "Can not append to table %s since it has more rows "
+                     "(%ld) than the bulk job produces (%ld).",
+                     output_table_name.c_str(), existing_table->num_rows(),
+                     total_output_rows);
+        return false;
+      }
+    }
 
     std::vector<i64> partition_boundaries;
-    if (slice_input_rows.size() == 0) {
+    if (existing_table != nullptr) {
+      appends_to_table[i] = true;
+      // Existing items keep their rows and new tasks start after them
+      partition_boundaries.push_back(0);
+      for (i64 r : existing_table->end_rows()) {
+        partition_boundaries.push_back(r);
+      }
+      for (i64 r = existing_table->num_rows() + io_packet_size;
+           r < total_output_rows; r += io_packet_size) {
+        partition_boundaries.push_back(r);
+      }
+      if (partition_boundaries.back() != total_output_rows) {
+        partition_boundaries.push_back(total_output_rows);
+      }
+    } else if (slice_input_rows.size() == 0) {
       // No slices, so we can split as desired. Currently use IO packet size
       // since it is the smallest granularity we can specify
       for (i64 r = 0; r < total_output_rows; r += io_packet_size) {
@@ -1025,42 +1364,88 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
           partition_boundaries);
       if (!job_result->success()) {
         // No database changes made at this point, so just return
-        finished_fn();
         return false;
       }
     }
     assert(partition_boundaries.back() == total_output_rows);
-    job_tasks_.emplace_back();
-    auto& tasks = job_tasks_.back();
-    for (i64 pi = 0; pi < partition_boundaries.size() - 1; ++pi) {
-      tasks.emplace_back();
-      auto& task_rows = tasks.back();
-
-      i64 s = partition_boundaries[pi];
-      i64 e = partition_boundaries[pi + 1];
-      for (i64 r = s; r < e; ++r) {
-        task_rows.push_back(r);
-      }
-      total_tasks_temp++;
-    }
+    bulk_job.job_tasks.add_job(partition_boundaries);
+    i64 first_task =
+        existing_table != nullptr ? existing_table->end_rows().size() : 0;
+    bulk_job.first_task_per_job.push_back(first_task);
+    bulk_job.tasks_used_per_job.push_back(first_task);
+    bulk_job.total_tasks += bulk_job.job_tasks.num_tasks(i) - first_task;
   }
-  total_tasks_ = total_tasks_temp;
 
   if (!job_result->success()) {
     // No database changes made at this point, so just return
-    finished_fn();
     return false;
   }
 
   // Write out database metadata so that workers can read it
-  write_bulk_job_metadata(storage_, BulkJobMetadata(job_descriptor));
+  write_bulk_job_metadata(storage_, BulkJobMetadata(bulk_job.job_descriptor));
 
-  std::vector<i32> job_uncommitted_tables_;
   {
     for (i64 job_idx = 0; job_idx < job_params->jobs_size(); ++job_idx) {
       auto& job = job_params->jobs(job_idx);
-      i32 table_id = meta_.add_table(job.output_table_name());
-      job_to_table_id_[job_idx] = table_id;
+      if (appends_to_table[job_idx]) {
+        // New items go after the existing ones and the table stays readable
+        // with its current rows until the bulk job commits
+        i32 table_id = meta_.get_table_id(job.output_table_name());
+        bulk_job.job_to_table_id[job_idx] = table_id;
+        proto::TableDescriptor table_desc =
+            table_metas_->at(table_id).get_descriptor();
+        table_desc.set_timestamp(
+            std::chrono::duration_cast<std::chrono::seconds>(
+                now().time_since_epoch())
+                .count());
+        i64 total_rows = table_desc.end_rows_size() > 0
+                             ? table_desc.end_rows(table_desc.end_rows_size() - 1)
+                             : 0;
+        for (i64 task_id = table_desc.end_rows_size();
+             task_id < bulk_job.job_tasks.num_tasks(job_idx); ++task_id) {
+          total_rows += bulk_job.job_tasks.num_task_rows(job_idx, task_id);
+          table_desc.add_end_rows(total_rows);
+        }
+        table_desc.set_job_id(bulk_job_id);
+        bulk_job.appended_tables.push_back(table_desc);
+        continue;
+      }
+      i32 table_id;
+      if (job_params->resume()) {
+        // The output tables were created when the bulk job first ran
+        const std::string& table_name = job.output_table_name();
+        table_id =
+            meta_.has_table(table_name) ? meta_.get_table_id(table_name) : -1;
+        if (table_id == -1 || meta_.table_is_committed(table_id) ||
+            table_metas_->at(table_id).get_descriptor().job_id() !=
+                bulk_job_id) {
+          RESULT_ERROR(job_result,
+                       "Can not resume bulk job %s since its output table %s "
+                       "is missing or was not created by it.",
+                       job_params->job_name().c_str(), table_name.c_str());
+          return false;
+        }
+        // Tasks must split the rows as they did when the bulk job first ran
+        // so the checkpointed task indices refer to the same rows
+        std::vector<i64> end_rows = table_metas_->at(table_id).end_rows();
+        bool same_tasks =
+            end_rows.size() == bulk_job.job_tasks.num_tasks(job_idx);
+        i64 total_rows = 0;
+        for (i64 t = 0; same_tasks && t < end_rows.size(); ++t) {
+          total_rows += bulk_job.job_tasks.num_task_rows(job_idx, t);
+          same_tasks = end_rows[t] == total_rows;
+        }
+        if (!same_tasks) {
+          RESULT_ERROR(job_result,
+                       "Can not resume bulk job %s since its tasks differ from "
+                       "the ones it was started with.",
+                       job_params->job_name().c_str());
+          return false;
+        }
+      } else {
+        table_id = meta_.add_table(job.output_table_name());
+      }
+      bulk_job.job_to_table_id[job_idx] = table_id;
       proto::TableDescriptor table_desc;
       table_desc.set_id(table_id);
       table_desc.set_name(job.output_table_name());
@@ -1076,9 +1461,9 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
 
       i64 total_rows = 0;
       std::vector<i64> end_rows;
-      auto& tasks = job_tasks_.at(job_idx);
-      for (i64 task_id = 0; task_id < tasks.size(); ++task_id) {
-        i64 task_rows = tasks.at(task_id).size();
+      for (i64 task_id = 0; task_id < bulk_job.job_tasks.num_tasks(job_idx);
+           ++task_id) {
+        i64 task_rows = bulk_job.job_tasks.num_task_rows(job_idx, task_id);
         total_rows += task_rows;
         end_rows.push_back(total_rows);
       }
@@ -1086,7 +1471,7 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
         table_desc.add_end_rows(r);
       }
       table_desc.set_job_id(bulk_job_id);
-      job_uncommitted_tables_.push_back(table_id);
+      bulk_job.uncommitted_tables.push_back(table_id);
       table_metas_->update(TableMetadata(table_desc));
     }
     // Write table metadata in parallel
@@ -1101,9 +1486,10 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
     for (i64 tid = 0; tid < num_threads; ++tid) {
       std::vector<i32> table_ids;
       i32 jobs_to_compute =
-          (job_params->jobs_size() - job_idx) / (num_threads - tid);
+          ((i32)bulk_job.uncommitted_tables.size() - job_idx) /
+          (num_threads - tid);
       for (i32 i = job_idx; i < job_idx + jobs_to_compute; ++i) {
-        table_ids.push_back(job_uncommitted_tables_[i]);
+        table_ids.push_back(bulk_job.uncommitted_tables[i]);
       }
       threads.emplace_back(write_meta, table_ids);
       job_idx += jobs_to_compute;
@@ -1114,159 +1500,180 @@ bool MasterImpl::process_job(const proto::BulkJobParameters* job_params,
   }
 
   // Setup initial task sampler
-  task_result_.set_success(true);
-  next_task_ = 0;
-  num_tasks_ = 0;
-  next_job_ = 0;
-  num_jobs_ = jobs.size();
-
-  write_database_metadata(storage_, meta_);
-
-  VLOG(1) << "Total jobs: " << num_jobs_;
-
-  // TODO(apoms): change this to support adding and removing nodes
-  //              the main change is that the workers should handle
-  //              spawning sub processes instead of appearing as
-  //              multiple logical nodes
-  for (auto kv : worker_addresses_) {
-    const std::string& address = kv.second;
-    // Strip port
-    std::vector<std::string> split_addr = split(address, ':');
-    std::string sans_port = split_addr[0];
-    if (local_totals_.count(sans_port) == 0) {
-      local_totals_[sans_port] = 0;
+  bulk_job.task_result.set_success(true);
+  bulk_job.next_job = 0;
+  bulk_job.num_jobs = jobs.size();
+  for (const auto& job : jobs) {
+    bulk_job.job_input_tables.emplace_back();
+    for (auto& ci : job.inputs()) {
+      bulk_job.job_input_tables.back().push_back(
+          meta_.get_table_id(ci.table_name()));
     }
-    local_totals_[sans_port] += 1;
   }
 
-  // Send new job command to workers
-  VLOG(1) << "Sending new job command to workers";
-  {
-    std::unique_lock<std::mutex> lk(work_mutex_);
-    std::vector<i32> worker_ids;
-    for (auto& kv : worker_active_) {
-      if (kv.second) {
-        worker_ids.push_back(kv.first);
+  if (job_params->resume()) {
+    std::vector<std::tuple<i64, i64, i32>> finished_tasks;
+    bulk_job.next_checkpoint_segment =
+        read_bulk_job_checkpoint(storage_, bulk_job_id, finished_tasks);
+    std::vector<std::set<i64>> finished_per_job(bulk_job.num_jobs);
+    for (const auto& job_task : finished_tasks) {
+      i64 job_idx = std::get<0>(job_task);
+      i64 task_idx = std::get<1>(job_task);
+      i32 attempt = std::get<2>(job_task);
+      if (job_idx < 0 || job_idx >= bulk_job.num_jobs ||
+          task_idx < bulk_job.first_task_per_job[job_idx] ||
+          task_idx >= bulk_job.job_tasks.num_tasks(job_idx)) {
+        continue;
       }
-    }
-    start_job_on_workers(worker_ids);
-    unstarted_workers_.clear();
-  }
-
-  // Ping workers every 10 seconds to make sure they are alive
-  start_worker_pinger();
-
-  // Wait for all workers to finish
-  VLOG(1) << "Waiting for workers to finish";
-
-  // Wait until all workers are done and work has been completed
-  auto all_workers_finished_start = now();
-  while (true) {
-    // Check if we have unfinished workers
-    bool all_workers_finished = true;
-    {
-      std::unique_lock<std::mutex> lk(work_mutex_);
-      for (auto& kv : unfinished_workers_) {
-        // If the worker is active and it is not finished, then
-        // we need to keep working
-        if (worker_active_[kv.first] && kv.second) {
-          all_workers_finished = false;
-          break;
-        }
+      finished_per_job[job_idx].insert(task_idx);
+      if (attempt != 0) {
+        bulk_job.committed_task_attempts[std::make_tuple(job_idx, task_idx)] =
+            attempt;
       }
     }
-    if (all_workers_finished && !finished_) {
-      // If we have unfinished work but no workers for some period of time,
-      // then fail
-      double seconds_since = std::chrono::duration_cast<std::chrono::seconds>(
-                                 now() - all_workers_finished_start)
-                                 .count();
-      if (seconds_since > db_params_.no_workers_timeout) {
-        RESULT_ERROR(job_result,
-                     "No workers but have unfinished work after %ld seconds",
-                     db_params_.no_workers_timeout);
-        finished_fn();
-        return false;
+    i64 num_finished = 0;
+    for (i64 job_idx = 0; job_idx < bulk_job.num_jobs; ++job_idx) {
+      const std::set<i64>& finished = finished_per_job[job_idx];
+      if (finished.empty()) {
+        continue;
       }
-    } else {
-      // Reset timer
-      all_workers_finished_start = now();
-    }
-    if (all_workers_finished && finished_) {
-      break;
-    }
-    // Check if we have unstarted workers and start them if so
-    {
-      std::unique_lock<std::mutex> lk(work_mutex_);
-      if (!unstarted_workers_.empty()) {
-        // Update locals
-        for (i32 wid : unstarted_workers_) {
-          const std::string& address = worker_addresses_.at(wid);
-          std::vector<std::string> split_addr = split(address, ':');
-          std::string sans_port = split_addr[0];
-          if (local_totals_.count(sans_port) == 0) {
-            local_totals_[sans_port] = 0;
-          }
-          local_totals_[sans_port] += 1;
+      // Hand out the remaining tasks like ones from failed workers, since
+      // they no longer form a contiguous range
+      i64 num_tasks = bulk_job.job_tasks.num_tasks(job_idx);
+      for (i64 t = bulk_job.first_task_per_job[job_idx]; t < num_tasks; ++t) {
+        if (finished.count(t) == 0) {
+          bulk_job.unallocated_job_tasks.emplace_back(job_idx, t);
         }
-        start_job_on_workers(unstarted_workers_);
       }
-      unstarted_workers_.clear();
+      bulk_job.first_task_per_job[job_idx] = num_tasks;
+      bulk_job.tasks_used_per_job[job_idx] += finished.size();
+      bulk_job.total_tasks_used += finished.size();
+      num_finished += finished.size();
     }
-    std::this_thread::yield();
+    VLOG(1) << "Resuming bulk job " << job_params->job_name() << " with "
+            << num_finished << " of " << bulk_job.total_tasks
+            << " tasks already finished";
   }
 
+  write_database_metadata(storage_, meta_);
+
+  VLOG(1) << "Total jobs: " << bulk_job.num_jobs;
+
+  return true;
+}
+
+void MasterImpl::finish_bulk_job(BulkJob& job) {
+  proto::Result* job_result = &job.job_result;
+  bool finished;
   {
-    std::unique_lock<std::mutex> lock(finished_mutex_);
-    finished_cv_.wait(lock, [this] { return finished_.load(); });
+    std::unique_lock<std::mutex> lk(work_mutex_);
+    finished = job.finished;
   }
+  // A bulk job which failed to set up created nothing to commit
+  if (job.started) {
+    // If we are shutting down before every task finished, then the job
+    // failed
+    if (trigger_shutdown_.raised() && !finished) {
+      job_result->set_success(false);
+    }
 
-  // If we are shutting down, then the job did not finish and we should fail
-  if (trigger_shutdown_.raised()) {
-    job_result->set_success(false);
-  }
+    if (job_result->success()) {
+      // Items saved by a retried or backup attempt of their task are named
+      // after the attempt, so readers find it in the table descriptor
+      std::map<i64, std::map<i64, i32>> item_attempts_per_table;
+      for (const auto& kv : job.committed_task_attempts) {
+        i64 table_id = job.job_to_table_id.at(std::get<0>(kv.first));
+        item_attempts_per_table[table_id][std::get<1>(kv.first)] = kv.second;
+      }
+      auto set_item_attempts = [&](proto::TableDescriptor& table_desc) {
+        auto it = item_attempts_per_table.find(table_desc.id());
+        if (it == item_attempts_per_table.end()) {
+          return false;
+        }
+        while (table_desc.item_attempts_size() <
+               table_desc.end_rows_size()) {
+          table_desc.add_item_attempts(0);
+        }
+        for (const auto& item_attempt : it->second) {
+          table_desc.set_item_attempts(item_attempt.first,
+                                       item_attempt.second);
+        }
+        return true;
+      };
+      // Commit all tables since the job was successful
+      for (i32 tid : job.uncommitted_tables) {
+        proto::TableDescriptor table_desc =
+            table_metas_->at(tid).get_descriptor();
+        if (set_item_attempts(table_desc)) {
+          TableMetadata table(table_desc);
+          write_table_metadata(storage_, table);
+          table_metas_->update(table);
+        }
+        meta_.commit_table(tid);
+      }
+      for (proto::TableDescriptor& table_desc : job.appended_tables) {
+        set_item_attempts(table_desc);
+        TableMetadata table(table_desc);
+        write_table_metadata(storage_, table);
+        table_metas_->update(table);
+      }
+      // Commit job since it was successful
+      meta_.commit_bulk_job(job.job_descriptor.id());
+    }
+    write_database_metadata(storage_, meta_);
+    if (job_result->success()) {
+      // The committed tables supersede the checkpoint log
+      delete_bulk_job_checkpoint(storage_, job.job_descriptor.id(),
+                                 job.next_checkpoint_segment);
+    } else {
+      write_checkpoint(job);
+    }
 
-  if (job_result->success()) {
-    // Commit all tables since the job was successful
-    for (i32 tid : job_uncommitted_tables_) {
-      meta_.commit_table(tid);
+    if (job_result->success() && db_params_.memoized_cache_bytes > 0) {
+      evict_memoized_tables();
     }
-    // Commit job since it was successful
-    meta_.commit_bulk_job(bulk_job_id);
-  }
-  write_database_metadata(storage_, meta_);
 
-  if (!task_result_.success()) {
-    job_result->CopyFrom(task_result_);
-  } else {
-    assert(next_job_ == num_jobs_);
-  }
+    if (!job.task_result.success()) {
+      job_result->CopyFrom(job.task_result);
+    } else if (job_result->success()) {
+      assert(job.next_job == job.num_jobs);
+    }
 
-  std::fflush(NULL);
-  sync();
+    std::fflush(NULL);
+    sync();
 
-  // No need to check status of workers anymore
-  stop_worker_pinger();
+    // Update job metadata with new # of nodes
+    {
+      std::unique_lock<std::mutex> lk(work_mutex_);
+      job.job_descriptor.set_num_nodes(workers_.size());
+    }
+    write_bulk_job_metadata(storage_, BulkJobMetadata(job.job_descriptor));
+  }
 
-  // Update job metadata with new # of nodes
+  std::string name = job.name;
   {
     std::unique_lock<std::mutex> lk(work_mutex_);
-    job_descriptor.set_num_nodes(workers_.size());
+    if (finished_bulk_jobs_.count(name) == 0) {
+      finished_bulk_job_names_.push_back(name);
+      while (finished_bulk_job_names_.size() > MAX_FINISHED_BULK_JOBS) {
+        finished_bulk_jobs_.erase(finished_bulk_job_names_.front());
+        finished_bulk_job_names_.pop_front();
+      }
+    }
+    finished_bulk_jobs_[name] = *job_result;
+    job_result_.CopyFrom(*job_result);
+    bulk_jobs_.erase(job.sequence);
+    work_state_changed();
   }
-  write_bulk_job_metadata(storage_, BulkJobMetadata(job_descriptor));
 
-  finished_fn();
-
-  VLOG(1) << "Master finished job";
-
-  return true;
+  VLOG(1) << "Master finished bulk job " << name;
 }
 
 void MasterImpl::start_worker_pinger() {
   VLOG(1) << "Starting worker pinger";
   pinger_active_ = true;
   pinger_thread_ = std::thread([this]() {
-    while (!finished_ && pinger_active_) {
+    while (pinger_active_) {
       std::map<i32, proto::Worker::Stub*> ws;
       {
         std::unique_lock<std::mutex> lk(work_mutex_);
@@ -1296,18 +1703,21 @@ void MasterImpl::start_worker_pinger() {
             LOG(WARNING) << "Worker " << worker_id
                          << " did not respond to Ping. "
                          << "Removing worker from active list.";
+            std::unique_lock<std::mutex> lk(work_mutex_);
+            // Reported in the status of the bulk job the worker was running
+            auto it = worker_bulk_jobs_.find(worker_id);
+            if (it != worker_bulk_jobs_.end() &&
+                bulk_jobs_.count(it->second) > 0) {
+              bulk_jobs_.at(it->second)->num_failed_workers++;
+            }
             remove_worker(worker_id);
-            num_failed_workers_++;
           }
         } else {
           pinger_number_of_failed_pings_[worker_id] = 0;
         }
       }
-      // FIXME(apoms): this sleep is unfortunate because it means a
-      //               job must take at least this long. A solution
-      //               would be to have this wait on a cv so it could
-      //               be woken up early.
-      std::this_thread::sleep_for(std::chrono::seconds(5));
+      // Woken up early when the master shuts down
+      trigger_shutdown_.wait_for(5000);
     }
   });
 }
@@ -1319,9 +1729,11 @@ void MasterImpl::stop_worker_pinger() {
   }
 }
 
-void MasterImpl::start_job_on_workers(const std::vector<i32>& worker_ids) {
+void MasterImpl::start_job_on_workers(BulkJob& job,
+                                      const std::vector<i32>& worker_ids) {
   proto::BulkJobParameters w_job_params;
-  w_job_params.MergeFrom(job_params_);
+  w_job_params.MergeFrom(job.job_params);
+  w_job_params.set_bulk_job_sequence(job.sequence);
 
   grpc::CompletionQueue cq;
   std::map<i32, std::unique_ptr<grpc::ClientContext>> client_contexts;
@@ -1329,30 +1741,54 @@ void MasterImpl::start_job_on_workers(const std::vector<i32>& worker_ids) {
   std::map<i32, std::unique_ptr<proto::Result>> replies;
   std::map<i32, std::unique_ptr<grpc::ClientAsyncResponseReader<proto::Result>>>
       rpcs;
-  for (i32 worker_id : worker_ids) {
-    const std::string& address = worker_addresses_.at(worker_id);
-    auto& worker = workers_.at(worker_id);
-    std::vector<std::string> split_addr = split(address, ':');
-    std::string sans_port = split_addr[0];
-    w_job_params.set_local_id(local_ids_[sans_port]);
-    w_job_params.set_local_total(local_totals_[sans_port]);
-    local_ids_[sans_port] += 1;
-    client_contexts[worker_id] =
-        std::unique_ptr<grpc::ClientContext>(new grpc::ClientContext);
-    statuses[worker_id] = std::unique_ptr<grpc::Status>(new grpc::Status);
-    replies[worker_id] = std::unique_ptr<proto::Result>(new proto::Result);
-    rpcs[worker_id] = worker->AsyncNewJob(client_contexts[worker_id].get(),
-                                          w_job_params, &cq);
-    rpcs[worker_id]->Finish(replies[worker_id].get(), statuses[worker_id].get(),
-                            (void*)worker_id);
-    worker_histories_[worker_id].start_time = now();
-    worker_histories_[worker_id].tasks_assigned = 0;
-    worker_histories_[worker_id].tasks_retired = 0;
-    unfinished_workers_[worker_id] = true;
-    VLOG(2) << "Sent NewJob command to worker " << worker_id;
-  }
-
-  for (i64 i = 0; i < worker_ids.size(); ++i) {
+  {
+    std::unique_lock<std::mutex> lk(work_mutex_);
+    for (i32 worker_id : worker_ids) {
+      // The worker may have left since it was picked
+      if (!worker_active_.at(worker_id)) {
+        continue;
+      }
+      const std::string& address = worker_addresses_.at(worker_id);
+      auto& worker = workers_.at(worker_id);
+      std::vector<std::string> split_addr = split(address, ':');
+      std::string sans_port = split_addr[0];
+      // Take the lowest local id not used by another active worker on the
+      // host, so ids freed by workers that left are reused
+      std::set<i32> taken_local_ids;
+      for (auto& kv : worker_local_ids_) {
+        if (kv.first != worker_id && worker_active_[kv.first] &&
+            split(worker_addresses_.at(kv.first), ':')[0] == sans_port) {
+          taken_local_ids.insert(kv.second);
+        }
+      }
+      i32 local_id = 0;
+      while (taken_local_ids.count(local_id) > 0) {
+        local_id++;
+      }
+      worker_local_ids_[worker_id] = local_id;
+      w_job_params.set_local_id(local_id);
+      w_job_params.set_local_total(
+          std::max(local_totals_[sans_port], local_id + 1));
+      client_contexts[worker_id] =
+          std::unique_ptr<grpc::ClientContext>(new grpc::ClientContext);
+      statuses[worker_id] = std::unique_ptr<grpc::Status>(new grpc::Status);
+      replies[worker_id] = std::unique_ptr<proto::Result>(new proto::Result);
+      rpcs[worker_id] = worker->AsyncNewJob(client_contexts[worker_id].get(),
+                                            w_job_params, &cq);
+      rpcs[worker_id]->Finish(replies[worker_id].get(),
+                              statuses[worker_id].get(), (void*)worker_id);
+      job.worker_histories[worker_id].start_time = now();
+      job.worker_histories[worker_id].tasks_assigned = 0;
+      job.worker_histories[worker_id].tasks_retired = 0;
+      job.worker_histories[worker_id].tasks_speculated = 0;
+      worker_bulk_jobs_[worker_id] = job.sequence;
+      VLOG(2) << "Sent NewJob command to worker " << worker_id;
+    }
+  }
+
+  // A worker still tearing down the pipeline of its last bulk job replies
+  // once that is done, so the replies are awaited without holding the lock
+  for (i64 i = 0; i < rpcs.size(); ++i) {
     void* got_tag;
     bool ok = false;
     auto status = (cq.Next(&got_tag, &ok));
@@ -1362,24 +1798,43 @@ void MasterImpl::start_job_on_workers(const std::vector<i32>& worker_ids) {
     i64 worker_id = (i64)got_tag;
     VLOG(2) << "Worker " << worker_id << " NewJob returned.";
 
+    std::unique_lock<std::mutex> lk(work_mutex_);
     if (worker_active_[worker_id] && !replies[worker_id]->success()) {
       LOG(WARNING) << "Worker " << worker_id << " ("
                    << worker_addresses_.at(worker_id) << ") "
                    << "returned error: " << replies[worker_id]->msg();
+      // The worker is not running the bulk job, so the job processor picks
+      // one for it again on its next pass
+      auto it = worker_bulk_jobs_.find(worker_id);
+      if (it != worker_bulk_jobs_.end() && it->second == job.sequence) {
+        worker_bulk_jobs_.erase(it);
+      }
     }
   }
   cq.Shutdown();
 }
 
-void MasterImpl::stop_job_on_worker(i32 worker_id) {
+void MasterImpl::stop_job_on_worker(BulkJob& job, i32 worker_id) {
   // Place workers active tasks back into the unallocated task samples
-  if (active_job_tasks_.count(worker_id) > 0) {
+  if (job.active_job_tasks.count(worker_id) > 0) {
     // Place workers active tasks back into the unallocated task samples
     VLOG(1) << "Reassigning worker " << worker_id << "'s "
-            << active_job_tasks_.at(worker_id).size() << " task samples.";
+            << job.active_job_tasks.at(worker_id).size() << " task samples.";
     for (const std::tuple<i64, i64>& worker_job_task :
-         active_job_tasks_.at(worker_id)) {
-      unallocated_job_tasks_.push_back(worker_job_task);
+         job.active_job_tasks.at(worker_id)) {
+      // If a backup copy of the task is still running elsewhere, it does not
+      // need to be reassigned
+      auto attempts_it = job.task_attempts.find(worker_job_task);
+      if (attempts_it != job.task_attempts.end()) {
+        attempts_it->second.erase(worker_id);
+        if (!attempts_it->second.empty()) {
+          continue;
+        }
+        job.task_attempts.erase(attempts_it);
+      }
+      job.unallocated_job_tasks.push_back(worker_job_task);
+      // The failed attempt may have saved some of its outputs
+      job.task_next_attempt.emplace(worker_job_task, 1);
 
       // The worker failure may be due to a bad task. We track number of times
       // a task has failed to detect a bad task and remove it from this bulk
@@ -1387,63 +1842,398 @@ void MasterImpl::stop_job_on_worker(i32 worker_id) {
       i64 job_id = std::get<0>(worker_job_task);
       i64 task_id = std::get<1>(worker_job_task);
 
-      i64 num_failures = ++job_tasks_num_failures_[job_id][task_id];
+      i64 num_failures = ++job.job_tasks_num_failures[job_id][task_id];
       const i64 TOTAL_FAILURES_BEFORE_REMOVAL = 5;
       if (num_failures >= TOTAL_FAILURES_BEFORE_REMOVAL) {
-        blacklist_job(job_id);
+        blacklist_job(job, job_id);
       }
     }
-    active_job_tasks_.erase(worker_id);
+    job.active_job_tasks.erase(worker_id);
   }
+  job.cancelled_worker_tasks.erase(worker_id);
 
-  worker_histories_[worker_id].end_time = now();
-  unfinished_workers_[worker_id] = false;
+  job.worker_histories[worker_id].end_time = now();
+  worker_bulk_jobs_.erase(worker_id);
 }
 
 void MasterImpl::remove_worker(i32 node_id) {
   assert(workers_.count(node_id) > 0);
 
   std::string worker_address = worker_addresses_.at(node_id);
+  bool was_active = worker_active_[node_id];
   // Remove worker from list
   worker_active_[node_id] = false;
 
-  {
-    std::unique_lock<std::mutex> lock(active_mutex_);
-    if (active_bulk_job_) {
-      stop_job_on_worker(node_id);
+  auto it = worker_bulk_jobs_.find(node_id);
+  if (it != worker_bulk_jobs_.end()) {
+    auto job_it = bulk_jobs_.find(it->second);
+    if (job_it != bulk_jobs_.end()) {
+      stop_job_on_worker(*job_it->second, node_id);
     }
+    worker_bulk_jobs_.erase(node_id);
   }
+  worker_next_bulk_jobs_.erase(node_id);
+  worker_recent_tables_.erase(node_id);
 
   // Update locals
-  /*std::vector<std::string> split_addr = split(worker_address, ':');
-  std::string sans_port = split_addr[0];
-  assert(local_totals_.count(sans_port) > 0);
-  local_totals_[sans_port] -= 1;
-  local_ids_[sans_port] -= 1;*/
+  if (was_active) {
+    std::vector<std::string> split_addr = split(worker_address, ':');
+    std::string sans_port = split_addr[0];
+    if (local_totals_[sans_port] > 0) {
+      local_totals_[sans_port] -= 1;
+    }
+  }
+  worker_local_ids_.erase(node_id);
+  // Its tasks may have been handed back for other workers to take
+  work_state_changed();
 
   VLOG(1) << "Removing worker " << node_id << " (" << worker_address << ").";
 }
 
-void MasterImpl::blacklist_job(i64 job_id) {
-  // All tasks in unallocated_job_tasks_ with this job id will be thrown away
-  blacklisted_jobs_.insert(job_id);
+void MasterImpl::evict_memoized_tables() {
+  std::unique_lock<std::mutex> lk(work_mutex_);
+  // Running bulk jobs have already spliced in the tables they read
+  std::set<std::string> in_use;
+  for (auto& kv : bulk_jobs_) {
+    const BulkJob& job = *kv.second;
+    if (!job.started || job.finished) {
+      continue;
+    }
+    for (const auto& j : job.job_params.jobs()) {
+      for (const auto& ci : j.inputs()) {
+        in_use.insert(ci.table_name());
+      }
+    }
+  }
+
+  // (last used, name) of every memoized table
+  std::vector<std::tuple<i64, std::string>> memoized;
+  i64 total_bytes = 0;
+  for (const std::string& table_name : meta_.table_names()) {
+    if (table_name.compare(0, MEMOIZED_TABLE_PREFIX.size(),
+                           MEMOIZED_TABLE_PREFIX) != 0) {
+      continue;
+    }
+    i32 table_id = meta_.get_table_id(table_name);
+    if (!meta_.table_is_committed(table_id)) {
+      continue;
+    }
+    const TableMetadata& table = table_metas_->at(table_id);
+    if (memoized_table_bytes_.count(table_name) == 0) {
+      memoized_table_bytes_[table_name] = table_data_bytes(storage_, table);
+    }
+    total_bytes += memoized_table_bytes_.at(table_name);
+    i64 last_used = table.get_descriptor().timestamp();
+    if (memoized_last_used_.count(table_name) > 0) {
+      last_used = std::max(last_used, memoized_last_used_.at(table_name));
+    }
+    memoized.emplace_back(last_used, table_name);
+  }
+  std::sort(memoized.begin(), memoized.end());
+
+  bool removed = false;
+  for (const auto& entry : memoized) {
+    if (total_bytes <= db_params_.memoized_cache_bytes) {
+      break;
+    }
+    const std::string& table_name = std::get<1>(entry);
+    if (in_use.count(table_name) > 0) {
+      continue;
+    }
+    i32 table_id = meta_.get_table_id(table_name);
+    VLOG(1) << "Evicting memoized table " << table_name;
+    delete_table_data(storage_, table_metas_->at(table_id));
+    meta_.remove_table(table_id);
+    total_bytes -= memoized_table_bytes_.at(table_name);
+    memoized_table_bytes_.erase(table_name);
+    memoized_last_used_.erase(table_name);
+    removed = true;
+  }
+  if (removed) {
+    write_database_metadata(storage_, meta_);
+  }
+}
+
+void MasterImpl::write_checkpoint(BulkJob& job) {
+  std::vector<std::tuple<i64, i64, i32>> finished_tasks;
+  i32 segment;
+  {
+    std::unique_lock<std::mutex> lk(work_mutex_);
+    if (job.pending_checkpoint_tasks.empty()) {
+      return;
+    }
+    std::swap(finished_tasks, job.pending_checkpoint_tasks);
+    segment = job.next_checkpoint_segment++;
+  }
+  write_bulk_job_checkpoint(storage_, job.job_descriptor.id(), segment,
+                            finished_tasks);
+}
+
+bool MasterImpl::next_task_for_worker(BulkJob& job, i64 worker_id,
+                                      std::tuple<i64, i64>& job_task) {
+  // Tasks from failed workers go first. Prefer ones on tables this worker has
+  // already loaded.
+  if (!job.unallocated_job_tasks.empty()) {
+    auto it = std::find_if(
+        job.unallocated_job_tasks.rbegin(), job.unallocated_job_tasks.rend(),
+        [&](const std::tuple<i64, i64>& t) {
+          return worker_has_loaded_job_tables(job, worker_id, std::get<0>(t));
+        });
+    if (it == job.unallocated_job_tasks.rend()) {
+      it = job.unallocated_job_tasks.rbegin();
+    }
+    job_task = *it;
+    job.unallocated_job_tasks.erase(std::next(it).base());
+    return true;
+  }
+
+  auto take_front = [&](i64 job_idx) {
+    OpenJob& open_job = job.open_jobs.at(job_idx);
+    job_task = std::make_tuple(job_idx, open_job.next_task++);
+    if (open_job.next_task == open_job.end_task) {
+      job.open_jobs.erase(job_idx);
+    }
+  };
+  auto take_back = [&](i64 job_idx) {
+    OpenJob& open_job = job.open_jobs.at(job_idx);
+    job_task = std::make_tuple(job_idx, --open_job.end_task);
+    if (open_job.next_task == open_job.end_task) {
+      job.open_jobs.erase(job_idx);
+    }
+  };
+
+  // Continue with the item following the one the worker loaded last
+  if (job.worker_last_task.count(worker_id) > 0) {
+    i64 last_job, last_task;
+    std::tie(last_job, last_task) = job.worker_last_task.at(worker_id);
+    auto it = job.open_jobs.find(last_job);
+    if (it != job.open_jobs.end() && it->second.next_task == last_task + 1) {
+      take_front(last_job);
+      return true;
+    }
+  }
+
+  // Then any job on a table the worker has recently loaded
+  for (auto& kv : job.open_jobs) {
+    if (worker_has_loaded_job_tables(job, worker_id, kv.first)) {
+      take_back(kv.first);
+      return true;
+    }
+  }
+
+  // Start a new job so the worker gets its own run of consecutive items
+  while (job.next_job < job.num_jobs && job.task_result.success()) {
+    i64 job_idx = job.next_job++;
+    i64 num_tasks = job.job_tasks.num_tasks(job_idx);
+    VLOG(1) << "Tasks left: " << job.total_tasks - job.total_tasks_used;
+    i64 first_task = job.first_task_per_job.at(job_idx);
+    if (num_tasks > first_task) {
+      job.open_jobs[job_idx] = OpenJob{first_task, num_tasks};
+      take_front(job_idx);
+      return true;
+    }
+  }
+
+  // Otherwise help with the job that has the most tasks left
+  auto largest = job.open_jobs.end();
+  for (auto it = job.open_jobs.begin(); it != job.open_jobs.end(); ++it) {
+    if (largest == job.open_jobs.end() ||
+        it->second.end_task - it->second.next_task >
+            largest->second.end_task - largest->second.next_task) {
+      largest = it;
+    }
+  }
+  if (largest != job.open_jobs.end()) {
+    take_back(largest->first);
+    return true;
+  }
+  return false;
+}
+
+bool MasterImpl::worker_has_loaded_job_tables(const BulkJob& job,
+                                              i64 worker_id, i64 job_idx) {
+  auto it = worker_recent_tables_.find(worker_id);
+  if (it == worker_recent_tables_.end()) {
+    return false;
+  }
+  const std::deque<i32>& recent_tables = it->second;
+  for (i32 table_id : job.job_input_tables.at(job_idx)) {
+    if (std::find(recent_tables.begin(), recent_tables.end(), table_id) !=
+        recent_tables.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MasterImpl::find_straggler_task(BulkJob& job, i64 worker_id,
+                                     std::tuple<i64, i64>& job_task) {
+  // A task is a straggler once it has been running this many times longer
+  // than the median task
+  const f64 STRAGGLER_SLOWDOWN = 2.0;
+  // Number of finished tasks needed before the median is meaningful
+  const size_t MIN_TASKS_FOR_SPECULATION = 8;
+  // Never back up tasks which have been running for less than this
+  const f64 MIN_STRAGGLER_SECONDS = 10.0;
+
+  if (job.completed_task_seconds.size() < MIN_TASKS_FOR_SPECULATION) {
+    return false;
+  }
+  std::vector<f64> durations(job.completed_task_seconds);
+  auto middle = durations.begin() + durations.size() / 2;
+  std::nth_element(durations.begin(), middle, durations.end());
+  f64 threshold = std::max(*middle * STRAGGLER_SLOWDOWN, MIN_STRAGGLER_SECONDS);
+
+  // Back up the task which has been running the longest
+  auto current_time = now();
+  f64 longest = threshold;
+  bool found = false;
+  for (auto& kv : job.task_attempts) {
+    const auto& attempts = kv.second;
+    // Only a single backup copy per task, and never on the same worker
+    if (attempts.size() != 1 || attempts.count(worker_id) > 0 ||
+        job.blacklisted_jobs.count(std::get<0>(kv.first)) > 0) {
+      continue;
+    }
+    f64 elapsed = std::chrono::duration<f64>(
+                      current_time - attempts.begin()->second).count();
+    if (elapsed > longest) {
+      longest = elapsed;
+      job_task = kv.first;
+      found = true;
+    }
+  }
+  if (found) {
+    VLOG(1) << "Speculatively running task (" << std::get<0>(job_task) << ", "
+            << std::get<1>(job_task) << ") on worker " << worker_id
+            << " after " << longest << "s (median " << *middle << "s)";
+  }
+  return found;
+}
+
+void MasterImpl::take_cancelled_tasks(
+    BulkJob& job, i64 worker_id,
+    google::protobuf::RepeatedPtrField<proto::JobTask>* cancelled_tasks) {
+  auto it = job.cancelled_worker_tasks.find(worker_id);
+  if (it == job.cancelled_worker_tasks.end()) {
+    return;
+  }
+  for (const std::tuple<i64, i64>& job_task : it->second) {
+    proto::JobTask* task = cancelled_tasks->Add();
+    task->set_job_index(std::get<0>(job_task));
+    task->set_task_index(std::get<1>(job_task));
+  }
+}
+
+void MasterImpl::blacklist_job(BulkJob& job, i64 job_id) {
+  // All tasks in unallocated_job_tasks with this job id will be thrown away
+  job.blacklisted_jobs.insert(job_id);
+  // Stop handing out the tasks of this job which were never started
+  job.open_jobs.erase(job_id);
   // Add number of remaining tasks to tasks used
   i64 num_tasks_left_in_job =
-      job_tasks_[job_id].size() - tasks_used_per_job_[job_id];
-  total_tasks_used_ += num_tasks_left_in_job;
+      job.job_tasks.num_tasks(job_id) - job.tasks_used_per_job[job_id];
+  job.total_tasks_used += num_tasks_left_in_job;
 
   VLOG(1) << "Blacklisted job " << job_id;
 
   // Check if blacklisting job finished the bulk job
-  if (total_tasks_used_ == total_tasks_) {
-    VLOG(1) << "Master blacklisting job triggered finished!";
-    assert(next_job_ == num_jobs_);
-    {
-      std::unique_lock<std::mutex> lock(finished_mutex_);
-      finished_ = true;
+  check_bulk_job_finished(job);
+}
+
+void MasterImpl::check_bulk_job_finished(BulkJob& job) {
+  if (job.finished || job.total_tasks_used != job.total_tasks) {
+    return;
+  }
+  VLOG(1) << "Master finished all tasks of bulk job " << job.name;
+  // Jobs whose tasks all finished before the bulk job was resumed are never
+  // opened
+  job.next_job = job.num_jobs;
+  job.finished = true;
+}
+
+MasterImpl::BulkJob* MasterImpl::running_bulk_job(i64 sequence) {
+  auto it = bulk_jobs_.find(sequence);
+  if (it == bulk_jobs_.end() || !it->second->started ||
+      it->second->finished) {
+    return nullptr;
+  }
+  return it->second.get();
+}
+
+i64 MasterImpl::num_bulk_job_workers(const BulkJob& job,
+                                     i64 excluded_worker_id) {
+  i64 num_workers = 0;
+  for (auto& kv : worker_active_) {
+    i32 worker_id = kv.first;
+    if (!kv.second || worker_id == excluded_worker_id) {
+      continue;
+    }
+    // A worker leaving its bulk job counts towards the one it moves to
+    auto next_it = worker_next_bulk_jobs_.find(worker_id);
+    auto it = worker_bulk_jobs_.find(worker_id);
+    if (next_it != worker_next_bulk_jobs_.end()) {
+      num_workers += next_it->second == job.sequence;
+    } else if (it != worker_bulk_jobs_.end()) {
+      num_workers += it->second == job.sequence;
+    }
+  }
+  return num_workers;
+}
+
+i64 MasterImpl::num_unassigned_tasks(const BulkJob& job) {
+  // Every task a worker is running has an entry in task_attempts
+  return std::max(job.total_tasks - job.total_tasks_used -
+                      (i64)job.task_attempts.size(),
+                  (i64)0);
+}
+
+MasterImpl::BulkJob* MasterImpl::pick_bulk_job_for_worker(i64 worker_id,
+                                                          BulkJob* current) {
+  BulkJob* best = nullptr;
+  i64 best_workers = 0;
+  for (auto& kv : bulk_jobs_) {
+    BulkJob* job = kv.second.get();
+    if (!job->started || job->finished) {
+      continue;
+    }
+    // A worker only moves to another bulk job if it has more tasks left than
+    // that job's workers are about to take, so a single task handed back by
+    // a failed worker does not pull every worker over
+    i64 num_workers = num_bulk_job_workers(*job, worker_id);
+    i64 num_tasks = num_unassigned_tasks(*job);
+    if (num_tasks == 0 || (job != current && num_tasks <= num_workers)) {
+      continue;
+    }
+    // Highest priority first, then the fewest other workers. Ties keep the
+    // worker where it is and otherwise go to the oldest bulk job, so a
+    // worker only moves if that evens out the workers per bulk job.
+    if (best == nullptr || job->priority > best->priority ||
+        (job->priority == best->priority &&
+         (num_workers < best_workers ||
+          (num_workers == best_workers && job == current)))) {
+      best = job;
+      best_workers = num_workers;
     }
-    finished_cv_.notify_all();
   }
+  if (best != nullptr || current != nullptr) {
+    // Without tasks to hand out anywhere, a worker stays to back up
+    // stragglers and take tasks handed back by failed workers
+    return best != nullptr ? best : current;
+  }
+  for (auto& kv : bulk_jobs_) {
+    BulkJob* job = kv.second.get();
+    if (job->started && !job->finished &&
+        (best == nullptr || job->priority > best->priority)) {
+      best = job;
+    }
+  }
+  return best;
+}
+
+void MasterImpl::work_state_changed() {
+  work_state_version_++;
+  work_state_cv_.notify_all();
 }
 
 }  // namespace internal
@@ -19,6 +19,7 @@
 #include "scanner/engine/rpc.grpc.pb.h"
 #include "scanner/engine/runtime.h"
 #include "scanner/engine/sampler.h"
+#include "scanner/engine/task_table.h"
 #include "scanner/util/util.h"
 
 #include <mutex>
@@ -92,16 +93,20 @@ class MasterImpl final : public proto::Master::Service {
       proto::Result* result);
 
   grpc::Status GetJobStatus(grpc::ServerContext* context,
-                            const proto::Empty* empty,
+                            const proto::GetJobStatusParams* params,
                             proto::JobStatus* job_status);
 
+  grpc::Status GetMemoizedTables(grpc::ServerContext* context,
+                                 const proto::BulkJobParameters* job_params,
+                                 proto::MemoizedTables* tables);
+
   grpc::Status NextWork(grpc::ServerContext* context,
                         const proto::NodeInfo* node_info,
                         proto::NewWork* new_work);
 
   grpc::Status FinishedWork(grpc::ServerContext* context,
                             const proto::FinishedWorkParameters* params,
-                            proto::Empty* empty);
+                            proto::FinishedWorkReply* reply);
 
   grpc::Status FinishedJob(grpc::ServerContext* context,
                            const proto::FinishedJobParams* params,
@@ -130,20 +135,80 @@ class MasterImpl final : public proto::Master::Service {
 
   void stop_job_processor();
 
-  bool process_job(const proto::BulkJobParameters* job_params,
-                   proto::Result* job_result);
+  // Task state of a submitted bulk job. Bulk jobs run side by side and every
+  // worker runs the pipeline of one of them at a time.
+  struct BulkJob;
+
+  // Validate a bulk job and create its output tables and tasks. Memoized Ops
+  // whose outputs are cached are spliced out of its parameters.
+  bool setup_job(BulkJob& job);
+
+  // Commit the outputs of a bulk job whose workers have all stopped, or save
+  // its checkpoint if it failed, and record its result
+  void finish_bulk_job(BulkJob& job);
+
+  // Delete the least recently used memoized tables until they fit in
+  // memoized_cache_bytes
+  void evict_memoized_tables();
+
+  // Append the tasks finished since the last call to the checkpoint log of
+  // the bulk job
+  void write_checkpoint(BulkJob& job);
 
   void start_worker_pinger();
 
   void stop_worker_pinger();
 
-  void start_job_on_workers(const std::vector<i32>& worker_ids);
+  void start_job_on_workers(BulkJob& job, const std::vector<i32>& worker_ids);
 
-  void stop_job_on_worker(i32 node_id);
+  void stop_job_on_worker(BulkJob& job, i32 node_id);
 
   void remove_worker(i32 node_id);
 
-  void blacklist_job(i64 job_id);
+  void blacklist_job(BulkJob& job, i64 job_id);
+
+  // Mark a bulk job as having no tasks left once all of them are used up
+  void check_bulk_job_finished(BulkJob& job);
+
+  // Wakes threads waiting on work_state_cv_. Expects work_mutex_ to be held.
+  void work_state_changed();
+
+  // The set up bulk job with this sequence number whose tasks are not all
+  // finished, or nullptr. Expects work_mutex_ to be held.
+  BulkJob* running_bulk_job(i64 sequence);
+
+  // Active workers running or switching to the bulk job. Expects work_mutex_
+  // to be held.
+  i64 num_bulk_job_workers(const BulkJob& job, i64 excluded_worker_id = -1);
+
+  // Tasks of the bulk job which are neither finished nor running
+  i64 num_unassigned_tasks(const BulkJob& job);
+
+  // Pick the bulk job worker_id should run tasks from: the one with the
+  // highest priority which has tasks to hand out, and among those the one
+  // with the fewest workers. The worker stays on current unless another bulk
+  // job needs it more. Expects work_mutex_ to be held.
+  BulkJob* pick_bulk_job_for_worker(i64 worker_id, BulkJob* current);
+
+  // Pick the next task of the bulk job for worker_id, preferring tasks which
+  // read the items and tables the worker has recently loaded
+  bool next_task_for_worker(BulkJob& job, i64 worker_id,
+                            std::tuple<i64, i64>& job_task);
+
+  // Whether job_idx reads a table worker_id has recently loaded
+  bool worker_has_loaded_job_tables(const BulkJob& job, i64 worker_id,
+                                    i64 job_idx);
+
+  // Pick a running task which has taken much longer than the typical task so
+  // that worker_id can run a backup copy of it
+  bool find_straggler_task(BulkJob& job, i64 worker_id,
+                           std::tuple<i64, i64>& job_task);
+
+  // Add the tasks worker_id should abandon to a reply. They are resent until
+  // the worker reports back on each of them.
+  void take_cancelled_tasks(
+      BulkJob& job, i64 worker_id,
+      google::protobuf::RepeatedPtrField<proto::JobTask>* cancelled_tasks);
 
   DatabaseParameters db_params_;
 
@@ -168,75 +233,146 @@ class MasterImpl final : public proto::Master::Service {
   std::map<i32, std::unique_ptr<proto::Worker::Stub>> workers_;
   std::map<i32, std::string> worker_addresses_;
 
-  i64 total_tasks_used_;
-  i64 total_tasks_;
-  std::vector<i64> tasks_used_per_job_;
-
-  // True if the master is executing a job
-  std::mutex active_mutex_;
-  std::condition_variable active_cv_;
-  bool active_bulk_job_ = false;
-  proto::BulkJobParameters job_params_;
-
-  // True if all work for job is done
-  std::mutex finished_mutex_;
-  std::condition_variable finished_cv_;
-  std::atomic<bool> finished_{true};
-  Result job_result_;
-
   std::thread job_processor_thread_;
   // Manages modification of all of the below structures
   std::mutex work_mutex_;
-  // Mapping from jobs to table ids
-  std::map<i64, i64> job_to_table_id_;
-  // Slice input rows for each job at each slice op
-  std::vector<std::map<i64, i64>> slice_input_rows_per_job_;
-  // Output rows for each job
-  std::vector<i64> total_output_rows_per_job_;
-  // All job task output rows
-  // Job -> Task -> task output rows
-  std::vector<std::vector<std::vector<i64>>> job_tasks_;
-  // Outstanding set of generated task samples that should be processed
-  std::deque<std::tuple<i64, i64>> unallocated_job_tasks_;
-  // The next job to use to generate tasks
-  i64 next_job_;
-  // Total number of jobs
-  i64 num_jobs_;
-  // Next sample index in the current task
-  i64 next_task_;
-  // Total samples in the current task
-  i64 num_tasks_;
-  Result task_result_;
+  // Signalled by work_state_changed() when tasks finish or are handed back,
+  // workers come or go, bulk jobs are submitted or the master shuts down.
+  // NextWork long polls and the job processor wait on it instead of polling.
+  std::condition_variable work_state_cv_;
+  i64 work_state_version_ = 0;
+
+  // Tasks [next_task, end_task) of a job which have not been handed out.
+  // The worker which opened the job takes tasks from the front while other
+  // workers take them from the back, so each worker keeps reading
+  // consecutive items of the same tables.
+  struct OpenJob {
+    i64 next_task;
+    i64 end_task;
+  };
 
-  //============================================================================
-  // Assignment of tasks to workers
-  //============================================================================
-  // Tracks tasks assigned to worker so they can be reassigned if the worker
-  // fails
-  // Worker id -> (job_id, task_id)
-  std::map<i64, std::set<std::tuple<i64, i64>>> active_job_tasks_;
-  // Tracks number of times a task has been failed so that a job can be removed
-  // if it is causing consistent failures
-  // job_id -> task_id -> num_failures
-  std::map<i64, std::map<i64, i64>> job_tasks_num_failures_;
-  // Tracks the jobs that have failed too many times and should be ignored
-  std::set<i64> blacklisted_jobs_;
   struct WorkerHistory {
     timepoint_t start_time;
     timepoint_t end_time;
     i64 tasks_assigned;
     i64 tasks_retired;
+    // Backup copies of straggling tasks run by this worker
+    i64 tasks_speculated;
+  };
+
+  struct BulkJob {
+    // Order in which the bulk job was submitted. Workers name the bulk job
+    // they run by it in NextWork, FinishedWork and FinishedJob.
+    i64 sequence;
+    std::string name;
+    i32 priority;
+    // Set once the output tables and tasks are created. Until then no worker
+    // runs the bulk job and only the fields above are read by other threads.
+    bool started = false;
+    // Set once no task is left to run or the bulk job failed. It is
+    // committed when its workers have stopped.
+    bool finished = false;
+    proto::BulkJobParameters job_params;
+    Result job_result;
+    // Descriptor and uncommitted output tables of the bulk job
+    proto::BulkJobDescriptor job_descriptor;
+    std::vector<i32> uncommitted_tables;
+    // Descriptors of the committed output tables an incremental bulk job
+    // appends to, written once the job succeeds
+    std::vector<proto::TableDescriptor> appended_tables;
+    // Mapping from jobs to table ids
+    std::map<i64, i64> job_to_table_id;
+    // Slice input rows for each job at each slice op
+    std::vector<std::map<i64, i64>> slice_input_rows_per_job;
+    // Output rows for each job
+    std::vector<i64> total_output_rows_per_job;
+    // Output rows of every task of every job
+    TaskTable job_tasks;
+    // First task of each job to compute. Incremental bulk jobs skip the tasks
+    // whose rows are already in the output table they append to.
+    std::vector<i64> first_task_per_job;
+    // Tasks which were assigned to a failed worker and must be reassigned
+    std::deque<std::tuple<i64, i64>> unallocated_job_tasks;
+    // The next job to use to generate tasks
+    i64 next_job = 0;
+    // Total number of jobs
+    i64 num_jobs = -1;
+    std::map<i64, OpenJob> open_jobs;
+    Result task_result;
+    // Job -> ids of the tables the job reads
+    std::vector<std::vector<i32>> job_input_tables;
+    i64 total_tasks_used = 0;
+    i64 total_tasks = 0;
+    std::vector<i64> tasks_used_per_job;
+    // Tracks number of times a task has been failed so that a job can be
+    // removed if it is causing consistent failures
+    // job_id -> task_id -> num_failures
+    std::map<i64, std::map<i64, i64>> job_tasks_num_failures;
+    // Tracks the jobs that have failed too many times and should be ignored
+    std::set<i64> blacklisted_jobs;
+    // Finished tasks and their committed attempts not yet written to the
+    // checkpoint log, and the segment of the log they will be written to
+    std::vector<std::tuple<i64, i64, i32>> pending_checkpoint_tasks;
+    i32 next_checkpoint_segment = 0;
+    timepoint_t last_checkpoint_time;
+    // Workers which stopped responding while running the bulk job
+    i64 num_failed_workers = 0;
+
+    // Worker id -> last task handed to the worker
+    std::map<i64, std::tuple<i64, i64>> worker_last_task;
+    // Tracks tasks assigned to worker so they can be reassigned if the worker
+    // fails
+    // Worker id -> (job_id, task_id)
+    std::map<i64, std::set<std::tuple<i64, i64>>> active_job_tasks;
+    std::map<i64, WorkerHistory> worker_histories;
+
+    // (job_id, task_id) -> worker id -> time the task was assigned to the
+    // worker for every task which has not finished yet
+    std::map<std::tuple<i64, i64>, std::map<i64, timepoint_t>> task_attempts;
+    // Seconds from assignment to completion of every finished task
+    std::vector<f64> completed_task_seconds;
+    // (job_id, task_id) -> attempt number the next assignment of the task
+    // gets. Only tasks which were reassigned or backed up are listed, since
+    // the first attempt of a task is always 0.
+    std::map<std::tuple<i64, i64>, i32> task_next_attempt;
+    // (job_id, task_id) -> attempt whose outputs were kept, for tasks where
+    // that is not the first attempt. Recorded in the output tables on commit.
+    std::map<std::tuple<i64, i64>, i32> committed_task_attempts;
+    // Worker id -> tasks the worker should abandon since another attempt of
+    // the task finished first
+    std::map<i64, std::set<std::tuple<i64, i64>>> cancelled_worker_tasks;
   };
-  std::map<i64, WorkerHistory> worker_histories_;
-  std::map<i32, bool> unfinished_workers_;
-  std::vector<i32> unstarted_workers_;
-  std::atomic<i64> num_failed_workers_{0};
 
-  std::map<i64, std::map<i64, i64>> job_task_num_rows_;
+  // Sequence -> bulk jobs which were submitted and not yet committed
+  std::map<i64, std::unique_ptr<BulkJob>> bulk_jobs_;
+  i64 next_bulk_job_sequence_ = 0;
+  // Worker id -> sequence of the bulk job whose pipeline runs on the worker,
+  // until the worker reports FinishedJob
+  std::map<i32, i64> worker_bulk_jobs_;
+  // Worker id -> sequence of the bulk job a worker which was told to leave
+  // its current one starts next
+  std::map<i32, i64> worker_next_bulk_jobs_;
+  // Bulk job name -> result of the most recently finished bulk jobs, oldest
+  // first in finished_bulk_job_names_
+  std::map<std::string, Result> finished_bulk_jobs_;
+  std::deque<std::string> finished_bulk_job_names_;
+  // Result of the bulk job which finished last
+  Result job_result_;
 
-  // Worker connections
-  std::map<std::string, i32> local_ids_;
+  // Worker id -> tables the worker recently loaded from, most recent last
+  std::map<i64, std::deque<i32>> worker_recent_tables_;
+  // Worker id -> index of the worker among the active workers on its host
+  std::map<i32, i32> worker_local_ids_;
+  // Host -> number of active workers on the host
   std::map<std::string, i32> local_totals_;
+
+  //============================================================================
+  // Memoized Op outputs
+  //============================================================================
+  // Memoized table name -> time it was last read by a bulk job, in seconds
+  std::map<std::string, i64> memoized_last_used_;
+  // Memoized table name -> bytes stored for the table
+  std::map<std::string, i64> memoized_table_bytes_;
 };
 }
 }
@@ -0,0 +1,75 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/memory_budget.h"
+
+#include <cassert>
+
+namespace scanner {
+namespace internal {
+
+MemoryBudget::MemoryBudget(i64 budget_bytes) : budget_bytes_(budget_bytes) {}
+
+bool MemoryBudget::reserve(i64 bytes, const std::function<bool()>& admit) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto fits = [&] {
+    return disabled_ || budget_bytes_ <= 0 || reserved_bytes_ == 0 ||
+           reserved_bytes_ + bytes <= budget_bytes_ || (admit && admit());
+  };
+  bool waited = !fits();
+  released_.wait(lock, fits);
+  if (!disabled_) {
+    reserved_bytes_ += bytes;
+  }
+  return waited;
+}
+
+void MemoryBudget::release(i64 bytes) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (disabled_) {
+      return;
+    }
+    reserved_bytes_ -= bytes;
+    assert(reserved_bytes_ >= 0);
+  }
+  released_.notify_all();
+}
+
+void MemoryBudget::notify() {
+  {
+    // Taking the lock orders this after any reservation which is between
+    // checking admit and waiting
+    std::unique_lock<std::mutex> lock(mutex_);
+  }
+  released_.notify_all();
+}
+
+bool MemoryBudget::exhausted() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !disabled_ && budget_bytes_ > 0 && reserved_bytes_ >= budget_bytes_;
+}
+
+void MemoryBudget::disable() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    disabled_ = true;
+    reserved_bytes_ = 0;
+  }
+  released_.notify_all();
+}
+
+}
+}
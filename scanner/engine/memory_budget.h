@@ -0,0 +1,66 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+namespace scanner {
+namespace internal {
+
+// Bytes of work entries a node may hold between pipeline stages. A stage
+// reserves the bytes of an entry before handing it downstream, and the stage
+// which consumes the entry releases them, so producers slow down to the pace
+// of consumers instead of filling up memory.
+class MemoryBudget {
+ public:
+  // A budget of 0 bytes never blocks
+  MemoryBudget(i64 budget_bytes);
+
+  // Blocks until the bytes fit in the budget or admit returns true. An entry
+  // larger than the whole budget is admitted once nothing else is reserved,
+  // so it still makes progress. Returns true if it had to wait.
+  //
+  // admit lets through entries a consumer is blocked on, such as the next
+  // entry of a task a replica has claimed. Waiting on those would deadlock
+  // once the budget is full of entries the consumer can not take yet.
+  bool reserve(i64 bytes, const std::function<bool()>& admit = nullptr);
+
+  void release(i64 bytes);
+
+  // Wakes waiting reservations so they check admit again
+  void notify();
+
+  // Whether a reservation would currently have to wait
+  bool exhausted();
+
+  // Drops all reservations and stops blocking. Used when a job fails and its
+  // queues are flushed without the entries in them being released.
+  void disable();
+
+ private:
+  i64 budget_bytes_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+  i64 reserved_bytes_ = 0;
+  bool disabled_ = false;
+};
+
+}
+}
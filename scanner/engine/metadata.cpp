@@ -24,6 +24,7 @@
 #include <limits.h> /* PATH_MAX */
 #include <string.h>
 #include <sys/stat.h> /* mkdir(2) */
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <iostream>
@@ -48,7 +49,7 @@ template <>
 std::string Metadata<VideoDescriptor>::descriptor_path() const {
   const VideoMetadata* meta = (const VideoMetadata*)this;
   return table_item_video_metadata_path(meta->table_id(), meta->column_id(),
-                                        meta->item_id());
+                                        meta->item_id(), meta->attempt());
 }
 
 template <>
@@ -68,22 +69,27 @@ DatabaseMetadata::DatabaseMetadata() : next_table_id_(0), next_bulk_job_id_(0) {
 DatabaseMetadata::DatabaseMetadata(const DatabaseDescriptor& d)
   : Metadata(d),
     next_table_id_(d.next_table_id()),
-    next_bulk_job_id_(d.next_bulk_job_id()) {
+    next_bulk_job_id_(d.next_bulk_job_id()),
+    log_start_(d.log_start()),
+    next_log_segment_(d.log_start()) {
   for (int i = 0; i < descriptor_.tables_size(); ++i) {
     const DatabaseDescriptor::Table& table = descriptor_.tables(i);
     table_id_names_.insert({table.id(), table.name()});
     table_committed_.insert({table.id(), table.committed()});
+    table_name_ids_.insert({table.name(), table.id()});
   }
   for (int i = 0; i < descriptor_.bulk_jobs_size(); ++i) {
     const DatabaseDescriptor_BulkJob& bulk_job = descriptor_.bulk_jobs(i);
     bulk_job_id_names_.insert({bulk_job.id(), bulk_job.name()});
     bulk_job_committed_.insert({bulk_job.id(), bulk_job.committed()});
+    bulk_job_name_ids_.insert({bulk_job.name(), bulk_job.id()});
   }
 }
 
 const DatabaseDescriptor& DatabaseMetadata::get_descriptor() const {
   descriptor_.set_next_table_id(next_table_id_);
   descriptor_.set_next_bulk_job_id(next_bulk_job_id_);
+  descriptor_.set_log_start(log_start_);
   descriptor_.clear_tables();
   descriptor_.clear_bulk_jobs();
 
@@ -117,12 +123,7 @@ std::vector<std::string> DatabaseMetadata::table_names() const {
 }
 
 bool DatabaseMetadata::has_table(const std::string& table) const {
-  for (const auto& kv : table_id_names_) {
-    if (kv.second == table) {
-      return true;
-    }
-  }
-  return false;
+  return table_name_ids_.count(table) > 0;
 }
 
 bool DatabaseMetadata::has_table(i32 table_id) const {
@@ -130,13 +131,8 @@ bool DatabaseMetadata::has_table(i32 table_id) const {
 }
 
 i32 DatabaseMetadata::get_table_id(const std::string& table) const {
-  i32 id = -1;
-  for (const auto& kv : table_id_names_) {
-    if (kv.second == table) {
-      id = kv.first;
-      break;
-    }
-  }
+  auto it = table_name_ids_.find(table);
+  i32 id = it == table_name_ids_.end() ? -1 : it->second;
   LOG_IF(WARNING, id == -1) << "Table " << table << " does not exist.";
   return id;
 }
@@ -148,16 +144,15 @@ const std::string& DatabaseMetadata::get_table_name(i32 table_id) const {
 i32 DatabaseMetadata::add_table(const std::string& table) {
   i32 table_id = -1;
   if (!has_table(table)) {
-    table_id = next_table_id_++;
-    table_id_names_[table_id] = table;
-    table_committed_[table_id] = false;
+    table_id = next_table_id_;
+    log(DatabaseLogEntry::ADD_TABLE, table_id, table);
   }
   return table_id;
 }
 
 void DatabaseMetadata::commit_table(i32 table_id) {
   assert(table_id_names_.count(table_id) > 0);
-  table_committed_[table_id] = true;
+  log(DatabaseLogEntry::COMMIT_TABLE, table_id);
 }
 
 bool DatabaseMetadata::table_is_committed(i32 table_id) const {
@@ -167,7 +162,7 @@ bool DatabaseMetadata::table_is_committed(i32 table_id) const {
 
 void DatabaseMetadata::remove_table(i32 table_id) {
   assert(table_id_names_.count(table_id) > 0);
-  table_id_names_.erase(table_id);
+  log(DatabaseLogEntry::REMOVE_TABLE, table_id);
 }
 
 const std::vector<std::string>& DatabaseMetadata::bulk_job_names() const {
@@ -179,12 +174,7 @@ const std::vector<std::string>& DatabaseMetadata::bulk_job_names() const {
 }
 
 bool DatabaseMetadata::has_bulk_job(const std::string& bulk_job) const {
-  for (const auto& kv : bulk_job_id_names_) {
-    if (kv.second == bulk_job) {
-      return true;
-    }
-  }
-  return false;
+  return bulk_job_name_ids_.count(bulk_job) > 0;
 }
 
 bool DatabaseMetadata::has_bulk_job(i32 bulk_job_id) const {
@@ -192,13 +182,8 @@ bool DatabaseMetadata::has_bulk_job(i32 bulk_job_id) const {
 }
 
 i32 DatabaseMetadata::get_bulk_job_id(const std::string& bulk_job) const {
-  i32 bulk_job_id = -1;
-  for (const auto& kv : bulk_job_id_names_) {
-    if (kv.second == bulk_job) {
-      bulk_job_id = kv.first;
-      break;
-    }
-  }
+  auto it = bulk_job_name_ids_.find(bulk_job);
+  i32 bulk_job_id = it == bulk_job_name_ids_.end() ? -1 : it->second;
   assert(bulk_job_id != -1);
   return bulk_job_id;
 }
@@ -208,16 +193,14 @@ const std::string& DatabaseMetadata::get_bulk_job_name(i32 bulk_job_id) const {
 }
 
 i32 DatabaseMetadata::add_bulk_job(const std::string& bulk_job_name) {
-  i32 bulk_job_id = next_bulk_job_id_++;
-  bulk_job_id_names_[bulk_job_id] = bulk_job_name;
-  bulk_job_committed_[bulk_job_id] = false;
+  i32 bulk_job_id = next_bulk_job_id_;
+  log(DatabaseLogEntry::ADD_BULK_JOB, bulk_job_id, bulk_job_name);
   return bulk_job_id;
 }
 
 void DatabaseMetadata::commit_bulk_job(i32 bulk_job_id) {
   assert(bulk_job_id_names_.count(bulk_job_id) > 0);
-  bulk_job_committed_[bulk_job_id] = true;
-
+  log(DatabaseLogEntry::COMMIT_BULK_JOB, bulk_job_id);
 }
 
 bool DatabaseMetadata::bulk_job_is_committed(i32 bulk_job_id) const {
@@ -227,7 +210,284 @@ bool DatabaseMetadata::bulk_job_is_committed(i32 bulk_job_id) const {
 
 void DatabaseMetadata::remove_bulk_job(i32 bulk_job_id) {
   assert(bulk_job_id_names_.count(bulk_job_id) > 0);
-  bulk_job_id_names_.erase(bulk_job_id);
+  log(DatabaseLogEntry::REMOVE_BULK_JOB, bulk_job_id);
+}
+
+void DatabaseMetadata::replay(const DatabaseLogEntry& entry) {
+  apply(entry);
+}
+
+void DatabaseMetadata::log(DatabaseLogEntry::Type type, i32 id,
+                           const std::string& name) {
+  DatabaseLogEntry entry;
+  entry.set_type(type);
+  entry.set_id(id);
+  entry.set_name(name);
+  apply(entry);
+  pending_log_.push_back(entry);
+}
+
+void DatabaseMetadata::apply(const DatabaseLogEntry& entry) {
+  i32 id = entry.id();
+  switch (entry.type()) {
+    case DatabaseLogEntry::ADD_TABLE: {
+      table_id_names_[id] = entry.name();
+      table_committed_[id] = false;
+      table_name_ids_[entry.name()] = id;
+      next_table_id_ = std::max(next_table_id_, id + 1);
+      break;
+    }
+    case DatabaseLogEntry::COMMIT_TABLE: {
+      table_committed_[id] = true;
+      break;
+    }
+    case DatabaseLogEntry::REMOVE_TABLE: {
+      auto it = table_id_names_.find(id);
+      if (it != table_id_names_.end()) {
+        table_name_ids_.erase(it->second);
+        table_id_names_.erase(it);
+      }
+      break;
+    }
+    case DatabaseLogEntry::ADD_BULK_JOB: {
+      bulk_job_id_names_[id] = entry.name();
+      bulk_job_committed_[id] = false;
+      bulk_job_name_ids_[entry.name()] = id;
+      next_bulk_job_id_ = std::max(next_bulk_job_id_, id + 1);
+      break;
+    }
+    case DatabaseLogEntry::COMMIT_BULK_JOB: {
+      bulk_job_committed_[id] = true;
+      break;
+    }
+    case DatabaseLogEntry::REMOVE_BULK_JOB: {
+      auto it = bulk_job_id_names_.find(id);
+      if (it != bulk_job_id_names_.end()) {
+        bulk_job_name_ids_.erase(it->second);
+        bulk_job_id_names_.erase(it);
+      }
+      break;
+    }
+    default: {
+      LOG(FATAL) << "Unknown database log entry type " << entry.type();
+    }
+  }
+}
+
+namespace {
+
+bool file_exists(storehouse::StorageBackend* storage, const std::string& path) {
+  storehouse::FileInfo info;
+  StoreResult result;
+  EXP_BACKOFF(storage->get_file_info(path, info), result);
+  return result == StoreResult::Success;
+}
+
+// Reads a log segment. Returns false if it does not exist, or if it is the
+// newest segment and was only partially written.
+bool read_log_segment(storehouse::StorageBackend* storage, i32 segment,
+                      DatabaseLogSegment& log_segment) {
+  std::string path = database_metadata_log_path(segment);
+  if (!file_exists(storage, path)) {
+    return false;
+  }
+  std::unique_ptr<RandomReadFile> segment_file;
+  BACKOFF_FAIL(make_unique_random_read_file(storage, path, segment_file));
+  u64 pos = 0;
+  std::vector<u8> data = storehouse::read_entire_file(segment_file.get(), pos);
+  if (!log_segment.ParseFromArray(data.data(), data.size())) {
+    // A writer may still be saving the newest segment, but a segment
+    // followed by others was written completely and must parse
+    LOG_IF(FATAL, file_exists(storage, database_metadata_log_path(segment + 1)))
+        << "Corrupt database metadata log segment " << path;
+    VLOG(1) << "Stopping at partially written metadata log segment " << path;
+    return false;
+  }
+  return true;
+}
+
+}
+
+void write_database_metadata(storehouse::StorageBackend* storage,
+                             DatabaseMetadata& meta) {
+  i32 num_segments = meta.next_log_segment() - meta.log_start();
+  if (!meta.has_snapshot() || num_segments >= DB_METADATA_COMPACTION_SEGMENTS) {
+    // Other writers may have appended segments this writer never replayed,
+    // or compacted segments it did. Start from what is in storage and apply
+    // this writer's pending changes on top, so the new descriptor only
+    // replaces segments whose changes it holds.
+    if (meta.has_snapshot()) {
+      DatabaseMetadata current =
+          read_database_metadata(storage, DatabaseMetadata::descriptor_path());
+      for (const DatabaseLogEntry& entry : meta.pending_log()) {
+        current.replay(entry);
+      }
+      meta = current;
+    }
+    // The descriptor is written before the segments are removed so a reader
+    // never misses a change
+    i32 folded_start = meta.log_start();
+    i32 folded_end = meta.next_log_segment();
+    meta.set_log_range(folded_end, folded_end);
+    write_db_proto(storage, meta);
+    meta.set_has_snapshot(true);
+    meta.clear_pending_log();
+    for (i32 s = folded_start; s < folded_end; ++s) {
+      storage->delete_file(database_metadata_log_path(s));
+    }
+    return;
+  }
+  if (meta.pending_log().empty()) {
+    return;
+  }
+  // Never overwrite a segment appended by another writer
+  i32 segment = meta.next_log_segment();
+  while (file_exists(storage, database_metadata_log_path(segment))) {
+    segment++;
+  }
+  DatabaseLogSegment log_segment;
+  for (const DatabaseLogEntry& entry : meta.pending_log()) {
+    log_segment.add_entries()->CopyFrom(entry);
+  }
+  std::unique_ptr<WriteFile> output_file;
+  BACKOFF_FAIL(make_unique_write_file(
+      storage, database_metadata_log_path(segment), output_file));
+  serialize_db_proto<DatabaseLogSegment>(output_file.get(), log_segment);
+  BACKOFF_FAIL(output_file->save());
+  meta.set_log_range(meta.log_start(), segment + 1);
+  meta.clear_pending_log();
+}
+
+DatabaseMetadata read_database_metadata(storehouse::StorageBackend* storage,
+                                        const std::string& path) {
+  DatabaseMetadata meta = read_db_proto<DatabaseMetadata>(storage, path);
+  meta.set_has_snapshot(true);
+  i32 segment = meta.log_start();
+  DatabaseLogSegment log_segment;
+  while (read_log_segment(storage, segment, log_segment)) {
+    for (const DatabaseLogEntry& entry : log_segment.entries()) {
+      meta.replay(entry);
+    }
+    segment++;
+  }
+  meta.set_log_range(meta.log_start(), segment);
+  return meta;
+}
+
+void write_bulk_job_checkpoint(
+    storehouse::StorageBackend* storage, i32 bulk_job_id, i32 segment,
+    const std::vector<std::tuple<i64, i64, i32>>& finished_tasks) {
+  proto::BulkJobCheckpointSegment checkpoint;
+  checkpoint.mutable_job_indices()->Reserve(finished_tasks.size());
+  checkpoint.mutable_task_indices()->Reserve(finished_tasks.size());
+  checkpoint.mutable_attempts()->Reserve(finished_tasks.size());
+  for (const auto& job_task : finished_tasks) {
+    checkpoint.add_job_indices(std::get<0>(job_task));
+    checkpoint.add_task_indices(std::get<1>(job_task));
+    checkpoint.add_attempts(std::get<2>(job_task));
+  }
+  std::unique_ptr<WriteFile> output_file;
+  BACKOFF_FAIL(make_unique_write_file(
+      storage, bulk_job_checkpoint_path(bulk_job_id, segment), output_file));
+  serialize_db_proto<proto::BulkJobCheckpointSegment>(output_file.get(),
+                                                      checkpoint);
+  BACKOFF_FAIL(output_file->save());
+}
+
+i32 read_bulk_job_checkpoint(
+    storehouse::StorageBackend* storage, i32 bulk_job_id,
+    std::vector<std::tuple<i64, i64, i32>>& finished_tasks) {
+  i32 segment = 0;
+  while (true) {
+    std::string segment_path = bulk_job_checkpoint_path(bulk_job_id, segment);
+    if (!file_exists(storage, segment_path)) {
+      break;
+    }
+    std::unique_ptr<RandomReadFile> segment_file;
+    BACKOFF_FAIL(
+        make_unique_random_read_file(storage, segment_path, segment_file));
+    u64 pos = 0;
+    proto::BulkJobCheckpointSegment checkpoint =
+        deserialize_db_proto<proto::BulkJobCheckpointSegment>(
+            segment_file.get(), pos);
+    for (i32 i = 0; i < checkpoint.job_indices_size(); ++i) {
+      i32 attempt =
+          i < checkpoint.attempts_size() ? checkpoint.attempts(i) : 0;
+      finished_tasks.emplace_back(checkpoint.job_indices(i),
+                                  checkpoint.task_indices(i), attempt);
+    }
+    segment++;
+  }
+  return segment;
+}
+
+void delete_bulk_job_checkpoint(storehouse::StorageBackend* storage,
+                                i32 bulk_job_id, i32 num_segments) {
+  for (i32 s = 0; s < num_segments; ++s) {
+    storage->delete_file(bulk_job_checkpoint_path(bulk_job_id, s));
+  }
+}
+
+namespace {
+
+// Files an attempt of a task saves for its item of every column of a table
+void append_table_item_paths(const TableMetadata& table, i32 item_id,
+                             i32 attempt, std::vector<std::string>& paths) {
+  for (const proto::Column& column : table.columns()) {
+    paths.push_back(
+        table_item_output_path(table.id(), column.id(), item_id, attempt));
+    paths.push_back(
+        table_item_metadata_path(table.id(), column.id(), item_id, attempt));
+    if (column.type() == ColumnType::Video) {
+      paths.push_back(table_item_video_metadata_path(table.id(), column.id(),
+                                                     item_id, attempt));
+    }
+  }
+}
+
+// Files holding the items of every column of a table
+std::vector<std::string> table_item_paths(const TableMetadata& table) {
+  std::vector<std::string> paths;
+  i64 num_items = table.end_rows().size();
+  for (i64 item = 0; item < num_items; ++item) {
+    append_table_item_paths(table, item, table.item_attempt(item), paths);
+  }
+  return paths;
+}
+
+}
+
+i64 table_data_bytes(storehouse::StorageBackend* storage,
+                     const TableMetadata& table) {
+  i64 bytes = 0;
+  for (const std::string& path : table_item_paths(table)) {
+    storehouse::FileInfo info;
+    StoreResult result;
+    EXP_BACKOFF(storage->get_file_info(path, info), result);
+    if (result == StoreResult::Success) {
+      bytes += info.size;
+    }
+  }
+  return bytes;
+}
+
+void delete_table_data(storehouse::StorageBackend* storage,
+                       const TableMetadata& table) {
+  for (const std::string& path : table_item_paths(table)) {
+    storage->delete_file(path);
+  }
+  storage->delete_file(table_descriptor_path(table.id()));
+}
+
+void delete_table_item_attempt(storehouse::StorageBackend* storage,
+                               const TableMetadata& table, i32 item_id,
+                               i32 attempt) {
+  std::vector<std::string> paths;
+  append_table_item_paths(table, item_id, attempt, paths);
+  // Files the attempt never got to create are simply missing
+  for (const std::string& path : paths) {
+    storage->delete_file(path);
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -238,8 +498,8 @@ VideoMetadata::VideoMetadata(const VideoDescriptor& descriptor)
   : Metadata(descriptor) {}
 
 std::string VideoMetadata::descriptor_path(i32 table_id, i32 column_id,
-                                           i32 item_id) {
-  return table_item_video_metadata_path(table_id, column_id, item_id);
+                                           i32 item_id, i32 attempt) {
+  return table_item_video_metadata_path(table_id, column_id, item_id, attempt);
 }
 
 i32 VideoMetadata::table_id() const { return descriptor_.table_id(); }
@@ -248,6 +508,8 @@ i32 VideoMetadata::column_id() const { return descriptor_.column_id(); }
 
 i32 VideoMetadata::item_id() const { return descriptor_.item_id(); }
 
+i32 VideoMetadata::attempt() const { return descriptor_.attempt(); }
+
 i32 VideoMetadata::frames() const { return descriptor_.frames(); }
 
 i32 VideoMetadata::width() const { return descriptor_.width(); }
@@ -404,6 +666,14 @@ std::vector<i64> TableMetadata::end_rows() const {
                           descriptor_.end_rows().end());
 }
 
+i32 TableMetadata::item_attempt(i64 item_id) const {
+  // Tables only list attempts when some item was saved by a later attempt
+  if (item_id < descriptor_.item_attempts_size()) {
+    return descriptor_.item_attempts(item_id);
+  }
+  return 0;
+}
+
 const std::vector<Column>& TableMetadata::columns() const { return columns_; }
 
 bool TableMetadata::has_column(const std::string& name) const {
@@ -20,6 +20,8 @@
 #include "storehouse/storage_backend.h"
 
 #include <set>
+#include <tuple>
+#include <unordered_map>
 
 namespace scanner {
 namespace internal {
@@ -38,6 +40,11 @@ inline std::string database_metadata_path() {
   return get_database_path() + "db_metadata.bin";
 }
 
+inline std::string database_metadata_log_path(i32 segment) {
+  return get_database_path() + "db_metadata_log/" + std::to_string(segment) +
+         ".bin";
+}
+
 inline std::string table_directory(i32 table_id) {
   return get_database_path() + "tables/" + std::to_string(table_id);
 }
@@ -46,22 +53,33 @@ inline std::string table_descriptor_path(i32 table_id) {
   return table_directory(table_id) + "/descriptor.bin";
 }
 
+// Retried and backup attempts of a task save their items under their own
+// names so they never overwrite the outputs of another attempt
+inline std::string table_item_name(i32 column_id, i32 item_id, i32 attempt) {
+  std::string name = std::to_string(column_id) + "_" + std::to_string(item_id);
+  if (attempt > 0) {
+    name += "_attempt" + std::to_string(attempt);
+  }
+  return name;
+}
+
 inline std::string table_item_output_path(i32 table_id, i32 column_id,
-                                          i32 item_id) {
-  return table_directory(table_id) + "/" + std::to_string(column_id) + "_" +
-         std::to_string(item_id) + ".bin";
+                                          i32 item_id, i32 attempt = 0) {
+  return table_directory(table_id) + "/" +
+         table_item_name(column_id, item_id, attempt) + ".bin";
 }
 
 inline std::string table_item_video_metadata_path(i32 table_id, i32 column_id,
-                                                  i32 item_id) {
-  return table_directory(table_id) + "/" + std::to_string(column_id) + "_" +
-         std::to_string(item_id) + "_video_metadata.bin";
+                                                  i32 item_id,
+                                                  i32 attempt = 0) {
+  return table_directory(table_id) + "/" +
+         table_item_name(column_id, item_id, attempt) + "_video_metadata.bin";
 }
 
 inline std::string table_item_metadata_path(i32 table_id, i32 column_id,
-                                            i32 item_id) {
-  return table_directory(table_id) + "/" + std::to_string(column_id) + "_" +
-         std::to_string(item_id) + "_metadata.bin";
+                                            i32 item_id, i32 attempt = 0) {
+  return table_directory(table_id) + "/" +
+         table_item_name(column_id, item_id, attempt) + "_metadata.bin";
 }
 
 inline std::string bulk_job_directory(i32 bulk_job_id) {
@@ -72,6 +90,11 @@ inline std::string bulk_job_descriptor_path(i32 bulk_job_id) {
   return bulk_job_directory(bulk_job_id) + "/descriptor.bin";
 }
 
+inline std::string bulk_job_checkpoint_path(i32 bulk_job_id, i32 segment) {
+  return bulk_job_directory(bulk_job_id) + "/checkpoint_" +
+         std::to_string(segment) + ".bin";
+}
+
 inline std::string bulk_job_profiler_path(i32 bulk_job_id, i32 node) {
   return bulk_job_directory(bulk_job_id) + "/profile_" + std::to_string(node) +
          ".bin";
@@ -126,14 +149,47 @@ class DatabaseMetadata : public Metadata<proto::DatabaseDescriptor> {
   bool bulk_job_is_committed(i32 job_id) const;
   void remove_bulk_job(i32 job_id);
 
+  /// Metadata log
+  // Changes made since the metadata was last written
+  const std::vector<proto::DatabaseLogEntry>& pending_log() const {
+    return pending_log_;
+  }
+  void clear_pending_log() { pending_log_.clear(); }
+  // Apply a change read back from the log
+  void replay(const proto::DatabaseLogEntry& entry);
+
+  // Log segments [log_start, next_log_segment) hold the changes which are
+  // not part of the compacted descriptor
+  i32 log_start() const { return log_start_; }
+  i32 next_log_segment() const { return next_log_segment_; }
+  void set_log_range(i32 log_start, i32 next_log_segment) {
+    log_start_ = log_start;
+    next_log_segment_ = next_log_segment;
+  }
+  // Whether a compacted descriptor exists in storage for this metadata
+  bool has_snapshot() const { return has_snapshot_; }
+  void set_has_snapshot(bool has_snapshot) { has_snapshot_ = has_snapshot; }
+
  private:
+  void apply(const proto::DatabaseLogEntry& entry);
+
+  void log(proto::DatabaseLogEntry::Type type, i32 id,
+           const std::string& name = "");
+
   i32 next_table_id_;
   i32 next_bulk_job_id_;
   std::map<i32, std::string> table_id_names_;
   std::map<i32, bool> table_committed_;
+  std::unordered_map<std::string, i32> table_name_ids_;
 
   std::map<i32, std::string> bulk_job_id_names_;
   std::map<i32, bool> bulk_job_committed_;
+  std::unordered_map<std::string, i32> bulk_job_name_ids_;
+
+  std::vector<proto::DatabaseLogEntry> pending_log_;
+  i32 log_start_ = 0;
+  i32 next_log_segment_ = 0;
+  bool has_snapshot_ = false;
 };
 
 class VideoMetadata : public Metadata<proto::VideoDescriptor> {
@@ -141,11 +197,13 @@ class VideoMetadata : public Metadata<proto::VideoDescriptor> {
   VideoMetadata();
   VideoMetadata(const Descriptor& descriptor);
 
-  static std::string descriptor_path(i32 table_id, i32 column_id, i32 item_id);
+  static std::string descriptor_path(i32 table_id, i32 column_id, i32 item_id,
+                                     i32 attempt = 0);
 
   i32 table_id() const;
   i32 column_id() const;
   i32 item_id() const;
+  i32 attempt() const;
   i32 frames() const;
   i32 width() const;
   i32 height() const;
@@ -230,6 +288,9 @@ class TableMetadata : public Metadata<proto::TableDescriptor> {
 
   std::vector<i64> end_rows() const;
 
+  // Attempt of the task which saved an item, which names the item's files
+  i32 item_attempt(i64 item_id) const;
+
   const std::vector<proto::Column>& columns() const;
 
   bool has_column(const std::string& name) const;
@@ -298,10 +359,49 @@ template <typename T>
 using ReadFn = T (*)(storehouse::StorageBackend* storage,
                      const std::string& path);
 
-constexpr WriteFn<DatabaseMetadata> write_database_metadata =
-    write_db_proto<DatabaseMetadata>;
-constexpr ReadFn<DatabaseMetadata> read_database_metadata =
-    read_db_proto<DatabaseMetadata>;
+// Number of log segments to accumulate before they are compacted into the
+// database descriptor
+const i32 DB_METADATA_COMPACTION_SEGMENTS = 64;
+
+// Appends the pending changes to the metadata log as a new segment, which
+// costs O(changes) instead of rewriting every entry. Once enough segments
+// accumulate, they are compacted into the database descriptor.
+void write_database_metadata(storehouse::StorageBackend* storage,
+                             DatabaseMetadata& meta);
+
+// Reads the compacted database descriptor and replays the log on top of it
+DatabaseMetadata read_database_metadata(storehouse::StorageBackend* storage,
+                                        const std::string& path);
+
+// Appends the (job, task, attempt) of finished tasks to the checkpoint log of
+// a bulk job as the given segment
+void write_bulk_job_checkpoint(
+    storehouse::StorageBackend* storage, i32 bulk_job_id, i32 segment,
+    const std::vector<std::tuple<i64, i64, i32>>& finished_tasks);
+
+// Reads every segment of the checkpoint log of a bulk job and returns the
+// number of segments
+i32 read_bulk_job_checkpoint(
+    storehouse::StorageBackend* storage, i32 bulk_job_id,
+    std::vector<std::tuple<i64, i64, i32>>& finished_tasks);
+
+void delete_bulk_job_checkpoint(storehouse::StorageBackend* storage,
+                                i32 bulk_job_id, i32 num_segments);
+
+// Bytes stored for the items of every column of a table
+i64 table_data_bytes(storehouse::StorageBackend* storage,
+                     const TableMetadata& table);
+
+// Remove the items and descriptor of a table from storage. The table must
+// also be removed from the database metadata.
+void delete_table_data(storehouse::StorageBackend* storage,
+                       const TableMetadata& table);
+
+// Remove whatever files an attempt of a task saved for its item of a table,
+// e.g. after another attempt of the task was committed instead
+void delete_table_item_attempt(storehouse::StorageBackend* storage,
+                               const TableMetadata& table, i32 item_id,
+                               i32 attempt);
 
 constexpr WriteFn<BulkJobMetadata> write_bulk_job_metadata =
     write_db_proto<BulkJobMetadata>;
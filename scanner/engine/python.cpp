@@ -63,11 +63,13 @@ std::string default_machine_params_wrapper() {
 
 proto::Result start_master_wrapper(Database& db, const std::string& port,
                                    bool watchdog, bool prefetch_table_metadata,
-                                   i64 no_workers_timeout) {
+                                   i64 no_workers_timeout,
+                                   i64 memoized_cache_bytes) {
   GILRelease r;
   return db.start_master(default_machine_params(), port, watchdog,
                          prefetch_table_metadata,
-                         no_workers_timeout);
+                         no_workers_timeout,
+                         memoized_cache_bytes);
 }
 
 proto::Result start_worker_wrapper(Database& db, const std::string& params_s,
@@ -0,0 +1,202 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/read_ahead_cache.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+// Files kept open at once
+const size_t MAX_OPEN_FILES = 64;
+
+}
+
+const size_t ReadAheadCache::DEFAULT_CAPACITY_BYTES = 256 * 1024 * 1024;
+
+ReadAheadCache::ReadAheadCache(storehouse::StorageConfig* storage_config,
+                               size_t capacity_bytes)
+  : capacity_bytes_(capacity_bytes),
+    storage_(storehouse::StorageBackend::make_from_config(storage_config)) {
+  prefetch_thread_ = std::thread(&ReadAheadCache::prefetch_loop, this);
+}
+
+ReadAheadCache::~ReadAheadCache() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  prefetch_thread_.join();
+}
+
+void ReadAheadCache::read(const std::string& path, u64 file_size, u64 offset,
+                          size_t size, u8* buffer, Profiler& profiler) {
+  FileKey key(path, file_size);
+  u64 pos = offset;
+  u64 end = offset + size;
+  i64 hit_bytes = 0;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (pos < end) {
+      auto it = find_block(key, pos);
+      if (it == blocks_.end()) {
+        break;
+      }
+      if (!it->ready) {
+        if (!it->reading) {
+          // Still queued, so it is no faster than reading it here
+          requests_.erase(std::find(requests_.begin(), requests_.end(), it));
+          blocks_.erase(it);
+          break;
+        }
+        auto wait_start = now();
+        cv_.wait(lock);
+        profiler.add_interval("read_ahead_wait", wait_start, now());
+        // The block may have failed and been dropped, so look it up again
+        continue;
+      }
+      u64 n = std::min(end, it->offset + it->size) - pos;
+      std::memcpy(buffer + (pos - offset), it->data.data() + (pos - it->offset),
+                  n);
+      blocks_.splice(blocks_.begin(), blocks_, it);
+      hit_bytes += n;
+      pos += n;
+    }
+  }
+  profiler.increment("read_ahead_hit_bytes", hit_bytes);
+
+  if (pos < end) {
+    bool success = read_file(key, pos, end - pos, buffer + (pos - offset));
+    LOG_IF(WARNING, !success) << "Short read of " << path << " at " << pos;
+  }
+}
+
+void ReadAheadCache::prefetch(const std::string& path, u64 file_size,
+                              u64 offset, size_t size) {
+  if (size == 0 || size > capacity_bytes_) {
+    return;
+  }
+  FileKey key(path, file_size);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (find_block(key, offset) != blocks_.end()) {
+      return;
+    }
+    Block block;
+    block.file = key;
+    block.offset = offset;
+    block.size = size;
+    blocks_.push_front(std::move(block));
+    requests_.push_back(blocks_.begin());
+  }
+  cv_.notify_all();
+}
+
+std::shared_ptr<ReadAheadCache::OpenFile> ReadAheadCache::open(
+    const FileKey& key) {
+  std::unique_lock<std::mutex> lock(files_mutex_);
+  auto it = file_index_.find(key);
+  if (it != file_index_.end()) {
+    files_.splice(files_.begin(), files_, it->second);
+    return files_.front();
+  }
+  if (files_.size() >= MAX_OPEN_FILES) {
+    // Handles still being read from stay open until their readers finish
+    file_index_.erase(files_.back()->key);
+    files_.pop_back();
+  }
+  std::shared_ptr<OpenFile> file(new OpenFile);
+  file->key = key;
+  BACKOFF_FAIL(storehouse::make_unique_random_read_file(storage_.get(),
+                                                        key.first, file->file));
+  files_.push_front(file);
+  file_index_[key] = files_.begin();
+  return file;
+}
+
+bool ReadAheadCache::read_file(const FileKey& key, u64 offset, size_t size,
+                               u8* buffer) {
+  std::shared_ptr<OpenFile> file = open(key);
+  std::unique_lock<std::mutex> lock(file->mutex);
+  size_t size_read = 0;
+  storehouse::StoreResult result =
+      file->file->read(offset, size, buffer, size_read);
+  return result == storehouse::StoreResult::Success && size_read == size;
+}
+
+std::list<ReadAheadCache::Block>::iterator ReadAheadCache::find_block(
+    const FileKey& key, u64 offset) {
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    if (it->offset <= offset && offset < it->offset + it->size &&
+        it->file == key) {
+      return it;
+    }
+  }
+  return blocks_.end();
+}
+
+void ReadAheadCache::evict() {
+  auto it = blocks_.end();
+  while (cached_bytes_ > capacity_bytes_ && it != blocks_.begin()) {
+    --it;
+    if (it->ready) {
+      cached_bytes_ -= it->size;
+      it = blocks_.erase(it);
+    }
+  }
+}
+
+void ReadAheadCache::prefetch_loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+    if (stop_) {
+      return;
+    }
+    auto it = requests_.front();
+    requests_.pop_front();
+    it->reading = true;
+    FileKey key = it->file;
+    u64 offset = it->offset;
+    std::vector<u8> data(it->size);
+
+    lock.unlock();
+    bool success = read_file(key, offset, data.size(), data.data());
+    lock.lock();
+
+    it->reading = false;
+    if (success) {
+      it->data.swap(data);
+      it->ready = true;
+      cached_bytes_ += it->size;
+      evict();
+    } else {
+      VLOG(1) << "Read ahead of " << key.first << " at " << offset
+              << " failed";
+      blocks_.erase(it);
+    }
+    cv_.notify_all();
+  }
+}
+
+}
+}
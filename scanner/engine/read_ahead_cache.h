@@ -0,0 +1,117 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+#include "scanner/util/profiler.h"
+
+#include "storehouse/storage_backend.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+// Byte ranges of inplace video files read ahead of the load workers. Inplace
+// videos are read straight from the user's original files, often on a
+// network filesystem, so the files are kept open across tasks and the
+// keyframe intervals after each one a load worker reads are fetched in the
+// background. Shared by all load workers of a node and kept across jobs, so
+// files are identified by their path and size: a file replaced or
+// re-ingested under the same path gets its own handle and blocks.
+class ReadAheadCache {
+ public:
+  ReadAheadCache(storehouse::StorageConfig* storage_config,
+                 size_t capacity_bytes = DEFAULT_CAPACITY_BYTES);
+  ~ReadAheadCache();
+
+  // Reads [offset, offset + size) of the file into buffer. Parts which were
+  // read ahead come from the cache, waiting for them if still in flight.
+  void read(const std::string& path, u64 file_size, u64 offset, size_t size,
+            u8* buffer, Profiler& profiler);
+
+  // Starts reading [offset, offset + size) of the file in the background
+  // unless the range is already cached or in flight
+  void prefetch(const std::string& path, u64 file_size, u64 offset,
+                size_t size);
+
+  static const size_t DEFAULT_CAPACITY_BYTES;
+
+ private:
+  // Path and size of a file
+  using FileKey = std::pair<std::string, u64>;
+
+  struct OpenFile {
+    FileKey key;
+    // Reads of a file handle are not safe to interleave
+    std::mutex mutex;
+    std::unique_ptr<storehouse::RandomReadFile> file;
+  };
+
+  struct Block {
+    FileKey file;
+    u64 offset;
+    u64 size;
+    std::vector<u8> data;
+    // Set while the prefetch thread reads the block
+    bool reading = false;
+    bool ready = false;
+  };
+
+  std::shared_ptr<OpenFile> open(const FileKey& key);
+
+  bool read_file(const FileKey& key, u64 offset, size_t size, u8* buffer);
+
+  // Block of the file holding offset, or blocks_.end()
+  std::list<Block>::iterator find_block(const FileKey& key, u64 offset);
+
+  // Drops the least recently used blocks until the cache fits its capacity
+  void evict();
+
+  void prefetch_loop();
+
+  const size_t capacity_bytes_;
+  std::unique_ptr<storehouse::StorageBackend> storage_;
+
+  std::mutex files_mutex_;
+  // Most recently used first
+  std::list<std::shared_ptr<OpenFile>> files_;
+  std::map<FileKey, std::list<std::shared_ptr<OpenFile>>::iterator>
+      file_index_;
+
+  std::mutex mutex_;
+  // Notified when a request is queued or a block finishes reading
+  std::condition_variable cv_;
+  // Most recently used first
+  std::list<Block> blocks_;
+  // Bytes of the blocks which are ready
+  size_t cached_bytes_ = 0;
+  std::deque<std::list<Block>::iterator> requests_;
+  bool stop_ = false;
+  std::thread prefetch_thread_;
+};
+
+}
+}
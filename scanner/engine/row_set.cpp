@@ -0,0 +1,207 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/row_set.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace scanner {
+namespace internal {
+
+RowSet RowSet::from_rows(const std::vector<i64>& rows) {
+  RowSet set;
+  if (rows.empty()) {
+    return set;
+  }
+  if (std::is_sorted(rows.begin(), rows.end())) {
+    // Common case: rows are already ordered so we can build the runs directly
+    i64 start = rows[0];
+    i64 end = start + 1;
+    for (size_t i = 1; i < rows.size(); ++i) {
+      i64 r = rows[i];
+      if (r <= end) {
+        end = std::max(end, r + 1);
+      } else {
+        set.intervals_.push_back({start, end});
+        start = r;
+        end = r + 1;
+      }
+    }
+    set.intervals_.push_back({start, end});
+  } else {
+    set.intervals_.reserve(rows.size());
+    for (i64 r : rows) {
+      set.intervals_.push_back({r, r + 1});
+    }
+    set.normalize();
+  }
+  return set;
+}
+
+RowSet RowSet::from_range(i64 start, i64 end) {
+  RowSet set;
+  set.add_range(start, end);
+  return set;
+}
+
+void RowSet::add_range(i64 start, i64 end) {
+  if (start >= end) {
+    return;
+  }
+  // Find the first interval which could touch [start, end)
+  auto it = std::lower_bound(
+      intervals_.begin(), intervals_.end(), start,
+      [](const RowInterval& a, i64 v) { return a.end < v; });
+  auto last = it;
+  while (last != intervals_.end() && last->start <= end) {
+    start = std::min(start, last->start);
+    end = std::max(end, last->end);
+    ++last;
+  }
+  if (it == last) {
+    intervals_.insert(it, {start, end});
+  } else {
+    it->start = start;
+    it->end = end;
+    intervals_.erase(it + 1, last);
+  }
+}
+
+void RowSet::add_rows(const std::vector<i64>& rows) {
+  merge(from_rows(rows));
+}
+
+void RowSet::merge(const RowSet& other) {
+  if (other.empty()) {
+    return;
+  }
+  if (empty()) {
+    intervals_ = other.intervals_;
+    return;
+  }
+  std::vector<RowInterval> merged;
+  merged.reserve(intervals_.size() + other.intervals_.size());
+  std::merge(intervals_.begin(), intervals_.end(), other.intervals_.begin(),
+             other.intervals_.end(), std::back_inserter(merged),
+             [](const RowInterval& a, const RowInterval& b) {
+               return a.start < b.start;
+             });
+  intervals_.swap(merged);
+  normalize();
+}
+
+RowSet RowSet::shifted(i64 offset) const {
+  RowSet set(*this);
+  for (RowInterval& i : set.intervals_) {
+    i.start += offset;
+    i.end += offset;
+  }
+  return set;
+}
+
+RowSet RowSet::dilated(const std::vector<i32>& offsets) const {
+  RowSet set;
+  if (offsets.empty() || empty()) {
+    return set;
+  }
+  std::vector<i32> sorted_offsets(offsets);
+  std::sort(sorted_offsets.begin(), sorted_offsets.end());
+  // Group the offsets into contiguous runs [lo, hi]. Shifting an interval by
+  // every offset in a run is the same as widening it by lo and hi, so the
+  // usual contiguous stencil costs a single pass over the intervals.
+  set.intervals_.reserve(intervals_.size());
+  size_t i = 0;
+  while (i < sorted_offsets.size()) {
+    i64 lo = sorted_offsets[i];
+    i64 hi = lo;
+    while (i + 1 < sorted_offsets.size() && sorted_offsets[i + 1] <= hi + 1) {
+      hi = sorted_offsets[++i];
+    }
+    ++i;
+    for (const RowInterval& interval : intervals_) {
+      set.intervals_.push_back({interval.start + lo, interval.end + hi});
+    }
+  }
+  set.normalize();
+  return set;
+}
+
+RowSet RowSet::extended_back(i64 count, i64 floor) const {
+  RowSet set;
+  set.intervals_.reserve(intervals_.size());
+  for (const RowInterval& interval : intervals_) {
+    i64 start = std::max(interval.start - count, floor);
+    if (start < interval.end) {
+      set.intervals_.push_back({start, interval.end});
+    }
+  }
+  set.normalize();
+  return set;
+}
+
+i64 RowSet::size() const {
+  i64 total = 0;
+  for (const RowInterval& interval : intervals_) {
+    total += interval.end - interval.start;
+  }
+  return total;
+}
+
+i64 RowSet::min() const {
+  assert(!empty());
+  return intervals_.front().start;
+}
+
+i64 RowSet::max() const {
+  assert(!empty());
+  return intervals_.back().end - 1;
+}
+
+std::vector<i64> RowSet::to_vector() const {
+  std::vector<i64> rows;
+  rows.reserve(size());
+  for (const RowInterval& interval : intervals_) {
+    for (i64 r = interval.start; r < interval.end; ++r) {
+      rows.push_back(r);
+    }
+  }
+  return rows;
+}
+
+void RowSet::normalize() {
+  if (intervals_.empty()) {
+    return;
+  }
+  std::sort(intervals_.begin(), intervals_.end(),
+            [](const RowInterval& a, const RowInterval& b) {
+              return a.start < b.start;
+            });
+  size_t out = 0;
+  for (size_t i = 1; i < intervals_.size(); ++i) {
+    RowInterval& current = intervals_[out];
+    const RowInterval& next = intervals_[i];
+    if (next.start <= current.end) {
+      current.end = std::max(current.end, next.end);
+    } else {
+      intervals_[++out] = next;
+    }
+  }
+  intervals_.resize(out + 1);
+}
+
+}
+}
@@ -0,0 +1,81 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+// Half-open range of rows [start, end)
+struct RowInterval {
+  i64 start;
+  i64 end;
+};
+
+// A set of row indices stored as a sorted list of disjoint, non-adjacent
+// intervals. Row sets in the DAG analysis are almost always a handful of
+// contiguous runs (a task's output range widened by stencils and warmup), so
+// this keeps set operations proportional to the number of runs instead of
+// the number of rows.
+class RowSet {
+ public:
+  RowSet() = default;
+
+  // Rows may be in any order and contain duplicates
+  static RowSet from_rows(const std::vector<i64>& rows);
+
+  static RowSet from_range(i64 start, i64 end);
+
+  void add_range(i64 start, i64 end);
+
+  void add_rows(const std::vector<i64>& rows);
+
+  void merge(const RowSet& other);
+
+  // Every row offset by `offset`
+  RowSet shifted(i64 offset) const;
+
+  // Union of the set shifted by each of the given offsets
+  RowSet dilated(const std::vector<i32>& offsets) const;
+
+  // Add the `count` rows preceding each row, never going below `floor`
+  RowSet extended_back(i64 count, i64 floor) const;
+
+  bool empty() const { return intervals_.empty(); }
+
+  i64 size() const;
+
+  // Smallest and largest row. Must not be empty.
+  i64 min() const;
+  i64 max() const;
+
+  const std::vector<RowInterval>& intervals() const { return intervals_; }
+
+  // Sorted, unique list of rows
+  std::vector<i64> to_vector() const;
+
+ private:
+  // Sort and coalesce overlapping or adjacent intervals
+  void normalize();
+
+  std::vector<RowInterval> intervals_;
+};
+
+}
+}
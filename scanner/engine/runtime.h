@@ -40,11 +40,19 @@ namespace internal {
 
 ///////////////////////////////////////////////////////////////////////////////
 /// Work structs - structs used to exchange data between workers during
-///   execution of the run command.
+///   execution of the run command. They are move-only so that each stage
+///   hands its row buffers to the next one instead of copying them.
 struct EvalWorkEntry {
+  EvalWorkEntry() = default;
+  EvalWorkEntry(EvalWorkEntry&&) = default;
+  EvalWorkEntry& operator=(EvalWorkEntry&&) = default;
+  EvalWorkEntry(const EvalWorkEntry&) = delete;
+  EvalWorkEntry& operator=(const EvalWorkEntry&) = delete;
+
   i64 table_id;
   i64 job_index;
   i64 task_index;
+  i32 attempt;
   std::vector<std::vector<i64>> row_ids;
   BatchedColumns columns;
   std::vector<DeviceHandle> column_handles;
@@ -61,9 +69,17 @@ struct EvalWorkEntry {
   // For save and pre worker
   std::vector<FrameInfo> frame_sizes;
   std::vector<bool> compressed;
+  // Bytes held in the node's memory budget for this entry
+  i64 reserved_bytes = 0;
 };
 
 struct TaskStream {
+  TaskStream() = default;
+  TaskStream(TaskStream&&) = default;
+  TaskStream& operator=(TaskStream&&) = default;
+  TaskStream(const TaskStream&) = delete;
+  TaskStream& operator=(const TaskStream&) = delete;
+
   i64 slice_group;
   std::vector<i64> valid_input_rows;
   std::vector<i64> compute_input_rows;
@@ -72,8 +88,6 @@ struct TaskStream {
 
 using LoadInputQueue =
     Queue<std::tuple<i32, std::deque<TaskStream>, LoadWorkEntry>>;
-using EvalQueue =
-    Queue<std::tuple<std::deque<TaskStream>, EvalWorkEntry>>;
 using OutputEvalQueue =
     Queue<std::tuple<i32, EvalWorkEntry>>;
 using SaveInputQueue =
@@ -90,6 +104,9 @@ struct DatabaseParameters {
   std::vector<i32> gpu_ids;
   bool prefetch_table_metadata;
   i64 no_workers_timeout; // in seconds
+  // Bytes of memoized Op outputs to keep before evicting the least recently
+  // used ones. 0 keeps everything.
+  i64 memoized_cache_bytes;
 };
 
 class MasterImpl;
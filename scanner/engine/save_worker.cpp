@@ -57,9 +57,18 @@ SaveWorker::~SaveWorker() {
   video_metadata_.clear();
 }
 
-void SaveWorker::feed(EvalWorkEntry& input_entry) {
+void SaveWorker::feed(EvalWorkEntry&& input_entry) {
   EvalWorkEntry& work_entry = input_entry;
 
+  if (cancelled_) {
+    for (size_t out_idx = 0; out_idx < work_entry.columns.size(); ++out_idx) {
+      for (Element& element : work_entry.columns[out_idx]) {
+        delete_element(work_entry.column_handles[out_idx], element);
+      }
+    }
+    return;
+  }
+
   // Write out each output column to an individual data file
   i32 video_col_idx = 0;
   for (size_t out_idx = 0; out_idx < work_entry.columns.size(); ++out_idx) {
@@ -136,7 +145,8 @@ void SaveWorker::feed(EvalWorkEntry& input_entry) {
 
         const std::string output_path =
             table_item_output_path(video_descriptor.table_id(), out_idx,
-                                   video_descriptor.item_id());
+                                   video_descriptor.item_id(),
+                                   video_descriptor.attempt());
         video_descriptor.set_data_path(output_path);
         video_descriptor.set_inplace(false);
 
@@ -206,7 +216,16 @@ void SaveWorker::feed(EvalWorkEntry& input_entry) {
   }
 }
 
-void SaveWorker::new_task(i32 table_id, i32 task_id,
+void SaveWorker::cancel() {
+  cancelled_ = true;
+  // Object stores only upload a file when it is saved, so dropping the
+  // handles skips writing outputs which would be deleted anyway
+  output_.clear();
+  output_metadata_.clear();
+  video_metadata_.clear();
+}
+
+void SaveWorker::new_task(i32 table_id, i32 task_id, i32 attempt,
                           std::vector<ColumnType> column_types) {
   auto io_start = now();
   for (auto& file : output_) {
@@ -226,9 +245,9 @@ void SaveWorker::new_task(i32 table_id, i32 task_id,
 
   for (size_t out_idx = 0; out_idx < column_types.size(); ++out_idx) {
     const std::string output_path =
-        table_item_output_path(table_id, out_idx, task_id);
+        table_item_output_path(table_id, out_idx, task_id, attempt);
     const std::string output_metdata_path =
-        table_item_metadata_path(table_id, out_idx, task_id);
+        table_item_metadata_path(table_id, out_idx, task_id, attempt);
 
     WriteFile* output_file = nullptr;
     BACKOFF_FAIL(storage_->make_write_file(output_path, output_file));
@@ -247,6 +266,7 @@ void SaveWorker::new_task(i32 table_id, i32 task_id,
       video_descriptor.set_table_id(table_id);
       video_descriptor.set_column_id(out_idx);
       video_descriptor.set_item_id(task_id);
+      video_descriptor.set_attempt(attempt);
     }
   }
 }
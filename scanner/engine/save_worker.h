@@ -38,11 +38,18 @@ class SaveWorker {
   SaveWorker(const SaveWorkerArgs& args);
   ~SaveWorker();
 
-  void feed(EvalWorkEntry& input_entry);
+  void feed(EvalWorkEntry&& input_entry);
 
-  void new_task(i32 table_id, i32 task_id,
+  // Each attempt of a task saves its item under its own paths
+  void new_task(i32 table_id, i32 task_id, i32 attempt,
                 std::vector<ColumnType> column_types);
 
+  // Drops the task's files without saving them and discards the rest of its
+  // entries. Used when another attempt of the task already committed.
+  void cancel();
+
+  bool cancelled() const { return cancelled_; }
+
  private:
   const i32 node_id_;
   const i32 worker_id_;
@@ -58,6 +65,7 @@ class SaveWorker {
   bool first_item_;
   bool needs_configure_;
   bool needs_reset_;
+  bool cancelled_ = false;
 
   i64 current_work_item_;
   i64 current_row_;
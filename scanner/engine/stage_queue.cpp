@@ -0,0 +1,138 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/stage_queue.h"
+
+#include <cassert>
+
+namespace scanner {
+namespace internal {
+
+StageQueue::StageQueue(i32 max_size) : max_size_(max_size) {}
+
+StageQueue::StageQueue(StageQueue&& o)
+  : max_size_(o.max_size_),
+    tasks_(std::move(o.tasks_)),
+    unclaimed_(std::move(o.unclaimed_)),
+    claims_(std::move(o.claims_)),
+    exit_messages_(std::move(o.exit_messages_)),
+    size_(o.size_),
+    budget_(o.budget_) {}
+
+void StageQueue::push(Entry item) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  EvalWorkEntry& work_entry = std::get<1>(item);
+  if (work_entry.job_index == -1) {
+    exit_messages_.push_back(std::move(item));
+  } else {
+    JobTask job_task =
+        std::make_tuple(work_entry.job_index, work_entry.task_index);
+    // A replica which claimed the task and ran out of its entries can not
+    // make progress until this one arrives, so let it through even if full
+    not_full_.wait(lock, [&] {
+      if (size_ < max_size_) {
+        return true;
+      }
+      for (auto& kv : claims_) {
+        if (kv.second == job_task && tasks_.at(job_task).empty()) {
+          return true;
+        }
+      }
+      return false;
+    });
+    auto it = tasks_.find(job_task);
+    if (it == tasks_.end()) {
+      it = tasks_.emplace(job_task, std::deque<Entry>()).first;
+      unclaimed_.push_back(job_task);
+    }
+    it->second.push_back(std::move(item));
+    size_++;
+  }
+  lock.unlock();
+  // Replicas wait on different tasks, so wake all of them
+  not_empty_.notify_all();
+}
+
+void StageQueue::pop(i32 replica, Entry& item) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  not_empty_.wait(lock, [&] {
+    auto claim = claims_.find(replica);
+    if (claim != claims_.end()) {
+      return !tasks_.at(claim->second).empty();
+    }
+    return !unclaimed_.empty() || !exit_messages_.empty();
+  });
+
+  auto claim = claims_.find(replica);
+  if (claim == claims_.end()) {
+    if (unclaimed_.empty()) {
+      item = std::move(exit_messages_.front());
+      exit_messages_.pop_front();
+      return;
+    }
+    claim = claims_.emplace(replica, unclaimed_.front()).first;
+    unclaimed_.pop_front();
+  }
+
+  JobTask job_task = claim->second;
+  auto& entries = tasks_.at(job_task);
+  item = std::move(entries.front());
+  entries.pop_front();
+  size_--;
+
+  EvalWorkEntry& work_entry = std::get<1>(item);
+  bool awaiting = true;
+  if (work_entry.last_in_task && work_entry.last_in_io_packet) {
+    assert(entries.empty());
+    tasks_.erase(job_task);
+    claims_.erase(claim);
+    awaiting = false;
+  } else {
+    awaiting = entries.empty();
+  }
+  lock.unlock();
+  not_full_.notify_all();
+  if (awaiting && budget_ != nullptr) {
+    budget_->notify();
+  }
+}
+
+bool StageQueue::awaited(i64 job_index, i64 task_index) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  JobTask job_task = std::make_tuple(job_index, task_index);
+  for (auto& kv : claims_) {
+    if (kv.second == job_task && tasks_.at(job_task).empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void StageQueue::set_memory_budget(MemoryBudget* budget) { budget_ = budget; }
+
+void StageQueue::clear() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  tasks_.clear();
+  unclaimed_.clear();
+  claims_.clear();
+  exit_messages_.clear();
+  size_ = 0;
+  lock.unlock();
+  not_full_.notify_all();
+  not_empty_.notify_all();
+}
+
+}
+}
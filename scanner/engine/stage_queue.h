@@ -0,0 +1,81 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/engine/memory_budget.h"
+#include "scanner/engine/runtime.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace scanner {
+namespace internal {
+
+// Input queue shared by the replicas of a pipeline stage. Replicas pull from
+// it concurrently, but each task is claimed by a single replica which
+// receives all of the task's entries in the order they were pushed. Workers
+// downstream therefore see every task as one contiguous, ordered stream no
+// matter how many replicas the stage has.
+class StageQueue {
+ public:
+  using Entry = std::tuple<std::deque<TaskStream>, EvalWorkEntry>;
+
+  StageQueue(i32 max_size = 4);
+  StageQueue(StageQueue&& o);
+
+  // Blocks while the queue is full, unless the entry belongs to a task whose
+  // replica is waiting for it
+  void push(Entry item);
+
+  // Next entry of the task claimed by the replica, or the first entry of the
+  // oldest unclaimed task. The claim is released once the last entry of the
+  // task is popped. Exit messages (job index -1) are only handed to replicas
+  // without a claim once no unclaimed task is waiting.
+  void pop(i32 replica, Entry& item);
+
+  // Whether a replica has claimed the task and is waiting for its next entry
+  bool awaited(i64 job_index, i64 task_index);
+
+  // Reservations in the budget are woken whenever a replica starts waiting
+  // for the next entry of its task, so they can check awaited again
+  void set_memory_budget(MemoryBudget* budget);
+
+  // Drops all entries and claims
+  void clear();
+
+ private:
+  using JobTask = std::tuple<i64, i64>;
+
+  i32 max_size_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  // Entries of each task in the order they were pushed
+  std::map<JobTask, std::deque<Entry>> tasks_;
+  // Tasks with entries which no replica has claimed yet, oldest first
+  std::deque<JobTask> unclaimed_;
+  // Replica -> task it is working on
+  std::map<i32, JobTask> claims_;
+  std::deque<Entry> exit_messages_;
+  i32 size_ = 0;
+  MemoryBudget* budget_ = nullptr;
+};
+
+}
+}
@@ -14,6 +14,11 @@
  */
 
 #include "scanner/engine/table_meta_cache.h"
+#include "scanner/util/thread_pool.h"
+
+#include <algorithm>
+#include <future>
+#include <set>
 
 namespace scanner {
 namespace internal {
@@ -25,13 +30,13 @@ TableMetaCache::TableMetaCache(storehouse::StorageBackend* storage,
 const TableMetadata& TableMetaCache::at(const std::string& table_name) const {
   i32 table_id = meta_.get_table_id(table_name);
   memoized_read(table_id);
-  std::lock_guard<std::mutex> lock(lock_);
+  std::shared_lock<std::shared_timed_mutex> lock(lock_);
   return cache_.at(table_id);
 }
 
 const TableMetadata& TableMetaCache::at(i32 table_id) const {
   memoized_read(table_id);
-  std::lock_guard<std::mutex> lock(lock_);
+  std::shared_lock<std::shared_timed_mutex> lock(lock_);
   return cache_.at(table_id);
 }
 
@@ -44,11 +49,38 @@ bool TableMetaCache::exists(i32 table_id) const {
 }
 
 void TableMetaCache::update(const TableMetadata& meta) {
-  std::lock_guard<std::mutex> lock(lock_);
+  std::unique_lock<std::shared_timed_mutex> lock(lock_);
   i32 table_id = meta_.get_table_id(meta.name());
   cache_[table_id] = meta;
 }
 
+void TableMetaCache::prefetch(const std::vector<i32>& table_ids,
+                              i32 num_threads) const {
+  std::vector<i32> missing;
+  {
+    std::set<i32> seen;
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
+    for (i32 table_id : table_ids) {
+      if (seen.insert(table_id).second && cache_.count(table_id) == 0 &&
+          meta_.has_table(table_id)) {
+        missing.push_back(table_id);
+      }
+    }
+  }
+  if (missing.empty()) {
+    return;
+  }
+  ThreadPool prefetch_pool(
+      std::max(1, std::min(num_threads, static_cast<i32>(missing.size()))));
+  std::vector<std::future<void>> futures;
+  for (i32 table_id : missing) {
+    futures.emplace_back(prefetch_pool.enqueue(
+        [this](i32 id) { memoized_read(id); }, table_id));
+  }
+  for (auto& future : futures) {
+    future.wait();
+  }
+}
 
 void TableMetaCache::memoized_read(const std::string& table_name) const {
   memoized_read(meta_.get_table_id(table_name));
@@ -57,13 +89,13 @@ void TableMetaCache::memoized_read(const std::string& table_name) const {
 void TableMetaCache::memoized_read(i32 table_id) const {
   bool b;
   {
-    std::lock_guard<std::mutex> lock(lock_);
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
     b = cache_.count(table_id) == 0 && meta_.has_table(table_id);
   }
   if (b) {
     std::string table_path = TableMetadata::descriptor_path(table_id);
     TableMetadata meta = read_table_metadata(storage_, table_path);
-    std::lock_guard<std::mutex> lock(lock_);
+    std::unique_lock<std::shared_timed_mutex> lock(lock_);
     cache_.insert({table_id, meta});
   }
 }
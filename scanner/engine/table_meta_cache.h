@@ -19,6 +19,7 @@
 
 #include <map>
 #include <mutex>
+#include <shared_mutex>
 
 namespace scanner {
 namespace internal {
@@ -38,6 +39,10 @@ class TableMetaCache {
 
   void update(const TableMetadata& meta);
 
+  // Read the descriptors of the given tables that are not cached yet, using
+  // up to num_threads concurrent reads
+  void prefetch(const std::vector<i32>& table_ids, i32 num_threads) const;
+
  private:
   void memoized_read(const std::string& table_name) const;
 
@@ -45,7 +50,8 @@ class TableMetaCache {
 
   storehouse::StorageBackend* storage_;
   const DatabaseMetadata& meta_;
-  mutable std::mutex lock_;
+  // Readers share the lock so lookups of cached tables do not serialize
+  mutable std::shared_timed_mutex lock_;
   mutable std::map<i32, TableMetadata> cache_;
 };
 
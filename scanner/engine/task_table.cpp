@@ -0,0 +1,56 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/task_table.h"
+
+namespace scanner {
+namespace internal {
+
+void TaskTable::add_job(const std::vector<i64>& partition_boundaries) {
+  jobs_.emplace_back();
+  auto& tasks = jobs_.back();
+  if (partition_boundaries.size() < 2) {
+    return;
+  }
+  tasks.reserve(partition_boundaries.size() - 1);
+  for (size_t pi = 0; pi < partition_boundaries.size() - 1; ++pi) {
+    tasks.push_back({partition_boundaries[pi], partition_boundaries[pi + 1]});
+  }
+  total_tasks_ += tasks.size();
+}
+
+i64 TaskTable::num_task_rows(i64 job_idx, i64 task_idx) const {
+  const TaskDescriptor& task = jobs_.at(job_idx).at(task_idx);
+  return task.end - task.start;
+}
+
+void TaskTable::task_rows(i64 job_idx, i64 task_idx,
+                          proto::TaskRows* rows) const {
+  const TaskDescriptor& task = jobs_.at(job_idx).at(task_idx);
+  rows->set_start(task.start);
+  rows->set_end(task.end);
+}
+
+void TaskTable::clear() {
+  jobs_.clear();
+  total_tasks_ = 0;
+}
+
+RowSet task_rows_to_row_set(const proto::TaskRows& rows) {
+  return RowSet::from_range(rows.start(), rows.end());
+}
+
+}
+}
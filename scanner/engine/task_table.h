@@ -0,0 +1,64 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/engine/row_set.h"
+#include "scanner/engine/rpc.pb.h"
+#include "scanner/util/common.h"
+
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+// Output rows of a task: [start, end)
+struct TaskDescriptor {
+  i64 start;
+  i64 end;
+};
+
+// Output rows of every task of every job in a bulk job. Tasks are kept as
+// range descriptors so the table stays small even for millions of tasks.
+// Samplers act upstream of the output rows, so every task is a contiguous
+// range of its job's output.
+class TaskTable {
+ public:
+  // Add a job whose tasks are the ranges between consecutive boundaries
+  void add_job(const std::vector<i64>& partition_boundaries);
+
+  i64 num_jobs() const { return jobs_.size(); }
+
+  i64 num_tasks(i64 job_idx) const { return jobs_.at(job_idx).size(); }
+
+  i64 total_tasks() const { return total_tasks_; }
+
+  i64 num_task_rows(i64 job_idx, i64 task_idx) const;
+
+  void task_rows(i64 job_idx, i64 task_idx, proto::TaskRows* rows) const;
+
+  void clear();
+
+ private:
+  // Job -> Task -> descriptor
+  std::vector<std::vector<TaskDescriptor>> jobs_;
+  i64 total_tasks_ = 0;
+};
+
+// Rows described by a task's descriptor
+RowSet task_rows_to_row_set(const proto::TaskRows& rows);
+
+}
+}
@@ -21,15 +21,18 @@ namespace internal {
 std::unique_ptr<storehouse::RandomReadFile> VideoIndexEntry::open_file() const {
   std::unique_ptr<storehouse::RandomReadFile> file;
   const std::string p =
-      inplace ? path : table_item_output_path(table_id, column_id, item_id);
+      inplace ? path
+              : table_item_output_path(table_id, column_id, item_id, attempt);
   BACKOFF_FAIL(storehouse::make_unique_random_read_file(storage, p, file));
   return std::move(file);
 }
 
 VideoIndexEntry read_video_index(storehouse::StorageBackend* storage,
-                                 i32 table_id, i32 column_id, i32 item_id) {
+                                 i32 table_id, i32 column_id, i32 item_id,
+                                 i32 attempt) {
   VideoMetadata video_meta = read_video_metadata(
-      storage, VideoMetadata::descriptor_path(table_id, column_id, item_id));
+      storage,
+      VideoMetadata::descriptor_path(table_id, column_id, item_id, attempt));
   return read_video_index(storage, video_meta);
 }
 
@@ -48,6 +51,7 @@ VideoIndexEntry read_video_index(storehouse::StorageBackend* storage,
   index_entry.table_id = table_id;
   index_entry.column_id = column_id;
   index_entry.item_id = item_id;
+  index_entry.attempt = video_meta.attempt();
   index_entry.width = video_meta.width();
   index_entry.height = video_meta.height();
   index_entry.channels = video_meta.channels();
@@ -33,6 +33,7 @@ struct VideoIndexEntry {
   i32 table_id;
   i32 column_id;
   i32 item_id;
+  i32 attempt;
   i32 width;
   i32 height;
   i32 channels;
@@ -51,7 +52,8 @@ struct VideoIndexEntry {
 };
 
 VideoIndexEntry read_video_index(storehouse::StorageBackend *storage,
-                                 i32 table_id, i32 column_id, i32 item_id);
+                                 i32 table_id, i32 column_id, i32 item_id,
+                                 i32 attempt = 0);
 
 VideoIndexEntry read_video_index(storehouse::StorageBackend *storage,
                                  const VideoMetadata& video_meta);
@@ -17,13 +17,17 @@
 #include "scanner/engine/evaluate_worker.h"
 #include "scanner/engine/kernel_registry.h"
 #include "scanner/engine/load_worker.h"
+#include "scanner/engine/memory_budget.h"
 #include "scanner/engine/runtime.h"
 #include "scanner/engine/save_worker.h"
+#include "scanner/engine/stage_queue.h"
 #include "scanner/engine/table_meta_cache.h"
 #include "scanner/engine/python_kernel.h"
 #include "scanner/engine/dag_analysis.h"
+#include "scanner/engine/task_table.h"
 #include "scanner/util/cuda.h"
 #include "scanner/util/glog.h"
+#include "scanner/util/numa.h"
 #include "scanner/util/thread_pool.h"
 #include "scanner/util/grpc.h"
 
@@ -52,6 +56,8 @@ inline bool operator==(const MemoryPoolConfig& lhs,
                        const MemoryPoolConfig& rhs) {
   return (lhs.cpu().use_pool() == rhs.cpu().use_pool()) &&
          (lhs.cpu().free_space() == rhs.cpu().free_space()) &&
+         (lhs.cpu().huge_page_size() == rhs.cpu().huge_page_size()) &&
+         (lhs.cpu().prefault() == rhs.cpu().prefault()) &&
          (lhs.gpu().use_pool() == rhs.gpu().use_pool()) &&
          (lhs.gpu().free_space() == rhs.gpu().free_space());
 }
@@ -61,8 +67,83 @@ inline bool operator!=(const MemoryPoolConfig& lhs,
   return !(lhs == rhs);
 }
 
+// Tasks this node should abandon because another node finished them first
+struct CancelledTasks {
+  std::mutex mutex;
+  std::set<std::tuple<i64, i64>> tasks;
+
+  void add(
+      const google::protobuf::RepeatedPtrField<proto::JobTask>& job_tasks) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto& t : job_tasks) {
+      tasks.insert(std::make_tuple(t.job_index(), t.task_index()));
+    }
+  }
+
+  bool take(i64 job_idx, i64 task_idx) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return tasks.erase(std::make_tuple(job_idx, task_idx)) > 0;
+  }
+
+  bool contains(i64 job_idx, i64 task_idx) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return tasks.count(std::make_tuple(job_idx, task_idx)) > 0;
+  }
+};
+
+// Bytes of the element buffers of an entry
+i64 work_entry_bytes(const EvalWorkEntry& entry) {
+  i64 bytes = 0;
+  for (auto& column : entry.columns) {
+    for (auto& element : column) {
+      if (element.is_null()) {
+        continue;
+      }
+      bytes += element.is_frame ? element.as_const_frame()->size()
+                                : element.size;
+    }
+  }
+  return bytes;
+}
+
+// Reserves the bytes of an entry a stage is about to hand downstream. An
+// entry of a task a replica of the next stage is waiting on is always let
+// through, since the budget may be full of entries the replica can not take
+// until it finishes that task.
+void reserve_work_entry(MemoryBudget& budget, Profiler& profiler,
+                        EvalWorkEntry& entry,
+                        StageQueue* output_queue = nullptr) {
+  auto start = now();
+  entry.reserved_bytes = work_entry_bytes(entry);
+  i64 job_index = entry.job_index;
+  i64 task_index = entry.task_index;
+  std::function<bool()> awaited;
+  if (output_queue != nullptr) {
+    awaited = [=] { return output_queue->awaited(job_index, task_index); };
+  }
+  if (budget.reserve(entry.reserved_bytes, awaited)) {
+    profiler.add_interval("memory_budget", start, now());
+  }
+}
+
+// Starts a thread which only runs on the CPUs of a NUMA node, or anywhere if
+// the node is -1
+template <typename Function, typename... Args>
+std::thread start_thread_on_node(i32 node, Function&& f, Args&&... args) {
+  return std::thread(
+      [node](auto&& f, auto&&... args) {
+        if (node >= 0) {
+          pin_thread_to_numa_node(node);
+        }
+        f(std::forward<decltype(args)>(args)...);
+      },
+      std::forward<Function>(f), std::forward<Args>(args)...);
+}
+
 void load_driver(LoadInputQueue& load_work,
-                 std::vector<EvalQueue>& initial_eval_work,
+                 std::vector<StageQueue>& initial_eval_work,
+                 SaveOutputQueue& retired_tasks,
+                 CancelledTasks& cancelled_tasks, MemoryBudget& budget,
                  LoadWorkerArgs args) {
   Profiler& profiler = args.profiler;
   LoadWorker worker(args);
@@ -81,14 +162,29 @@ void load_driver(LoadInputQueue& load_work,
       break;
     }
 
+    // A backup copy of this task already finished elsewhere, so retire it
+    // without doing any work
+    if (cancelled_tasks.take(load_work_entry.job_index(),
+                             load_work_entry.task_index())) {
+      VLOG(1) << "Load (N/PU: " << args.node_id << "/" << args.worker_id
+              << "): skipping cancelled job task ("
+              << load_work_entry.job_index() << ", "
+              << load_work_entry.task_index() << ")";
+      retired_tasks.push(std::make_tuple(output_queue_idx,
+                                         load_work_entry.job_index(),
+                                         load_work_entry.task_index()));
+      continue;
+    }
+
     VLOG(2) << "Load (N/PU: " << args.node_id << "/" << args.worker_id
             << "): processing job task (" << load_work_entry.job_index() << ", "
             << load_work_entry.task_index() << ")";
 
     auto work_start = now();
 
-    auto input_entry = load_work_entry;
-    worker.feed(input_entry);
+    i64 job_index = load_work_entry.job_index();
+    i64 task_index = load_work_entry.task_index();
+    worker.feed(std::move(load_work_entry));
 
     while (true) {
       EvalWorkEntry output_entry;
@@ -97,8 +193,12 @@ void load_driver(LoadInputQueue& load_work,
         auto& work_entry = output_entry;
         work_entry.first = !task_streams.empty();
         work_entry.last_in_task = worker.done();
+        // Each load output is a whole IO packet
+        work_entry.last_in_io_packet = true;
+        reserve_work_entry(budget, profiler, work_entry,
+                           &initial_eval_work[output_queue_idx]);
         initial_eval_work[output_queue_idx].push(
-            std::make_tuple(task_streams, work_entry));
+            std::make_tuple(std::move(task_streams), std::move(work_entry)));
         // We use the task streams being empty to indicate that this is
         // a new task, so clear it here to show that this is from the same task
         task_streams.clear();
@@ -108,8 +208,8 @@ void load_driver(LoadInputQueue& load_work,
     }
     profiler.add_interval("task", work_start, now());
     VLOG(2) << "Load (N/PU: " << args.node_id << "/" << args.worker_id
-            << "): finished job task (" << load_work_entry.job_index() << ", "
-            << load_work_entry.task_index() << "), pushed to worker "
+            << "): finished job task (" << job_index << ", " << task_index
+            << "), pushed to worker "
             << output_queue_idx;
   }
   VLOG(1) << "Load (N/PU: " << args.node_id << "/" << args.worker_id
@@ -120,69 +220,30 @@ std::map<int, std::mutex> no_pipelining_locks;
 std::map<int, std::condition_variable> no_pipelining_cvars;
 std::map<int, bool> no_pipelining_conditions;
 
-void pre_evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
-                         PreEvaluateWorkerArgs args) {
+void pre_evaluate_driver(StageQueue& input_work, StageQueue& output_work,
+                         MemoryBudget& budget, PreEvaluateWorkerArgs args) {
   Profiler& profiler = args.profiler;
   PreEvaluateWorker worker(args);
-  // We sort inputs into task work queues to ensure we process them
-  // sequentially
-  std::map<std::tuple<i32, i32>,
-           Queue<std::tuple<std::deque<TaskStream>, EvalWorkEntry>>>
-      task_work_queue;
   i32 work_packet_size = args.work_packet_size;
-
-  std::tuple<i32, i32> active_job_task = std::make_tuple(-1, -1);
   while (true) {
     auto idle_start = now();
 
-    // If we have no work at all or we do not have work for our current task..
-    if (task_work_queue.empty() ||
-        (std::get<0>(active_job_task) != -1 &&
-         task_work_queue.at(active_job_task).size() <= 0)) {
-      std::tuple<std::deque<TaskStream>, EvalWorkEntry> entry;
-      input_work.pop(entry);
-
-
-      auto& task_streams = std::get<0>(entry);
-      EvalWorkEntry& work_entry = std::get<1>(entry);
-      VLOG(1) << "Pre-evaluate (N/KI: " << args.node_id << "/" << args.worker_id
-              << "): got work " << work_entry.job_index << " " << work_entry.task_index;
-      if (work_entry.job_index == -1) {
-        break;
-      }
-
-      VLOG(1) << "Pre-evaluate (N/KI: " << args.node_id << "/" << args.worker_id
-              << "): "
-              << "received job task " << work_entry.job_index << ", "
-              << work_entry.task_index;
+    // The input queue hands us every entry of a task in order before
+    // moving on to another task
+    std::tuple<std::deque<TaskStream>, EvalWorkEntry> entry;
+    input_work.pop(args.replica, entry);
 
-      task_work_queue[std::make_tuple(work_entry.job_index,
-                                      work_entry.task_index)]
-          .push(entry);
-    }
+    auto& task_streams = std::get<0>(entry);
+    EvalWorkEntry& work_entry = std::get<1>(entry);
 
     args.profiler.add_interval("idle", idle_start, now());
 
-    if (std::get<0>(active_job_task) == -1) {
-      // Choose the next task to work on
-      active_job_task = task_work_queue.begin()->first;
-    }
-
-    // Wait until we have the next io item for the current task
-    if (task_work_queue.at(active_job_task).size() <= 0) {
-      std::this_thread::yield();
-      continue;
+    if (work_entry.job_index == -1) {
+      break;
     }
 
-    // Grab next entry for active task
-    std::tuple<std::deque<TaskStream>, EvalWorkEntry> entry;
-    task_work_queue.at(active_job_task).pop(entry);
-
-    auto& task_streams = std::get<0>(entry);
-    EvalWorkEntry& work_entry = std::get<1>(entry);
-
-    VLOG(1) << "Pre-evaluate (N/KI: " << args.node_id << "/" << args.worker_id
-            << "): "
+    VLOG(1) << "Pre-evaluate (N/KI/R: " << args.node_id << "/"
+            << args.worker_id << "/" << args.replica << "): "
             << "processing job task " << work_entry.job_index << ", "
             << work_entry.task_index;
 
@@ -194,10 +255,10 @@ void pre_evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
     }
 
     bool first = work_entry.first;
-    bool last = work_entry.last_in_task;
 
-    auto input_entry = work_entry;
-    worker.feed(input_entry, first);
+    i64 input_bytes = work_entry.reserved_bytes;
+    worker.feed(std::move(work_entry), first);
+    budget.release(input_bytes);
     i32 rows_used = 0;
     while (rows_used < total_rows) {
       EvalWorkEntry output_entry;
@@ -209,12 +270,14 @@ void pre_evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
         no_pipelining_conditions[args.worker_id] = true;
       }
 
+      reserve_work_entry(budget, profiler, output_entry, &output_work);
       if (first) {
-        output_work.push(std::make_tuple(task_streams, output_entry));
+        output_work.push(
+            std::make_tuple(std::move(task_streams), std::move(output_entry)));
         first = false;
       } else {
-        output_work.push(
-            std::make_tuple(std::deque<TaskStream>(), output_entry));
+        output_work.push(std::make_tuple(std::deque<TaskStream>(),
+                                         std::move(output_entry)));
       }
 
       if (std::getenv("NO_PIPELINING")) {
@@ -226,27 +289,22 @@ void pre_evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
       rows_used += work_packet_size;
     }
 
-    if (last) {
-      task_work_queue.erase(active_job_task);
-      active_job_task = std::make_tuple(-1, -1);
-    }
-
     profiler.add_interval("task", work_start, now());
   }
 
-  VLOG(1) << "Pre-evaluate (N/PU: " << args.node_id << "/" << args.worker_id
-          << "): thread finished ";
+  VLOG(1) << "Pre-evaluate (N/PU/R: " << args.node_id << "/" << args.worker_id
+          << "/" << args.replica << "): thread finished ";
 }
 
-void evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
-                     EvaluateWorkerArgs args) {
+void evaluate_driver(StageQueue& input_work, StageQueue& output_work,
+                     MemoryBudget& budget, EvaluateWorkerArgs args) {
   Profiler& profiler = args.profiler;
   EvaluateWorker worker(args);
   while (true) {
     auto idle_pull_start = now();
 
     std::tuple<std::deque<TaskStream>, EvalWorkEntry> entry;
-    input_work.pop(entry);
+    input_work.pop(args.replica, entry);
 
     auto& task_streams = std::get<0>(entry);
     EvalWorkEntry& work_entry = std::get<1>(entry);
@@ -257,9 +315,9 @@ void evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
       break;
     }
 
-    VLOG(1) << "Evaluate (N/KI/G: " << args.node_id << "/" << args.ki << "/"
-            << args.kg << "): processing job task " << work_entry.job_index
-            << ", " << work_entry.task_index;
+    VLOG(1) << "Evaluate (N/KI/G/R: " << args.node_id << "/" << args.ki << "/"
+            << args.kg << "/" << args.replica << "): processing job task "
+            << work_entry.job_index << ", " << work_entry.task_index;
 
     auto work_start = now();
 
@@ -268,7 +326,7 @@ void evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
       std::vector<TaskStream> streams;
       for (i32 i = 0; i < args.arg_group.kernel_factories.size(); ++i) {
         assert(!task_streams.empty());
-        streams.push_back(task_streams.front());
+        streams.push_back(std::move(task_streams.front()));
         task_streams.pop_front();
       }
       worker.new_task(work_entry.job_index, work_entry.task_index, streams);
@@ -280,8 +338,9 @@ void evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
           std::max(work_packet_size, (i32)work_entry.columns[i].size());
     }
 
-    auto input_entry = work_entry;
-    worker.feed(input_entry);
+    i64 input_bytes = work_entry.reserved_bytes;
+    worker.feed(std::move(work_entry));
+    budget.release(input_bytes);
     EvalWorkEntry output_entry;
     bool result = worker.yield(work_packet_size, output_entry);
     (void)result;
@@ -289,8 +348,10 @@ void evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
 
     profiler.add_interval("task", work_start, now());
 
+    reserve_work_entry(budget, profiler, output_entry, &output_work);
     auto idle_push_start = now();
-    output_work.push(std::make_tuple(task_streams, output_entry));
+    output_work.push(
+        std::make_tuple(std::move(task_streams), std::move(output_entry)));
     args.profiler.add_interval("idle_push", idle_push_start, now());
 
   }
@@ -298,15 +359,17 @@ void evaluate_driver(EvalQueue& input_work, EvalQueue& output_work,
           << "): thread finished";
 }
 
-void post_evaluate_driver(EvalQueue& input_work, OutputEvalQueue& output_work,
-                          PostEvaluateWorkerArgs args) {
+void post_evaluate_driver(StageQueue& input_work, OutputEvalQueue& output_work,
+                          MemoryBudget& budget, PostEvaluateWorkerArgs args) {
   Profiler& profiler = args.profiler;
   PostEvaluateWorker worker(args);
   while (true) {
     auto idle_start = now();
 
+    // Post evaluate buffers rows across entries, so it always runs as a
+    // single replica which sees each task in order
     std::tuple<std::deque<TaskStream>, EvalWorkEntry> entry;
-    input_work.pop(entry);
+    input_work.pop(0, entry);
     EvalWorkEntry& work_entry = std::get<1>(entry);
 
     args.profiler.add_interval("idle", idle_start, now());
@@ -321,15 +384,18 @@ void post_evaluate_driver(EvalQueue& input_work, OutputEvalQueue& output_work,
 
     auto work_start = now();
 
-    auto input_entry = work_entry;
-    worker.feed(input_entry);
+    bool last_in_task = work_entry.last_in_task;
+    i64 input_bytes = work_entry.reserved_bytes;
+    worker.feed(std::move(work_entry));
+    budget.release(input_bytes);
     EvalWorkEntry output_entry;
     bool result = worker.yield(output_entry);
     profiler.add_interval("task", work_start, now());
 
     if (result) {
-      output_entry.last_in_task = work_entry.last_in_task;
-      output_work.push(std::make_tuple(args.id, output_entry));
+      output_entry.last_in_task = last_in_task;
+      reserve_work_entry(budget, profiler, output_entry);
+      output_work.push(std::make_tuple(args.id, std::move(output_entry)));
     }
 
     if (std::getenv("NO_PIPELINING")) {
@@ -345,9 +411,10 @@ void post_evaluate_driver(EvalQueue& input_work, OutputEvalQueue& output_work,
           << "): thread finished ";
 }
 
+// Pipeline instance -> save workers its tasks may be handed to
 void save_coordinator(OutputEvalQueue& eval_work,
-                      std::vector<SaveInputQueue>& save_work) {
-  i32 num_save_workers = save_work.size();
+                      std::vector<SaveInputQueue>& save_work,
+                      std::vector<std::vector<i32>> instance_save_workers) {
   std::map<std::tuple<i32, i32>, i32> task_to_worker_mapping;
   i32 last_worker_assigned = 0;
   while (true) {
@@ -367,21 +434,22 @@ void save_coordinator(OutputEvalQueue& eval_work,
         std::make_tuple(work_entry.job_index, work_entry.task_index);
     if (task_to_worker_mapping.count(job_task_id) == 0) {
       // Assign worker to this task
+      auto& candidates = instance_save_workers.at(std::get<0>(entry));
       task_to_worker_mapping[job_task_id] =
-          last_worker_assigned++ % num_save_workers;
+          candidates[last_worker_assigned++ % candidates.size()];
     }
 
     i32 assigned_worker = task_to_worker_mapping.at(job_task_id);
-    save_work[assigned_worker].push(entry);
-
     if (work_entry.last_in_task) {
       task_to_worker_mapping.erase(job_task_id);
     }
+    save_work[assigned_worker].push(std::move(entry));
   }
 }
 
 void save_driver(SaveInputQueue& save_work,
                  SaveOutputQueue& output_work,
+                 CancelledTasks& cancelled_tasks, MemoryBudget& budget,
                  SaveWorkerArgs args) {
   Profiler& profiler = args.profiler;
   std::map<std::tuple<i32, i32>, std::unique_ptr<SaveWorker>> workers;
@@ -409,28 +477,46 @@ void save_driver(SaveInputQueue& save_work,
     // Check if we have a worker for this task
     auto job_task_id =
         std::make_tuple(work_entry.job_index, work_entry.task_index);
+    bool cancelled =
+        cancelled_tasks.contains(work_entry.job_index, work_entry.task_index);
     if (workers.count(job_task_id) == 0) {
       SaveWorker* worker = new SaveWorker(args);
-      worker->new_task(work_entry.table_id, work_entry.task_index,
-                       work_entry.column_types);
+      // A backup copy of this task already committed its outputs, so there
+      // is no point in creating the files
+      if (!cancelled) {
+        worker->new_task(work_entry.table_id, work_entry.task_index,
+                         work_entry.attempt, work_entry.column_types);
+      }
       workers[job_task_id].reset(worker);
     }
 
     auto& worker = workers.at(job_task_id);
+    if (cancelled && !worker->cancelled()) {
+      VLOG(1) << "Save (N/KI: " << args.node_id << "/" << args.worker_id
+              << "): dropping outputs of cancelled job task ("
+              << work_entry.job_index << ", " << work_entry.task_index << ")";
+      worker->cancel();
+    }
 
-    auto input_entry = work_entry;
-    worker->feed(input_entry);
+    i64 job_index = work_entry.job_index;
+    i64 task_index = work_entry.task_index;
+    bool last_in_task = work_entry.last_in_task;
+    i64 input_bytes = work_entry.reserved_bytes;
+    worker->feed(std::move(work_entry));
+    budget.release(input_bytes);
 
     VLOG(1) << "Save (N/KI: " << args.node_id << "/" << args.worker_id
-            << "): finished task (" << work_entry.job_index << ", "
-            << work_entry.task_index << ")";
+            << "): finished task (" << job_index << ", " << task_index << ")";
 
     args.profiler.add_interval("task", work_start, now());
 
-    if (work_entry.last_in_task) {
-      output_work.push(std::make_tuple(pipeline_instance, work_entry.job_index,
-                                       work_entry.task_index));
+    if (last_in_task) {
+      // Destroying the save worker saves the task's files, which must happen
+      // before the task is reported finished and checkpointed by the master
       workers.erase(job_task_id);
+      cancelled_tasks.take(job_index, task_index);
+      output_work.push(
+          std::make_tuple(pipeline_instance, job_index, task_index));
     }
   }
 
@@ -465,6 +551,7 @@ WorkerImpl::WorkerImpl(DatabaseParameters& db_params,
 
   storage_ =
       storehouse::StorageBackend::make_from_config(db_params_.storage_config);
+  read_ahead_cache_.reset(new ReadAheadCache(db_params_.storage_config));
 
   // Set up Python runtime if any kernels need it
   Py_Initialize();
@@ -491,6 +578,8 @@ WorkerImpl::~WorkerImpl() {
     watchdog_thread_.join();
   }
   delete storage_;
+  read_ahead_cache_.reset();
+  decoder_pool_.clear();
   if (memory_pool_initialized_) {
     destroy_memory_allocators();
   }
@@ -499,6 +588,10 @@ WorkerImpl::~WorkerImpl() {
 grpc::Status WorkerImpl::NewJob(grpc::ServerContext* context,
                                 const proto::BulkJobParameters* job_params,
                                 proto::Result* job_result) {
+  if (draining_) {
+    RESULT_ERROR(job_result, "This worker is draining!");
+    return grpc::Status::OK;
+  }
   // Ensure that only one job is running at a time and that the worker
   // is in idle mode before transitioning to job start
   State state = state_.get();
@@ -506,6 +599,12 @@ grpc::Status WorkerImpl::NewJob(grpc::ServerContext* context,
   while (!ready) {
     switch (state) {
       case RUNNING_JOB: {
+        if (finished_) {
+          // The previous job already reported it finished to the master and
+          // is only tearing down its pipeline
+          state_.wait_for_change(RUNNING_JOB);
+          break;
+        }
         RESULT_ERROR(job_result, "This worker is already running a job!");
         return grpc::Status::OK;
       }
@@ -530,16 +629,23 @@ grpc::Status WorkerImpl::NewJob(grpc::ServerContext* context,
   job_result->set_success(true);
   set_database_path(db_params_.db_path);
 
-  job_params_.Clear();
-  job_params_.MergeFrom(*job_params);
-  {
-    std::unique_lock<std::mutex> lock(finished_mutex_);
-    finished_ = false;
-  }
-  finished_cv_.notify_all();
-
   {
+    // The job is handed over under the lock Drain sets draining_ with, so a
+    // drain either reaches the job processor before this job or is seen by
+    // the job itself
     std::unique_lock<std::mutex> lock(active_mutex_);
+    if (draining_) {
+      state_.test_and_set(RUNNING_JOB, IDLE);
+      RESULT_ERROR(job_result, "This worker is draining!");
+      return grpc::Status::OK;
+    }
+    job_params_.Clear();
+    job_params_.MergeFrom(*job_params);
+    {
+      std::unique_lock<std::mutex> finished_lock(finished_mutex_);
+      finished_ = false;
+    }
+    finished_cv_.notify_all();
     active_bulk_job_ = true;
   }
   active_cv_.notify_all();
@@ -635,7 +741,8 @@ grpc::Status WorkerImpl::RegisterPythonKernel(
   bool can_batch = (batch_size > 1);
   KernelFactory* factory =
       new KernelFactory(op_name, device_type, 1, input_devices, output_devices,
-                        can_batch, batch_size, constructor);
+                        can_batch, batch_size, batch_size, batch_size,
+                        constructor);
   // Register the kernel
   KernelRegistry* registry = get_kernel_registry();
   registry->add_kernel(op_name, factory);
@@ -671,6 +778,20 @@ grpc::Status WorkerImpl::Shutdown(grpc::ServerContext* context,
   return grpc::Status::OK;
 }
 
+grpc::Status WorkerImpl::Drain(grpc::ServerContext* context,
+                               const proto::Empty* empty, Result* result) {
+  VLOG(1) << "Worker " << node_id_ << " received Drain command";
+  // A running job stops requesting work. The job processor leaves once no
+  // job is left to run, which it checks under the same lock.
+  {
+    std::unique_lock<std::mutex> lock(active_mutex_);
+    draining_ = true;
+  }
+  active_cv_.notify_all();
+  result->set_success(true);
+  return grpc::Status::OK;
+}
+
 grpc::Status WorkerImpl::PokeWatchdog(grpc::ServerContext* context,
                                       const proto::Empty* empty,
                                       proto::Empty* result) {
@@ -772,17 +893,30 @@ void WorkerImpl::try_unregister() {
 void WorkerImpl::start_job_processor() {
   job_processor_thread_ = std::thread([this]() {
     while (!trigger_shutdown_.raised()) {
+      bool drain = false;
       // Wait on not finished
       {
         std::unique_lock<std::mutex> lock(active_mutex_);
         active_cv_.wait(lock, [this] {
-          return active_bulk_job_ || trigger_shutdown_.raised();
+          return active_bulk_job_ || draining_ || trigger_shutdown_.raised();
         });
+        // A job handed over before the drain still runs and stops taking
+        // tasks. NewJob refuses jobs offered after it.
+        drain = draining_ && !active_bulk_job_;
       }
       if (trigger_shutdown_.raised()) break;
+      if (drain) {
+        // Every accepted task has been reported to the master, so it has
+        // nothing to reassign when this worker leaves
+        state_.set(SHUTTING_DOWN);
+        try_unregister();
+        trigger_shutdown_.set();
+        break;
+      }
       // Start processing job
       bool result = process_job(&job_params_, &job_result_);
-      // Set to idle if we finished without a shutdown
+      // Set to idle if we finished without a shutdown. A drain which arrived
+      // during the job is picked up by the wait above.
       state_.test_and_set(RUNNING_JOB, IDLE);
     }
   });
@@ -802,13 +936,28 @@ void WorkerImpl::stop_job_processor() {
 
 static const i32 NUM_PREFETCH_THREADS = 64;
 
+// Longest the job loop blocks waiting for a task to retire before it checks
+// for shutdown and drain requests again
+static const i32 WORKER_LOOP_WAKEUP_INTERVAL_MS = 100;
+// Longest the job loop waits after a wait for work signal before asking the
+// master again when none of its tasks retire in the meantime
+static const i32 WAIT_FOR_WORK_INTERVAL_MS = 1000;
+
 bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
                              proto::Result* job_result) {
   job_result->set_success(true);
   auto finished_fn = [&]() {
+    // Set before telling the master so that a NewJob which arrives right
+    // after waits for this job to wind down instead of being refused
+    {
+      std::unique_lock<std::mutex> lock(finished_mutex_);
+      finished_ = true;
+    }
+    finished_cv_.notify_all();
     {
       proto::FinishedJobParams node_info;
       node_info.set_node_id(node_id_);
+      node_info.set_bulk_job_sequence(job_params->bulk_job_sequence());
       proto::Empty empty;
       grpc::Status status;
       GRPC_BACKOFF(master_->FinishedJob(&ctx, node_info, &empty), status);
@@ -820,12 +969,7 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
     }
 
     {
-      std::unique_lock<std::mutex> lock(finished_mutex_);
-      finished_ = true;
-    }
-    finished_cv_.notify_all();
-    {
-      std::unique_lock<std::mutex> lock(finished_mutex_);
+      std::unique_lock<std::mutex> lock(active_mutex_);
       active_bulk_job_ = false;
     }
     active_cv_.notify_all();
@@ -841,24 +985,11 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
   // Initialize worker table metadata
   if (db_params_.prefetch_table_metadata) {
     VLOG(1) << "Prefetching table metadata";
-    auto load_table_meta = [&](const std::string& table_name) {
-      std::string table_path =
-          TableMetadata::descriptor_path(meta.get_table_id(table_name));
-      table_meta.update(read_table_metadata(storage_, table_path));
-    };
-
-    VLOG(1) << "Spawning thread pool";
-    ThreadPool prefetch_pool(NUM_PREFETCH_THREADS);
-    std::vector<std::future<void>> futures;
+    std::vector<i32> table_ids;
     for (const auto& t : meta.table_names()) {
-      futures.emplace_back(prefetch_pool.enqueue(load_table_meta, t));
+      table_ids.push_back(meta.get_table_id(t));
     }
-
-    VLOG(1) << "Waiting on futures";
-    for (auto& future : futures) {
-      future.wait();
-    }
-
+    table_meta.prefetch(table_ids, NUM_PREFETCH_THREADS);
     VLOG(1) << "Prefetch complete.";
   }
 
@@ -880,6 +1011,23 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
   std::vector<proto::Op> ops(job_params->ops().begin(),
                              job_params->ops().end());
 
+  // Slice analysis and the stencil derivation for each task read the
+  // descriptors of the job's tables, so fetch them in parallel up front
+  {
+    std::vector<i32> job_table_ids;
+    for (const auto& job : jobs) {
+      for (auto& ci : job.inputs()) {
+        if (meta.has_table(ci.table_name())) {
+          job_table_ids.push_back(meta.get_table_id(ci.table_name()));
+        }
+      }
+      if (meta.has_table(job.output_table_name())) {
+        job_table_ids.push_back(meta.get_table_id(job.output_table_name()));
+      }
+    }
+    table_meta.prefetch(job_table_ids, NUM_PREFETCH_THREADS);
+  }
+
   DAGAnalysisInfo analysis_results;
   populate_analysis_info(ops, analysis_results);
   // Need slice input rows to know which slice we are in
@@ -888,6 +1036,13 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
   // Analyze op DAG to determine what inputs need to be pipped along
   // and when intermediates can be retired -- essentially liveness analysis
   perform_liveness_analysis(ops, analysis_results);
+  // Find adjacent CPU kernels that can run back-to-back on each batch
+  derive_fused_op_chains(ops, analysis_results);
+  for (auto& kv : analysis_results.fused_ops) {
+    VLOG(1) << "Fusing op " << ops.at(kv.first - 1).name() << " ("
+            << kv.first - 1 << ") with op " << ops.at(kv.first).name() << " ("
+            << kv.first << ")";
+  }
   // The live columns at each op index
   std::vector<std::vector<std::tuple<i32, std::string>>>& live_columns =
       analysis_results.live_columns;
@@ -1032,6 +1187,8 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
       auto& cm = groups.back().column_mapping;
       auto& st = groups.back().kernel_stencils;
       auto& bt = groups.back().kernel_batch_sizes;
+      auto& bb = groups.back().kernel_batch_size_bounds;
+      auto& fu = groups.back().fused_with_previous;
       const std::string& op_name = ops.at(i).name();
       op_group.push_back(op_name);
       if (analysis_results.slice_ops.count(i) > 0) {
@@ -1077,9 +1234,31 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
       cm.push_back(column_mapping[i]);
       st.push_back(analysis_results.stencils[i]);
       bt.push_back(analysis_results.batch_sizes[i]);
+      {
+        // Only autotune when the op did not request a specific batch size
+        i32 batch_size = analysis_results.batch_sizes[i];
+        i32 min_batch = batch_size;
+        i32 max_batch = batch_size;
+        if (job_params->autotune_batch_size() && factory != nullptr &&
+            factory->can_batch() && ops.at(i).batch() == -1) {
+          min_batch = factory->min_batch_size();
+          max_batch = factory->max_batch_size();
+        }
+        bb.push_back(std::make_tuple(min_batch, max_batch));
+      }
+      // The previous op must be in the same group to fuse with it
+      fu.push_back(!fu.empty() && analysis_results.fused_ops.count(i) > 0);
+      // A group runs as many threads as its most demanding op asks for
+      groups.back().replicas =
+          std::max(groups.back().replicas, ops.at(i).replicas());
     }
   }
 
+  for (auto& group : groups) {
+    group.autotune_batches = job_params->autotune_batches();
+    group.replicas = std::max(group.replicas, 1);
+  }
+
   i32 num_kernel_groups = static_cast<i32>(groups.size());
   assert(num_kernel_groups > 0);  // is this actually necessary?
 
@@ -1128,9 +1307,21 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
     return false;
   }
 
+  // Pipeline instances are spread round robin over the NUMA nodes, each
+  // running only on the CPUs of its node and allocating from its memory
+  i32 numa_nodes = job_params->numa_placement() ? num_numa_nodes() : 1;
+  auto instance_node = [&](i32 ki) {
+    return numa_nodes > 1 ? ki % numa_nodes : -1;
+  };
+  if (numa_nodes > 1) {
+    VLOG(1) << "Node " << node_id_ << " placing " << pipeline_instances_per_node
+            << " pipeline instances on " << numa_nodes << " NUMA nodes";
+  }
+
   // Set up memory pool if different than previous memory pool
   if (!memory_pool_initialized_ ||
-      job_params->memory_pool_config() != cached_memory_pool_config_) {
+      job_params->memory_pool_config() != cached_memory_pool_config_ ||
+      numa_nodes != cached_numa_nodes_) {
     if (db_params_.num_cpus < local_total * pipeline_instances_per_node &&
         job_params->memory_pool_config().cpu().use_pool()) {
       RESULT_ERROR(job_result,
@@ -1146,10 +1337,14 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
       return false;
     }
     if (memory_pool_initialized_) {
+      // Idle decoders may hold buffers from the old pools
+      decoder_pool_.clear();
       destroy_memory_allocators();
     }
-    init_memory_allocators(job_params->memory_pool_config(), gpu_ids);
+    init_memory_allocators(job_params->memory_pool_config(), gpu_ids,
+                           numa_nodes);
     cached_memory_pool_config_ = job_params->memory_pool_config();
+    cached_numa_nodes_ = numa_nodes;
     memory_pool_initialized_ = true;
   }
 
@@ -1157,12 +1352,26 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
 
   // Setup shared resources for distributing work to processing threads
   i64 accepted_tasks = 0;
+  // Output table and attempt of each accepted task until it retires
+  std::map<std::tuple<i64, i64>, std::tuple<i32, i32>> task_attempts;
   LoadInputQueue load_work;
-  std::vector<EvalQueue> initial_eval_work(pipeline_instances_per_node);
-  std::vector<std::vector<EvalQueue>> eval_work(pipeline_instances_per_node);
+  std::vector<StageQueue> initial_eval_work(pipeline_instances_per_node);
+  std::vector<std::vector<StageQueue>> eval_work(pipeline_instances_per_node);
   OutputEvalQueue output_eval_work(pipeline_instances_per_node);
   std::vector<SaveInputQueue> save_work(db_params_.num_save_workers);
   SaveOutputQueue retired_tasks;
+  CancelledTasks cancelled_tasks;
+  // Bytes of work entries in flight between stages. Defaults to half of the
+  // CPU pool, leaving the rest for decoders and kernels, and to no limit
+  // without a pool.
+  i64 memory_budget_bytes = job_params->memory_budget();
+  if (memory_budget_bytes == 0) {
+    memory_budget_bytes = cpu_pool_size() / 2;
+  }
+  MemoryBudget memory_budget(memory_budget_bytes);
+  for (auto& q : initial_eval_work) {
+    q.set_memory_budget(&memory_budget);
+  }
 
   // Setup load workers
   i32 num_load_workers = db_params_.num_load_workers;
@@ -1177,25 +1386,46 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
                         // Per worker arguments
                         i, db_params_.storage_config, load_thread_profilers[i],
                         job_params->load_sparsity_threshold(), io_packet_size,
-                        work_packet_size};
+                        work_packet_size, job_params->inplace_read_ahead(),
+                        *read_ahead_cache_};
+
+    // Load workers serve every pipeline instance, so spread them over the
+    // nodes
+    load_threads.push_back(start_thread_on_node(
+        instance_node(i), load_driver, std::ref(load_work),
+        std::ref(initial_eval_work), std::ref(retired_tasks),
+        std::ref(cancelled_tasks), std::ref(memory_budget), args));
+  }
 
-    load_threads.emplace_back(load_driver, std::ref(load_work),
-                              std::ref(initial_eval_work), args);
+  // Setup evaluate workers. Each stage of a pipeline instance runs as many
+  // replica threads as it asks for, all pulling from the stage's queue.
+  // Stages are decode, one per kernel group, and post evaluate.
+  std::vector<i32> stage_replicas;
+  stage_replicas.push_back(std::max(job_params->decode_replicas(), 1));
+  for (auto& group : groups) {
+    stage_replicas.push_back(group.replicas);
+  }
+  stage_replicas.push_back(1);
+  i32 decode_replicas = stage_replicas.front();
+  i32 num_eval_threads_per_instance = 0;
+  for (auto& group : groups) {
+    num_eval_threads_per_instance += group.replicas;
   }
 
-  // Setup evaluate workers
-  std::vector<std::vector<Profiler>> eval_profilers(
+  // Instance -> Stage -> Replica
+  std::vector<std::vector<std::vector<Profiler>>> eval_profilers(
       pipeline_instances_per_node);
+  // Instance -> evaluate thread
   std::vector<std::vector<proto::Result>> eval_results(
       pipeline_instances_per_node);
 
-  std::vector<std::tuple<EvalQueue*, EvalQueue*>> pre_eval_queues;
+  std::vector<std::tuple<StageQueue*, StageQueue*>> pre_eval_queues;
   std::vector<PreEvaluateWorkerArgs> pre_eval_args;
-  std::vector<std::vector<std::tuple<EvalQueue*, EvalQueue*>>> eval_queues(
-      pipeline_instances_per_node);
-  std::vector<std::vector<EvaluateWorkerArgs>> eval_args(
-      pipeline_instances_per_node);
-  std::vector<std::tuple<EvalQueue*, OutputEvalQueue*>> post_eval_queues;
+  // Kernel group -> evaluate thread
+  std::vector<std::vector<std::tuple<StageQueue*, StageQueue*>>> eval_queues(
+      num_kernel_groups);
+  std::vector<std::vector<EvaluateWorkerArgs>> eval_args(num_kernel_groups);
+  std::vector<std::tuple<StageQueue*, OutputEvalQueue*>> post_eval_queues;
   std::vector<PostEvaluateWorkerArgs> post_eval_args;
 
   i32 next_cpu_num = 0;
@@ -1206,24 +1436,26 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
   i32 eval_total = 0;
   for (i32 ki = 0; ki < pipeline_instances_per_node; ++ki) {
     auto& work_queues = eval_work[ki];
-    std::vector<Profiler>& eval_thread_profilers = eval_profilers[ki];
+    std::vector<std::vector<Profiler>>& eval_thread_profilers =
+        eval_profilers[ki];
     std::vector<proto::Result>& results = eval_results[ki];
     work_queues.resize(num_kernel_groups - 1 + 2);  // +2 for pre/post
-    results.resize(num_kernel_groups);
+    for (auto& q : work_queues) {
+      q.set_memory_budget(&memory_budget);
+    }
+    results.resize(num_eval_threads_per_instance);
     for (auto& result : results) {
       result.set_success(true);
     }
-    for (i32 i = 0; i < num_kernel_groups + 2; ++i) {
-      eval_thread_profilers.push_back(Profiler(base_time));
+    for (i32 replicas : stage_replicas) {
+      eval_thread_profilers.emplace_back(replicas, Profiler(base_time));
     }
 
     // Evaluate worker
     DeviceHandle first_kernel_type;
+    i32 result_idx = 0;
     for (i32 kg = 0; kg < num_kernel_groups; ++kg) {
       auto& group = groups[kg].kernel_factories;
-      std::vector<EvaluateWorkerArgs>& thread_args = eval_args[ki];
-      std::vector<std::tuple<EvalQueue*, EvalQueue*>>& thread_qs =
-          eval_queues[ki];
       // HACK(apoms): we assume all ops in a kernel group use the
       //   same number of devices for now.
       // for (size_t i = 0; i < group.size(); ++i) {
@@ -1240,55 +1472,59 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
         device_type = factory->get_device_type();
         max_devices = factory->get_max_devices();
       }
-      if (device_type == DeviceType::CPU) {
-        for (i32 i = 0; i < max_devices; ++i) {
-          i32 device_id = 0;
-          next_cpu_num++ % num_cpus;
-          for (size_t i = 0; i < group.size(); ++i) {
-            KernelConfig& config = std::get<1>(group[i]);
-            config.devices.clear();
-            config.devices.push_back({device_type, device_id});
+      for (i32 r = 0; r < groups[kg].replicas; ++r) {
+        // Every replica gets its own kernel instances and devices
+        if (device_type == DeviceType::CPU) {
+          for (i32 i = 0; i < max_devices; ++i) {
+            i32 device_id = 0;
+            next_cpu_num++ % num_cpus;
+            for (size_t i = 0; i < group.size(); ++i) {
+              KernelConfig& config = std::get<1>(group[i]);
+              config.devices.clear();
+              config.devices.push_back({device_type, device_id});
+            }
           }
-        }
-      } else {
-        for (i32 i = 0; i < max_devices; ++i) {
-          i32 device_id = gpu_ids[next_gpu_idx++ % num_gpus];
-          for (size_t i = 0; i < group.size(); ++i) {
-            KernelConfig& config = std::get<1>(group[i]);
-            config.devices.clear();
-            config.devices.push_back({device_type, device_id});
+        } else {
+          for (i32 i = 0; i < max_devices; ++i) {
+            i32 device_id = gpu_ids[next_gpu_idx++ % num_gpus];
+            for (size_t i = 0; i < group.size(); ++i) {
+              KernelConfig& config = std::get<1>(group[i]);
+              config.devices.clear();
+              config.devices.push_back({device_type, device_id});
+            }
           }
         }
-      }
-      // Get the device handle for the first kernel in the pipeline
-      if (kg == 0) {
-        first_kernel_type = std::get<1>(group[0]).devices[0];
-      }
-
-      // Input work queue
-      EvalQueue* input_work_queue = &work_queues[kg];
-      // Create new queue for output, reuse previous queue as input
-      EvalQueue* output_work_queue = &work_queues[kg + 1];
-      // Create eval thread for passing data through neural net
-      thread_qs.push_back(
-          std::make_tuple(input_work_queue, output_work_queue));
-      thread_args.emplace_back(EvaluateWorkerArgs{
-          // Uniform arguments
-          node_id_, startup_lock, startup_cv, startup_count,
+        // Get the device handle for the first kernel in the pipeline
+        if (kg == 0 && r == 0) {
+          first_kernel_type = std::get<1>(group[0]).devices[0];
+        }
 
-          // Per worker arguments
-          ki, kg, groups[kg], eval_thread_profilers[kg + 1], results[kg]});
-      eval_total += 1;
+        // Input work queue
+        StageQueue* input_work_queue = &work_queues[kg];
+        // Create new queue for output, reuse previous queue as input
+        StageQueue* output_work_queue = &work_queues[kg + 1];
+        // Create eval thread for passing data through neural net
+        eval_queues[kg].push_back(
+            std::make_tuple(input_work_queue, output_work_queue));
+        eval_args[kg].emplace_back(EvaluateWorkerArgs{
+            // Uniform arguments
+            node_id_, startup_lock, startup_cv, startup_count,
+
+            // Per worker arguments
+            ki, kg, r, groups[kg], eval_thread_profilers[kg + 1][r],
+            results[result_idx++]});
+        eval_total += 1;
+      }
     }
-    // Pre evaluate worker
-    {
-      EvalQueue* input_work_queue;
+    // Pre evaluate workers
+    for (i32 r = 0; r < decode_replicas; ++r) {
+      StageQueue* input_work_queue;
       if (distribute_work_dynamically) {
         input_work_queue = &initial_eval_work[ki];
       } else {
         input_work_queue = &initial_eval_work[0];
       }
-      EvalQueue* output_work_queue =
+      StageQueue* output_work_queue =
           &work_queues[0];
       assert(groups.size() > 0);
       pre_eval_queues.push_back(
@@ -1299,9 +1535,12 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
       pre_eval_args.emplace_back(PreEvaluateWorkerArgs{
           // Uniform arguments
           node_id_, num_cpus, job_params->work_packet_size(),
+          job_params->decoders_per_column(),
 
-          // Per worker arguments
-          ki, decoder_type, eval_thread_profilers.front(),
+          // Per worker arguments. Replicas of every instance may share the
+          // first input queue, so number them across instances.
+          ki, ki * decode_replicas + r, decoder_type,
+          eval_thread_profilers.front()[r], decoder_pool_,
       });
     }
 
@@ -1313,7 +1552,7 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
         column_names.push_back(op_input.column());
       }
 
-      EvalQueue* input_work_queue = &work_queues.back();
+      StageQueue* input_work_queue = &work_queues.back();
       OutputEvalQueue* output_work_queue = &output_eval_work;
       post_eval_queues.push_back(
           std::make_tuple(input_work_queue, output_work_queue));
@@ -1322,7 +1561,7 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
           node_id_,
 
           // Per worker arguments
-          ki, eval_thread_profilers.back(), column_mapping.back(),
+          ki, eval_thread_profilers.back().front(), column_mapping.back(),
           final_output_columns, final_compression_options,
       });
     }
@@ -1330,30 +1569,52 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
 
   // Launch eval worker threads
   std::vector<std::thread> pre_eval_threads;
-  std::vector<std::vector<std::thread>> eval_threads;
+  std::vector<std::vector<std::thread>> eval_threads(num_kernel_groups);
   std::vector<std::thread> post_eval_threads;
-  for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
-    // Pre thread
-    pre_eval_threads.emplace_back(
-        pre_evaluate_driver, std::ref(*std::get<0>(pre_eval_queues[pu])),
-        std::ref(*std::get<1>(pre_eval_queues[pu])), pre_eval_args[pu]);
-    // Op threads
-    eval_threads.emplace_back();
-    std::vector<std::thread>& threads = eval_threads.back();
-    for (i32 kg = 0; kg < num_kernel_groups; ++kg) {
-      threads.emplace_back(
-          evaluate_driver, std::ref(*std::get<0>(eval_queues[pu][kg])),
-          std::ref(*std::get<1>(eval_queues[pu][kg])), eval_args[pu][kg]);
+  for (size_t i = 0; i < pre_eval_args.size(); ++i) {
+    pre_eval_threads.push_back(start_thread_on_node(
+        instance_node(pre_eval_args[i].worker_id), pre_evaluate_driver,
+        std::ref(*std::get<0>(pre_eval_queues[i])),
+        std::ref(*std::get<1>(pre_eval_queues[i])), std::ref(memory_budget),
+        pre_eval_args[i]));
+  }
+  for (i32 kg = 0; kg < num_kernel_groups; ++kg) {
+    for (size_t i = 0; i < eval_args[kg].size(); ++i) {
+      eval_threads[kg].push_back(start_thread_on_node(
+          instance_node(eval_args[kg][i].ki), evaluate_driver,
+          std::ref(*std::get<0>(eval_queues[kg][i])),
+          std::ref(*std::get<1>(eval_queues[kg][i])), std::ref(memory_budget),
+          eval_args[kg][i]));
     }
-    // Post threads
-    post_eval_threads.emplace_back(
-        post_evaluate_driver, std::ref(*std::get<0>(post_eval_queues[pu])),
-        std::ref(*std::get<1>(post_eval_queues[pu])), post_eval_args[pu]);
+  }
+  for (size_t i = 0; i < post_eval_args.size(); ++i) {
+    post_eval_threads.push_back(start_thread_on_node(
+        instance_node(post_eval_args[i].id), post_evaluate_driver,
+        std::ref(*std::get<0>(post_eval_queues[i])),
+        std::ref(*std::get<1>(post_eval_queues[i])),
+        std::ref(memory_budget), post_eval_args[i]));
   }
 
-  // Setup save coordinator
-  std::thread save_coordinator_thread(
-      save_coordinator, std::ref(output_eval_work), std::ref(save_work));
+  // Setup save coordinator. Save worker i runs on the same node as pipeline
+  // instance i, and instances prefer the save workers on their node.
+  std::vector<std::vector<i32>> instance_save_workers(
+      pipeline_instances_per_node);
+  for (i32 ki = 0; ki < pipeline_instances_per_node; ++ki) {
+    for (i32 i = 0; i < db_params_.num_save_workers; ++i) {
+      if (instance_node(i) == instance_node(ki)) {
+        instance_save_workers[ki].push_back(i);
+      }
+    }
+    if (instance_save_workers[ki].empty()) {
+      for (i32 i = 0; i < db_params_.num_save_workers; ++i) {
+        instance_save_workers[ki].push_back(i);
+      }
+    }
+  }
+  std::thread save_coordinator_thread(save_coordinator,
+                                      std::ref(output_eval_work),
+                                      std::ref(save_work),
+                                      instance_save_workers);
 
   // Setup save workers
   i32 num_save_workers = db_params_.num_save_workers;
@@ -1369,8 +1630,10 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
                         // Per worker arguments
                         i, db_params_.storage_config, save_thread_profilers[i]};
 
-    save_threads.emplace_back(save_driver, std::ref(save_work[i]),
-                              std::ref(retired_tasks), args);
+    save_threads.push_back(start_thread_on_node(
+        instance_node(i), save_driver, std::ref(save_work[i]),
+        std::ref(retired_tasks), std::ref(cancelled_tasks),
+        std::ref(memory_budget), args));
   }
 
   if (job_params->profiling()) {
@@ -1387,7 +1650,11 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
   // Round robin work
   std::vector<i64> allocated_work_to_queues(pipeline_instances_per_node);
   std::vector<i64> retired_work_for_queues(pipeline_instances_per_node);
+  // Samplers are built lazily the first time a task from a job is seen
+  std::map<i64, JobDomainSamplers> job_domain_samplers;
   bool finished = false;
+  // Tasks which retired while the loop was blocked below
+  std::vector<std::tuple<i32, i64, i64>> woken_by_tasks;
   while (true) {
     if (trigger_shutdown_.raised()) {
       // Abandon ship!
@@ -1398,11 +1665,13 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
     }
     // We batch up retired tasks to avoid sync overhead
     std::vector<std::tuple<i32, i64, i64>> batched_retired_tasks;
-    while (retired_tasks.size() > 0) {
+    batched_retired_tasks.swap(woken_by_tasks);
+    {
       // Pull retired tasks
       std::tuple<i32, i64, i64> task_retired;
-      retired_tasks.pop(task_retired);
-      batched_retired_tasks.push_back(task_retired);
+      while (retired_tasks.try_pop(task_retired)) {
+        batched_retired_tasks.push_back(task_retired);
+      }
     }
     if (!batched_retired_tasks.empty()) {
       // Make sure the retired tasks were flushed to disk before confirming
@@ -1413,13 +1682,31 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
       // Inform master that this task was finished
       proto::FinishedWorkParameters params;
 
+      i64 job_idx = std::get<1>(task_retired);
+      i64 task_idx = std::get<2>(task_retired);
+      auto attempt_it = task_attempts.find(std::make_tuple(job_idx, task_idx));
+      i32 table_id = std::get<0>(attempt_it->second);
+      i32 attempt = std::get<1>(attempt_it->second);
+      task_attempts.erase(attempt_it);
+
       params.set_node_id(node_id_);
-      params.set_job_id(std::get<1>(task_retired));
-      params.set_task_id(std::get<2>(task_retired));
+      params.set_bulk_job_sequence(job_params->bulk_job_sequence());
+      params.set_job_id(job_idx);
+      params.set_task_id(task_idx);
+      params.set_attempt(attempt);
 
-      proto::Empty empty;
+      proto::FinishedWorkReply reply;
       grpc::Status status;
-      GRPC_BACKOFF(master_->FinishedWork(&ctx, params, &empty), status);
+      GRPC_BACKOFF(master_->FinishedWork(&ctx, params, &reply), status);
+      cancelled_tasks.add(reply.cancelled_tasks());
+      if (status.ok() && !reply.committed()) {
+        // The master kept the outputs of another attempt of this task
+        VLOG(1) << "Node " << node_id_ << " removing outputs of uncommitted "
+                << "attempt " << attempt << " of task (" << job_idx << ", "
+                << task_idx << ")";
+        delete_table_item_attempt(storage_, table_meta.at(table_id), task_idx,
+                                  attempt);
+      }
 
       // Update how much is in each pipeline instances work queue
       retired_work_for_queues[std::get<0>(task_retired)] += 1;
@@ -1435,19 +1722,30 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
     for (i64 t : retired_work_for_queues) {
       total_tasks_processed += t;
     }
-    if (finished) {
-      if (total_tasks_processed == accepted_tasks) {
-        break;
-      } else {
-        std::this_thread::yield();
-        continue;
-      }
+    if (draining_ && !finished) {
+      // Stop taking new tasks and finish the ones already accepted
+      VLOG(1) << "Node " << node_id_ << " draining.";
+      finished = true;
+    }
+    if (finished && total_tasks_processed == accepted_tasks) {
+      break;
     }
     i32 local_work = accepted_tasks - total_tasks_processed;
-    if (local_work <
-        pipeline_instances_per_node * job_params->tasks_in_queue_per_pu()) {
+    // Entries already fill the memory budget, so more tasks would only wait
+    bool wants_work =
+        !finished &&
+        local_work <
+            pipeline_instances_per_node * job_params->tasks_in_queue_per_pu() &&
+        (local_work == 0 || !memory_budget.exhausted());
+    // Set when the master had no task for us while tasks were in flight
+    bool waiting_for_work = false;
+    if (wants_work) {
       proto::NodeInfo node_info;
       node_info.set_node_id(node_id_);
+      node_info.set_bulk_job_sequence(job_params->bulk_job_sequence());
+      // Nothing else to do until a task arrives, so let the master hold the
+      // request instead of replying right away
+      node_info.set_long_poll(local_work == 0);
 
       proto::NewWork new_work;
       grpc::Status status;
@@ -1458,10 +1756,14 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
         break;
       }
 
+      cancelled_tasks.add(new_work.cancelled_tasks());
+
       if (new_work.wait_for_work()) {
         // Waiting for more work
         VLOG(1) << "Node " << node_id_ << " received wait for work signal.";
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        // A long poll already waited at the master, so ask again right
+        // away. Otherwise wait for one of our tasks to retire first.
+        waiting_for_work = local_work > 0;
       }
       else if (new_work.no_more_work()) {
         // No more work left
@@ -1472,13 +1774,25 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
         // requirements and when to discard elements.
         std::deque<TaskStream> task_stream;
         LoadWorkEntry stenciled_entry;
+        i64 job_idx = new_work.job_index();
+        if (job_domain_samplers.count(job_idx) == 0) {
+          Result sampler_result = make_job_domain_samplers(
+              jobs.at(job_idx), job_domain_samplers[job_idx]);
+          if (!sampler_result.success()) {
+            job_result->set_success(false);
+            job_result->set_msg(sampler_result.msg());
+            break;
+          }
+        }
         derive_stencil_requirements(
-            meta, table_meta, jobs.at(new_work.job_index()), ops,
-            analysis_results, job_params->boundary_condition(),
+            meta, table_meta, jobs.at(job_idx), ops, analysis_results,
+            job_domain_samplers.at(job_idx), job_params->boundary_condition(),
             new_work.table_id(), new_work.job_index(), new_work.task_index(),
-            std::vector<i64>(new_work.output_rows().begin(),
-                             new_work.output_rows().end()),
-            stenciled_entry, task_stream);
+            task_rows_to_row_set(new_work.output_rows()), stenciled_entry,
+            task_stream);
+        stenciled_entry.set_attempt(new_work.attempt());
+        task_attempts[std::make_tuple(job_idx, new_work.task_index())] =
+            std::make_tuple(new_work.table_id(), new_work.attempt());
 
         // Determine which worker to allocate to
         i32 target_work_queue = -1;
@@ -1492,7 +1806,8 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
           }
         }
         load_work.push(
-            std::make_tuple(target_work_queue, task_stream, stenciled_entry));
+            std::make_tuple(target_work_queue, std::move(task_stream),
+                            std::move(stenciled_entry)));
         allocated_work_to_queues[target_work_queue]++;
         accepted_tasks++;
       }
@@ -1515,13 +1830,25 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
     break;
   remain_loop:
 
-    std::this_thread::yield();
+    if (!wants_work || waiting_for_work) {
+      // Nothing to ask the master for until a task retires, so block on that
+      // instead of spinning
+      std::chrono::milliseconds timeout(waiting_for_work
+                                            ? WAIT_FOR_WORK_INTERVAL_MS
+                                            : WORKER_LOOP_WAKEUP_INTERVAL_MS);
+      std::tuple<i32, i64, i64> task_retired;
+      if (retired_tasks.pop_for(task_retired, timeout)) {
+        woken_by_tasks.push_back(task_retired);
+      }
+    }
   }
 
   // If the job failed, can't expect queues to have drained, so
   // attempt to flush all queues here (otherwise we could block
   // on pushing into a queue)
   if (!job_result->success()) {
+    // Stages blocked on the budget must get to their exit messages
+    memory_budget.disable();
     load_work.clear();
     for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
       initial_eval_work[pu].clear();
@@ -1541,22 +1868,22 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
     retired_tasks.clear();
   }
 
-  auto push_exit_message = [](EvalQueue& q) {
+  auto push_exit_message = [](StageQueue& q) {
     EvalWorkEntry entry;
     entry.job_index = -1;
-    q.push(std::make_tuple(std::deque<TaskStream>(), entry));
+    q.push(std::make_tuple(std::deque<TaskStream>(), std::move(entry)));
   };
 
   auto push_output_eval_exit_message = [](OutputEvalQueue& q) {
     EvalWorkEntry entry;
     entry.job_index = -1;
-    q.push(std::make_tuple(0, entry));
+    q.push(std::make_tuple(0, std::move(entry)));
   };
 
   auto push_save_exit_message = [](SaveInputQueue& q) {
     EvalWorkEntry entry;
     entry.job_index = -1;
-    q.push(std::make_tuple(0, entry));
+    q.push(std::make_tuple(0, std::move(entry)));
   };
 
   // Push sentinel work entries into queue to terminate load threads
@@ -1574,14 +1901,16 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
 
   // Push sentinel work entries into queue to terminate eval threads
   for (i32 i = 0; i < pipeline_instances_per_node; ++i) {
-    if (distribute_work_dynamically) {
-      push_exit_message(initial_eval_work[i]);
-    } else {
-      push_exit_message(initial_eval_work[0]);
+    for (i32 r = 0; r < decode_replicas; ++r) {
+      if (distribute_work_dynamically) {
+        push_exit_message(initial_eval_work[i]);
+      } else {
+        push_exit_message(initial_eval_work[0]);
+      }
     }
   }
 
-  for (i32 i = 0; i < pipeline_instances_per_node; ++i) {
+  for (size_t i = 0; i < pre_eval_threads.size(); ++i) {
     // Wait until pre eval has finished
     LOG(INFO) << "Pre join " << i;
     pre_eval_threads[i].join();
@@ -1589,11 +1918,13 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
 
   for (i32 kg = 0; kg < num_kernel_groups; ++kg) {
     for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
-      push_exit_message(eval_work[pu][kg]);
+      for (i32 r = 0; r < groups[kg].replicas; ++r) {
+        push_exit_message(eval_work[pu][kg]);
+      }
     }
-    for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
+    for (auto& thread : eval_threads[kg]) {
       // Wait until eval has finished
-      eval_threads[pu][kg].join();
+      thread.join();
     }
   }
 
@@ -1671,24 +2002,27 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
   // Evaluate worker profilers
   u8 eval_worker_count = pipeline_instances_per_node;
   s_write(profiler_output.get(), eval_worker_count);
-  u8 profilers_per_chain = 3;
-  s_write(profiler_output.get(), profilers_per_chain);
+  u8 stages_per_chain = stage_replicas.size();
+  s_write(profiler_output.get(), stages_per_chain);
+  for (i32 replicas : stage_replicas) {
+    u8 replica_count = replicas;
+    s_write(profiler_output.get(), replica_count);
+  }
   for (i32 pu = 0; pu < pipeline_instances_per_node; ++pu) {
-    i32 i = pu;
-    {
-      std::string tag = "pre";
-      write_profiler_to_file(profiler_output.get(), out_rank, "eval", tag, i,
-                             eval_profilers[pu][0]);
-    }
-    {
-      std::string tag = "eval";
-      write_profiler_to_file(profiler_output.get(), out_rank, "eval", tag, i,
-                             eval_profilers[pu][1]);
-    }
-    {
-      std::string tag = "post";
-      write_profiler_to_file(profiler_output.get(), out_rank, "eval", tag, i,
-                             eval_profilers[pu][2]);
+    for (size_t stage = 0; stage < stage_replicas.size(); ++stage) {
+      std::string stage_name;
+      if (stage == 0) {
+        stage_name = "pre";
+      } else if (stage == stage_replicas.size() - 1) {
+        stage_name = "post";
+      } else {
+        stage_name = "eval" + std::to_string(stage - 1);
+      }
+      for (i32 r = 0; r < stage_replicas[stage]; ++r) {
+        std::string tag = stage_name + "_" + std::to_string(r);
+        write_profiler_to_file(profiler_output.get(), out_rank, "eval", tag,
+                               pu, eval_profilers[pu][stage][r]);
+      }
     }
   }
 
@@ -1700,6 +2034,10 @@ bool WorkerImpl::process_job(const proto::BulkJobParameters* job_params,
                            save_thread_profilers[i]);
   }
 
+  // Page size the CPU pool ended up with, 0 without a pool
+  i64 cpu_pool_page_size_bytes = cpu_pool_page_size();
+  s_write(profiler_output.get(), cpu_pool_page_size_bytes);
+
   BACKOFF_FAIL(profiler_output->save());
 
   std::fflush(NULL);
@@ -16,8 +16,10 @@
 #pragma once
 
 #include "scanner/engine/metadata.h"
+#include "scanner/engine/read_ahead_cache.h"
 #include "scanner/engine/rpc.grpc.pb.h"
 #include "scanner/engine/runtime.h"
+#include "scanner/video/decoder_pool.h"
 
 #include <grpc/grpc_posix.h>
 #include <grpc/support/log.h>
@@ -54,6 +56,9 @@ class WorkerImpl final : public proto::Worker::Service {
   grpc::Status Shutdown(grpc::ServerContext* context, const proto::Empty* empty,
                         Result* result);
 
+  grpc::Status Drain(grpc::ServerContext* context, const proto::Empty* empty,
+                     Result* result);
+
   grpc::Status PokeWatchdog(grpc::ServerContext* context,
                             const proto::Empty* empty, proto::Empty* result);
 
@@ -84,6 +89,9 @@ class WorkerImpl final : public proto::Worker::Service {
 
   Condition<State> state_;
   std::atomic_flag unregistered_;
+  // Set when the worker should stop asking for tasks and leave once its
+  // accepted tasks are done. Only set under active_mutex_.
+  std::atomic<bool> draining_{false};
 
   std::thread watchdog_thread_;
   std::atomic<bool> watchdog_awake_;
@@ -98,6 +106,11 @@ class WorkerImpl final : public proto::Worker::Service {
   std::map<std::string, TableMetadata*> table_metas_;
   bool memory_pool_initialized_ = false;
   MemoryPoolConfig cached_memory_pool_config_;
+  i32 cached_numa_nodes_ = 1;
+  // Decoders left over from earlier tasks and jobs
+  DecoderPool decoder_pool_;
+  // Inplace video bytes read ahead of the load workers
+  std::unique_ptr<ReadAheadCache> read_ahead_cache_;
 
   // True if the worker is executing a job
   std::mutex active_mutex_;
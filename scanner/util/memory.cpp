@@ -15,12 +15,22 @@
 
 #include "scanner/util/memory.h"
 #include "scanner/util/cuda.h"
+#include "scanner/util/numa.h"
 
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <sys/sysinfo.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <mutex>
+#include <thread>
 
 #ifdef HAVE_CUDA
 #include <cuda.h>
@@ -133,61 +143,159 @@ bool pointer_in_buffer(u8* ptr, u8* buf_start, u8* buf_end) {
   return (size_t)ptr >= (size_t)buf_start && (size_t)ptr < (size_t)buf_end;
 }
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+// How often an allocation waiting for room in a full pool says so
+static const i64 POOL_FULL_WARNING_SECONDS = 60;
+
+// Transparent huge pages are always the size of a page middle directory entry
+static const size_t TRANSPARENT_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static size_t round_up(size_t size, size_t multiple) {
+  return (size + multiple - 1) / multiple * multiple;
+}
+
+// Resident and transparent huge page backed bytes of the mappings
+// overlapping [start, end), from /proc/self/smaps
+static void resident_bytes(size_t start, size_t end, size_t& rss,
+                           size_t& anon_huge_pages) {
+  rss = 0;
+  anon_huge_pages = 0;
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  bool overlaps = false;
+  while (std::getline(smaps, line)) {
+    size_t kb;
+    char field[64];
+    unsigned long map_start, map_end;
+    if (sscanf(line.c_str(), "%lx-%lx ", &map_start, &map_end) == 2) {
+      overlaps = map_start < end && start < map_end;
+    } else if (overlaps && sscanf(line.c_str(), "%63[^:]: %zu kB", field,
+                                  &kb) == 2) {
+      if (strcmp(field, "Rss") == 0) {
+        rss += kb * 1024;
+      } else if (strcmp(field, "AnonHugePages") == 0) {
+        anon_huge_pages += kb * 1024;
+      }
+    }
+  }
+}
+
+static bool transparent_huge_pages_enabled() {
+  std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string modes;
+  std::getline(file, modes);
+  return !modes.empty() && modes.find("[never]") == std::string::npos;
+}
+
 class PoolAllocator : public Allocator {
  public:
+  // CPU pools with a huge page size are mapped directly instead of going
+  // through the system allocator so that they can be backed by huge pages
   PoolAllocator(DeviceHandle device, SystemAllocator* allocator,
-                size_t pool_size)
+                size_t pool_size, size_t huge_page_size = 0)
     : device_(device), system_allocator(allocator), pool_size_(pool_size) {
-    pool_ = system_allocator->allocate(pool_size_);
+    if (device_.type == DeviceType::CPU && huge_page_size > 0) {
+      map_huge_pages(huge_page_size);
+    } else {
+      pool_ = system_allocator->allocate(pool_size_);
+      page_size_ = sysconf(_SC_PAGESIZE);
+    }
   }
 
   ~PoolAllocator() {
-    system_allocator->free(pool_);
+    if (mapping_size_ > 0) {
+      munmap(mapping_, mapping_size_);
+    } else {
+      system_allocator->free(pool_);
+    }
+  }
+
+  // Touches every page of a CPU pool so that allocations never fault. Pages
+  // are only known to be huge for explicit huge page mappings, so pools
+  // relying on transparent huge pages touch every base page.
+  void prefault() {
+    if (device_.type != DeviceType::CPU) {
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    size_t chunk = round_up(pool_size_ / num_threads + 1, page_size_);
+    std::vector<std::thread> threads;
+    for (size_t begin = 0; begin < pool_size_; begin += chunk) {
+      size_t end = std::min(begin + chunk, pool_size_);
+      threads.emplace_back([this, begin, end]() {
+        for (size_t offset = begin; offset < end; offset += page_size_) {
+          pool_[offset] = 0;
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    LOG(INFO) << "Pre-faulted " << pool_size_ << " byte CPU pool in "
+              << std::chrono::duration<f64>(std::chrono::steady_clock::now() -
+                                            start)
+                     .count()
+              << "s";
   }
 
   u8* allocate(size_t size) {
     Allocation alloc;
     alloc.length = size;
 
-    std::lock_guard<std::mutex> guard(lock_);
-    bool found = false;
-    i32 num_alloc = allocations_.size();
-    for (i32 i = 0; i < num_alloc; ++i) {
-      Allocation lower;
-      if (i == 0) {
-        lower.offset = 0;
-        lower.length = 0;
-      } else {
-        lower = allocations_[i - 1];
-      }
-      Allocation higher = allocations_[i];
-      assert(higher.offset >= lower.offset + lower.length);
-      size_t base = align(lower.offset + lower.length);
-      if ((higher.offset - base) >= size) {
-        alloc.offset = base;
-        allocations_.insert(allocations_.begin() + i, alloc);
-        found = true;
-        break;
-      }
-    }
-
-    if (!found) {
-      if (num_alloc > 0) {
-        Allocation& last = allocations_[num_alloc - 1];
-        alloc.offset = align(last.offset + last.length);
-      } else {
-        alloc.offset = 0;
+    std::unique_lock<std::mutex> lock(lock_);
+    i32 index;
+    if (!find_space(size, index, alloc.offset)) {
+      // Only an allocation which could never fit is an error
+      LOG_IF(FATAL, size > pool_size_) << "Exceeded pool size: " << size
+                                       << " byte allocation in a "
+                                       << pool_size_ << " byte pool";
+      // Buffers are freed as later pipeline stages finish with them, so a
+      // full pool slows the producer down instead of failing
+      VLOG(1) << "Pool full, waiting for " << size << " bytes to be freed";
+      i64 waited_seconds = 0;
+      while (!freed_.wait_for(
+          lock, std::chrono::seconds(POOL_FULL_WARNING_SECONDS),
+          [&] { return find_space(size, index, alloc.offset); })) {
+        waited_seconds += POOL_FULL_WARNING_SECONDS;
+        LOG(WARNING) << "Pool full: waited " << waited_seconds
+                     << " seconds for " << size << " bytes to be freed";
       }
-      allocations_.push_back(alloc);
     }
-
-    LOG_IF(FATAL, alloc.offset + alloc.length >= pool_size_)
-        << "Exceeded pool size";
+    allocations_.insert(allocations_.begin() + index, alloc);
 
     u8* buffer = pool_ + alloc.offset;
     return buffer;
   }
 
+  bool contains(u8* buffer) {
+    return pointer_in_buffer(buffer, pool_, pool_ + pool_size_);
+  }
+
+  u8* data() { return pool_; }
+
+  size_t size() { return pool_size_; }
+
+  // Size of the pages backing most of the pool. Transparent huge pages are
+  // only used where the kernel managed to back the pool with them when it
+  // was faulted in, so that is read back from the kernel.
+  size_t page_size() {
+    if (!transparent_huge_pages_) {
+      return page_size_;
+    }
+    size_t rss;
+    size_t anon_huge_pages;
+    resident_bytes((size_t)pool_, (size_t)pool_ + pool_size_, rss,
+                   anon_huge_pages);
+    if (rss > 0 && anon_huge_pages * 2 >= rss) {
+      return TRANSPARENT_HUGE_PAGE_SIZE;
+    }
+    return page_size_;
+  }
+
   size_t align(size_t ptr) {
     size_t alignment = system_allocator->alignment();
     size_t remainder = ptr % alignment;
@@ -209,9 +317,42 @@ class PoolAllocator : public Allocator {
 
     Allocation& alloc = allocations_[index];
     allocations_.erase(allocations_.begin() + index);
+    freed_.notify_all();
   }
 
  private:
+  // First gap which fits size bytes: the position in allocations_ to insert
+  // at and the offset into the pool
+  bool find_space(size_t size, i32& index, size_t& offset) {
+    i32 num_alloc = allocations_.size();
+    for (i32 i = 0; i < num_alloc; ++i) {
+      Allocation lower;
+      if (i == 0) {
+        lower.offset = 0;
+        lower.length = 0;
+      } else {
+        lower = allocations_[i - 1];
+      }
+      Allocation higher = allocations_[i];
+      assert(higher.offset >= lower.offset + lower.length);
+      size_t base = align(lower.offset + lower.length);
+      if (higher.offset >= base && (higher.offset - base) >= size) {
+        index = i;
+        offset = base;
+        return true;
+      }
+    }
+
+    index = num_alloc;
+    if (num_alloc > 0) {
+      Allocation& last = allocations_[num_alloc - 1];
+      offset = align(last.offset + last.length);
+    } else {
+      offset = 0;
+    }
+    return offset + size < pool_size_;
+  }
+
   bool find_buffer(u8* buffer, i32& index) {
     i32 num_alloc = allocations_.size();
     for (i32 i = 0; i < num_alloc; ++i) {
@@ -229,15 +370,123 @@ class PoolAllocator : public Allocator {
     size_t length;
   } Allocation;
 
+  // Explicit huge pages must be reserved by the administrator, so fall back
+  // to asking for transparent huge pages on a regular mapping aligned to
+  // their size when none are left
+  void map_huge_pages(size_t huge_page_size) {
+    size_t size = round_up(pool_size_, huge_page_size);
+    i32 huge_page_shift = __builtin_ctzll(huge_page_size);
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                             (huge_page_shift << MAP_HUGE_SHIFT),
+                         -1, 0);
+    if (mapping != MAP_FAILED) {
+      mapping_ = (u8*)mapping;
+      mapping_size_ = size;
+      pool_ = mapping_;
+      pool_size_ = size;
+      page_size_ = huge_page_size;
+      return;
+    }
+    LOG(WARNING) << "Could not map " << size << " bytes of " << huge_page_size
+                 << " byte huge pages for the CPU pool (" << strerror(errno)
+                 << "), falling back to transparent huge pages";
+
+    size = pool_size_ + TRANSPARENT_HUGE_PAGE_SIZE;
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    LOG_IF(FATAL, mapping == MAP_FAILED)
+        << "Could not map " << size << " bytes for the CPU pool: "
+        << strerror(errno);
+    mapping_ = (u8*)mapping;
+    mapping_size_ = size;
+    pool_ = (u8*)round_up((size_t)mapping_, TRANSPARENT_HUGE_PAGE_SIZE);
+    page_size_ = sysconf(_SC_PAGESIZE);
+    if (madvise(pool_, pool_size_, MADV_HUGEPAGE) == 0 &&
+        transparent_huge_pages_enabled()) {
+      transparent_huge_pages_ = true;
+    } else {
+      LOG(WARNING) << "Transparent huge pages are not available, so the CPU "
+                   << "pool uses " << page_size_ << " byte pages";
+    }
+  }
+
   DeviceHandle device_;
   u8* pool_ = nullptr;
   size_t pool_size_;
+  // Size of the pages the pool is guaranteed to be backed by
+  size_t page_size_;
+  // Whether the kernel may back the pool with transparent huge pages
+  bool transparent_huge_pages_ = false;
+  // Set when the pool was mapped directly
+  u8* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
   std::mutex lock_;
+  // Notified whenever a buffer is freed
+  std::condition_variable freed_;
   std::vector<Allocation> allocations_;
 
   SystemAllocator* system_allocator;
 };
 
+// One CPU pool per NUMA node. Threads allocate from the pool of the node they
+// are running on, so pipeline instances pinned to a node keep their frames in
+// its memory.
+class NumaPoolAllocator : public Allocator {
+ public:
+  NumaPoolAllocator(SystemAllocator* allocator, size_t total_pool_size,
+                    i32 numa_nodes, size_t huge_page_size) {
+    size_t node_pool_size = total_pool_size / numa_nodes;
+    for (i32 node = 0; node < numa_nodes; ++node) {
+      PoolAllocator* pool = new PoolAllocator(CPU_DEVICE, allocator,
+                                              node_pool_size, huge_page_size);
+      // The pool has not been touched yet, so its pages are placed on the
+      // node as they are first used
+      bind_memory_to_numa_node(pool->data(), pool->size(), node);
+      pools_.emplace_back(pool);
+    }
+  }
+
+  u8* allocate(size_t size) {
+    i32 node = current_numa_node();
+    if (node >= (i32)pools_.size()) {
+      node = 0;
+    }
+    return pools_[node]->allocate(size);
+  }
+
+  void free(u8* buffer) {
+    // Buffers are often freed by a thread on another node than the one
+    // which allocated them
+    for (auto& pool : pools_) {
+      if (pool->contains(buffer)) {
+        pool->free(buffer);
+        return;
+      }
+    }
+    LOG(FATAL) << "NUMA pool allocator tried to free buffer not in any pool";
+  }
+
+  void prefault() {
+    // Each pool is bound to its node, so the pages land there no matter
+    // which thread touches them
+    for (auto& pool : pools_) {
+      pool->prefault();
+    }
+  }
+
+  size_t page_size() {
+    size_t page_size = pools_[0]->page_size();
+    for (auto& pool : pools_) {
+      page_size = std::min(page_size, pool->page_size());
+    }
+    return page_size;
+  }
+
+ private:
+  std::vector<std::unique_ptr<PoolAllocator>> pools_;
+};
+
 class BlockAllocator {
  public:
   BlockAllocator(Allocator* allocator) : allocator_(allocator) {}
@@ -502,7 +751,10 @@ class LinkedAllocator {
 
 static std::unique_ptr<SystemAllocator> cpu_system_allocator;
 static std::map<i32, SystemAllocator*> gpu_system_allocators;
-static PoolAllocator* cpu_pool_allocator = nullptr;
+static Allocator* cpu_pool_allocator = nullptr;
+static size_t cpu_pool_size_bytes = 0;
+// Reads the page size of the CPU pool
+static std::function<size_t()> cpu_pool_page_size_fn;
 static std::unique_ptr<BlockAllocator> cpu_block_allocator;
 static std::map<i32, PoolAllocator*> gpu_pool_allocators;
 static std::map<i32, BlockAllocator*> gpu_block_allocators;
@@ -515,7 +767,8 @@ static std::map<i32, u8*> pinned_cpu_buffers;
 static std::map<i32, std::mutex> pinned_cpu_locks;
 
 void init_memory_allocators(MemoryPoolConfig config,
-                            std::vector<i32> gpu_device_ids) {
+                            std::vector<i32> gpu_device_ids,
+                            i32 numa_nodes) {
   cpu_system_allocator.reset(new SystemAllocator(CPU_DEVICE));
   Allocator* cpu_block_allocator_base = cpu_system_allocator.get();
   if (config.cpu().use_pool()) {
@@ -526,9 +779,30 @@ void init_memory_allocators(MemoryPoolConfig config,
     LOG_IF(FATAL, config.cpu().free_space() > total_mem)
         << "Requested CPU free space (" << config.cpu().free_space() << ") "
         << "larger than total CPU memory size ( " << total_mem << ")";
-    cpu_pool_allocator =
-        new PoolAllocator(CPU_DEVICE, cpu_system_allocator.get(),
-                          total_mem - config.cpu().free_space());
+    size_t pool_size = total_mem - config.cpu().free_space();
+    size_t huge_page_size = config.cpu().huge_page_size();
+    LOG_IF(FATAL, (huge_page_size & (huge_page_size - 1)) != 0)
+        << "Huge page size (" << huge_page_size << ") must be a power of two";
+    if (numa_nodes > 1) {
+      NumaPoolAllocator* pool = new NumaPoolAllocator(
+          cpu_system_allocator.get(), pool_size, numa_nodes, huge_page_size);
+      if (config.cpu().prefault()) {
+        pool->prefault();
+      }
+      cpu_pool_page_size_fn = [pool]() { return pool->page_size(); };
+      cpu_pool_allocator = pool;
+    } else {
+      PoolAllocator* pool = new PoolAllocator(
+          CPU_DEVICE, cpu_system_allocator.get(), pool_size, huge_page_size);
+      if (config.cpu().prefault()) {
+        pool->prefault();
+      }
+      cpu_pool_page_size_fn = [pool]() { return pool->page_size(); };
+      cpu_pool_allocator = pool;
+    }
+    cpu_pool_size_bytes = pool_size;
+    LOG(INFO) << "CPU pool of " << pool_size << " bytes is backed by "
+              << cpu_pool_page_size() << " byte pages";
     cpu_block_allocator_base = cpu_pool_allocator;
   }
 #ifdef USE_LINKED_ALLOCATOR
@@ -579,6 +853,8 @@ void destroy_memory_allocators() {
     delete cpu_pool_allocator;
     cpu_pool_allocator = nullptr;
   }
+  cpu_pool_size_bytes = 0;
+  cpu_pool_page_size_fn = nullptr;
   cpu_system_allocator.reset(nullptr);
 
 #ifdef HAVE_CUDA
@@ -601,6 +877,14 @@ void destroy_memory_allocators() {
 #endif
 }
 
+size_t cpu_pool_size() {
+  return cpu_pool_size_bytes;
+}
+
+size_t cpu_pool_page_size() {
+  return cpu_pool_page_size_fn ? cpu_pool_page_size_fn() : 0;
+}
+
 SystemAllocator* system_allocator_for_device(DeviceHandle device) {
   if (device.type == DeviceType::CPU) {
     return cpu_system_allocator.get();
@@ -23,11 +23,23 @@ namespace scanner {
 
 static const i64 DEFAULT_POOL_SIZE = 2L * 1024L * 1024L * 1024L;
 
+// With more than one NUMA node, the CPU pool is split into one pool per node
+// backed by that node's memory. Allocations come from the pool of the node
+// the calling thread runs on.
 void init_memory_allocators(MemoryPoolConfig config,
-                            std::vector<i32> gpu_device_ids);
+                            std::vector<i32> gpu_device_ids,
+                            i32 numa_nodes = 1);
 
 void destroy_memory_allocators();
 
+// Size of the CPU pool in bytes, or 0 if there is no CPU pool
+size_t cpu_pool_size();
+
+// Size of the pages backing most of the resident CPU pool, or 0 if there is
+// no CPU pool. Pools relying on transparent huge pages report the base page
+// size until the kernel backs them with huge pages.
+size_t cpu_pool_page_size();
+
 u8* new_buffer(DeviceHandle device, size_t size);
 
 u8* new_block_buffer(DeviceHandle device, size_t size, i32 refs);
@@ -0,0 +1,163 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/util/numa.h"
+
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace scanner {
+
+namespace {
+
+// From linux/mempolicy.h. Calling mbind directly avoids depending on libnuma.
+const int MPOL_BIND_MODE = 2;
+
+const std::string NODE_SYSFS_PATH = "/sys/devices/system/node";
+
+struct NumaTopology {
+  std::vector<std::vector<i32>> node_cpus;
+  std::vector<i32> cpu_to_node;
+};
+
+std::string read_first_line(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// Parses sysfs lists such as "0-3,8-11"
+std::vector<i32> parse_id_list(const std::string& list) {
+  std::vector<i32> ids;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty()) {
+      continue;
+    }
+    size_t dash = range.find('-');
+    i32 first = std::atoi(range.substr(0, dash).c_str());
+    i32 last = dash == std::string::npos
+                   ? first
+                   : std::atoi(range.substr(dash + 1).c_str());
+    for (i32 id = first; id <= last; ++id) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+NumaTopology load_topology() {
+  NumaTopology topology;
+  std::vector<i32> nodes =
+      parse_id_list(read_first_line(NODE_SYSFS_PATH + "/online"));
+  if (nodes.empty()) {
+    // No NUMA information, so every CPU is on node 0
+    topology.node_cpus.resize(1);
+    i32 num_cpus = std::thread::hardware_concurrency();
+    for (i32 cpu = 0; cpu < num_cpus; ++cpu) {
+      topology.node_cpus[0].push_back(cpu);
+    }
+  } else {
+    topology.node_cpus.resize(*std::max_element(nodes.begin(), nodes.end()) +
+                              1);
+    for (i32 node : nodes) {
+      topology.node_cpus[node] = parse_id_list(read_first_line(
+          NODE_SYSFS_PATH + "/node" + std::to_string(node) + "/cpulist"));
+    }
+  }
+  for (size_t node = 0; node < topology.node_cpus.size(); ++node) {
+    for (i32 cpu : topology.node_cpus[node]) {
+      if (cpu >= (i32)topology.cpu_to_node.size()) {
+        topology.cpu_to_node.resize(cpu + 1, 0);
+      }
+      topology.cpu_to_node[cpu] = node;
+    }
+  }
+  return topology;
+}
+
+const NumaTopology& topology() {
+  static NumaTopology topology = load_topology();
+  return topology;
+}
+
+}
+
+i32 num_numa_nodes() {
+  return topology().node_cpus.size();
+}
+
+std::vector<i32> numa_node_cpus(i32 node) {
+  const NumaTopology& t = topology();
+  if (node < 0 || node >= (i32)t.node_cpus.size()) {
+    return {};
+  }
+  return t.node_cpus[node];
+}
+
+i32 current_numa_node() {
+  const NumaTopology& t = topology();
+  i32 cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= (i32)t.cpu_to_node.size()) {
+    return 0;
+  }
+  return t.cpu_to_node[cpu];
+}
+
+bool pin_thread_to_numa_node(i32 node) {
+  std::vector<i32> cpus = numa_node_cpus(node);
+  if (cpus.empty()) {
+    return false;
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (i32 cpu : cpus) {
+    CPU_SET(cpu, &cpu_set);
+  }
+  i32 err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  LOG_IF(WARNING, err != 0) << "Could not pin thread to NUMA node " << node
+                            << ": " << strerror(err);
+  return err == 0;
+}
+
+bool bind_memory_to_numa_node(void* ptr, size_t size, i32 node) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t start = ((size_t)ptr + page_size - 1) / page_size * page_size;
+  size_t end = ((size_t)ptr + size) / page_size * page_size;
+  if (end <= start) {
+    return true;
+  }
+  const size_t bits_per_word = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> node_mask(node / bits_per_word + 1, 0);
+  node_mask[node / bits_per_word] |= 1UL << (node % bits_per_word);
+  long err = syscall(SYS_mbind, (void*)start, end - start, MPOL_BIND_MODE,
+                     node_mask.data(), node_mask.size() * bits_per_word + 1,
+                     0);
+  LOG_IF(WARNING, err != 0) << "Could not bind memory to NUMA node " << node
+                            << ": " << strerror(errno);
+  return err == 0;
+}
+}
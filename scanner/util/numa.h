@@ -0,0 +1,45 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace scanner {
+
+// Topology is read from /sys/devices/system/node. Machines without it are
+// treated as a single node holding every CPU.
+
+// Number of NUMA nodes on this machine
+i32 num_numa_nodes();
+
+// CPUs which belong to the node
+std::vector<i32> numa_node_cpus(i32 node);
+
+// Node of the CPU the calling thread is running on, or 0 if unknown
+i32 current_numa_node();
+
+// Restricts the calling thread to the CPUs of the node. Returns false if the
+// affinity could not be set.
+bool pin_thread_to_numa_node(i32 node);
+
+// Backs the pages of [ptr, ptr + size) with memory from the node as they are
+// faulted in. Pages which are only partially inside the range are left
+// alone. Returns false if the policy could not be set.
+bool bind_memory_to_numa_node(void* ptr, size_t size, i32 node);
+}
@@ -17,6 +17,7 @@
 
 #include "scanner/util/util.h"
 
+#include <algorithm>
 #include <atomic>
 #include <fstream>
 #include <map>
@@ -39,6 +40,12 @@ class Profiler {
 
   void increment(const std::string& key, int64_t value);
 
+  // Raises a gauge to value. Gauges share the counters but are named with a
+  // GAUGE_PREFIX so they are combined with max rather than summed.
+  void set_gauge(const std::string& key, int64_t value);
+
+  static const std::string GAUGE_PREFIX;
+
   struct TaskRecord {
     std::string key;
     int64_t start;
@@ -40,6 +40,17 @@ inline void Profiler::increment(const std::string& key, int64_t value) {
   unlock();
 }
 
+inline void Profiler::set_gauge(const std::string& key, int64_t value) {
+  spin_lock();
+  auto it = counters_.find(GAUGE_PREFIX + key);
+  if (it == counters_.end()) {
+    counters_[GAUGE_PREFIX + key] = value;
+  } else {
+    it->second = std::max(it->second, value);
+  }
+  unlock();
+}
+
 inline void Profiler::spin_lock() {
   while (lock_.test_and_set(std::memory_order_acquire));
 }
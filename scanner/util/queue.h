@@ -16,9 +16,11 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <mutex>
+#include <utility>
 
 namespace scanner {
 
@@ -39,6 +41,10 @@ class Queue {
 
   void pop(T& item);
 
+  // Waits up to timeout for an item. Returns false if none arrived.
+  template <typename Rep, typename Period>
+  bool pop_for(T& item, const std::chrono::duration<Rep, Period>& timeout);
+
   void peek(T& item);
 
   void clear();
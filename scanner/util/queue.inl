@@ -51,7 +51,7 @@ void Queue<T>::push(T item) {
   not_full_.wait(lock, [this]{ return data_.size() < max_size_; });
   push_waiters_--;
 
-  data_.push_back(item);
+  data_.push_back(std::move(item));
   lock.unlock();
   // TODO(apoms): check how much overhead this causes. Would it be better to
   //              check if the deque was empty before and only notify then
@@ -65,7 +65,7 @@ bool Queue<T>::try_pop(T& item) {
   if (data_.empty()) {
     return false;
   } else {
-    item = data_.front();
+    item = std::move(data_.front());
     data_.pop_front();
     lock.unlock();
     not_full_.notify_one();
@@ -83,7 +83,30 @@ void Queue<T>::pop(T& item) {
   not_empty_.wait(lock, [this]{ return data_.size() > 0; });
   pop_waiters_--;
 
-  item = data_.front();
+  item = std::move(data_.front());
+  data_.pop_front();
+
+  lock.unlock();
+  if (size() <= 0) {
+    empty_.notify_all();
+  }
+  not_full_.notify_one();
+}
+
+template <typename T>
+template <typename Rep, typename Period>
+bool Queue<T>::pop_for(T& item,
+                       const std::chrono::duration<Rep, Period>& timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  pop_waiters_++;
+  bool ready =
+      not_empty_.wait_for(lock, timeout, [this] { return data_.size() > 0; });
+  pop_waiters_--;
+  if (!ready) {
+    return false;
+  }
+
+  item = std::move(data_.front());
   data_.pop_front();
 
   lock.unlock();
@@ -91,6 +114,7 @@ void Queue<T>::pop(T& item) {
     empty_.notify_all();
   }
   not_full_.notify_one();
+  return true;
 }
 
 template <typename T>
@@ -220,6 +220,20 @@ void DecoderAutomata::set_profiler(Profiler* profiler) {
   decoder_->set_profiler(profiler);
 }
 
+void DecoderAutomata::release_encoded_data() {
+  while (decoder_->discard_frame()) {
+  }
+
+  std::unique_lock<std::mutex> lk(feeder_mutex_);
+  wake_feeder_.wait(lk, [this] { return feeder_waiting_.load(); });
+
+  for (auto& args : encoded_data_) {
+    delete_buffer(CPU_DEVICE, (u8*)args.encoded_video());
+  }
+  encoded_data_.clear();
+  set_feeder_idx(0);
+}
+
 void DecoderAutomata::feeder() {
   // printf("feeder start\n");
   i64 total_frames_fed = 0;
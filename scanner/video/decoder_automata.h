@@ -41,6 +41,19 @@ class DecoderAutomata {
 
   void set_profiler(Profiler* profiler);
 
+  // Waits for the feeder to go idle and frees the encoded data handed to
+  // initialize, so an automaton can be kept around without holding buffers
+  void release_encoded_data();
+
+  DeviceHandle device_handle() const { return device_handle_; }
+
+  i32 num_devices() const { return num_devices_; }
+
+  VideoDecoderType decoder_type() const { return decoder_type_; }
+
+  // Frame geometry the decoder was last configured for
+  const FrameInfo& frame_info() const { return info_; }
+
  private:
   void feeder();
 
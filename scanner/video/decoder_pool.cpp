@@ -0,0 +1,111 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/video/decoder_pool.h"
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+// Every idle decoder holds a feeder thread and a codec context with its own
+// threads, so only keep a few around
+const size_t MAX_IDLE_DECODERS = 16;
+
+}
+
+std::unique_ptr<DecoderAutomata> DecoderPool::acquire(
+    DeviceHandle device_handle, i32 num_devices, VideoDecoderType decoder_type,
+    const FrameInfo& info, Profiler* profiler) {
+  std::unique_ptr<DecoderAutomata> decoder =
+      take(device_handle, num_devices, decoder_type, &info, profiler);
+  if (!decoder) {
+    decoder = take(device_handle, num_devices, decoder_type, nullptr, profiler);
+  }
+  if (!decoder) {
+    decoder.reset(
+        new DecoderAutomata(device_handle, num_devices, decoder_type));
+    decoder->set_profiler(profiler);
+    if (profiler) {
+      profiler->increment("decoders_created", 1);
+    }
+  }
+  return decoder;
+}
+
+std::unique_ptr<DecoderAutomata> DecoderPool::acquire_configured(
+    DeviceHandle device_handle, i32 num_devices, VideoDecoderType decoder_type,
+    const FrameInfo& info, Profiler* profiler) {
+  return take(device_handle, num_devices, decoder_type, &info, profiler);
+}
+
+void DecoderPool::release(std::unique_ptr<DecoderAutomata> decoder) {
+  if (!decoder) {
+    return;
+  }
+  // The profiler and the encoded buffers belong to the job which used it
+  decoder->set_profiler(nullptr);
+  decoder->release_encoded_data();
+
+  // Destroyed outside of the lock since joining its feeder thread takes a
+  // moment
+  std::unique_ptr<DecoderAutomata> evicted;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(decoder));
+    if (idle_.size() > MAX_IDLE_DECODERS) {
+      evicted = std::move(idle_.front());
+      idle_.pop_front();
+    }
+  }
+}
+
+void DecoderPool::clear() {
+  std::deque<std::unique_ptr<DecoderAutomata>> idle;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle.swap(idle_);
+  }
+}
+
+std::unique_ptr<DecoderAutomata> DecoderPool::take(
+    DeviceHandle device_handle, i32 num_devices, VideoDecoderType decoder_type,
+    const FrameInfo* info, Profiler* profiler) {
+  std::unique_ptr<DecoderAutomata> decoder;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Most recently released first, since it is the most likely to be warm
+    for (auto it = idle_.rbegin(); it != idle_.rend(); ++it) {
+      DecoderAutomata& d = **it;
+      if (d.device_handle() == device_handle &&
+          d.num_devices() == num_devices && d.decoder_type() == decoder_type &&
+          (info == nullptr || d.frame_info() == *info)) {
+        decoder = std::move(*it);
+        idle_.erase(std::next(it).base());
+        break;
+      }
+    }
+  }
+  if (decoder) {
+    decoder->set_profiler(profiler);
+    if (profiler) {
+      profiler->increment("decoders_reused", 1);
+    }
+  }
+  return decoder;
+}
+
+}
+}
@@ -0,0 +1,72 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/video/decoder_automata.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace scanner {
+namespace internal {
+
+// Idle decoders a worker keeps across tasks and bulk jobs. Making a decoder
+// opens a codec context and starts a feeder thread, and configuring it for
+// a new frame geometry rebuilds its conversion state, so tasks that switch
+// between videos take a decoder which is already set up instead.
+class DecoderPool {
+ public:
+  DecoderPool() = default;
+  DecoderPool(const DecoderPool&) = delete;
+  DecoderPool& operator=(const DecoderPool&) = delete;
+
+  // An idle decoder for the device and type, preferring one configured for
+  // the geometry, or a new one if none is idle
+  std::unique_ptr<DecoderAutomata> acquire(DeviceHandle device_handle,
+                                           i32 num_devices,
+                                           VideoDecoderType decoder_type,
+                                           const FrameInfo& info,
+                                           Profiler* profiler);
+
+  // An idle decoder for the device and type which is configured for the
+  // geometry, or nullptr if there is none
+  std::unique_ptr<DecoderAutomata> acquire_configured(
+      DeviceHandle device_handle, i32 num_devices,
+      VideoDecoderType decoder_type, const FrameInfo& info,
+      Profiler* profiler);
+
+  // Keeps the decoder for reuse, evicting the longest idle one if full
+  void release(std::unique_ptr<DecoderAutomata> decoder);
+
+  // Destroys all idle decoders. Must be called before the memory allocators
+  // they were used with go away.
+  void clear();
+
+ private:
+  std::unique_ptr<DecoderAutomata> take(DeviceHandle device_handle,
+                                        i32 num_devices,
+                                        VideoDecoderType decoder_type,
+                                        const FrameInfo* info,
+                                        Profiler* profiler);
+
+  std::mutex mutex_;
+  // Oldest released first
+  std::deque<std::unique_ptr<DecoderAutomata>> idle_;
+};
+
+}
+}
@@ -35,6 +35,13 @@ extern "C" {
 namespace scanner {
 namespace internal {
 
+namespace {
+
+// Geometries whose conversion contexts a decoder keeps around
+const size_t MAX_SWS_CONTEXTS = 8;
+
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /// SoftwareVideoDecoder
 SoftwareVideoDecoder::SoftwareVideoDecoder(i32 device_id,
@@ -89,7 +96,9 @@ SoftwareVideoDecoder::~SoftwareVideoDecoder() {
     av_frame_free(&frame);
   }
 
-  sws_freeContext(sws_context_);
+  for (auto& kv : sws_contexts_) {
+    sws_freeContext(kv.second);
+  }
 }
 
 void SoftwareVideoDecoder::configure(const FrameInfo& metadata) {
@@ -188,10 +197,26 @@ bool SoftwareVideoDecoder::get_frame(u8* decoded_buffer, size_t decoded_size) {
   if (reset_context_) {
     auto get_context_start = now();
     AVPixelFormat decoder_pixel_format = cc_->pix_fmt;
-    sws_freeContext(sws_context_);
-    sws_context_ = sws_getContext(
-        frame_width_, frame_height_, decoder_pixel_format, frame_width_,
-        frame_height_, AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL);
+    auto key =
+        std::make_tuple(frame_width_, frame_height_, decoder_pixel_format);
+    auto it = sws_contexts_.find(key);
+    if (it == sws_contexts_.end()) {
+      if (sws_contexts_.size() >= MAX_SWS_CONTEXTS) {
+        for (auto& kv : sws_contexts_) {
+          sws_freeContext(kv.second);
+        }
+        sws_contexts_.clear();
+      }
+      SwsContext* context = sws_getContext(
+          frame_width_, frame_height_, decoder_pixel_format, frame_width_,
+          frame_height_, AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL);
+      if (context != NULL) {
+        it = sws_contexts_.emplace(key, context).first;
+      }
+      sws_context_ = context;
+    } else {
+      sws_context_ = it->second;
+    }
     reset_context_ = false;
     auto get_context_end = now();
     if (profiler_) {
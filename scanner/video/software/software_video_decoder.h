@@ -31,7 +31,9 @@ extern "C" {
 }
 
 #include <deque>
+#include <map>
 #include <mutex>
+#include <tuple>
 #include <vector>
 
 namespace scanner {
@@ -73,6 +75,9 @@ class SoftwareVideoDecoder : public VideoDecoder {
   std::vector<u8> conversion_buffer_;
   bool reset_context_;
   SwsContext* sws_context_;
+  // (Width, height, decoder pixel format) -> conversion context, so going
+  // back to a geometry seen before does not rebuild its context
+  std::map<std::tuple<i32, i32, AVPixelFormat>, SwsContext*> sws_contexts_;
 
   Queue<AVFrame*> frame_pool_;
   Queue<AVFrame*> decoded_frame_queue_;
@@ -16,15 +16,16 @@
 #include "scanner/api/kernel.h"
 #include "scanner/api/op.h"
 #include "scanner/util/memory.h"
+#include "stdlib/imgproc/box_filter.h"
 #include "stdlib/stdlib.pb.h"
 
 #include <cmath>
 
 namespace scanner {
 
-class BlurKernel : public Kernel, public VideoKernel {
+class BlurKernel : public BatchedKernel, public VideoKernel {
  public:
-  BlurKernel(const KernelConfig& config) : Kernel(config) {
+  BlurKernel(const KernelConfig& config) : BatchedKernel(config) {
     scanner::proto::BlurArgs args;
     bool parsed = args.ParseFromArray(config.args.data(), config.args.size());
     if (!parsed || config.args.size() == 0) {
@@ -35,6 +36,12 @@ class BlurKernel : public Kernel, public VideoKernel {
     kernel_size_ = args.kernel_size();
     sigma_ = args.sigma();
 
+    if (kernel_size_ < 1 || kernel_size_ > BOX_FILTER_MAX_WINDOW) {
+      RESULT_ERROR(&valid_, "Blur kernel_size must be between 1 and %d",
+                   BOX_FILTER_MAX_WINDOW);
+      return;
+    }
+
     filter_left_ = std::ceil(kernel_size_ / 2.0) - 1;
     filter_right_ = kernel_size_ / 2;
 
@@ -48,35 +55,24 @@ class BlurKernel : public Kernel, public VideoKernel {
     frame_height_ = frame_info_.height();
   }
 
-  void execute(const Columns& input_columns,
-               Columns& output_columns) override {
+  void execute(const BatchedColumns& input_columns,
+               BatchedColumns& output_columns) override {
     auto& frame_col = input_columns[0];
-    check_frame(CPU_DEVICE, frame_col);
-
-    i32 width = frame_width_;
-    i32 height = frame_height_;
-    size_t frame_size = width * height * 3 * sizeof(u8);
-    FrameInfo info = frame_col.as_const_frame()->as_frame_info();
-    Frame* output_frame = new_frame(CPU_DEVICE, info);
-
-    const u8* frame_buffer = frame_col.as_const_frame()->data;
-    u8* blurred_buffer = output_frame->data;
-    for (i32 y = filter_left_; y < height - filter_right_; ++y) {
-      for (i32 x = filter_left_; x < width - filter_right_; ++x) {
-        for (i32 c = 0; c < 3; ++c) {
-          u32 value = 0;
-          for (i32 ry = -filter_left_; ry < filter_right_ + 1; ++ry) {
-            for (i32 rx = -filter_left_; rx < filter_right_ + 1; ++rx) {
-              value += frame_buffer[(y + ry) * width * 3 + (x + rx) * 3 + c];
-            }
-          }
-          blurred_buffer[y * width * 3 + x * 3 + c] =
-              value / ((filter_right_ + filter_left_ + 1) *
-                       (filter_right_ + filter_left_ + 1));
-        }
-      }
+    check_frame(CPU_DEVICE, frame_col[0]);
+
+    i32 input_count = num_rows(frame_col);
+    FrameInfo info = frame_col[0].as_const_frame()->as_frame_info();
+    std::vector<Frame*> output_frames =
+        new_frames(CPU_DEVICE, info, input_count);
+
+    for (i32 i = 0; i < input_count; ++i) {
+      const u8* frame_buffer = frame_col[i].as_const_frame()->data;
+      u8* blurred_buffer = output_frames[i]->data;
+      box_filter_separable(frame_buffer, blurred_buffer, frame_width_,
+                           frame_height_, 3, filter_left_, filter_right_,
+                           scratch_);
+      insert_frame(output_columns[0], output_frames[i]);
     }
-    insert_frame(output_columns[0], output_frame);
   }
 
  private:
@@ -87,10 +83,15 @@ class BlurKernel : public Kernel, public VideoKernel {
 
   i32 frame_width_;
   i32 frame_height_;
+  std::vector<u32> scratch_;
   Result valid_;
 };
 
 REGISTER_OP(Blur).frame_input("frame").frame_output("frame");
 
-REGISTER_KERNEL(Blur, BlurKernel).device(DeviceType::CPU).num_devices(1);
+REGISTER_KERNEL(Blur, BlurKernel)
+    .device(DeviceType::CPU)
+    .batch()
+    .batch_bounds(1, 64)
+    .num_devices(1);
 }
@@ -0,0 +1,130 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdlib/imgproc/box_filter.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace scanner {
+
+namespace {
+
+// Largest window area divided through a 64-bit fixed point reciprocal.
+// Larger areas would overflow the product and use integer division.
+const u64 MAX_RECIPROCAL_AREA = 1 << 22;
+
+}
+
+void box_filter_naive(const u8* src, u8* dst, i32 width, i32 height,
+                      i32 channels, i32 filter_left, i32 filter_right) {
+  i32 row_stride = width * channels;
+  i32 area = (filter_right + filter_left + 1) * (filter_right + filter_left + 1);
+  for (i32 y = filter_left; y < height - filter_right; ++y) {
+    for (i32 x = filter_left; x < width - filter_right; ++x) {
+      for (i32 c = 0; c < channels; ++c) {
+        u32 value = 0;
+        for (i32 ry = -filter_left; ry < filter_right + 1; ++ry) {
+          for (i32 rx = -filter_left; rx < filter_right + 1; ++rx) {
+            value += src[(y + ry) * row_stride + (x + rx) * channels + c];
+          }
+        }
+        dst[y * row_stride + x * channels + c] = value / area;
+      }
+    }
+  }
+}
+
+void box_filter_separable(const u8* src, u8* dst, i32 width, i32 height,
+                          i32 channels, i32 filter_left, i32 filter_right,
+                          std::vector<u32>& scratch) {
+  const i64 row_stride = width * channels;
+  const i32 window = filter_left + filter_right + 1;
+  assert(window <= BOX_FILTER_MAX_WINDOW);
+  const u64 area = (u64)window * window;
+  // Fixed point reciprocal m = ceil(2^shift / area) of the window area. For
+  // a sum n, n * m / 2^shift exceeds n / area by less than n / 2^shift. Sums
+  // are at most 255 * area, so with 2^shift >= 255 * area^2 the excess is
+  // below 1 / area. The fractional part of n / area is at most
+  // (area - 1) / area, so the floor equals integer division. The product is
+  // below 2 * 255^2 * area^2, which fits in 64 bits up to
+  // MAX_RECIPROCAL_AREA.
+  const bool use_reciprocal = area <= MAX_RECIPROCAL_AREA;
+  u32 shift = 0;
+  while (((u64)1 << shift) < 255 * area * area) {
+    ++shift;
+  }
+  const u64 reciprocal = (((u64)1 << shift) + area - 1) / area;
+
+  // Column sums for the current output row, followed by the prefix sums of
+  // those column sums along the edge-extended row
+  const i64 extended_width = width + window - 1;
+  scratch.resize(row_stride + (extended_width + 1) * channels);
+  u32* column_sums = scratch.data();
+  u32* prefix = column_sums + row_stride;
+
+  auto clamp_row = [height](i64 y) {
+    return std::min(std::max(y, (i64)0), (i64)height - 1);
+  };
+  auto clamp_col = [width](i64 x) {
+    return std::min(std::max(x, (i64)0), (i64)width - 1);
+  };
+
+  // Seed the vertical running sums with the window around row 0
+  std::fill(column_sums, column_sums + row_stride, 0);
+  for (i64 ry = -filter_left; ry <= filter_right; ++ry) {
+    const u8* row = src + clamp_row(ry) * row_stride;
+    for (i64 i = 0; i < row_stride; ++i) {
+      column_sums[i] += row[i];
+    }
+  }
+
+  for (i64 y = 0; y < height; ++y) {
+    // Horizontal pass: prefix sums over the edge-extended row turn every
+    // window sum into a single subtraction
+    for (i32 c = 0; c < channels; ++c) {
+      prefix[c] = 0;
+    }
+    for (i64 e = 0; e < extended_width; ++e) {
+      const u32* col = column_sums + clamp_col(e - filter_left) * channels;
+      u32* p = prefix + e * channels;
+      for (i32 c = 0; c < channels; ++c) {
+        p[channels + c] = p[c] + col[c];
+      }
+    }
+    u8* out_row = dst + y * row_stride;
+    const u32* window_end = prefix + window * channels;
+    if (use_reciprocal) {
+      for (i64 i = 0; i < row_stride; ++i) {
+        u64 sum = window_end[i] - prefix[i];
+        out_row[i] = (u8)((sum * reciprocal) >> shift);
+      }
+    } else {
+      for (i64 i = 0; i < row_stride; ++i) {
+        out_row[i] = (u8)((window_end[i] - prefix[i]) / area);
+      }
+    }
+
+    // Slide the vertical window down one row
+    if (y + 1 < height) {
+      const u8* add_row = src + clamp_row(y + 1 + filter_right) * row_stride;
+      const u8* sub_row = src + clamp_row(y - filter_left) * row_stride;
+      for (i64 i = 0; i < row_stride; ++i) {
+        column_sums[i] += (u32)add_row[i] - (u32)sub_row[i];
+      }
+    }
+  }
+}
+}
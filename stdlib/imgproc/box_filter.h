@@ -0,0 +1,44 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "scanner/util/common.h"
+
+#include <vector>
+
+namespace scanner {
+
+// Box filters over interleaved 8-bit images of size height x width x
+// channels. The window around each pixel spans [-filter_left, filter_right]
+// in both dimensions.
+
+// Widest window whose sums fit in 32 bits
+const i32 BOX_FILTER_MAX_WINDOW = 4095;
+
+// Direct 2D box filter. Costs O(window area) per pixel and only writes pixels
+// whose window lies entirely inside the image.
+void box_filter_naive(const u8* src, u8* dst, i32 width, i32 height,
+                      i32 channels, i32 filter_left, i32 filter_right);
+
+// Separable running-sum box filter. Costs O(1) per pixel regardless of the
+// window size and writes every pixel, replicating edge pixels for windows
+// that extend past the image border. Interior pixels match box_filter_naive.
+// The window may be at most BOX_FILTER_MAX_WINDOW wide. scratch is reused
+// across calls to avoid reallocating per frame.
+void box_filter_separable(const u8* src, u8* dst, i32 width, i32 height,
+                          i32 channels, i32 filter_left, i32 filter_right,
+                          std::vector<u32>& scratch);
+}
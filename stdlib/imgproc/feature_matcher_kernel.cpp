@@ -49,6 +49,7 @@ class FeatureMatcherKernel : public StenciledKernel, public VideoKernel {
     kps_suffix_.clear();
     features_suffix_.resize(C_.w);
     kps_suffix_.resize(C_.w);
+    clear_row_cache();
   }
 
   void set_device() {
@@ -68,34 +69,22 @@ protected:
 
     i32 window_size = features_col.size();
 
-    std::vector<cvc::GpuMat> features;
-    std::vector<std::vector<proto::Keypoint>> kps;
-
+    // Overlapping windows share most of their rows, so the keypoints and
+    // feature matrix for each row are only unpacked the first time it is seen.
+    // The feature matrix wraps the element buffer, which the engine keeps
+    // alive for as long as the memoized row.
+    std::vector<const RowFeatures*> row_features;
     for (i32 i = 0; i < window_size; ++i) {
-      size_t size = keypoints_col[i].size;
-      u8* buf = new_buffer(CPU_DEVICE, size);
-      memcpy_buffer(buf, CPU_DEVICE, keypoints_col[i].buffer, device_,
-                    size);
-      std::vector<proto::Keypoint> kp =
-        deserialize_proto_vector<proto::Keypoint>(buf, size);
-      kps.push_back(kp);
-
-      size = features_col[i].size;
-      if (kp.size() == 0) {
-        features.push_back(cvc::GpuMat());
-      } else {
-        i32 step = size / kp.size();
-        i32 cols;
-        if (kp.size() == 1) {
-          cols = step / sizeof(f32);
-        } else {
-          cols = step / (sizeof(f32) * 2);
-        }
-        LOG_IF(FATAL, cols != 64) << "Not 64 cols: " << cols;
-        features.push_back(cvc::GpuMat(kp.size(), cols, CV_32F,
-                                       features_col[i].buffer, step));
-      }
+      const Element& keypoints = keypoints_col[i];
+      const Element& feature_data = features_col[i];
+      row_features.push_back(&memoize_row<RowFeatures>(
+          keypoints.index, [this, &keypoints, &feature_data]() {
+            return unpack_features(keypoints, feature_data);
+          }));
     }
+    auto kps = [&row_features](i32 i) -> const std::vector<proto::Keypoint>& {
+      return row_features[i]->keypoints;
+    };
 
     size_t size = window_size * sizeof(f32);
     f32* cost_buf = (f32*)new_buffer(CPU_DEVICE, size);
@@ -103,15 +92,16 @@ protected:
     std::vector<std::vector<cv::DMatch>> matches;
     matches.resize(window_size);
     for (i32 j = 1; j < window_size; j++) {
-      if (kps[0].size() == 0 || kps[j].size() == 0) {
+      if (kps(0).size() == 0 || kps(j).size() == 0) {
         continue;
       }
-      matcher_->match(features[0], features[j], matches[j]);
+      matcher_->match(row_features[0]->features, row_features[j]->features,
+                      matches[j]);
     }
 
 #pragma omp parallel for
     for (i32 j = 1; j < window_size; j++) {
-      f32 cost = match_cost(kps[0], kps[j], matches[j]);
+      f32 cost = match_cost(kps(0), kps(j), matches[j]);
       cost_buf[j] = cost;
     }
 
@@ -126,6 +116,37 @@ protected:
   }
 
  private:
+  struct RowFeatures {
+    std::vector<proto::Keypoint> keypoints;
+    cvc::GpuMat features;
+  };
+
+  RowFeatures unpack_features(const Element& keypoints_element,
+                              const Element& features_element) {
+    RowFeatures rf;
+    size_t size = keypoints_element.size;
+    u8* buf = new_buffer(CPU_DEVICE, size);
+    memcpy_buffer(buf, CPU_DEVICE, keypoints_element.buffer, device_, size);
+    rf.keypoints = deserialize_proto_vector<proto::Keypoint>(buf, size);
+    delete_buffer(CPU_DEVICE, buf);
+
+    auto& kp = rf.keypoints;
+    size = features_element.size;
+    if (kp.size() > 0) {
+      i32 step = size / kp.size();
+      i32 cols;
+      if (kp.size() == 1) {
+        cols = step / sizeof(f32);
+      } else {
+        cols = step / (sizeof(f32) * 2);
+      }
+      LOG_IF(FATAL, cols != 64) << "Not 64 cols: " << cols;
+      rf.features =
+          cvc::GpuMat(kp.size(), cols, CV_32F, features_element.buffer, step);
+    }
+    return rf;
+  }
+
   float reprojection_error(std::vector<cv::Point2f>& src,
                            std::vector<cv::Point2f>& dst, cv::Mat& H) {
     std::vector<cv::Point2f> dst_proj;
@@ -146,8 +167,8 @@ protected:
     return mean(sq)[0];
   }
 
-  float match_cost(std::vector<proto::Keypoint>& kp1,
-                   std::vector<proto::Keypoint>& kp2,
+  float match_cost(const std::vector<proto::Keypoint>& kp1,
+                   const std::vector<proto::Keypoint>& kp2,
                    std::vector<cv::DMatch>& matches) {
     if (matches.size() == 0) {
       return C_.gamma;
@@ -54,6 +54,7 @@ REGISTER_OP(Histogram).frame_input("frame").output("histogram");
 REGISTER_KERNEL(Histogram, HistogramKernelCPU)
     .device(DeviceType::CPU)
     .batch()
+    .batch_bounds(1, 64)
     .num_devices(1);
 }
 
@@ -16,13 +16,7 @@ class OpticalFlowKernelCPU : public StenciledKernel, public VideoKernel {
         cv::FarnebackOpticalFlow::create(3, 0.5, false, 15, 3, 5, 1.2, 0);
   }
 
-  void new_frame_info() override {
-    grayscale_.resize(0);
-    for (i32 i = 0; i < 2; ++i) {
-      grayscale_.emplace_back(frame_info_.height(), frame_info_.width(),
-                              CV_8UC1);
-    }
-  }
+  void new_frame_info() override { clear_row_cache(); }
 
   void execute(const StenciledColumns& input_columns,
                Columns& output_columns) override {
@@ -33,19 +27,25 @@ class OpticalFlowKernelCPU : public StenciledKernel, public VideoKernel {
                              FrameType::F32);
     Frame* output_frame = new_frame(device_, out_frame_info);
 
-    cv::Mat input0 = frame_to_mat(frame_col[0].as_const_frame());
-    cv::Mat input1 = frame_to_mat(frame_col[1].as_const_frame());
-    cv::cvtColor(input0, grayscale_[0], CV_BGR2GRAY);
-    cv::cvtColor(input1, grayscale_[1], CV_BGR2GRAY);
+    // Each frame appears in two windows, so only convert it the first time
+    auto grayscale = [this](const Element& element) -> const cv::Mat& {
+      return memoize_row<cv::Mat>(element.index, [&element]() {
+        cv::Mat gray;
+        cv::cvtColor(frame_to_mat(element.as_const_frame()), gray,
+                     CV_BGR2GRAY);
+        return gray;
+      });
+    };
+    const cv::Mat& gray0 = grayscale(frame_col[0]);
+    const cv::Mat& gray1 = grayscale(frame_col[1]);
     cv::Mat flow = frame_to_mat(output_frame);
-    flow_finder_->calc(grayscale_[0], grayscale_[1], flow);
+    flow_finder_->calc(gray0, gray1, flow);
     insert_frame(output_columns[0], output_frame);
   }
 
  private:
   DeviceHandle device_;
   cv::Ptr<cv::DenseOpticalFlow> flow_finder_;
-  std::vector<cv::Mat> grayscale_;
 };
 
 REGISTER_OP(OpticalFlow)
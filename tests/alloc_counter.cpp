@@ -0,0 +1,141 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests/alloc_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The replacements live in their own translation unit so that the compiler
+// never inlines them into the code under test and pairs a malloc with a
+// delete expression. Every form of new is replaced, so that each allocation
+// is counted and freed by the matching allocator.
+
+namespace {
+
+std::atomic<long> allocations{0};
+
+void* allocate(size_t size) {
+  allocations++;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* allocate_or_throw(size_t size) {
+  void* p = allocate(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+}
+
+void* operator new(size_t size) { return allocate_or_throw(size); }
+
+void* operator new[](size_t size) { return allocate_or_throw(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete[](void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+namespace {
+
+void* allocate_aligned(size_t size, std::align_val_t alignment) {
+  allocations++;
+  size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+  void* p = nullptr;
+  if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0) {
+    return nullptr;
+  }
+  return p;
+}
+
+void* allocate_aligned_or_throw(size_t size, std::align_val_t alignment) {
+  void* p = allocate_aligned(size, alignment);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return allocate_aligned_or_throw(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return allocate_aligned_or_throw(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+  return allocate_aligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t&) noexcept {
+  return allocate_aligned(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+#endif
+
+namespace scanner {
+
+long num_allocations() { return allocations; }
+
+}
@@ -0,0 +1,101 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/batch_scratch.h"
+#include "tests/alloc_counter.h"
+
+#include <gtest/gtest.h>
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+const i32 NUM_COLUMNS = 2;
+const i64 BATCH = 8;
+const i32 STENCIL = 3;
+const i32 NUM_BATCHES = 64;
+
+// Fills the inputs the way EvaluateWorker stages a batch and the outputs the
+// way a kernel produces one
+void fill_batch(StenciledBatchedColumns& inputs, BatchedColumns& outputs) {
+  for (auto& column : inputs) {
+    for (ElementList& stencil : column) {
+      for (i32 s = 0; s < STENCIL; ++s) {
+        stencil.push_back(Element(nullptr, 0));
+      }
+    }
+  }
+  for (ElementList& column : outputs) {
+    for (i64 r = 0; r < BATCH; ++r) {
+      insert_element(column, nullptr, 0);
+    }
+  }
+}
+
+}
+
+TEST(BatchScratch, ReusedBatchesDoNotAllocate) {
+  BatchScratch scratch;
+  fill_batch(scratch.inputs(NUM_COLUMNS, BATCH), scratch.outputs(NUM_COLUMNS));
+
+  long start = num_allocations();
+  for (i32 b = 1; b < NUM_BATCHES; ++b) {
+    fill_batch(scratch.inputs(NUM_COLUMNS, BATCH),
+               scratch.outputs(NUM_COLUMNS));
+  }
+  EXPECT_EQ(num_allocations() - start, 0);
+  EXPECT_EQ(scratch.batches(), NUM_BATCHES);
+  EXPECT_EQ(scratch.growths(), 1);
+
+  scratch.release();
+  EXPECT_EQ(scratch.batches(), 0);
+  EXPECT_EQ(scratch.growths(), 0);
+}
+
+TEST(BatchScratch, FreshBatchesAllocatePerRow) {
+  // Baseline: building new containers for every batch allocates for every
+  // stencil of every row
+  long start = num_allocations();
+  for (i32 b = 0; b < NUM_BATCHES; ++b) {
+    StenciledBatchedColumns inputs(NUM_COLUMNS);
+    for (auto& column : inputs) {
+      column.resize(BATCH);
+    }
+    BatchedColumns outputs(NUM_COLUMNS);
+    fill_batch(inputs, outputs);
+  }
+  EXPECT_GE(num_allocations() - start, NUM_BATCHES * NUM_COLUMNS * BATCH);
+}
+
+TEST(BatchScratch, BatchesAreEmptyAndSized) {
+  BatchScratch scratch;
+  fill_batch(scratch.inputs(NUM_COLUMNS, BATCH), scratch.outputs(NUM_COLUMNS));
+
+  StenciledBatchedColumns& inputs = scratch.inputs(1, BATCH / 2);
+  ASSERT_EQ(inputs.size(), 1);
+  ASSERT_EQ(inputs[0].size(), BATCH / 2);
+  for (ElementList& stencil : inputs[0]) {
+    EXPECT_TRUE(stencil.empty());
+  }
+  BatchedColumns& outputs = scratch.outputs(3);
+  ASSERT_EQ(outputs.size(), 3);
+  for (ElementList& column : outputs) {
+    EXPECT_TRUE(column.empty());
+  }
+}
+
+}
+}
@@ -0,0 +1,125 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/evaluate_worker.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+// Runs the tuner to completion, timing each batch with seconds_per_row for
+// its batch size, and returns the batch sizes it tried in order
+std::vector<i32> run_tuner(BatchSizeTuner& tuner,
+                           const std::map<i32, f64>& seconds_per_row) {
+  std::vector<i32> tried;
+  while (!tuner.done()) {
+    i32 batch = tuner.batch_size();
+    tried.push_back(batch);
+    tuner.record(batch, batch * seconds_per_row.at(batch));
+  }
+  return tried;
+}
+
+}
+
+TEST(BatchSizeTuner, TriesPowersOfTwoWithinBoundsAndUpperBound) {
+  BatchSizeTuner tuner(3, 20, 8, 20);
+  std::map<i32, f64> seconds_per_row{{4, 1.0}, {8, 1.0}, {16, 1.0}, {20, 1.0}};
+  std::vector<i32> tried = run_tuner(tuner, seconds_per_row);
+  // Batches are split evenly among the candidates
+  EXPECT_EQ(tried, (std::vector<i32>{4, 4, 8, 8, 16, 16, 20, 20}));
+}
+
+TEST(BatchSizeTuner, KeepsHighestThroughput) {
+  BatchSizeTuner tuner(1, 16, 5, 16);
+  std::map<i32, f64> seconds_per_row{
+      {1, 1.0}, {2, 0.5}, {4, 0.1}, {8, 0.2}, {16, 0.3}};
+  run_tuner(tuner, seconds_per_row);
+  EXPECT_EQ(tuner.batch_size(), 4);
+
+  // Measurements after the choice do not change it
+  tuner.record(4, 100.0);
+  EXPECT_TRUE(tuner.done());
+  EXPECT_EQ(tuner.batch_size(), 4);
+}
+
+TEST(BatchSizeTuner, ThroughputCountsRowsNotBatches) {
+  // Batches of the upper bound take longer than batches of 8 but run more
+  // rows per second
+  BatchSizeTuner tuner(8, 12, 4, 12);
+  std::map<i32, f64> seconds_per_row{{8, 1.0}, {12, 10.0 / 12.0}};
+  std::vector<i32> tried = run_tuner(tuner, seconds_per_row);
+  EXPECT_EQ(tried, (std::vector<i32>{8, 8, 12, 12}));
+  EXPECT_EQ(tuner.batch_size(), 12);
+}
+
+TEST(BatchSizeTuner, InstantBatchesWin) {
+  BatchSizeTuner tuner(1, 4, 3, 4);
+  std::map<i32, f64> seconds_per_row{{1, 1.0}, {2, 0.0}, {4, 1.0}};
+  run_tuner(tuner, seconds_per_row);
+  EXPECT_EQ(tuner.batch_size(), 2);
+}
+
+TEST(BatchSizeTuner, MoreCandidatesThanBatches) {
+  // Each candidate still gets one batch
+  BatchSizeTuner tuner(1, 8, 2, 8);
+  std::map<i32, f64> seconds_per_row{{1, 1.0}, {2, 1.0}, {4, 1.0}, {8, 0.5}};
+  std::vector<i32> tried = run_tuner(tuner, seconds_per_row);
+  EXPECT_EQ(tried, (std::vector<i32>{1, 2, 4, 8}));
+  EXPECT_EQ(tuner.batch_size(), 8);
+}
+
+TEST(BatchSizeTuner, PartialBatchesFinishTuning) {
+  // Work packets of 25 rows never fill a batch of 32 or 64
+  BatchSizeTuner tuner(1, 64, 14, 1);
+  std::vector<i32> tried;
+  while (!tuner.done()) {
+    i32 batch = tuner.batch_size();
+    tried.push_back(batch);
+    i64 rows = std::min(batch, 25);
+    // Larger batches are faster per row
+    tuner.record(rows, rows * (1.0 / batch));
+  }
+  EXPECT_EQ(tried, (std::vector<i32>{1, 1, 2, 2, 4, 4, 8, 8, 16, 16, 32, 32,
+                                     64, 64}));
+  EXPECT_EQ(tuner.batch_size(), 64);
+}
+
+TEST(BatchSizeTuner, NothingToTune) {
+  // A single candidate
+  BatchSizeTuner single(16, 16, 10, 16);
+  EXPECT_TRUE(single.done());
+  EXPECT_EQ(single.batch_size(), 16);
+
+  // No batches to measure with keeps the configured batch size
+  BatchSizeTuner disabled(1, 16, 0, 4);
+  EXPECT_TRUE(disabled.done());
+  EXPECT_EQ(disabled.batch_size(), 4);
+
+  // Bounds below one are clamped
+  BatchSizeTuner clamped(0, 0, 10, 0);
+  EXPECT_TRUE(clamped.done());
+  EXPECT_EQ(clamped.batch_size(), 1);
+}
+
+}
+}
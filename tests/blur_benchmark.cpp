@@ -0,0 +1,94 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the naive 2D box filter the Blur kernel used to run against the
+// separable running-sum filter it uses now, for kernel sizes 3 to 31.
+//
+// Usage: BlurBenchmark [width] [height] [iterations]
+
+#include "stdlib/imgproc/box_filter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace scanner;
+
+namespace {
+
+template <typename F>
+double time_ms(i32 iterations, F fn) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (i32 i = 0; i < iterations; ++i) {
+    fn();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         iterations;
+}
+
+}
+
+int main(int argc, char** argv) {
+  i32 width = argc > 1 ? std::atoi(argv[1]) : 1280;
+  i32 height = argc > 2 ? std::atoi(argv[2]) : 720;
+  i32 iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+  const i32 channels = 3;
+
+  std::vector<u8> src(width * height * channels);
+  std::mt19937 rng(0);
+  for (u8& v : src) {
+    v = rng() & 0xFF;
+  }
+  std::vector<u8> naive_dst(src.size(), 0);
+  std::vector<u8> separable_dst(src.size(), 0);
+  std::vector<u32> scratch;
+
+  printf("Frame %dx%dx%d, %d iterations\n", width, height, channels,
+         iterations);
+  printf("%6s %12s %12s %9s %10s\n", "kernel", "naive (ms)", "sep (ms)",
+         "speedup", "mismatch");
+  for (i32 kernel_size = 3; kernel_size <= 31; kernel_size += 2) {
+    i32 filter_left = std::ceil(kernel_size / 2.0) - 1;
+    i32 filter_right = kernel_size / 2;
+
+    double naive_ms = time_ms(iterations, [&]() {
+      box_filter_naive(src.data(), naive_dst.data(), width, height, channels,
+                       filter_left, filter_right);
+    });
+    double separable_ms = time_ms(iterations, [&]() {
+      box_filter_separable(src.data(), separable_dst.data(), width, height,
+                           channels, filter_left, filter_right, scratch);
+    });
+
+    // The two filters must agree everywhere the naive filter writes
+    i64 mismatches = 0;
+    for (i32 y = filter_left; y < height - filter_right; ++y) {
+      for (i32 x = filter_left; x < width - filter_right; ++x) {
+        for (i32 c = 0; c < channels; ++c) {
+          i64 idx = (y * width + x) * channels + c;
+          mismatches += naive_dst[idx] != separable_dst[idx];
+        }
+      }
+    }
+
+    printf("%6d %12.2f %12.2f %8.1fx %10ld\n", kernel_size, naive_ms,
+           separable_ms, naive_ms / separable_ms, (long)mismatches);
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "stdlib/imgproc/box_filter.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace scanner {
+
+namespace {
+
+i32 filter_left(i32 window) { return std::ceil(window / 2.0) - 1; }
+
+i32 filter_right(i32 window) { return window / 2; }
+
+// Number of interior pixels of the separable filter which differ from the
+// naive filter
+i64 count_mismatches(const std::vector<u8>& src, i32 width, i32 height,
+                     i32 channels, i32 window) {
+  i32 left = filter_left(window);
+  i32 right = filter_right(window);
+  std::vector<u8> naive(src.size(), 0);
+  std::vector<u8> separable(src.size(), 0);
+  std::vector<u32> scratch;
+  box_filter_naive(src.data(), naive.data(), width, height, channels, left,
+                   right);
+  box_filter_separable(src.data(), separable.data(), width, height, channels,
+                       left, right, scratch);
+  i64 mismatches = 0;
+  for (i32 y = left; y < height - right; ++y) {
+    for (i32 x = left; x < width - right; ++x) {
+      for (i32 c = 0; c < channels; ++c) {
+        i64 idx = ((i64)y * width + x) * channels + c;
+        mismatches += naive[idx] != separable[idx];
+      }
+    }
+  }
+  return mismatches;
+}
+
+}
+
+TEST(BoxFilter, SeparableMatchesNaive) {
+  std::mt19937 rng(0);
+  for (i32 window = 1; window <= 129; ++window) {
+    i32 width = window + 6;
+    i32 height = window + 4;
+    i32 channels = 3;
+    std::vector<u8> src(width * height * channels);
+    // Values near 255 give the largest sums, where rounding errors of the
+    // division show up first
+    for (u8& v : src) {
+      v = 192 + rng() % 64;
+    }
+    EXPECT_EQ(count_mismatches(src, width, height, channels, window), 0)
+        << "window " << window;
+
+    for (u8& v : src) {
+      v = rng() & 0xFF;
+    }
+    EXPECT_EQ(count_mismatches(src, width, height, channels, window), 0)
+        << "window " << window;
+  }
+}
+
+TEST(BoxFilter, SumsJustBelowMaximum) {
+  // A window sum of 255 * area - d has the largest quotient with a nonzero
+  // remainder, which is where an inexact reciprocal rounds up
+  for (i32 window = 1; window <= 129; ++window) {
+    i32 area = window * window;
+    std::vector<i32> deficits = {1, 2, 3, area / 2, area - 1};
+    for (i32 d = 4; d < std::min(area, 64); ++d) {
+      deficits.push_back(d);
+    }
+    for (i32 d : deficits) {
+      if (d < 1 || d >= area) {
+        continue;
+      }
+      // One output pixel whose window covers the whole image
+      std::vector<u8> src(area, 255);
+      for (i32 i = 0; i < d; ++i) {
+        src[i] = 254;
+      }
+      ASSERT_EQ(count_mismatches(src, window, window, 1, window), 0)
+          << "window " << window << ", sum 255 * area - " << d;
+    }
+  }
+}
+
+TEST(BoxFilter, ConstantImageIsUnchanged) {
+  // Constant images hit every sum value * area, including the largest, for
+  // windows which are too big to compare against the naive filter. The
+  // widest windows divide without the fixed point reciprocal.
+  const i32 width = 5;
+  const i32 height = 3;
+  std::vector<u8> dst(width * height);
+  std::vector<u32> scratch;
+  for (i32 window : {130, 255, 1023, 2047, 2049, BOX_FILTER_MAX_WINDOW}) {
+    for (i32 value = 0; value < 256; ++value) {
+      std::vector<u8> src(width * height, value);
+      box_filter_separable(src.data(), dst.data(), width, height, 1,
+                           filter_left(window), filter_right(window),
+                           scratch);
+      for (u8 v : dst) {
+        ASSERT_EQ(v, value) << "window " << window;
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,230 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/memory_budget.h"
+#include "scanner/engine/stage_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+TEST(MemoryBudget, ReserveBlocksUntilReleased) {
+  MemoryBudget budget(100);
+  EXPECT_FALSE(budget.reserve(60));
+  EXPECT_FALSE(budget.exhausted());
+  EXPECT_FALSE(budget.reserve(40));
+  EXPECT_TRUE(budget.exhausted());
+
+  std::atomic<bool> reserved{false};
+  std::thread producer([&] {
+    EXPECT_TRUE(budget.reserve(50));
+    reserved = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(reserved);
+
+  budget.release(60);
+  producer.join();
+  EXPECT_TRUE(reserved);
+}
+
+TEST(MemoryBudget, OversizedEntryAdmittedWhenEmpty) {
+  MemoryBudget budget(100);
+  EXPECT_FALSE(budget.reserve(500));
+  EXPECT_TRUE(budget.exhausted());
+  budget.release(500);
+  EXPECT_FALSE(budget.exhausted());
+}
+
+TEST(MemoryBudget, UnlimitedNeverBlocks) {
+  MemoryBudget budget(0);
+  EXPECT_FALSE(budget.reserve(1000));
+  EXPECT_FALSE(budget.reserve(1000));
+  EXPECT_FALSE(budget.exhausted());
+}
+
+TEST(MemoryBudget, DisableWakesWaiters) {
+  MemoryBudget budget(100);
+  budget.reserve(100);
+  std::thread producer([&] { budget.reserve(100); });
+  budget.disable();
+  producer.join();
+  EXPECT_FALSE(budget.exhausted());
+  // Releases of entries reserved before the budget was disabled are ignored
+  budget.release(100);
+  EXPECT_FALSE(budget.exhausted());
+}
+
+namespace {
+
+const i64 ENTRY_BYTES = 10;
+
+// Reserves an entry and pushes it the way the worker drivers do
+void reserve_and_push(MemoryBudget& budget, StageQueue& queue, i64 task,
+                      bool last) {
+  EvalWorkEntry entry;
+  entry.job_index = 0;
+  entry.task_index = task;
+  entry.last_in_task = last;
+  entry.last_in_io_packet = true;
+  entry.reserved_bytes = ENTRY_BYTES;
+  budget.reserve(ENTRY_BYTES, [&] { return queue.awaited(0, task); });
+  queue.push(std::make_tuple(std::deque<TaskStream>(), std::move(entry)));
+}
+
+i64 pop_task(StageQueue& queue, i32 replica) {
+  StageQueue::Entry entry;
+  queue.pop(replica, entry);
+  return std::get<1>(entry).task_index;
+}
+
+// Joins the thread, failing the test instead of hanging if it is stuck
+void join_or_unblock(MemoryBudget& budget, std::thread& thread,
+                     std::atomic<bool>& done) {
+  for (i32 i = 0; i < 500 && !done; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_TRUE(done) << "Producer deadlocked on the memory budget";
+  if (!done) {
+    budget.disable();
+  }
+  thread.join();
+}
+
+}
+
+TEST(MemoryBudget, AdmitsEntriesOfClaimedTasks) {
+  // Two replicas each claim a task spanning several packets, and the budget
+  // then fills up with a third task neither of them can take yet
+  MemoryBudget budget(2 * ENTRY_BYTES);
+  StageQueue queue(16);
+  queue.set_memory_budget(&budget);
+
+  reserve_and_push(budget, queue, 0, false);
+  reserve_and_push(budget, queue, 1, false);
+  EXPECT_EQ(pop_task(queue, 0), 0);
+  EXPECT_EQ(pop_task(queue, 1), 1);
+  budget.release(2 * ENTRY_BYTES);
+  reserve_and_push(budget, queue, 2, false);
+  reserve_and_push(budget, queue, 2, true);
+  EXPECT_TRUE(budget.exhausted());
+
+  // Replica 0 waits on task 0, so its next packet gets through
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    reserve_and_push(budget, queue, 0, true);
+    done = true;
+  });
+  join_or_unblock(budget, producer, done);
+  EXPECT_EQ(pop_task(queue, 0), 0);
+}
+
+TEST(MemoryBudget, ClaimWakesWaitingProducer) {
+  MemoryBudget budget(2 * ENTRY_BYTES);
+  StageQueue queue(16);
+  queue.set_memory_budget(&budget);
+
+  reserve_and_push(budget, queue, 0, false);
+  reserve_and_push(budget, queue, 1, false);
+
+  // Nobody waits on task 0 yet, so its second packet blocks
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    reserve_and_push(budget, queue, 0, true);
+    done = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(done);
+
+  // Claiming task 0 without releasing its bytes must still let it through
+  EXPECT_EQ(pop_task(queue, 0), 0);
+  join_or_unblock(budget, producer, done);
+  EXPECT_EQ(pop_task(queue, 0), 0);
+}
+
+TEST(MemoryBudget, ReplicatedStageWithMultiPacketTasks) {
+  // More producers than replicas, each producing whole tasks of several
+  // packets, through a budget holding only two entries
+  const i32 num_producers = 3;
+  const i32 num_replicas = 2;
+  const i64 tasks_per_producer = 20;
+  const i64 packets_per_task = 4;
+  MemoryBudget budget(2 * ENTRY_BYTES);
+  StageQueue queue(16);
+  queue.set_memory_budget(&budget);
+
+  std::atomic<i64> packets_consumed{0};
+  const i64 total_packets = num_producers * tasks_per_producer *
+                            packets_per_task;
+  std::vector<std::thread> consumers;
+  for (i32 r = 0; r < num_replicas; ++r) {
+    consumers.emplace_back([&, r] {
+      while (true) {
+        StageQueue::Entry entry;
+        queue.pop(r, entry);
+        if (std::get<1>(entry).job_index == -1) {
+          break;
+        }
+        budget.release(std::get<1>(entry).reserved_bytes);
+        packets_consumed++;
+      }
+    });
+  }
+
+  std::atomic<i32> producers_done{0};
+  std::vector<std::thread> producers;
+  for (i32 p = 0; p < num_producers; ++p) {
+    producers.emplace_back([&, p] {
+      for (i64 t = 0; t < tasks_per_producer; ++t) {
+        i64 task = t * num_producers + p;
+        for (i64 k = 0; k < packets_per_task; ++k) {
+          reserve_and_push(budget, queue, task, k == packets_per_task - 1);
+        }
+      }
+      producers_done++;
+    });
+  }
+
+  for (i32 i = 0; i < 1000 && producers_done < num_producers; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(producers_done, num_producers)
+      << "Producers deadlocked on the memory budget";
+  if (producers_done < num_producers) {
+    budget.disable();
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  for (i32 r = 0; r < num_replicas; ++r) {
+    EvalWorkEntry exit;
+    exit.job_index = -1;
+    queue.push(std::make_tuple(std::deque<TaskStream>(), std::move(exit)));
+  }
+  for (auto& t : consumers) {
+    t.join();
+  }
+  EXPECT_EQ(packets_consumed, total_packets);
+  EXPECT_FALSE(budget.exhausted());
+}
+
+}
+}
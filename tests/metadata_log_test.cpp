@@ -0,0 +1,139 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/metadata.h"
+#include "scanner/util/fs.h"
+#include "storehouse/storage_backend.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+namespace scanner {
+namespace internal {
+
+class MetadataLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::string db_path;
+    temp_dir(db_path);
+    set_database_path(db_path);
+    config_.reset(storehouse::StorageConfig::make_posix_config());
+    storage_.reset(storehouse::StorageBackend::make_from_config(config_.get()));
+
+    DatabaseMetadata meta;
+    write_database_metadata(storage_.get(), meta);
+  }
+
+  DatabaseMetadata read() {
+    return read_database_metadata(storage_.get(),
+                                  DatabaseMetadata::descriptor_path());
+  }
+
+  // Writes single changes until the log is long enough to be compacted by
+  // the next write. Writers which run concurrently add different kinds of
+  // entries, since each hands out ids from its own counters.
+  void fill_log(DatabaseMetadata& meta, const std::string& prefix,
+                bool bulk_jobs = false) {
+    i32 i = 0;
+    while (meta.next_log_segment() - meta.log_start() <
+           DB_METADATA_COMPACTION_SEGMENTS) {
+      std::string name = prefix + std::to_string(i++);
+      if (bulk_jobs) {
+        meta.add_bulk_job(name);
+      } else {
+        meta.add_table(name);
+      }
+      write_database_metadata(storage_.get(), meta);
+    }
+  }
+
+  std::unique_ptr<storehouse::StorageConfig> config_;
+  std::unique_ptr<storehouse::StorageBackend> storage_;
+};
+
+TEST_F(MetadataLogTest, ReplaysAppendedChanges) {
+  DatabaseMetadata meta = read();
+  i32 table_id = meta.add_table("a");
+  write_database_metadata(storage_.get(), meta);
+  meta.commit_table(table_id);
+  meta.add_bulk_job("job");
+  write_database_metadata(storage_.get(), meta);
+  meta.remove_bulk_job(meta.get_bulk_job_id("job"));
+  write_database_metadata(storage_.get(), meta);
+
+  // Nothing was compacted yet, so every change comes from the log
+  DatabaseMetadata reread = read();
+  EXPECT_EQ(reread.log_start(), 0);
+  EXPECT_EQ(reread.next_log_segment(), 3);
+  ASSERT_TRUE(reread.has_table("a"));
+  EXPECT_EQ(reread.get_table_id("a"), table_id);
+  EXPECT_TRUE(reread.table_is_committed(table_id));
+  EXPECT_FALSE(reread.has_bulk_job("job"));
+}
+
+TEST_F(MetadataLogTest, CompactionKeepsChanges) {
+  DatabaseMetadata meta = read();
+  fill_log(meta, "t");
+  meta.add_table("last");
+  write_database_metadata(storage_.get(), meta);
+  EXPECT_EQ(meta.log_start(), meta.next_log_segment());
+
+  DatabaseMetadata reread = read();
+  EXPECT_EQ(reread.table_names().size(), meta.table_names().size());
+  EXPECT_TRUE(reread.has_table("t0"));
+  EXPECT_TRUE(reread.has_table("last"));
+}
+
+TEST_F(MetadataLogTest, CompactionKeepsOtherWritersChanges) {
+  DatabaseMetadata compactor = read();
+  DatabaseMetadata other = read();
+
+  // Appended after the compactor last read the log, so it never replayed it
+  other.add_bulk_job("other");
+  write_database_metadata(storage_.get(), other);
+
+  fill_log(compactor, "t");
+  compactor.add_table("compacted");
+  write_database_metadata(storage_.get(), compactor);
+
+  DatabaseMetadata reread = read();
+  EXPECT_TRUE(reread.has_bulk_job("other"));
+  EXPECT_TRUE(reread.has_table("compacted"));
+  EXPECT_TRUE(reread.has_table("t0"));
+}
+
+TEST_F(MetadataLogTest, ConcurrentCompactions) {
+  DatabaseMetadata first = read();
+  DatabaseMetadata second = read();
+  fill_log(first, "first");
+  fill_log(second, "second", true);
+
+  first.add_table("first_done");
+  write_database_metadata(storage_.get(), first);
+  // The first compaction folded and removed segments the second writer had
+  // appended, which the second compaction must not drop
+  second.add_bulk_job("second_done");
+  write_database_metadata(storage_.get(), second);
+
+  DatabaseMetadata reread = read();
+  EXPECT_TRUE(reread.has_table("first0"));
+  EXPECT_TRUE(reread.has_bulk_job("second0"));
+  EXPECT_TRUE(reread.has_table("first_done"));
+  EXPECT_TRUE(reread.has_bulk_job("second_done"));
+}
+
+}
+}
@@ -15,6 +15,9 @@ import numpy as np
 import sys
 import grpc
 import struct
+import subprocess
+import threading
+import time
 
 try:
     run(['nvidia-smi'])
@@ -162,10 +165,112 @@ def test_profiler(db):
     f = tempfile.NamedTemporaryFile(delete=False)
     f.close()
     profiler.write_trace(f.name)
-    profiler.statistics()
+    stats = profiler.statistics()
+    # No CPU pool was requested
+    assert stats['cpu_pool_page_size'] == 0
     run(['rm', '-f', f.name])
 
 
+def test_decoder_pool(db):
+    def decoder_counters(output_name):
+        frame = db.ops.FrameInput()
+        hist = db.ops.Histogram(frame=frame)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test1').column('frame'),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        output = db.run(bulk_job, show_progress=False, force=True)
+        stats = output[0].profiler().statistics()
+        counters = {}
+        for name in ['decoders_created', 'decoders_reused']:
+            counters[name] = sum(
+                [v.get(name, 0) for v in stats.values() if isinstance(v, dict)])
+        return counters
+
+    decoder_counters('test_decoder_pool1')
+    # The decoders of the first job are kept by the worker for the second
+    counters = decoder_counters('test_decoder_pool2')
+    assert counters['decoders_created'] == 0
+    assert counters['decoders_reused'] > 0
+
+
+def test_stage_replicas(db):
+    def run_histogram(output_name, replicas, decode_replicas):
+        frame = db.ops.FrameInput()
+        hist = db.ops.Histogram(frame=frame, replicas=replicas)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test1').column('frame'),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return db.run(bulk_job, force=True, show_progress=False,
+                      io_packet_size=50, work_packet_size=25,
+                      pipeline_instances_per_node=1,
+                      decode_replicas=decode_replicas)[0]
+
+    single = run_histogram('test_replicas_single', 1, 1)
+    replicated = run_histogram('test_replicas_replicated', 3, 2)
+    replicas = replicated.profiler().stage_replicas()
+    assert replicas['pre'] == 2
+    assert replicas['eval0'] == 3
+    assert replicas['post'] == 1
+    assert replicated.num_rows() == single.num_rows()
+    for (i, a), (j, b) in zip(single.load(['histogram']),
+                              replicated.load(['histogram'])):
+        assert i == j
+        assert a == b
+
+
+def test_numa_placement(db):
+    def run_histogram(output_name, numa_placement):
+        frame = db.ops.FrameInput()
+        hist = db.ops.Histogram(frame=frame)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test1').column('frame'),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return db.run(bulk_job, force=True, show_progress=False,
+                      pipeline_instances_per_node=2,
+                      numa_placement=numa_placement)[0]
+
+    default = run_histogram('test_numa_default', False)
+    placed = run_histogram('test_numa_placed', True)
+    assert placed.num_rows() == default.num_rows()
+    for (i, a), (j, b) in zip(default.load(['histogram']),
+                              placed.load(['histogram'])):
+        assert i == j
+        assert a == b
+
+
+def test_memory_budget(db):
+    frame = db.ops.FrameInput()
+    hist = db.ops.Histogram(frame=frame)
+    output_op = db.ops.Output(columns=[hist])
+    job = Job(
+        op_args={
+            frame: db.table('test1').column('frame'),
+            output_op: 'test_memory_budget'
+        }
+    )
+    bulk_job = BulkJob(output=output_op, jobs=[job])
+    # Smaller than a single work entry, so every stage has to wait for the
+    # next one to finish before producing more
+    table = db.run(bulk_job, force=True, show_progress=False,
+                   work_packet_size=8, memory_budget='1M')[0]
+    assert table.num_rows() == db.table('test1').num_rows()
+
+
 def test_sample(db):
     def run_sampler_job(sampler_args, expected_rows):
         frame = db.ops.FrameInput()
@@ -196,6 +301,69 @@ def test_sample(db):
     # Gather
     run_sampler_job(db.sampler.gather([0, 150, 377, 500]), 4)
 
+def test_decoders_per_column(db):
+    def run_gather(output_name, decoders_per_column):
+        frame = db.ops.FrameInput()
+        sample_frame = frame.sample()
+        hist = db.ops.Histogram(frame=sample_frame)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test1').column('frame'),
+                sample_frame: db.sampler.gather(
+                    [0, 5, 150, 151, 377, 500, 501, 700]),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return db.run(bulk_job, force=True, show_progress=False,
+                      decoders_per_column=decoders_per_column)[0]
+
+    single = run_gather('test_decoders_single', 1)
+    spread = run_gather('test_decoders_spread', 3)
+    assert spread.num_rows() == single.num_rows()
+    # Frames decoded by different decoders come back in row order
+    for (i, a), (j, b) in zip(single.load(['histogram']),
+                              spread.load(['histogram'])):
+        assert i == j
+        assert a == b
+
+
+def test_inplace_read_ahead(db):
+    def run_inplace(output_name, inplace_read_ahead):
+        frame = db.ops.FrameInput()
+        sample_frame = frame.sample()
+        hist = db.ops.Histogram(frame=sample_frame)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test1_inplace').column('frame'),
+                sample_frame: db.sampler.strided(8),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return db.run(bulk_job, force=True, show_progress=False,
+                      io_packet_size=16, work_packet_size=8,
+                      inplace_read_ahead=inplace_read_ahead)[0]
+
+    def hit_bytes(table):
+        stats = table.profiler().statistics()
+        return sum([v.get('read_ahead_hit_bytes', 0)
+                    for v in stats.values() if isinstance(v, dict)])
+
+    direct = run_inplace('test_read_ahead_none', 0)
+    read_ahead = run_inplace('test_read_ahead', 4)
+    assert read_ahead.num_rows() == direct.num_rows()
+    # Later tasks start at the intervals read ahead of earlier ones
+    assert hit_bytes(read_ahead) > 0
+    # Bytes read ahead decode to the same frames as bytes read directly
+    for (i, a), (j, b) in zip(direct.load(['histogram']),
+                              read_ahead.load(['histogram'])):
+        assert i == j
+        assert a == b
+
+
 def test_space(db):
     def run_spacer_job(spacing_args):
         frame = db.ops.FrameInput()
@@ -447,6 +615,97 @@ def test_blur(db):
     assert frame_array.shape[1] == 640
     assert frame_array.shape[2] == 3
 
+def test_db_metadata_log_tail(db):
+    desc = db._load_descriptor(db.protobufs.DatabaseDescriptor,
+                               'db_metadata.bin')
+    end = desc.log_start
+    while db._read_db_metadata_log_segment(end) is not None:
+        end += 1
+    tables = sorted(t.name for t in db._load_db_metadata().tables)
+
+    def write_segment(segment, data):
+        db._storage.write(
+            '{}/db_metadata_log/{}.bin'.format(db._db_path,
+                                               segment).encode('ascii'),
+            data)
+
+    def reload_tables():
+        db._cached_db_metadata = None
+        return sorted(t.name for t in db._load_db_metadata().tables)
+
+    # A segment still being written at the end of the log is skipped
+    truncated = b'\x0a\x05ab'
+    write_segment(end, truncated)
+    assert reload_tables() == tables
+
+    # Once another segment follows it, it can only be corrupt
+    empty = db.protobufs.DatabaseLogSegment().SerializeToString()
+    write_segment(end + 1, empty)
+    with pytest.raises(ScannerException):
+        reload_tables()
+
+    # Leave valid, empty segments behind for the other tests
+    write_segment(end, empty)
+    assert reload_tables() == tables
+
+
+def test_memoize(db):
+    def run_histogram(output_name):
+        frame = db.ops.FrameInput()
+        range_frame = frame.sample()
+        blurred_frame = db.ops.Blur(frame=range_frame, kernel_size=3,
+                                    sigma=0.1, memoize=True)
+        hist = db.ops.Histogram(frame=blurred_frame)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test1').column('frame'),
+                range_frame: db.sampler.range(0, 30),
+                output_op: output_name,
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return db.run(bulk_job, force=True, show_progress=False)[0]
+
+    computed = run_histogram('test_memoize_computed')
+    assert any(t.name.startswith('__memo_')
+               for t in db._load_db_metadata().tables)
+    cached = run_histogram('test_memoize_cached')
+    assert cached.num_rows() == computed.num_rows()
+    for (_, a), (_, b) in zip(computed.load(['histogram']),
+                              cached.load(['histogram'])):
+        assert a == b
+
+def test_incremental(db):
+    _, video_desc = db.table('test2_inplace')._load_column('frame')
+    video_path = video_desc.data_path
+    db.ingest_videos([('test_incremental', video_path)], force=True)
+
+    def run_histogram():
+        frame = db.ops.FrameInput()
+        hist = db.ops.Histogram(frame=frame)
+        output_op = db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: db.table('test_incremental').column('frame'),
+                output_op: 'test_incremental_hist',
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return db.run(bulk_job, incremental=True, show_progress=False)[0]
+
+    first = run_histogram()
+    num_rows = first.num_rows()
+    assert num_rows == db.table('test_incremental').num_rows()
+
+    db.ingest_videos([('test_incremental', video_path)], append=True)
+    assert db.table('test_incremental').num_rows() == 2 * num_rows
+
+    second = run_histogram()
+    assert second.num_rows() == 2 * num_rows
+    hists = [h for _, h in second.load(['histogram'])]
+    assert hists[0] == hists[num_rows]
+
 def test_lossless(db):
     frame = db.ops.FrameInput()
     range_frame = frame.sample()
@@ -817,3 +1076,349 @@ def test_fault_tolerance(fault_db):
             raise ScannerException('Worker errored with status: {}'
                                    .format(status))
     killer_process.join()
+
+
+def test_drain_racing_job_start(fault_db):
+    spawn_port = 5012
+    spawn_address = 'localhost:{:d}'.format(spawn_port)
+    script_dir = os.path.dirname(os.path.realpath(__file__))
+
+    def run_histogram(output_name):
+        frame = fault_db.ops.FrameInput()
+        hist = fault_db.ops.Histogram(frame=frame)
+        output_op = fault_db.ops.Output(columns=[hist])
+        job = Job(
+            op_args={
+                frame: fault_db.table('test1').column('frame'),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        return fault_db.run(bulk_job, force=True, show_progress=False)[0]
+
+    # Drain before, while and after the spawned worker starts its job
+    for delay in [0.0, 0.1, 0.5, 2.0]:
+        with open(os.devnull, 'w') as fp:
+            worker = subprocess.Popen(
+                ['python', script_dir + '/spawn_worker.py', str(spawn_port)],
+                stdout=fp, stderr=fp)
+        # Wait for the worker to register with the master
+        time.sleep(5)
+
+        drain = threading.Timer(delay, fault_db.drain_worker,
+                                args=[spawn_address])
+        drain.start()
+        table = run_histogram('test_drain_race')
+        drain.join()
+        # Tasks of the drained worker are finished by it or by the others
+        assert table.num_rows() == fault_db.table('test1').num_rows()
+
+        # The drained worker leaves instead of idling
+        for _ in range(60):
+            if worker.poll() is not None:
+                break
+            time.sleep(1)
+        left = worker.poll() is not None
+        if not left:
+            worker.kill()
+            worker.wait()
+        assert left
+
+
+def test_speculative_execution(fault_db):
+    spawn_port = 5013
+    script_dir = os.path.dirname(os.path.realpath(__file__))
+    stall_marker = '/tmp/scanner_test_straggler'
+
+    fault_db.register_op('TestPyStraggler',
+                         [('frame', ColumnType.Video)],
+                         ['dummy'])
+    fault_db.register_python_kernel('TestPyStraggler', DeviceType.CPU,
+                                    cwd + '/test_py_straggler_kernel.py')
+
+    def run_straggler(output_name):
+        frame = fault_db.ops.FrameInput()
+        range_frame = frame.sample()
+        test_out = fault_db.ops.TestPyStraggler(frame=range_frame)
+        output_op = fault_db.ops.Output(columns=[test_out])
+        job = Job(
+            op_args={
+                frame: fault_db.table('test1').column('frame'),
+                range_frame: fault_db.sampler.range(0, 240),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        # One task in flight per worker, so the stalled worker holds just the
+        # straggler and the other worker finishes the rest
+        return fault_db.run(bulk_job, force=True, show_progress=False,
+                            io_packet_size=10, work_packet_size=10,
+                            pipeline_instances_per_node=1,
+                            tasks_in_queue_per_pu=1)[0]
+
+    # The marker exists, so no task stalls
+    open(stall_marker, 'w').close()
+    clean = run_straggler('test_speculative_clean')
+
+    with open(os.devnull, 'w') as fp:
+        worker = subprocess.Popen(
+            ['python', script_dir + '/spawn_worker.py', str(spawn_port)],
+            stdout=fp, stderr=fp)
+    # Wait for the worker to register with the master
+    time.sleep(5)
+
+    os.remove(stall_marker)
+    try:
+        table = run_straggler('test_speculative')
+    finally:
+        channel = grpc.insecure_channel(
+            'localhost:' + str(spawn_port),
+            options=[('grpc.max_message_length', 24499183 * 2)])
+        try:
+            fault_db.protobufs.WorkerStub(channel).Shutdown(
+                fault_db.protobufs.Empty())
+        except grpc.RpcError:
+            worker.kill()
+        worker.wait()
+        os.remove(stall_marker)
+
+    # The backup copy of the stalled task was committed instead of it
+    table._need_descriptor()
+    attempts = list(table._descriptor.item_attempts)
+    assert any(a > 0 for a in attempts)
+    assert ([v for _, v in table.column('dummy').load()] ==
+            [v for _, v in clean.column('dummy').load()])
+
+    # The stalled attempt removed its outputs once it was not committed
+    column_id = table.column('dummy').id()
+    for item_id, attempt in enumerate(attempts):
+        if attempt == 0:
+            continue
+        path = '{}/tables/{:d}/{:d}_{:d}.bin'.format(
+            fault_db.config.db_path, table.id(), column_id, item_id)
+        assert not os.path.exists(path)
+
+
+def test_bulk_job_priority(fault_db):
+    stall_marker = '/tmp/scanner_test_straggler'
+
+    fault_db.register_op('TestPyStraggler',
+                         [('frame', ColumnType.Video)],
+                         ['dummy'])
+    fault_db.register_python_kernel('TestPyStraggler', DeviceType.CPU,
+                                    cwd + '/test_py_straggler_kernel.py')
+
+    def run_straggler(output_name, end, priority, job_name=None):
+        frame = fault_db.ops.FrameInput()
+        range_frame = frame.sample()
+        test_out = fault_db.ops.TestPyStraggler(frame=range_frame)
+        output_op = fault_db.ops.Output(columns=[test_out])
+        job = Job(
+            op_args={
+                frame: fault_db.table('test1').column('frame'),
+                range_frame: fault_db.sampler.range(0, end),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        # The worker only asks for a task once its last one retired, so it
+        # moves to another bulk job right after the stalled task
+        return fault_db.run(bulk_job, force=True, show_progress=False,
+                            io_packet_size=10, work_packet_size=10,
+                            pipeline_instances_per_node=1,
+                            tasks_in_queue_per_pu=1, priority=priority,
+                            job_name=job_name)[0]
+
+    def job_status(job_name):
+        return fault_db._master.GetJobStatus(
+            fault_db.protobufs.GetJobStatusParams(job_name=job_name))
+
+    def run_in_thread(*args):
+        result = {}
+
+        def run():
+            try:
+                result['table'] = run_straggler(*args)
+            except Exception as e:
+                result['error'] = e
+
+        thread = threading.Thread(target=run)
+        thread.start()
+        return thread, result
+
+    def wait_for(predicate):
+        for _ in range(60):
+            if predicate():
+                return True
+            time.sleep(0.5)
+        return False
+
+    # The first task of the low priority job stalls, which keeps the only
+    # worker busy while the high priority job is submitted
+    if os.path.exists(stall_marker):
+        os.remove(stall_marker)
+    try:
+        low_thread, low = run_in_thread('test_priority_low', 720, 0,
+                                        'test_priority_low_job')
+        assert wait_for(lambda: os.path.exists(stall_marker))
+
+        high_thread, high = run_in_thread('test_priority_high', 100, 1,
+                                          'test_priority_high_job')
+        # Set up but waiting for the worker
+        assert wait_for(
+            lambda: job_status('test_priority_high_job').total_tasks > 0)
+        status = job_status('test_priority_high_job')
+        assert not status.finished and status.queued
+        assert not job_status('test_priority_low_job').queued
+
+        high_thread.join()
+        assert 'error' not in high
+        # The worker ran the high priority job before the rest of the low
+        # priority one
+        assert not job_status('test_priority_low_job').finished
+
+        low_thread.join()
+        assert 'error' not in low
+        status = job_status('test_priority_low_job')
+        assert status.finished and status.result.success
+
+        # The marker exists now, so no task stalls
+        clean = run_straggler('test_priority_clean', 720, 0)
+    finally:
+        if os.path.exists(stall_marker):
+            os.remove(stall_marker)
+
+    clean_rows = [v for _, v in clean.column('dummy').load()]
+    assert [v for _, v in low['table'].column('dummy').load()] == clean_rows
+    assert ([v for _, v in high['table'].column('dummy').load()] ==
+            clean_rows[:100])
+
+
+def test_resume_bulk_job(fault_db):
+    spawn_port = 5014
+    script_dir = os.path.dirname(os.path.realpath(__file__))
+    stall_marker = '/tmp/scanner_test_straggler'
+    stall_seconds = 30
+
+    def register_straggler(db):
+        db.register_op('TestPyStraggler',
+                       [('frame', ColumnType.Video)],
+                       ['dummy'])
+        db.register_python_kernel('TestPyStraggler', DeviceType.CPU,
+                                  cwd + '/test_py_straggler_kernel.py')
+
+    def run_straggler(db, output_name, packet_size=10, **kwargs):
+        frame = db.ops.FrameInput()
+        range_frame = frame.sample()
+        test_out = db.ops.TestPyStraggler(frame=range_frame)
+        output_op = db.ops.Output(columns=[test_out])
+        job = Job(
+            op_args={
+                frame: db.table('test1').column('frame'),
+                range_frame: db.sampler.range(0, 240),
+                output_op: output_name
+            }
+        )
+        bulk_job = BulkJob(output=output_op, jobs=[job])
+        # Without backup copies the stalled task is still running when the
+        # master goes down, while the other worker finishes the tasks after it
+        return db.run(bulk_job, force=True, show_progress=False,
+                      io_packet_size=packet_size,
+                      work_packet_size=packet_size,
+                      pipeline_instances_per_node=1,
+                      tasks_in_queue_per_pu=1,
+                      speculative_execution=False, **kwargs)[0]
+
+    def checkpoint_segments():
+        jobs_dir = '{}/jobs'.format(fault_db.config.db_path)
+        return [f for d in os.listdir(jobs_dir)
+                for f in os.listdir('{}/{}'.format(jobs_dir, d))
+                if f.startswith('checkpoint_')]
+
+    def wait_for(predicate):
+        for _ in range(60):
+            if predicate():
+                return True
+            time.sleep(0.5)
+        return False
+
+    register_straggler(fault_db)
+    # The marker exists, so no task stalls
+    open(stall_marker, 'w').close()
+    clean = run_straggler(fault_db, 'test_resume_clean')
+    clean_rows = [v for _, v in clean.column('dummy').load()]
+
+    with open(os.devnull, 'w') as fp:
+        worker = subprocess.Popen(
+            ['python', script_dir + '/spawn_worker.py', str(spawn_port)],
+            stdout=fp, stderr=fp)
+    # Wait for the worker to register with the master
+    time.sleep(5)
+
+    os.remove(stall_marker)
+    try:
+        result = {}
+
+        def run():
+            try:
+                run_straggler(fault_db, 'test_resume',
+                              job_name='test_resume_job')
+            except ScannerException as e:
+                result['error'] = e
+
+        thread = threading.Thread(target=run)
+        thread.start()
+        assert wait_for(lambda: os.path.exists(stall_marker))
+        stall_start = time.time()
+
+        def tasks_done():
+            return fault_db._master.GetJobStatus(
+                fault_db.protobufs.GetJobStatusParams(
+                    job_name='test_resume_job')).tasks_done
+        # Tasks after the stalled one finished and were checkpointed, so the
+        # tasks left over do not form a contiguous range
+        assert wait_for(lambda: tasks_done() >= 2 and checkpoint_segments())
+
+        # The master goes down before the bulk job commits
+        fault_db.stop_cluster()
+        thread.join()
+        assert 'error' in result
+        for _ in range(60):
+            if worker.poll() is not None:
+                break
+            time.sleep(1)
+        if worker.poll() is None:
+            worker.kill()
+            worker.wait()
+        # Let the stalled task of the old worker return
+        time.sleep(max(stall_start + stall_seconds + 5 - time.time(), 0))
+    finally:
+        if worker.poll() is None:
+            worker.kill()
+            worker.wait()
+    assert checkpoint_segments()
+
+    # The marker still exists, so no task of the resumed bulk job stalls
+    try:
+        with Database(config=fault_db.config, no_workers_timeout=120) as db:
+            register_straggler(db)
+            assert not db.table('test_resume').committed()
+
+            # Tasks split differently would not match the checkpointed ones
+            exc = False
+            try:
+                run_straggler(db, 'test_resume', packet_size=20,
+                              job_name='test_resume_job', resume=True)
+            except ScannerException:
+                exc = True
+            assert exc
+
+            table = run_straggler(db, 'test_resume',
+                                  job_name='test_resume_job', resume=True)
+            assert table.committed()
+            assert [v for _, v in table.column('dummy').load()] == clean_rows
+            # The committed bulk job no longer keeps its checkpoint log
+            assert not checkpoint_segments()
+    finally:
+        if os.path.exists(stall_marker):
+            os.remove(stall_marker)
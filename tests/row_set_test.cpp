@@ -0,0 +1,152 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/row_set.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <vector>
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+// Every stride'th row in [start, end), the way task rows are described
+std::vector<i64> strided_rows(i64 start, i64 end, i64 stride) {
+  std::vector<i64> rows;
+  for (i64 r = start; r < end; r += stride) {
+    rows.push_back(r);
+  }
+  return rows;
+}
+
+// Sorted, unique rows
+std::vector<i64> sorted_unique(const std::vector<i64>& rows) {
+  std::set<i64> unique(rows.begin(), rows.end());
+  return std::vector<i64>(unique.begin(), unique.end());
+}
+
+}
+
+TEST(RowSet, EmptySets) {
+  RowSet from_rows = RowSet::from_rows({});
+  EXPECT_TRUE(from_rows.empty());
+  EXPECT_EQ(from_rows.size(), 0);
+  EXPECT_TRUE(from_rows.to_vector().empty());
+
+  // Ranges which end where they start, or before, hold no rows
+  EXPECT_TRUE(RowSet::from_range(5, 5).empty());
+  EXPECT_TRUE(RowSet::from_range(5, 4).empty());
+
+  // A strided range whose end is its start holds no rows
+  EXPECT_TRUE(RowSet::from_rows(strided_rows(7, 7, 3)).empty());
+
+  RowSet merged;
+  merged.merge(RowSet());
+  EXPECT_TRUE(merged.empty());
+  merged.add_rows({});
+  EXPECT_TRUE(merged.to_vector().empty());
+}
+
+TEST(RowSet, StridedRangesRoundTrip) {
+  for (i64 stride : {1, 2, 3, 7, 64}) {
+    for (i64 start : {0, 1, 5}) {
+      // Ends on, just after and just before a row of the stride
+      for (i64 end : {start + 10 * stride, start + 10 * stride + 1,
+                      start + 10 * stride - 1}) {
+        std::vector<i64> rows = strided_rows(start, end, stride);
+        RowSet set = RowSet::from_rows(rows);
+        EXPECT_EQ(set.to_vector(), rows)
+            << "stride " << stride << ", [" << start << ", " << end << ")";
+        EXPECT_EQ(set.size(), (i64)rows.size());
+        EXPECT_EQ(set.min(), start);
+        EXPECT_EQ(set.max(), rows.back());
+        // Consecutive rows form one run, other strides one run per row
+        EXPECT_EQ(set.intervals().size(), stride == 1 ? 1 : rows.size());
+      }
+    }
+  }
+}
+
+TEST(RowSet, RangeEndIsExclusive) {
+  RowSet set = RowSet::from_range(3, 8);
+  EXPECT_EQ(set.to_vector(), (std::vector<i64>{3, 4, 5, 6, 7}));
+  EXPECT_EQ(set.max(), 7);
+
+  // A range starting at another's end joins it into one run
+  set.add_range(8, 10);
+  ASSERT_EQ(set.intervals().size(), 1);
+  EXPECT_EQ(set.intervals()[0].start, 3);
+  EXPECT_EQ(set.intervals()[0].end, 10);
+
+  // A row right after the end joins the run as well
+  set.add_rows({10});
+  ASSERT_EQ(set.intervals().size(), 1);
+  EXPECT_EQ(set.intervals()[0].end, 11);
+
+  // One row past that starts a new run
+  set.add_rows({12});
+  EXPECT_EQ(set.intervals().size(), 2);
+  EXPECT_EQ(set.to_vector(),
+            (std::vector<i64>{3, 4, 5, 6, 7, 8, 9, 10, 12}));
+}
+
+TEST(RowSet, GathersRoundTrip) {
+  std::vector<std::vector<i64>> gathers = {
+      {42},
+      {9, 3, 7, 8, 0},
+      {5, 5, 5, 4, 6, 4},
+      {100, 2, 3, 1, 50, 51, 49, 0},
+      {0, 1, 2, 10, 11, 12, 20},
+  };
+  for (const std::vector<i64>& rows : gathers) {
+    RowSet set = RowSet::from_rows(rows);
+    std::vector<i64> expected = sorted_unique(rows);
+    EXPECT_EQ(set.to_vector(), expected);
+    EXPECT_EQ(set.size(), (i64)expected.size());
+    EXPECT_EQ(set.min(), expected.front());
+    EXPECT_EQ(set.max(), expected.back());
+  }
+
+  // Runs of a gather are coalesced whatever order the rows come in
+  RowSet set = RowSet::from_rows({12, 2, 11, 0, 10, 1});
+  ASSERT_EQ(set.intervals().size(), 2);
+  EXPECT_EQ(set.intervals()[0].start, 0);
+  EXPECT_EQ(set.intervals()[0].end, 3);
+  EXPECT_EQ(set.intervals()[1].start, 10);
+  EXPECT_EQ(set.intervals()[1].end, 13);
+}
+
+TEST(RowSet, MergedStridesRoundTrip) {
+  // Interleaved strides fill in the rows between each other
+  RowSet set = RowSet::from_rows(strided_rows(0, 20, 2));
+  set.merge(RowSet::from_rows(strided_rows(1, 20, 2)));
+  EXPECT_EQ(set.to_vector(), strided_rows(0, 20, 1));
+  EXPECT_EQ(set.intervals().size(), 1);
+
+  // A strided range merged with a gather
+  std::vector<i64> strided = strided_rows(3, 30, 5);
+  std::vector<i64> gather = {29, 4, 0, 13};
+  set = RowSet::from_rows(strided);
+  set.add_rows(gather);
+  std::vector<i64> all = strided;
+  all.insert(all.end(), gather.begin(), gather.end());
+  EXPECT_EQ(set.to_vector(), sorted_unique(all));
+}
+
+}
+}
@@ -0,0 +1,103 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/stage_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+StageQueue::Entry make_entry(i64 task, i64 row, bool last) {
+  EvalWorkEntry entry;
+  entry.job_index = 0;
+  entry.task_index = task;
+  entry.last_in_task = last;
+  entry.last_in_io_packet = true;
+  entry.row_ids.push_back({row});
+  return std::make_tuple(std::deque<TaskStream>(), std::move(entry));
+}
+
+StageQueue::Entry make_exit_message() {
+  EvalWorkEntry entry;
+  entry.job_index = -1;
+  return std::make_tuple(std::deque<TaskStream>(), std::move(entry));
+}
+
+}
+
+TEST(StageQueue, ReplicaSeesWholeTaskInOrder) {
+  StageQueue queue(16);
+  // Entries of two tasks arrive interleaved
+  for (i64 row = 0; row < 4; ++row) {
+    queue.push(make_entry(0, row, row == 3));
+    queue.push(make_entry(1, row, row == 3));
+  }
+
+  StageQueue::Entry entry;
+  for (i64 row = 0; row < 4; ++row) {
+    queue.pop(0, entry);
+    EXPECT_EQ(std::get<1>(entry).task_index, 0);
+    EXPECT_EQ(std::get<1>(entry).row_ids[0][0], row);
+  }
+  for (i64 row = 0; row < 4; ++row) {
+    queue.pop(1, entry);
+    EXPECT_EQ(std::get<1>(entry).task_index, 1);
+    EXPECT_EQ(std::get<1>(entry).row_ids[0][0], row);
+  }
+}
+
+TEST(StageQueue, ExitMessageWaitsForClaimedTask) {
+  StageQueue queue(16);
+  queue.push(make_entry(0, 0, false));
+  queue.push(make_exit_message());
+
+  StageQueue::Entry entry;
+  queue.pop(0, entry);
+  EXPECT_EQ(std::get<1>(entry).task_index, 0);
+
+  // Replica 0 still holds task 0, so only the rest of it can reach it
+  std::thread producer([&] { queue.push(make_entry(0, 1, true)); });
+  queue.pop(0, entry);
+  producer.join();
+  EXPECT_EQ(std::get<1>(entry).row_ids[0][0], 1);
+
+  queue.pop(0, entry);
+  EXPECT_EQ(std::get<1>(entry).job_index, -1);
+}
+
+TEST(StageQueue, FullQueueAdmitsAwaitedTask) {
+  StageQueue queue(2);
+  queue.push(make_entry(0, 0, false));
+  queue.push(make_entry(1, 0, true));
+
+  StageQueue::Entry entry;
+  queue.pop(0, entry);
+  queue.push(make_entry(2, 0, true));
+
+  // The queue is full, but replica 0 is waiting on task 0
+  std::thread producer([&] { queue.push(make_entry(0, 1, true)); });
+  queue.pop(0, entry);
+  producer.join();
+  EXPECT_EQ(std::get<1>(entry).task_index, 0);
+  EXPECT_EQ(std::get<1>(entry).row_ids[0][0], 1);
+}
+
+}
+}
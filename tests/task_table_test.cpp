@@ -0,0 +1,90 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/task_table.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <unistd.h>
+
+namespace scanner {
+namespace internal {
+
+namespace {
+
+// Resident set size of this process in bytes
+i64 resident_bytes() {
+  i64 total_pages = 0;
+  i64 resident_pages = 0;
+  std::ifstream statm("/proc/self/statm");
+  statm >> total_pages >> resident_pages;
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+}
+
+TEST(TaskTable, RangeTasks) {
+  TaskTable table;
+  table.add_job({0, 10, 25, 30});
+  ASSERT_EQ(table.num_jobs(), 1);
+  ASSERT_EQ(table.num_tasks(0), 3);
+  ASSERT_EQ(table.total_tasks(), 3);
+  EXPECT_EQ(table.num_task_rows(0, 1), 15);
+
+  proto::TaskRows rows;
+  table.task_rows(0, 1, &rows);
+  std::vector<i64> expanded = task_rows_to_row_set(rows).to_vector();
+  ASSERT_EQ(expanded.size(), 15);
+  EXPECT_EQ(expanded.front(), 10);
+  EXPECT_EQ(expanded.back(), 24);
+}
+
+// A bulk job with a million tasks over a few thousand long videos should not
+// take noticeable time or memory to set up on the master.
+TEST(TaskTable, MillionTaskScale) {
+  const i64 num_jobs = 2000;
+  const i64 tasks_per_job = 500;
+  const i64 rows_per_task = 1000;
+
+  i64 rss_before = resident_bytes();
+  auto setup_start = std::chrono::steady_clock::now();
+  TaskTable table;
+  for (i64 j = 0; j < num_jobs; ++j) {
+    std::vector<i64> boundaries;
+    for (i64 t = 0; t <= tasks_per_job; ++t) {
+      boundaries.push_back(t * rows_per_task);
+    }
+    table.add_job(boundaries);
+  }
+  f64 setup_seconds = std::chrono::duration<f64>(
+                          std::chrono::steady_clock::now() - setup_start)
+                          .count();
+  i64 rss_growth = resident_bytes() - rss_before;
+
+  ASSERT_EQ(table.total_tasks(), num_jobs * tasks_per_job);
+  // Materializing the rows would need 8 bytes per row, or 16 GB here
+  EXPECT_LT(rss_growth, 128 * 1024 * 1024);
+  EXPECT_LT(setup_seconds, 2.0);
+
+  // Descriptors sent to workers stay constant size regardless of task length
+  proto::TaskRows rows;
+  table.task_rows(num_jobs - 1, tasks_per_job - 1, &rows);
+  EXPECT_LT(rows.ByteSizeLong(), 32);
+  EXPECT_EQ(task_rows_to_row_set(rows).size(), rows_per_task);
+}
+}
+}
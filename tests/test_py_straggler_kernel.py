@@ -0,0 +1,27 @@
+import scannerpy
+import os
+import struct
+import time
+
+# Created by the first row processed anywhere, so only that row stalls
+STALL_MARKER = '/tmp/scanner_test_straggler'
+STALL_SECONDS = 30
+
+class TestPyStragglerKernel(scannerpy.Kernel):
+    def __init__(self, config, protobufs):
+        self.protobufs = protobufs
+        pass
+
+    def close(self):
+        pass
+
+    def execute(self, input_columns):
+        try:
+            os.close(os.open(STALL_MARKER, os.O_CREAT | os.O_EXCL))
+        except OSError:
+            pass
+        else:
+            time.sleep(STALL_SECONDS)
+        return [struct.pack('=Q', int(input_columns[0].sum()))]
+
+KERNEL = TestPyStragglerKernel
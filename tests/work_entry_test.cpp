@@ -0,0 +1,176 @@
+/* Copyright 2017 Carnegie Mellon University
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scanner/engine/evaluate_worker.h"
+#include "scanner/engine/runtime.h"
+#include "scanner/engine/stage_queue.h"
+#include "tests/alloc_counter.h"
+
+#include <gtest/gtest.h>
+
+#include <type_traits>
+
+namespace scanner {
+namespace internal {
+
+static_assert(!std::is_copy_constructible<EvalWorkEntry>::value,
+              "EvalWorkEntry should only be moved between stages");
+static_assert(!std::is_copy_constructible<TaskStream>::value,
+              "TaskStream should only be moved between stages");
+
+namespace {
+
+// Number of queues an entry crosses on its way from the load worker to the
+// save worker: pre-evaluate, evaluate, post-evaluate and save
+const i32 NUM_STAGES = 4;
+
+EvalWorkEntry make_entry(i64 num_rows, i32 num_columns) {
+  EvalWorkEntry entry;
+  entry.table_id = 0;
+  entry.job_index = 0;
+  entry.task_index = 0;
+  entry.first = true;
+  entry.last_in_task = true;
+  entry.last_in_io_packet = true;
+  entry.columns.resize(num_columns);
+  entry.row_ids.resize(num_columns);
+  for (i32 c = 0; c < num_columns; ++c) {
+    entry.column_handles.push_back(CPU_DEVICE);
+    entry.column_types.push_back(ColumnType::Other);
+    for (i64 r = 0; r < num_rows; ++r) {
+      entry.columns[c].push_back(Element(nullptr, 0));
+      entry.row_ids[c].push_back(r);
+    }
+  }
+  return entry;
+}
+
+std::deque<TaskStream> make_task_streams(i64 num_rows) {
+  std::deque<TaskStream> streams;
+  for (i32 i = 0; i < NUM_STAGES; ++i) {
+    TaskStream s;
+    s.slice_group = 0;
+    for (i64 r = 0; r < num_rows; ++r) {
+      s.valid_input_rows.push_back(r);
+      s.compute_input_rows.push_back(r);
+      s.valid_output_rows.push_back(r);
+    }
+    streams.push_back(std::move(s));
+  }
+  return streams;
+}
+
+// Hands an entry through one queue per stage the way the worker drivers do
+// and returns the number of heap allocations made while doing so
+long allocations_to_pass_through_stages(i64 num_rows) {
+  std::vector<StageQueue> queues(NUM_STAGES);
+  SaveInputQueue save_queue;
+
+  auto entry = make_entry(num_rows, 3);
+  auto streams = make_task_streams(num_rows);
+
+  long start = num_allocations();
+  queues[0].push(std::make_tuple(std::move(streams), std::move(entry)));
+  for (i32 i = 0; i < NUM_STAGES - 1; ++i) {
+    std::tuple<std::deque<TaskStream>, EvalWorkEntry> work;
+    queues[i].pop(0, work);
+    queues[i + 1].push(std::move(work));
+  }
+  std::tuple<std::deque<TaskStream>, EvalWorkEntry> work;
+  queues.back().pop(0, work);
+  save_queue.push(std::make_tuple(0, std::move(std::get<1>(work))));
+  std::tuple<i32, EvalWorkEntry> saved;
+  save_queue.pop(saved);
+  long allocations = num_allocations() - start;
+
+  EXPECT_EQ(std::get<1>(saved).row_ids[0].size(), num_rows);
+  return allocations;
+}
+
+// Feeds an entry to a pre-evaluate worker and yields it back in work packets
+// of packet_rows rows, returning the number of heap allocations made while
+// doing so. Set to whether the rows were handed over without copying.
+long allocations_to_pre_evaluate(i64 num_rows, i64 packet_rows,
+                                 bool& handed_over) {
+  Profiler profiler(now());
+  DecoderPool decoder_pool;
+  PreEvaluateWorkerArgs args{
+      0, 1, (i32)packet_rows, 1, 0, 0, CPU_DEVICE, profiler, decoder_pool};
+  PreEvaluateWorker worker(args);
+
+  auto entry = make_entry(num_rows, 3);
+  const Element* elements = entry.columns[0].data();
+  const i64* row_ids = entry.row_ids[0].data();
+
+  long start = num_allocations();
+  worker.feed(std::move(entry), true);
+  i64 rows = 0;
+  handed_over = false;
+  EvalWorkEntry output;
+  while (worker.yield(packet_rows, output)) {
+    handed_over = output.columns[0].data() == elements &&
+                  output.row_ids[0].data() == row_ids;
+    rows += output.row_ids[0].size();
+  }
+  long allocations = num_allocations() - start;
+
+  EXPECT_EQ(rows, num_rows);
+  return allocations;
+}
+
+}
+
+TEST(WorkEntry, AllocationsPerRow) {
+  const i64 small_rows = 16;
+  const i64 large_rows = 4096;
+  long small_allocations = allocations_to_pass_through_stages(small_rows);
+  long large_allocations = allocations_to_pass_through_stages(large_rows);
+  // Moving an entry between stages only allocates queue bookkeeping, so the
+  // cost must not grow with the number of rows in the entry
+  EXPECT_EQ(small_allocations, large_allocations);
+  EXPECT_LT((double)large_allocations / large_rows, 0.05);
+}
+
+TEST(WorkEntry, PreEvaluateHandsOverWholeEntry) {
+  const i64 small_rows = 16;
+  const i64 large_rows = 4096;
+  bool small_handed_over;
+  bool large_handed_over;
+  long small_allocations =
+      allocations_to_pre_evaluate(small_rows, small_rows, small_handed_over);
+  long large_allocations =
+      allocations_to_pre_evaluate(large_rows, large_rows, large_handed_over);
+  // One work packet covers the whole entry, so its rows are moved through
+  EXPECT_TRUE(small_handed_over);
+  EXPECT_TRUE(large_handed_over);
+  EXPECT_EQ(small_allocations, large_allocations);
+  EXPECT_LT((double)large_allocations / large_rows, 0.05);
+}
+
+TEST(WorkEntry, PreEvaluateAllocationsPerPacket) {
+  const i64 packets = 4;
+  bool handed_over;
+  long small_allocations =
+      allocations_to_pre_evaluate(packets * 16, 16, handed_over);
+  EXPECT_FALSE(handed_over);
+  long large_allocations =
+      allocations_to_pre_evaluate(packets * 1024, 1024, handed_over);
+  // Splitting an entry copies each packet's rows once, so the number of
+  // allocations depends on the packets and not on their size
+  EXPECT_EQ(small_allocations, large_allocations);
+}
+
+}
+}